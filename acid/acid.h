@@ -10,7 +10,14 @@
 //#include "common/env.h"
 #include "common/daemon.h"
 #include "common/fiber.h"
+#include "common/task.h"
+#include "common/task_group.h"
+#include "http/http2_session.h"
+#include "http/http_connection.h"
 #include "http/http_server.h"
+#include "http/static_file_servlet.h"
+#include "http/ws_session.h"
+#include "logger/deferred_logger.h"
 #include "logger/logger.h"
 #include "rpc/rpc_connection_pool.h"
 #include "rpc/rpc_server.h"
@@ -352,7 +352,7 @@ void ByteArray::read(void* buffer, size_t size) {
     }
 
     size_t npos = m_position % m_base_size;
-    size_t ncap = m_cur->size - m_position;
+    size_t ncap = m_cur->size - npos;
     size_t bpos = 0;
 
     while (size > 0) {
@@ -540,7 +540,7 @@ uint64_t ByteArray::get_read_buffers(std::vector<iovec>& buffers, uint64_t len)
         if (ncap >= len) {
             iov.iov_base = cur->ptr + npos;
             iov.iov_len = len;
-            break;
+            len = 0;
         }
         else {
             iov.iov_base = cur->ptr + npos;
@@ -565,7 +565,7 @@ uint64_t ByteArray::get_read_buffers(std::vector<iovec>& buffers, uint64_t len,
 
     size_t npos = position % m_base_size;
     size_t count = position / m_base_size;
-    Node* cur = m_cur;
+    Node* cur = m_root;
 
     while (count > 0) {
         cur = cur->next;
@@ -579,7 +579,7 @@ uint64_t ByteArray::get_read_buffers(std::vector<iovec>& buffers, uint64_t len,
         if (ncap >= len) {
             iov.iov_base = cur->ptr + npos;
             iov.iov_len = len;
-            break;
+            len = 0;
         }
         else {
             iov.iov_base = cur->ptr + npos;
@@ -611,7 +611,7 @@ uint64_t ByteArray::get_write_buffers(std::vector<iovec>& buffers, uint64_t len)
         if (ncap >= len) {
             iov.iov_base = cur->ptr + npos;
             iov.iov_len = len;
-            break;
+            len = 0;
         }
         else {
             iov.iov_base = cur->ptr + npos;
@@ -13,78 +13,248 @@
 #define ACID_CHANNEL_H
 
 #include "co_mutex.h"
+#include "task.h"
+#include "util.h"
 
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
 
 namespace acid {
 
+/**
+ * @brief 有界多生产者多消费者channel
+ * @details 数据放在定长环形缓冲区中, 每个槽位带一个序号: 序号等于写位置时可写, 等于写位置+1时可读,
+ * 读完后加上容量留给下一轮。生产者和消费者各自用CAS推进写位置和读位置, 互不加锁, 也不分配内存;
+ * 只有缓冲区满或空时才登记到CoNotifier上挂起协程
+ */
 template <class T>
 class ChannelImpl : Noncopyable {
 public:
-    using MutexType = CoMutex;
-    using LockGuard = MutexType::Lock;
-
-    ChannelImpl(size_t capacity) : m_is_close(false), m_capacity(capacity) {
+    ChannelImpl(size_t capacity)
+        : m_capacity(capacity), m_size(std::max<size_t>(capacity, 1)), m_slots(new Slot[m_size]) {
+        for (size_t i = 0; i < m_size; ++i) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
     }
 
     ~ChannelImpl() {
         close();
+        // close之前已经通过检查的生产者可能又写入了数据
+        discard();
     }
 
     /**
-     * @brief 发送数据到channel
+     * @brief 发送数据到channel, 缓冲区满时挂起等待
      *
      * @param[in] t 发送的数据
      * @return true
-     * @return false
+     * @return false channel已经关闭
      */
     bool push(const T& t) {
-        LockGuard lock(m_mutex);
-        if (m_is_close) {
-            return false;
-        }
+        return push_for(t, ~0ull);
+    }
 
-        // 如果缓冲区满了, 需要等待入队条件变量唤醒
-        while (m_queue.size() >= m_capacity) {
-            m_push_cond.wait(lock);
-            if (m_is_close) {
+    bool push(T&& t) {
+        return push_for(std::move(t), ~0ull);
+    }
+
+    /**
+     * @brief 发送数据, 缓冲区满时最多等待timeout_ms毫秒
+     * @return false channel已经关闭或者超时
+     */
+    template <class U>
+    bool push_for(U&& t, uint64_t timeout_ms) {
+        uint64_t deadline = deadline_of(timeout_ms);
+        while (true) {
+            if (is_closed()) {
                 return false;
             }
+            if (enqueue(std::forward<U>(t))) {
+                m_not_empty.notify();
+                return true;
+            }
+            uint64_t left = left_of(deadline);
+            if (left == 0) {
+                return false;
+            }
+            CoNotifier::Wait wait(1, left);
+            wait.add(m_not_full);
+            if (is_closed() || !full()) {
+                wait.cancel();
+                continue;
+            }
+            wait.park();
         }
+    }
 
-        m_queue.push(t);
-        // 队列中有数据了, 可以唤醒出队条件变量
-        m_pop_cond.notify();
+    /**
+     * @brief 不等待的发送
+     * @return false channel已经关闭或者缓冲区满
+     */
+    bool try_push(const T& t) {
+        if (is_closed() || !enqueue(t)) {
+            return false;
+        }
+        m_not_empty.notify();
         return true;
     }
 
     /**
-     * @brief 从channel读取数据
+     * @brief 批量发送, 一次CAS占用多个连续的槽位, 缓冲区满时挂起等待
+     * @return 发送的数量, 只有channel关闭时才少于n
+     */
+    size_t push_n(const T* items, size_t n) {
+        size_t pushed = 0;
+        while (pushed < n) {
+            if (is_closed()) {
+                break;
+            }
+            size_t count = enqueue_n(items + pushed, n - pushed);
+            if (count) {
+                pushed += count;
+                m_not_empty.notify(count);
+                continue;
+            }
+            CoNotifier::Wait wait;
+            wait.add(m_not_full);
+            if (is_closed() || !full()) {
+                wait.cancel();
+                continue;
+            }
+            wait.park();
+        }
+        return pushed;
+    }
+
+    /**
+     * @brief 从channel读取数据, 缓冲区空时挂起等待
      *
      * @param[out] t 读取到t
      * @return true
-     * @return false
+     * @return false channel已经关闭
      */
     bool pop(T& t) {
-        LockGuard lock(m_mutex);
-        if (m_is_close) {
-            return false;
-        }
+        return pop_for(t, ~0ull);
+    }
 
-        while (m_queue.empty()) {
-            m_pop_cond.wait(lock);
-            if (m_is_close) {
+    /**
+     * @brief 读取数据, 缓冲区空时最多等待timeout_ms毫秒
+     * @return false channel已经关闭或者超时
+     */
+    bool pop_for(T& t, uint64_t timeout_ms) {
+        uint64_t deadline = deadline_of(timeout_ms);
+        while (true) {
+            if (is_closed()) {
                 return false;
             }
+            if (dequeue(t)) {
+                m_not_full.notify();
+                return true;
+            }
+            uint64_t left = left_of(deadline);
+            if (left == 0) {
+                return false;
+            }
+            CoNotifier::Wait wait(1, left);
+            wait.add(m_not_empty);
+            if (is_closed() || readable()) {
+                wait.cancel();
+                continue;
+            }
+            wait.park();
         }
+    }
 
-        t = m_queue.front();
-        m_queue.pop();
-        // 缓冲区空了位置, 通知入队条件变量
-        m_push_cond.notify();
+    /**
+     * @brief 不等待的读取
+     * @return false channel已经关闭或者缓冲区空
+     */
+    bool try_pop(T& t) {
+        if (is_closed() || !dequeue(t)) {
+            return false;
+        }
+        m_not_full.notify();
         return true;
     }
 
+    /**
+     * @brief 批量读取, 缓冲区空时挂起等待, 有数据后一次CAS取走最多n个
+     * @return 读取的数量, channel关闭时返回0
+     */
+    size_t pop_n(T* items, size_t n) {
+        while (n) {
+            if (is_closed()) {
+                return 0;
+            }
+            size_t count = dequeue_n(items, n);
+            if (count) {
+                m_not_full.notify(count);
+                return count;
+            }
+            CoNotifier::Wait wait;
+            wait.add(m_not_empty);
+            if (is_closed() || readable()) {
+                wait.cancel();
+                continue;
+            }
+            wait.park();
+        }
+        return 0;
+    }
+
+    /**
+     * @brief C++20协程中发送, 缓冲区满时只挂起协程
+     * @details 协程帧持有channel的引用, 挂起期间Channel对象可以先析构
+     * @return false channel已经关闭或者超时
+     */
+    static Task<bool> co_push(std::shared_ptr<ChannelImpl> self, T t, uint64_t timeout_ms) {
+        uint64_t deadline = deadline_of(timeout_ms);
+        while (true) {
+            if (self->is_closed()) {
+                co_return false;
+            }
+            if (self->enqueue(std::move(t))) {
+                self->m_not_empty.notify();
+                co_return true;
+            }
+            uint64_t left = left_of(deadline);
+            if (left == 0) {
+                co_return false;
+            }
+            ChannelImpl* channel = self.get();
+            co_await self->m_not_full.co_wait(
+                [channel] { return channel->is_closed() || !channel->full(); }, left);
+        }
+    }
+
+    /**
+     * @brief C++20协程中读取, 缓冲区空时只挂起协程
+     * @return false channel已经关闭或者超时
+     */
+    static Task<bool> co_pop(std::shared_ptr<ChannelImpl> self, T& t, uint64_t timeout_ms) {
+        uint64_t deadline = deadline_of(timeout_ms);
+        while (true) {
+            if (self->is_closed()) {
+                co_return false;
+            }
+            if (self->dequeue(t)) {
+                self->m_not_full.notify();
+                co_return true;
+            }
+            uint64_t left = left_of(deadline);
+            if (left == 0) {
+                co_return false;
+            }
+            ChannelImpl* channel = self.get();
+            co_await self->m_not_empty.co_wait(
+                [channel] { return channel->is_closed() || channel->readable(); }, left);
+        }
+    }
+
     ChannelImpl& operator>>(T& t) {
         pop(t);
         return *this;
@@ -96,43 +266,234 @@ public:
     }
 
     void close() {
-        LockGuard lock(m_mutex);
-        if (m_is_close) {
+        if (m_is_close.exchange(true)) {
             return;
         }
-        m_is_close = true;
         // 唤醒等待的协程
-        m_push_cond.notify_all();
-        m_pop_cond.notify_all();
-        std::queue<T> q;
-        q.swap(m_queue);
+        m_not_full.notify_all();
+        m_not_empty.notify_all();
+        discard();
     }
 
     operator bool() const {
-        return m_is_close == false;
+        return !is_closed();
     }
 
     size_t capacity() const {
         return m_capacity;
     }
 
-    size_t size() {
-        LockGuard lock(m_mutex);
-        return m_queue.size();
+    size_t size() const {
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail > head ? std::min(tail - head, m_size) : 0;
     }
 
-    bool empty() {
-        LockGuard lock(m_mutex);
-        return m_queue.empty();
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /**
+     * @brief 等待多个channel中的任意一个有数据并读取
+     * @details 依次尝试每个channel, 都为空时同时登记到所有channel上挂起, 起点轮转避免总是偏向前面的channel
+     * @return 读到数据的channel序号, 全部关闭或超时返回-1
+     */
+    static int select(const std::vector<ChannelImpl*>& channels, T& t, uint64_t timeout_ms) {
+        static thread_local size_t t_start = 0;
+        uint64_t deadline = deadline_of(timeout_ms);
+        size_t n = channels.size();
+        while (true) {
+            size_t start = t_start++;
+            bool open = false;
+            for (size_t i = 0; i < n; ++i) {
+                size_t index = (start + i) % n;
+                ChannelImpl* channel = channels[index];
+                if (channel->is_closed()) {
+                    continue;
+                }
+                open = true;
+                if (channel->dequeue(t)) {
+                    channel->m_not_full.notify();
+                    return static_cast<int>(index);
+                }
+            }
+            uint64_t left = left_of(deadline);
+            if (!open || left == 0) {
+                return -1;
+            }
+
+            // 只登记还没关闭的channel, 登记之后任意一个有数据或者关闭了都重新尝试
+            CoNotifier::Wait wait(n, left);
+            bool ready = false;
+            for (auto channel : channels) {
+                if (!channel->is_closed()) {
+                    wait.add(channel->m_not_empty);
+                    ready |= channel->is_closed() || channel->readable();
+                }
+            }
+            if (ready) {
+                wait.cancel();
+                continue;
+            }
+            wait.park();
+        }
     }
 
 private:
-    bool m_is_close;
-    size_t m_capacity;      // channel缓冲区大小
-    MutexType m_mutex;      // 协程锁, 配合协程条件变量
-    CoCond m_push_cond;     // 入队条件变量
-    CoCond m_pop_cond;      // 出队条件变量
-    std::queue<T> m_queue;  // 消息队列
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    bool is_closed() const {
+        return m_is_close.load(std::memory_order_acquire);
+    }
+
+    // 登记等待之后按槽位序号重新检查, 写位置已经推进但还没写完的槽位不算, 写完后生产者会通知
+    bool full() const {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        Slot& slot = m_slots[tail % m_size];
+        return static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) - tail) < 0;
+    }
+
+    bool readable() const {
+        size_t head = m_head.load(std::memory_order_acquire);
+        Slot& slot = m_slots[head % m_size];
+        return static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) - (head + 1)) >= 0;
+    }
+
+    static uint64_t deadline_of(uint64_t timeout_ms) {
+        return timeout_ms == ~0ull ? ~0ull : get_current_ms() + timeout_ms;
+    }
+
+    static uint64_t left_of(uint64_t deadline) {
+        if (deadline == ~0ull) {
+            return ~0ull;
+        }
+        uint64_t now = get_current_ms();
+        return deadline > now ? deadline - now : 0;
+    }
+
+    template <class U>
+    bool enqueue(U&& t) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = m_slots[pos % m_size];
+            intptr_t diff =
+                static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (slot.storage) T(std::forward<U>(t));
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // 上一轮的数据还没被读走, 缓冲区满
+                return false;
+            }
+            else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t enqueue_n(const T* items, size_t n) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            // 从写位置开始数连续可写的槽位, 它们在写位置越过之前不会变成其它状态
+            size_t count = 0;
+            intptr_t diff = 0;
+            while (count < n && count < m_size) {
+                Slot& slot = m_slots[(pos + count) % m_size];
+                diff = static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) -
+                                             (pos + count));
+                if (diff != 0) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                if (diff < 0) {
+                    return 0;
+                }
+                pos = m_tail.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_tail.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < count; ++i) {
+                    Slot& slot = m_slots[(pos + i) % m_size];
+                    new (slot.storage) T(items[i]);
+                    slot.seq.store(pos + i + 1, std::memory_order_release);
+                }
+                return count;
+            }
+        }
+    }
+
+    bool dequeue(T& t) {
+        return dequeue_n(&t, 1) == 1;
+    }
+
+    size_t dequeue_n(T* items, size_t n) {
+        return take(n, [items](size_t i, T& value) { items[i] = std::move(value); });
+    }
+
+    // 关闭后丢弃剩余的数据
+    void discard() {
+        while (take(m_size, [](size_t, T&) {})) {
+        }
+    }
+
+    // 占用从读位置开始最多n个连续可读的槽位, 依次交给f处理后析构
+    template <class F>
+    size_t take(size_t n, F&& f) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        while (true) {
+            size_t count = 0;
+            intptr_t diff = 0;
+            while (count < n && count < m_size) {
+                Slot& slot = m_slots[(pos + count) % m_size];
+                diff = static_cast<intptr_t>(slot.seq.load(std::memory_order_acquire) -
+                                             (pos + count + 1));
+                if (diff != 0) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                if (diff < 0) {
+                    // 这一轮还没有写入, 缓冲区空
+                    return 0;
+                }
+                pos = m_head.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_head.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < count; ++i) {
+                    Slot& slot = m_slots[(pos + i) % m_size];
+                    f(i, *slot.value());
+                    slot.value()->~T();
+                    slot.seq.store(pos + i + m_size, std::memory_order_release);
+                }
+                return count;
+            }
+        }
+    }
+
+private:
+    size_t m_capacity;                    // channel缓冲区大小
+    size_t m_size;                        // 槽位数量, 至少为1
+    std::unique_ptr<Slot[]> m_slots;      // 环形缓冲区
+    alignas(64) std::atomic<size_t> m_tail {0};  // 下一个写位置
+    alignas(64) std::atomic<size_t> m_head {0};  // 下一个读位置
+    alignas(64) std::atomic<bool> m_is_close {false};
+    CoNotifier m_not_full;   // 等待缓冲区有空位的生产者
+    CoNotifier m_not_empty;  // 等待缓冲区有数据的消费者
 };
 
 /**
@@ -163,10 +524,52 @@ public:
         return m_channel->push(t);
     }
 
+    bool push(T&& t) {
+        return m_channel->push(std::move(t));
+    }
+
+    bool push_for(const T& t, uint64_t timeout_ms) {
+        return m_channel->push_for(t, timeout_ms);
+    }
+
+    bool try_push(const T& t) {
+        return m_channel->try_push(t);
+    }
+
+    size_t push_n(const T* items, size_t n) {
+        return m_channel->push_n(items, n);
+    }
+
     bool pop(T& t) {
         return m_channel->pop(t);
     }
 
+    bool pop_for(T& t, uint64_t timeout_ms) {
+        return m_channel->pop_for(t, timeout_ms);
+    }
+
+    bool try_pop(T& t) {
+        return m_channel->try_pop(t);
+    }
+
+    size_t pop_n(T* items, size_t n) {
+        return m_channel->pop_n(items, n);
+    }
+
+    /**
+     * @brief C++20协程中发送: bool ok = co_await channel.co_push(t);
+     */
+    Task<bool> co_push(T t, uint64_t timeout_ms = ~0ull) {
+        return ChannelImpl<T>::co_push(m_channel, std::move(t), timeout_ms);
+    }
+
+    /**
+     * @brief C++20协程中读取, 与pop一样返回false表示channel已经关闭或者超时
+     */
+    Task<bool> co_pop(T& t, uint64_t timeout_ms = ~0ull) {
+        return ChannelImpl<T>::co_pop(m_channel, t, timeout_ms);
+    }
+
     Channel& operator>>(T& t) {
         pop(t);
         return *this;
@@ -193,10 +596,24 @@ public:
         return m_channel.unique();
     }
 
+    /**
+     * @brief 从多个channel中读取最先到达的数据
+     * @param[in] timeout_ms 超时时间, ~0ull表示一直等待
+     * @return 读到数据的channel在channels中的序号, 全部关闭或超时返回-1
+     */
+    static int select(const std::vector<Channel>& channels, T& t, uint64_t timeout_ms = ~0ull) {
+        std::vector<ChannelImpl<T>*> impls;
+        impls.reserve(channels.size());
+        for (auto& channel : channels) {
+            impls.push_back(channel.m_channel.get());
+        }
+        return ChannelImpl<T>::select(impls, t, timeout_ms);
+    }
+
 private:
     std::shared_ptr<ChannelImpl<T> > m_channel;
 };
 
 }  // namespace acid
 
-#endif
\ No newline at end of file
+#endif
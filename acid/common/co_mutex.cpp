@@ -2,127 +2,651 @@
 
 #include "fiber.h"
 #include "iomanager.h"
+#include "scheduler.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sched.h>
+#include <sys/sysinfo.h>
 
 namespace acid {
 
+CoWaiter::CoWaiter() : scheduler(Scheduler::get_this()) {
+    if (scheduler) {
+        fiber = Fiber::get_this();
+        self = fiber.get();
+    }
+}
+
+CoWaiter::CoWaiter(std::coroutine_handle<> handle) : scheduler(Scheduler::get_this()), handle(handle) {
+    assert(scheduler);
+}
+
+void CoWaiter::park() {
+    if (scheduler) {
+        // 唤醒方在本协程让出之前就可能已经把它放回调度队列, 调度器在让出完成之后才会恢复它
+        scheduler->add_waiting_fiber();
+        self->yield();
+        scheduler->remove_waiting_fiber();
+    }
+    else {
+        while (!woken.load(std::memory_order_acquire)) {
+            sched_yield();
+        }
+    }
+}
+
+bool CoWaiter::suspend() {
+    // 与挂起的Fiber一样计入调度器的等待数, 放回调度队列之后再减掉
+    scheduler->add_waiting_fiber();
+    if (woken.exchange(true, std::memory_order_acq_rel)) {
+        scheduler->remove_waiting_fiber();
+        return false;
+    }
+    return true;
+}
+
+void CoWaiter::wake() {
+    if (handle) {
+        Scheduler* target = scheduler;
+        std::coroutine_handle<> waiting = handle;
+        if (woken.exchange(true, std::memory_order_acq_rel)) {
+            target->schedule(waiting);
+            target->remove_waiting_fiber();
+        }
+    }
+    else if (scheduler) {
+        Scheduler* target = scheduler;
+        Fiber::ptr waiting = std::move(fiber);
+        target->schedule(&waiting);
+    }
+    else {
+        woken.store(true, std::memory_order_release);
+    }
+}
+
+void CoWaitQueue::push(CoWaiter* waiter) {
+    waiter->next = nullptr;
+    if (tail) {
+        tail->next = waiter;
+    }
+    else {
+        head = waiter;
+    }
+    tail = waiter;
+}
+
+CoWaiter* CoWaitQueue::pop() {
+    CoWaiter* waiter = head;
+    if (waiter) {
+        head = waiter->next;
+        if (!head) {
+            tail = nullptr;
+        }
+    }
+    return waiter;
+}
+
+// 把后进先出的栈反转为等待顺序
+static CoWaiter* reverse(CoWaiter* head) {
+    CoWaiter* fifo = nullptr;
+    while (head) {
+        CoWaiter* next = head->next;
+        head->next = fifo;
+        fifo = head;
+        head = next;
+    }
+    return fifo;
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+static const int MAX_SPIN = 100;
+
+/**
+ * @brief 挂起之前自旋等待, 次数根据最近的成功次数调整
+ * @details 持有者一般很快释放时多自旋, 总是自旋失败时次数衰减; 单核上持有者无法同时运行, 不自旋
+ */
+template <class TryLock>
+static bool spin_lock(std::atomic<int>& estimate, TryLock&& try_lock) {
+    static const bool s_multi_core = get_nprocs() > 1;
+    if (!s_multi_core) {
+        return false;
+    }
+    int spin = estimate.load(std::memory_order_relaxed);
+    int limit = std::min(MAX_SPIN, spin * 2 + 8);
+    for (int i = 0; i < limit; ++i) {
+        if (try_lock()) {
+            estimate.store(spin + (i - spin) / 8, std::memory_order_relaxed);
+            return true;
+        }
+        cpu_relax();
+    }
+    estimate.store(spin - (spin + 7) / 8, std::memory_order_relaxed);
+    return false;
+}
+
+static const uintptr_t MUTEX_LOCKED = 1;
+
 void CoMutex::lock() {
+    uint64_t fiber_id = Fiber::get_fiber_id();
     // 如果本协程持有锁就退出
-    if (Fiber::get_fiber_id() == m_fiber_id) {
+    if (fiber_id && m_fiber_id.load(std::memory_order_relaxed) == fiber_id) {
         return;
     }
 
-    // 第一次尝试获取锁
-    while (!try_lock()) {
-        Fiber::ptr self;
-        {
-            LockGuard lock(m_guard);
-            // 由于进入等待队列和出队的代价比较大，所以再次尝试获取锁，成功获取锁将m_fiberId改成自己的id
-            if (try_lock()) {
-                m_fiber_id = Fiber::get_fiber_id();
-                return;
+    if (!try_lock() && !spin_lock(m_spin, [this] { return try_lock(); })) {
+        CoWaiter waiter;
+        uintptr_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(state & MUTEX_LOCKED)) {
+                if (m_state.compare_exchange_weak(state, state | MUTEX_LOCKED,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed)) {
+                    break;
+                }
+                continue;
+            }
+            // 压入等待栈后挂起, 被唤醒时锁已经交给了本协程
+            waiter.next = reinterpret_cast<CoWaiter*>(state & ~MUTEX_LOCKED);
+            if (m_state.compare_exchange_weak(state,
+                                              reinterpret_cast<uintptr_t>(&waiter) | MUTEX_LOCKED,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+                waiter.park();
+                break;
             }
-            // 获取所在的协程
-            self = Fiber::get_this();
-            // 将自己加入协程等待队列
-            m_wait_queue.push(self);
         }
-        self->yield();
     }
     // 成功获取锁后将m_fiber_id改成自己的id
-    m_fiber_id = Fiber::get_fiber_id();
+    m_fiber_id.store(fiber_id, std::memory_order_relaxed);
+}
+
+bool CoMutex::LockAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    m_waiter.emplace(handle);
+    CoWaiter* waiter = &*m_waiter;
+    uintptr_t state = m_mutex.m_state.load(std::memory_order_relaxed);
+    while (true) {
+        if (!(state & MUTEX_LOCKED)) {
+            if (m_mutex.m_state.compare_exchange_weak(state, state | MUTEX_LOCKED,
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed)) {
+                return false;
+            }
+            continue;
+        }
+        // 与lock一样压入等待栈, 解锁方把锁交给本协程后恢复它
+        waiter->next = reinterpret_cast<CoWaiter*>(state & ~MUTEX_LOCKED);
+        if (m_mutex.m_state.compare_exchange_weak(state,
+                                                  reinterpret_cast<uintptr_t>(waiter) | MUTEX_LOCKED,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+            return waiter->suspend();
+        }
+    }
 }
 
 bool CoMutex::try_lock() {
-    return m_mutex.try_lock();
+    uintptr_t state = m_state.load(std::memory_order_relaxed);
+    return !(state & MUTEX_LOCKED) &&
+           m_state.compare_exchange_strong(state, state | MUTEX_LOCKED, std::memory_order_acquire,
+                                           std::memory_order_relaxed);
 }
 
 void CoMutex::unlock() {
-    Fiber::ptr fiber;
-    {
-        LockGuard lock(m_guard);
-        m_fiber_id = 0;
-        if (!m_wait_queue.empty()) {
-            // 获取一个等待的协程
-            fiber = m_wait_queue.front();
-            m_wait_queue.pop();
+    m_fiber_id.store(0, std::memory_order_relaxed);
+    CoWaiter* waiter = m_handoff;
+    if (!waiter) {
+        uintptr_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            // 没有加锁时忽略
+            if (!(state & MUTEX_LOCKED)) {
+                return;
+            }
+            if (state == MUTEX_LOCKED) {
+                if (m_state.compare_exchange_weak(state, 0, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            // 取走整个等待栈, 锁仍然保持加锁状态. 只有持有者会取栈, 不存在ABA问题
+            if (m_state.compare_exchange_weak(state, MUTEX_LOCKED, std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+                break;
+            }
         }
+        waiter = reverse(reinterpret_cast<CoWaiter*>(state & ~MUTEX_LOCKED));
     }
-    m_mutex.unlock();
-    if (fiber) {
-        IOManager::get_this()->schedule(fiber);
+    // 剩下的等待者随锁一起交给下一个持有者
+    m_handoff = waiter->next;
+    waiter->wake();
+}
+
+void CoCond::push(CoWaiter* waiter) {
+    CoWaiter* head = m_waiters.load(std::memory_order_relaxed);
+    do {
+        waiter->next = head;
+    } while (!m_waiters.compare_exchange_weak(head, waiter, std::memory_order_release,
+                                              std::memory_order_relaxed));
+}
+
+void CoCond::collect() {
+    CoWaiter* waiter = reverse(m_waiters.exchange(nullptr, std::memory_order_acquire));
+    while (waiter) {
+        CoWaiter* next = waiter->next;
+        m_queue.push(waiter);
+        waiter = next;
     }
+    m_queued.store(m_queue.head != nullptr, std::memory_order_relaxed);
 }
 
 void CoCond::notify() {
-    Fiber::ptr fiber;
+    // 等待者在释放关联的锁之前已经入栈, 通知方修改条件之后一定能看到
+    if (!m_waiters.load(std::memory_order_relaxed) && !m_queued.load(std::memory_order_relaxed)) {
+        return;
+    }
+    CoWaiter* waiter;
     {
-        // 获取一个等待的协程
-        LockGuard lock(m_mutex);
-        if (m_wait_queue.empty()) {
-            return;
+        Mutex::Lock lock(m_mutex);
+        if (!m_queue.head) {
+            collect();
         }
+        waiter = m_queue.pop();
+        m_queued.store(m_queue.head != nullptr, std::memory_order_relaxed);
+    }
+    if (waiter) {
+        waiter->wake();
+    }
+}
+
+void CoCond::notify_all() {
+    if (!m_waiters.load(std::memory_order_relaxed) && !m_queued.load(std::memory_order_relaxed)) {
+        return;
+    }
+    CoWaiter* waiter;
+    {
+        Mutex::Lock lock(m_mutex);
+        collect();
+        waiter = m_queue.head;
+        m_queue = {};
+        m_queued.store(false, std::memory_order_relaxed);
+    }
+    while (waiter) {
+        CoWaiter* next = waiter->next;
+        waiter->wake();
+        waiter = next;
+    }
+}
+
+void CoCond::wait() {
+    CoWaiter waiter;
+    push(&waiter);
+    waiter.park();
+}
+
+void CoCond::wait(CoMutex::Lock& lock) {
+    CoWaiter waiter;
+    push(&waiter);
+    lock.unlock();
+    waiter.park();
+    lock.lock();
+}
 
-        fiber = m_wait_queue.front();
-        m_wait_queue.pop();
-        if (m_timer) {
-            m_timer->cancel();
-            m_timer.reset();
+static const uint32_t RW_WRITER = 1u << 31;          // 写者持有
+static const uint32_t RW_WRITER_WAITING = 1u << 30;  // 有写者在排队
+static const uint32_t RW_READER_WAITING = 1u << 29;  // 有读者在排队
+static const uint32_t RW_READERS = RW_READER_WAITING - 1;
+
+void CoRWMutex::rdlock() {
+    auto try_rdlock = [this] {
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (!(state & (RW_WRITER | RW_WRITER_WAITING))) {
+            if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                              std::memory_order_relaxed)) {
+                return true;
+            }
         }
+        return false;
+    };
+    if (try_rdlock() || spin_lock(m_spin, try_rdlock)) {
+        return;
     }
-    // 将协程重新加入调度
-    if (fiber) {
-        IOManager::get_this()->schedule(fiber);
+
+    CoWaiter waiter;
+    {
+        Mutex::Lock lock(m_mutex);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(state & (RW_WRITER | RW_WRITER_WAITING))) {
+                if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                                  std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if ((state & RW_READER_WAITING) ||
+                m_state.compare_exchange_weak(state, state | RW_READER_WAITING,
+                                              std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        m_readers.push(&waiter);
     }
+    // 被唤醒时读者计数已经替本协程加上
+    waiter.park();
 }
 
-void CoCond::notify_all() {
-    LockGuard lock(m_mutex);
-    // 将全部等待的协程全部加入调度
-    while (!m_wait_queue.empty()) {
-        Fiber::ptr fiber = m_wait_queue.front();
-        m_wait_queue.pop();
-        if (fiber) {
-            IOManager::get_this()->schedule(fiber);
+void CoRWMutex::wrlock() {
+    auto try_wrlock = [this] {
+        uint32_t state = 0;
+        return m_state.compare_exchange_strong(state, RW_WRITER, std::memory_order_acquire,
+                                               std::memory_order_relaxed);
+    };
+    if (try_wrlock() || spin_lock(m_spin, try_wrlock)) {
+        return;
+    }
+
+    CoWaiter waiter;
+    {
+        Mutex::Lock lock(m_mutex);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        while (true) {
+            if (!m_writers.head && !(state & (RW_WRITER | RW_READERS))) {
+                if (m_state.compare_exchange_weak(state, state | RW_WRITER,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            if ((state & RW_WRITER_WAITING) ||
+                m_state.compare_exchange_weak(state, state | RW_WRITER_WAITING,
+                                              std::memory_order_relaxed)) {
+                break;
+            }
         }
+        m_writers.push(&waiter);
     }
-    // 删除定时器
-    if (m_timer) {
-        m_timer->cancel();
-        m_timer.reset();
+    // 被唤醒时写锁已经交给本协程
+    waiter.park();
+}
+
+void CoRWMutex::unlock() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    if (state & RW_WRITER) {
+        if (state != RW_WRITER || !m_state.compare_exchange_strong(state, 0,
+                                                                   std::memory_order_release,
+                                                                   std::memory_order_relaxed)) {
+            unlock_writer();
+        }
+        return;
+    }
+    state = m_state.fetch_sub(1, std::memory_order_release);
+    if ((state & RW_READERS) == 1 && (state & RW_WRITER_WAITING)) {
+        handoff_to_writer();
     }
 }
 
-void CoCond::wait() {
-    Fiber::ptr self = Fiber::get_this();
+void CoRWMutex::handoff_to_writer() {
+    CoWaiter* waiter;
     {
-        LockGuard lock(m_mutex);
-        // 将自己加入等待队列
-        m_wait_queue.push(self);
-        if (!m_timer) {
-            // 加入一个空任务定时器, 不让调度器退出
-            m_timer = IOManager::get_this()->add_timer(
-                -1, [] {}, true);
+        Mutex::Lock lock(m_mutex);
+        // 有写者等待时新读者都会排队, 读者计数不会再增加, 只有最后一个读者会走到这里
+        waiter = m_writers.pop();
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        uint32_t waiting = m_writers.head ? RW_WRITER_WAITING : 0;
+        while (!m_state.compare_exchange_weak(
+            state, (state & ~RW_WRITER_WAITING) | RW_WRITER | waiting, std::memory_order_acq_rel,
+            std::memory_order_relaxed)) {
         }
     }
-    // 让出协程
-    self->yield();
+    waiter->wake();
 }
 
-void CoCond::wait(CoMutex::Lock& lock) {
-    Fiber::ptr self = Fiber::get_this();
+void CoRWMutex::unlock_writer() {
+    CoWaiter* readers = nullptr;
+    CoWaiter* writer = nullptr;
     {
-        LockGuard lock1(m_mutex);
-        // 将自己加入等待队列
-        m_wait_queue.push(self);
-        if (!m_timer) {
-            m_timer = IOManager::get_this()->add_timer(
-                -1, []() {}, true);
+        Mutex::Lock lock(m_mutex);
+        uint32_t state = m_state.load(std::memory_order_relaxed);
+        uint32_t next;
+        if (m_readers.head) {
+            // 写者之后先让全部等待的读者进入, 读者计数替它们加上
+            uint32_t count = 0;
+            for (CoWaiter* waiter = m_readers.head; waiter; waiter = waiter->next) {
+                ++count;
+            }
+            readers = m_readers.head;
+            m_readers = {};
+            next = (state & RW_WRITER_WAITING) | count;
+        }
+        else if (m_writers.head) {
+            writer = m_writers.pop();
+            next = RW_WRITER | (m_writers.head ? RW_WRITER_WAITING : 0);
         }
-        lock.unlock();
+        else {
+            next = 0;
+        }
+        while (!m_state.compare_exchange_weak(state, next, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed)) {
+        }
+    }
+    while (readers) {
+        CoWaiter* next = readers->next;
+        readers->wake();
+        readers = next;
     }
+    if (writer) {
+        writer->wake();
+    }
+}
 
-    self->yield();
-    lock.lock();
+CoNotifier::~CoNotifier() {
+    assert(!m_head);
+}
+
+void CoNotifier::link(Link* link) {
+    link->prev = m_tail;
+    link->next = nullptr;
+    if (m_tail) {
+        m_tail->next = link;
+    }
+    else {
+        m_head = link;
+    }
+    m_tail = link;
+    link->linked = true;
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CoNotifier::unlink(Link* link) {
+    if (link->prev) {
+        link->prev->next = link->next;
+    }
+    else {
+        m_head = link->next;
+    }
+    if (link->next) {
+        link->next->prev = link->prev;
+    }
+    else {
+        m_tail = link->prev;
+    }
+    link->linked = false;
+    m_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void CoNotifier::notify(size_t n) {
+    // 与Wait::add之后的屏障配对: 要么等待者看到了条件的改变, 要么这里看到了它的登记
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_count.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    Wait* woken = nullptr;
+    Wait** tail = &woken;
+    {
+        Mutex::Lock lock(m_mutex);
+        while (n && m_head) {
+            Link* link = m_head;
+            unlink(link);
+            // 已经被别的CoNotifier唤醒或超时的等待者只移除, 不计数
+            if (link->wait->claim(static_cast<int>(link - link->wait->m_links))) {
+                *tail = link->wait;
+                tail = &link->wait->m_next_woken;
+                --n;
+            }
+        }
+    }
+    *tail = nullptr;
+    // 被选中的等待者在被唤醒之前不会返回, 可以在锁外唤醒
+    while (woken) {
+        Wait* next = woken->m_next_woken;
+        woken->m_waiter.wake();
+        woken = next;
+    }
+}
+
+CoNotifier::Wait::Wait(size_t count, uint64_t timeout_ms)
+    : m_timeout_ms(timeout_ms), m_state(&m_inline_state), m_links(m_inline_links), m_capacity(count) {
+    init();
+}
+
+CoNotifier::Wait::Wait(std::coroutine_handle<> handle, size_t count, uint64_t timeout_ms)
+    : m_waiter(handle)
+    , m_timeout_ms(timeout_ms)
+    , m_state(&m_inline_state)
+    , m_links(m_inline_links)
+    , m_capacity(count) {
+    init();
+}
+
+void CoNotifier::Wait::init() {
+    if (m_capacity > sizeof(m_inline_links) / sizeof(m_inline_links[0])) {
+        m_heap_links.reset(new Link[m_capacity]);
+        m_links = m_heap_links.get();
+    }
+    if (m_timeout_ms != ~0ull) {
+        // 定时器回调可能在等待结束之后才执行, 状态放在共享的堆内存中
+        m_shared_state = std::make_shared<std::atomic<int>>(WAITING);
+        m_state = m_shared_state.get();
+    }
+}
+
+CoNotifier::Wait::~Wait() {
+    if (!m_done) {
+        cancel();
+    }
+}
+
+void CoNotifier::Wait::add(CoNotifier& notifier) {
+    assert(m_count < m_capacity);
+    Link* link = &m_links[m_count++];
+    link->wait = this;
+    link->notifier = &notifier;
+    {
+        Mutex::Lock lock(notifier.m_mutex);
+        notifier.link(link);
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void CoNotifier::Wait::unlink_all() {
+    for (size_t i = 0; i < m_count; ++i) {
+        Link* link = &m_links[i];
+        Mutex::Lock lock(link->notifier->m_mutex);
+        if (link->linked) {
+            link->notifier->unlink(link);
+        }
+    }
+    m_done = true;
+}
+
+int CoNotifier::Wait::park() {
+    if (m_waiter.scheduler) {
+        Timer::ptr timer;
+        IOManager* iom = IOManager::get_this();
+        if (m_timeout_ms != ~0ull && iom) {
+            std::shared_ptr<std::atomic<int>> state = m_shared_state;
+            Fiber::ptr fiber = m_waiter.fiber;
+            timer = iom->add_timer(m_timeout_ms, [state, fiber, iom]() mutable {
+                int expected = WAITING;
+                if (state->compare_exchange_strong(expected, TIMEOUT, std::memory_order_acq_rel)) {
+                    iom->schedule(&fiber);
+                }
+            });
+        }
+        // 不论谁抢到了唤醒, 它都会把本协程放回调度队列, 这里恰好让出一次
+        m_waiter.park();
+        if (timer && m_state->load(std::memory_order_acquire) != TIMEOUT) {
+            timer->cancel();
+        }
+    }
+    else {
+        uint64_t deadline = m_timeout_ms == ~0ull ? ~0ull : get_current_ms() + m_timeout_ms;
+        while (!m_waiter.woken.load(std::memory_order_acquire)) {
+            if (deadline != ~0ull && get_current_ms() >= deadline && claim(TIMEOUT)) {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    unlink_all();
+    return m_state->load(std::memory_order_acquire);
+}
+
+void CoNotifier::Wait::cancel() {
+    if (claim(CANCELLED)) {
+        unlink_all();
+        return;
+    }
+    // 已经被某个CoNotifier选中并放回调度队列, 先让出一次消耗掉这次唤醒, 再转给下一个等待者
+    int index = m_state->load(std::memory_order_acquire);
+    m_waiter.park();
+    unlink_all();
+    if (index >= 0) {
+        m_links[index].notifier->notify(1);
+    }
+}
+
+bool CoNotifier::Wait::suspend() {
+    IOManager* iom = IOManager::get_this();
+    if (m_timeout_ms != ~0ull && iom) {
+        // 抢到超时的定时器回调是唯一的唤醒方, 在协程恢复之前等待对象一直有效
+        std::shared_ptr<std::atomic<int>> state = m_shared_state;
+        m_timer = iom->add_timer(m_timeout_ms, [state, this]() {
+            int expected = WAITING;
+            if (state->compare_exchange_strong(expected, TIMEOUT, std::memory_order_acq_rel)) {
+                m_waiter.wake();
+            }
+        });
+    }
+    return m_waiter.suspend();
+}
+
+int CoNotifier::Wait::resume() {
+    if (m_timer && m_state->load(std::memory_order_acquire) != TIMEOUT) {
+        m_timer->cancel();
+    }
+    m_timer.reset();
+    unlink_all();
+    return m_state->load(std::memory_order_acquire);
+}
+
+bool CoNotifier::Wait::try_cancel() {
+    if (claim(CANCELLED)) {
+        unlink_all();
+        return true;
+    }
+    return false;
 }
 
 CoSemaphore::CoSemaphore(uint32_t num) : m_num(num), m_used(0) {
@@ -146,6 +670,30 @@ void CoSemaphore::notify() {
     m_cond.notify();
 }
 
+void CoWaitGroup::done() {
+    m_finishing.fetch_add(1, std::memory_order_relaxed);
+    if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_notifier.notify_all();
+    }
+    m_finishing.fetch_sub(1, std::memory_order_release);
+}
+
+void CoWaitGroup::wait() {
+    while (count() > 0) {
+        CoNotifier::Wait wait;
+        wait.add(m_notifier);
+        if (count() <= 0) {
+            wait.cancel();
+            break;
+        }
+        wait.park();
+    }
+    // 最后一个done可能还在notify中, 很短, 让出CPU等它退出
+    while (m_finishing.load(std::memory_order_acquire) != 0) {
+        sched_yield();
+    }
+}
+
 CoCountDownLatch::CoCountDownLatch(int count) : m_count(count) {
 }
 
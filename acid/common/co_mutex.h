@@ -15,35 +15,124 @@
 #include "mutex.h"
 #include "noncopyable.h"
 
-#include <queue>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <optional>
 
 namespace acid {
 
 class Fiber;
+class Scheduler;
+class Timer;
+
+/**
+ * @brief 挂起的协程或线程在自己栈上的等待节点
+ * @details 在调度器中的协程挂起时让出, 被唤醒时放回调度队列; 不在调度器中的线程让出CPU轮询标志;
+ * C++20协程在协程帧中登记, 被唤醒时把句柄放回调度队列。唤醒方调用wake之后节点随时可能失效, 不能再访问
+ */
+struct CoWaiter {
+    CoWaiter* next = nullptr;
+    Scheduler* scheduler;
+    std::shared_ptr<Fiber> fiber;
+    Fiber* self = nullptr;
+    std::coroutine_handle<> handle;
+    std::atomic<bool> woken {false};
+
+    CoWaiter();
+
+    /**
+     * @brief C++20协程的等待节点, 只能在调度器中使用
+     */
+    explicit CoWaiter(std::coroutine_handle<> handle);
+
+    void park();
+
+    /**
+     * @brief C++20协程登记完成后在await_suspend中调用
+     * @details await_suspend返回之前协程还不能恢复, 唤醒方和这里后到的一方负责把它放回调度队列
+     * @return false 已经被唤醒, 不需要挂起
+     */
+    bool suspend();
+
+    void wake();
+};
+
+/**
+ * @brief 等待节点组成的先进先出队列, 不分配内存, 由使用者加锁保护
+ */
+struct CoWaitQueue {
+    CoWaiter* head = nullptr;
+    CoWaiter* tail = nullptr;
+
+    void push(CoWaiter* waiter);
+
+    CoWaiter* pop();
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 状态字最低位表示已加锁, 其余位是等待节点栈的栈顶, 等待节点在挂起协程的栈上。
+ * 加锁时先按自适应的次数自旋, 仍然失败再把节点无锁压栈并挂起; 解锁时如果有等待者,
+ * 锁不释放, 而是按等待顺序直接交给下一个协程, 并把它放回调度队列
+ */
 class CoMutex : Noncopyable {
 public:
     using Lock = ScopedLockImpl<CoMutex>;
-    using LockGuard = Spinlock::Lock;
+
+    /**
+     * @brief C++20协程中加锁, 竞争时挂起协程排队, 与Fiber的等待者一起按顺序交接
+     */
+    class LockAwaiter {
+    public:
+        explicit LockAwaiter(CoMutex& mutex) : m_mutex(mutex) {
+        }
+
+        bool await_ready() {
+            return m_mutex.try_lock();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        void await_resume() noexcept {
+        }
+
+    private:
+        CoMutex& m_mutex;
+        std::optional<CoWaiter> m_waiter;
+    };
 
     void lock();
 
+    /**
+     * @brief co_await mutex.co_lock(); 之后调用unlock解锁
+     */
+    LockAwaiter co_lock() {
+        return LockAwaiter(*this);
+    }
+
     bool try_lock();
 
     void unlock();
 
 private:
-    Spinlock m_mutex;                                 // 协程所持有的锁
-    Spinlock m_guard;                                 // 保护等待队列的锁
-    uint64_t m_fiber_id;                              // 持有锁的协程ID
-    std::queue<std::shared_ptr<Fiber>> m_wait_queue;  // 协程等待队列
+    std::atomic<uintptr_t> m_state {0};
+    // 从等待栈取出并反转为等待顺序的节点, 只由持有锁的协程访问
+    CoWaiter* m_handoff = nullptr;
+    // 持有锁的协程ID, 同一个协程重复加锁时直接返回
+    std::atomic<uint64_t> m_fiber_id {0};
+    // 最近几次自旋成功时的平均次数
+    std::atomic<int> m_spin {0};
 };
 
-class Timer;
+/**
+ * @brief 协程条件变量
+ * @details 等待者无锁压栈; 唤醒方用一个短互斥锁串行取出节点, 按等待顺序唤醒。
+ * 有协程挂起时调度器不会停止, 不需要额外的定时器
+ */
 class CoCond : Noncopyable {
 public:
-    using MutexType = Spinlock;
-    using LockGuard = MutexType::Lock;
-
     void notify();
 
     void notify_all();
@@ -53,9 +142,226 @@ public:
     void wait(CoMutex::Lock& lock);
 
 private:
-    std::queue<std::shared_ptr<Fiber>> m_wait_queue;  // 协程等待队列
-    MutexType m_mutex;                                // 保护协程等待队列
-    std::shared_ptr<Timer> m_timer;  // 空任务定时器, 让调度器保持调度
+    void push(CoWaiter* waiter);
+
+    // 把新的等待者按等待顺序接到m_queue后面, 调用前持有m_mutex
+    void collect();
+
+private:
+    std::atomic<CoWaiter*> m_waiters {nullptr};  // 新加入的等待者, 后进先出
+    std::atomic<bool> m_queued {false};          // m_queue是否非空, 用于无锁判断
+    CoWaitQueue m_queue;                         // 按等待顺序排好的等待者
+    Mutex m_mutex;                               // 串行化唤醒方
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 没有竞争时只用一次CAS加解锁; 需要等待时先自旋, 再挂起到读者或写者队列。
+ * 有写者等待时新的读者也排队, 写锁释放时优先唤醒全部等待的读者, 读写双方都不会饿死
+ */
+class CoRWMutex : Noncopyable {
+public:
+    using ReadLock = ReadScopedLockImpl<CoRWMutex>;
+    using WriteLock = WriteScopedLockImpl<CoRWMutex>;
+
+    void rdlock();
+
+    void wrlock();
+
+    void unlock();
+
+private:
+    // 最后一个读者释放时把锁交给等待的写者
+    void handoff_to_writer();
+
+    void unlock_writer();
+
+private:
+    std::atomic<uint32_t> m_state {0};  // 写者持有, 写者等待, 读者等待三个标志位和读者计数
+    std::atomic<int> m_spin {0};
+    CoWaitQueue m_readers;  // 等待的读者
+    CoWaitQueue m_writers;  // 等待的写者
+    Mutex m_mutex;          // 只在需要排队时保护两个队列
+};
+
+/**
+ * @brief 无锁结构使用的协程等待点
+ * @details 等待方先用Wait登记, 再检查一遍条件, 条件仍不满足才挂起; 改变条件的一方改变之后调用notify。
+ * 登记之后和通知之前各有一次全屏障, 两边至少有一方能看到对方, 不会丢失唤醒。没有等待者时notify
+ * 只读一次计数, 不加锁
+ */
+class CoNotifier : Noncopyable {
+public:
+    class Wait;
+
+    template <class Ready>
+    class Awaiter;
+
+    ~CoNotifier();
+
+    /**
+     * @brief 唤醒最多n个等待者
+     */
+    void notify(size_t n = 1);
+
+    void notify_all() {
+        notify(SIZE_MAX);
+    }
+
+    /**
+     * @brief C++20协程中等待一次通知
+     * @param[in] ready 登记之后再检查的条件, 已经满足时不挂起
+     * @param[in] timeout_ms 超时时间, ~0ull表示不超时
+     * @return 可以co_await的对象, 结果与Wait::park相同
+     */
+    template <class Ready>
+    Awaiter<Ready> co_wait(Ready ready, uint64_t timeout_ms = ~0ull) {
+        return Awaiter<Ready>(*this, std::move(ready), timeout_ms);
+    }
+
+private:
+    // 一个Wait在一个CoNotifier上的登记, 在Wait里
+    struct Link {
+        Link* prev = nullptr;
+        Link* next = nullptr;
+        Wait* wait = nullptr;
+        CoNotifier* notifier = nullptr;
+        bool linked = false;
+    };
+
+    // 以下两个调用前持有m_mutex
+    void link(Link* link);
+
+    void unlink(Link* link);
+
+private:
+    std::atomic<size_t> m_count {0};  // 登记的等待者数量
+    Link* m_head = nullptr;           // 按登记顺序排列的等待者
+    Link* m_tail = nullptr;
+    Mutex m_mutex;
+};
+
+/**
+ * @brief 一次等待, 可以同时登记在多个CoNotifier上, 被其中任意一个唤醒或者超时后结束
+ * @details 协程只能在栈上使用, C++20协程放在协程帧中。超时需要在IOManager中或者不在调度器中的线程里,
+ * 在其它调度器中忽略超时
+ */
+class CoNotifier::Wait : Noncopyable {
+public:
+    static const int TIMEOUT = -1;
+
+    /**
+     * @param[in] count 最多登记的CoNotifier数量
+     * @param[in] timeout_ms 超时时间, ~0ull表示不超时
+     */
+    explicit Wait(size_t count = 1, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief C++20协程使用的等待, 在await_suspend中构造
+     */
+    Wait(std::coroutine_handle<> handle, size_t count, uint64_t timeout_ms);
+
+    /**
+     * @brief 还没有等待就析构时取消登记
+     */
+    ~Wait();
+
+    /**
+     * @brief 登记到notifier上, 登记之后调用方应该再检查一遍条件
+     */
+    void add(CoNotifier& notifier);
+
+    /**
+     * @brief 挂起直到被唤醒或超时
+     * @return 唤醒它的CoNotifier的登记序号, 超时返回TIMEOUT
+     */
+    int park();
+
+    /**
+     * @brief 登记之后发现条件已经满足, 不再等待
+     * @details 如果已经被某个CoNotifier唤醒, 把这次唤醒转给它的下一个等待者, 不会丢失
+     */
+    void cancel();
+
+    /**
+     * @brief C++20协程版本的park, 登记并检查完条件之后调用, 结果作为await_suspend的返回值
+     * @return false 已经被唤醒或超时, 不需要挂起
+     */
+    bool suspend();
+
+    /**
+     * @brief C++20协程恢复之后调用, 返回值与park相同
+     */
+    int resume();
+
+    /**
+     * @brief C++20协程版本的cancel, 不会挂起
+     * @return false 已经被某个CoNotifier唤醒, 调用方应该调用suspend等这次唤醒到达
+     */
+    bool try_cancel();
+
+private:
+    friend class CoNotifier;
+
+    void init();
+
+    static constexpr int WAITING = -2;
+    static constexpr int CANCELLED = -3;
+
+    bool claim(int result) {
+        int expected = WAITING;
+        return m_state->compare_exchange_strong(expected, result, std::memory_order_acq_rel);
+    }
+
+    // 等待结束后从还登记着的CoNotifier上移除
+    void unlink_all();
+
+private:
+    CoWaiter m_waiter;
+    uint64_t m_timeout_ms;
+    // 登记序号, 超时或取消, 带超时时和定时器共享
+    std::shared_ptr<std::atomic<int>> m_shared_state;
+    std::atomic<int> m_inline_state {WAITING};
+    std::atomic<int>* m_state;
+    Link m_inline_links[2];
+    std::unique_ptr<Link[]> m_heap_links;
+    Link* m_links;
+    size_t m_count = 0;
+    size_t m_capacity;
+    Wait* m_next_woken = nullptr;  // notify一次唤醒多个时暂时串起来
+    bool m_done = false;
+    std::shared_ptr<Timer> m_timer;  // C++20协程等待的超时定时器
+};
+
+template <class Ready>
+class CoNotifier::Awaiter {
+public:
+    Awaiter(CoNotifier& notifier, Ready ready, uint64_t timeout_ms)
+        : m_notifier(notifier), m_ready(std::move(ready)), m_timeout_ms(timeout_ms) {
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        m_wait.emplace(handle, 1, m_timeout_ms);
+        m_wait->add(m_notifier);
+        if (m_ready() && m_wait->try_cancel()) {
+            return false;
+        }
+        return m_wait->suspend();
+    }
+
+    int await_resume() {
+        return m_wait->resume();
+    }
+
+private:
+    CoNotifier& m_notifier;
+    Ready m_ready;
+    uint64_t m_timeout_ms;
+    std::optional<Wait> m_wait;
 };
 
 class CoSemaphore : Noncopyable {
@@ -73,6 +379,35 @@ private:
     CoMutex m_mutex;  // 协程锁
 };
 
+/**
+ * @brief 等待一组任务完成
+ * @details 与CoCountDownLatch不同, 计数可以在等待的过程中继续增加, 加减计数不加锁,
+ * 只有等待时才登记到CoNotifier上挂起
+ */
+class CoWaitGroup : Noncopyable {
+public:
+    void add(int64_t n = 1) {
+        m_count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void done();
+
+    /**
+     * @brief 挂起直到计数减到0
+     */
+    void wait();
+
+    int64_t count() const {
+        return m_count.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<int64_t> m_count {0};
+    // 正在执行的done数量, wait返回前等它们退出, 之后调用方可以立即销毁对象
+    std::atomic<int> m_finishing {0};
+    CoNotifier m_notifier;
+};
+
 class CoCountDownLatch {
 public:
     CoCountDownLatch(int count);
@@ -6,6 +6,8 @@
 #include "mutex.h"
 #include "util.h"
 
+#include <atomic>
+#include <cassert>
 #include <map>
 #include <memory>
 #include <set>
@@ -26,7 +28,7 @@ public:
     using ptr = std::shared_ptr<ConfigVarBase>;
     explicit ConfigVarBase(const std::string& name, const std::string& description = "")
     : m_name(name)
-    , m_description() {
+    , m_description(description) {
         std::transform(m_name.begin(), m_name.end(), m_name.begin(), ::tolower);
     }
 
@@ -59,9 +61,28 @@ public:
      */
     [[nodiscard]] virtual std::string get_typename() const = 0;
 
+    /*!
+     * @brief 全局配置版本号, 任意配置修改后加1, 用于一次判断一组配置是否有变化。
+     * 线程缓存按每个ConfigVar自己的版本号判断, 修改一个配置不影响其它配置的缓存
+     */
+    static uint64_t get_version() {
+        return s_version.load(std::memory_order_acquire);
+    }
+
+protected:
+    /*!
+     * @brief 新的值发布之后调用
+     */
+    static void bump_version() {
+        s_version.fetch_add(1, std::memory_order_release);
+    }
+
 protected:
     std::string m_name;
     std::string m_description;
+
+private:
+    static inline std::atomic<uint64_t> s_version {1};
 };
 
 /*!
@@ -268,6 +289,40 @@ public:
     }
 };
 
+namespace detail {
+
+/**
+ * @brief 配置值的线程缓存, 每个ConfigVar占一个槽位
+ */
+class ConfigCache {
+public:
+    struct Entry {
+        uint64_t version = 0;
+        std::shared_ptr<const void> value;
+    };
+
+    static size_t alloc_slot() {
+        return s_slots.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static Entry& entry(size_t slot) {
+        if (slot >= t_entries.size()) [[unlikely]] {
+            t_entries.resize(slot + 1);
+        }
+        return t_entries[slot];
+    }
+
+private:
+    // 每个线程缓存的快照, 按槽位编号索引
+    static inline thread_local std::vector<Entry> t_entries;
+    static inline std::atomic<size_t> s_slots {0};
+};
+
+}  // namespace detail
+
+template <class T>
+class ConfigRef;
+
 // FromStr T operator()(const std::string&)
 // ToStr  std::string operator()(const T&)
 template <class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>>
@@ -281,19 +336,21 @@ public:
     using Callback = std::function<void(const T&, const T&)>;
 
     ConfigVar(const std::string& name, const T& value, const std::string description = "")
-        : ConfigVarBase(name, description), m_val(value) {
+        : ConfigVarBase(name, description)
+        , m_slot(detail::ConfigCache::alloc_slot())
+        , m_snapshot(std::make_shared<const T>(value)) {
     }
 
     // 将参数转换成YAML string
     std::string to_string() override {
         try {
-            ReadLockGuard lock(m_mutex);
-            return ToStr()(m_val);
+            return ToStr()(*m_snapshot.load(std::memory_order_acquire));
         }
         catch (std::exception& e) {
             LOG_ERROR(GET_ROOT_LOGGER()) << "ConfigVar::to_string exception" << e.what()
-                                         << " convert: " << typeid(m_val).name() << " to string.";
+                                         << " convert: " << typeid(T).name() << " to string.";
         }
+        return "";
     }
 
     // 从YAML string获取参数
@@ -304,30 +361,44 @@ public:
         }
         catch (std::exception& e) {
             LOG_ERROR(GET_ROOT_LOGGER()) << "ConfigVar::fromString exception" << e.what() << " convert: string to"
-                                         << typeid(m_val).name();
+                                         << typeid(T).name();
         }
         return false;
     }
 
+    /*!
+     * @brief 返回当前值的拷贝, 容器类型的配置每次都会复制, 频繁读取时用snapshot或ConfigRef
+     */
     const T get_value() {
-        ReadLockGuard lock(m_mutex);
-        return m_val;
+        return cached();
+    }
+
+    /*!
+     * @brief 返回当前值的只读快照, 不加锁也不复制值
+     * @details 修改配置时发布新的对象, 不改动旧对象, 持有快照期间看到的值不会变化
+     */
+    std::shared_ptr<const T> snapshot() const {
+        cached();
+        return std::static_pointer_cast<const T>(detail::ConfigCache::entry(m_slot).value);
     }
 
     void set_value(const T& value) {
         {
             ReadLockGuard lock(m_mutex);
-            if (value == m_val) {
+            std::shared_ptr<const T> old_value = m_snapshot.load(std::memory_order_acquire);
+            if (value == *old_value) {
                 return;
             }
             // 配置参数有更改就触发该参数对应的所有回调函数
             for (auto& item : m_callbacks) {
-                item.second(m_val, value);
+                item.second(*old_value, value);
             }
         }
-        // 最后将值写入
+        // 最后发布新值, 读者之后拿到的是新的快照
         WriteLockGuard lock(m_mutex);
-        m_val = value;
+        m_snapshot.store(std::make_shared<const T>(value), std::memory_order_release);
+        m_version.fetch_add(1, std::memory_order_release);
+        bump_version();
     }
 
     [[nodiscard]] std::string get_typename() const override {
@@ -372,11 +443,91 @@ public:
     }
 
 private:
-    T m_val;
+    friend class ConfigRef<T>;
+
+    /*!
+     * @brief 当前线程缓存的值
+     * @details 只比较这个配置的版本号, 没有修改时直接返回缓存, 不加锁、不写共享的内存;
+     * 这个配置修改后在下一次读取时从m_snapshot重新取一次, libstdc++的atomic<shared_ptr>::load内部会短暂加锁。
+     * 返回的引用在本线程下一次读取这个配置之前有效
+     */
+    const T& cached() const {
+        uint64_t version = m_version.load(std::memory_order_acquire);
+        detail::ConfigCache::Entry& entry = detail::ConfigCache::entry(m_slot);
+        if (entry.version != version) [[unlikely]] {
+            // 先读版本号再取快照, 取到的快照不会比版本号旧
+            entry.value = m_snapshot.load(std::memory_order_acquire);
+            entry.version = version;
+        }
+        return *static_cast<const T*>(entry.value.get());
+    }
+
+private:
+    // 读取时只访问这一个缓存行, 与m_snapshot分开, 重新取快照时对它的写入不影响其它线程的读取
+    // 值的版本号, 每次修改加1, 线程缓存用0表示空
+    alignas(64) std::atomic<uint64_t> m_version {1};
+    // 线程缓存的槽位
+    size_t m_slot;
+    // 当前值, 只整体替换不原地修改
+    alignas(64) std::atomic<std::shared_ptr<const T>> m_snapshot;
     std::map<uint64_t, Callback> m_callbacks;
+    // 保护回调表, 并让修改串行执行
     RWMutexType m_mutex;
 };
 
+/*!
+ * @brief 配置的读取句柄, 每个线程缓存一份快照
+ * @details 读取时只比较这个配置的版本号, 没有修改时直接返回线程缓存的值, 不加锁、不复制、不修改共享的引用计数;
+ * 这个配置修改后各线程在下一次读取时重新取一次快照。
+ * get, operator*和operator->返回的引用只在本线程下一次读取这个配置之前有效: 同一线程上的其它协程或者
+ * 持有者自己再次读取时, 缓存可能换成新的快照, 旧的值随之释放。因此只在不会让出协程、也不会再读这个配置的
+ * 表达式或者循环中直接使用, 否则先用snapshot取得快照再使用
+ *
+ * @code
+ * static ConfigRef<std::vector<std::string>> s_hosts(Config::look_up("hosts", std::vector<std::string>()));
+ * size_t count = s_hosts->size();
+ * // 循环体可能让出协程, 持有快照
+ * auto hosts = s_hosts.snapshot();
+ * for (const auto& host : *hosts) { connect(host); }
+ * @endcode
+ */
+template <class T>
+class ConfigRef {
+public:
+    explicit ConfigRef(typename ConfigVar<T>::ptr var) : m_var(std::move(var)) {
+        assert(m_var);
+    }
+
+    /*!
+     * @brief 当前值的引用, 有效期见类的说明
+     */
+    const T& get() const {
+        return m_var->cached();
+    }
+
+    const T& operator*() const {
+        return get();
+    }
+
+    const T* operator->() const {
+        return &get();
+    }
+
+    /*!
+     * @brief 当前值的快照, 持有期间不会释放, 可以跨越协程切换
+     */
+    std::shared_ptr<const T> snapshot() const {
+        return m_var->snapshot();
+    }
+
+    const typename ConfigVar<T>::ptr& get_var() const {
+        return m_var;
+    }
+
+private:
+    typename ConfigVar<T>::ptr m_var;
+};
+
 // 管理类，创建并管理ConfigVar
 class Config {
 public:
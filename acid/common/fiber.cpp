@@ -12,6 +12,7 @@
 #include "util.h"
 
 #include <cassert>
+#include <stdexcept>
 
 namespace acid {
 
@@ -52,6 +53,50 @@ public:
 
 using StackAllocator = MallocStackAllocator;
 
+Fiber* Fiber::current() {
+    if (!t_fiber) {
+        get_this();
+    }
+    return t_fiber;
+}
+
+// 可继承的槽位, 每一位对应一个槽位
+static std::atomic<uint64_t> s_inherit_slots = 0;
+static std::atomic<size_t> s_local_slots = 0;
+
+size_t Fiber::alloc_local_slot(bool inherit) {
+    size_t slot = s_local_slots++;
+    // 可继承的掩码只有64位, 超出后移位是未定义行为, release版本同样直接失败
+    if (slot >= MAX_LOCAL_SLOTS) {
+        // FiberLocal通常是静态变量, 这里可能早于root_logger初始化
+        LOG_FATAL(GET_ROOT_LOGGER()) << "too many FiberLocal, at most " << MAX_LOCAL_SLOTS;
+        throw std::length_error("too many FiberLocal");
+    }
+    if (inherit) {
+        s_inherit_slots |= 1ull << slot;
+    }
+    return slot;
+}
+
+void Fiber::set_local(size_t slot, std::shared_ptr<void> value) {
+    if (slot >= m_locals.size()) {
+        if (!value) {
+            return;
+        }
+        m_locals.resize(slot + 1);
+    }
+    m_locals[slot] = std::move(value);
+}
+
+void Fiber::inherit_locals(const Fiber& parent) {
+    uint64_t mask = s_inherit_slots.load(std::memory_order_relaxed);
+    for (size_t slot = 0; slot < parent.m_locals.size(); ++slot) {
+        if ((mask >> slot & 1) && parent.m_locals[slot]) {
+            set_local(slot, parent.m_locals[slot]);
+        }
+    }
+}
+
 uint64_t Fiber::get_fiber_id() {
     if (t_fiber) {
         return t_fiber->get_id();
@@ -61,6 +106,7 @@ uint64_t Fiber::get_fiber_id() {
 
 Fiber::Fiber() : m_stack_size(0), m_ctx(), m_run_in_scheduler(false) {
     LOG_DEBUG(root_logger) << "Fiber::Fiber()";
+    m_id = ++s_fiber_id;
     set_this(this);
     m_state = State::RUNNING;
 
@@ -70,7 +116,6 @@ Fiber::Fiber() : m_stack_size(0), m_ctx(), m_run_in_scheduler(false) {
     }
 
     ++s_fiber_count;
-    m_id = ++s_fiber_id;
 }
 
 Fiber::Fiber(std::function<void()> callback, size_t stack_size, bool run_in_scheduler)
@@ -115,6 +160,7 @@ Fiber::ptr Fiber::get_this() {
 // 设置当前线程正在执行的主协程
 void Fiber::set_this(acid::Fiber* f) {
     t_fiber = f;
+    LogContext::set_fiber_id(f ? f->m_id : 0);
 }
 
 // 析构时要先判断是主协程还是子协程
@@ -150,6 +196,9 @@ void Fiber::reset(std::function<void()> callback) {
     assert(m_stack);
     assert(m_state == State::TERM);
     m_callback = callback;
+    m_locals.clear();
+    m_bound_thread = -1;
+    m_numa_node = -1;
     if (getcontext(&m_ctx)) {
         //        assert(false, "getcontext");
     }
@@ -165,7 +214,7 @@ void Fiber::reset(std::function<void()> callback) {
 void Fiber::resume() {
     assert(m_state != State::TERM && m_state != State::RUNNING);
     set_this(this);
-    m_state = State::RUNNING;
+    m_state.store(State::RUNNING, std::memory_order_relaxed);
     // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
     if (m_run_in_scheduler) {
         // swapcontext将上下文保存在第一个参数中，然后切换到第二个参数指定的上下文
@@ -179,6 +228,10 @@ void Fiber::resume() {
             // TODO assert
         }
     }
+    // 回到这里时协程的上下文已经保存完毕, 这之后其它线程才能恢复它
+    if (m_state.load(std::memory_order_relaxed) != State::TERM) {
+        m_state.store(State::READY, std::memory_order_release);
+    }
 }
 
 // 会在子协程中调用，用于切换到主协程或是调度协程
@@ -186,9 +239,7 @@ void Fiber::yield() {
     /// 协程运行完之后会自动yield一次，用于回到主协程，此时状态已为结束状态
     assert(m_state == State::RUNNING || m_state == State::TERM);
     set_this(t_main_fiber.get());
-    if (m_state != State::TERM) {
-        m_state = State::READY;
-    }
+    // 不在这里改为就绪态: 其它线程看到就绪态时本协程的上下文可能还没保存, 由resume返回后设置
 
     // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
     if (m_run_in_scheduler) {
@@ -212,6 +263,8 @@ void Fiber::main_func() {
     assert(cur);
     cur->m_callback();
     cur->m_callback = nullptr;
+    // 结束时就释放局部变量, 不等协程对象析构
+    cur->m_locals.clear();
     cur->m_state = State::TERM;
 
     auto raw_ptr = cur.get();
@@ -8,9 +8,13 @@
 #ifndef DF_FIBER_H
 #define DF_FIBER_H
 
+#include "noncopyable.h"
+
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <ucontext.h>
+#include <vector>
 
 namespace acid {
 class Fiber : public std::enable_shared_from_this<Fiber> {
@@ -67,7 +71,7 @@ public:
     }
 
     State get_state() const {
-        return m_state;
+        return m_state.load(std::memory_order_acquire);
     }
 
 public:
@@ -100,17 +104,124 @@ public:
      */
     static uint64_t get_fiber_id();
 
+    /*!
+     * @brief 返回当前线程正在执行的协程, 与get_this相同但不增加引用计数
+     */
+    static Fiber* current();
+
+    // 协程局部存储的槽位上限, 即FiberLocal对象的最大个数
+    static constexpr size_t MAX_LOCAL_SLOTS = 64;
+
+    /*!
+     * @brief 分配一个协程局部存储槽位, 由FiberLocal调用, 槽位不回收
+     * @param[in] inherit 通过inherit_locals创建的子协程是否继承这个槽位的值
+     * @exception std::length_error 槽位超过MAX_LOCAL_SLOTS
+     */
+    static size_t alloc_local_slot(bool inherit);
+
+    /*!
+     * @brief 读取协程局部存储, 没有设置过时返回空指针
+     */
+    const std::shared_ptr<void>& get_local(size_t slot) const {
+        static const std::shared_ptr<void> s_empty;
+        return slot < m_locals.size() ? m_locals[slot] : s_empty;
+    }
+
+    void set_local(size_t slot, std::shared_ptr<void> value);
+
+    /*!
+     * @brief 复制parent中可继承的槽位, 子协程与父协程共享同一个值对象
+     */
+    void inherit_locals(const Fiber& parent);
+
+    /*!
+     * @brief 绑定调度线程, 之后以任意线程调度这个协程(IO事件、协程锁唤醒等)时都放到该线程上运行
+     * @param[in] thread 线程号, -1表示解除绑定
+     */
+    void bind_thread(int thread) {
+        m_bound_thread = thread;
+    }
+
+    int get_bound_thread() const {
+        return m_bound_thread;
+    }
+
+    /*!
+     * @brief 上一次运行所在的NUMA节点, 调度器配置了CPU亲和性时才记录
+     */
+    int get_numa_node() const {
+        return m_numa_node;
+    }
+
+    void set_numa_node(int node) {
+        m_numa_node = node;
+    }
+
 private:
     uint64_t m_id; // 协程id
     uint32_t m_stack_size; // 协程栈大小
-    State m_state; // 协程状态
+    std::atomic<State> m_state; // 协程状态, 让出的协程在上下文保存完之后才变为就绪态
     ucontext_t m_ctx; // 协程上下文
     void* m_stack = nullptr; // 协程栈地址
     std::function<void(void)> m_callback; // 协程入口函数
     bool m_run_in_scheduler; // 本协程是否参与调度器
+    std::vector<std::shared_ptr<void>> m_locals; // 协程局部存储, 按槽位编号索引
+    int m_bound_thread = -1; // 绑定的调度线程号
+    int m_numa_node = -1; // 上一次运行所在的NUMA节点
 
 };  // class Fiber : public std::enable_shared_from_this<Fiber>
 
+/*!
+ * @brief 协程局部变量
+ * @details 值保存在当前协程上, 协程在线程之间迁移时跟着协程走, 不像thread_local那样串到别的协程;
+ * 不在协程中时保存在线程的主协程上。一般定义为静态变量, 例如请求的trace id和截止时间
+ */
+template <class T>
+class FiberLocal : Noncopyable {
+public:
+    /*!
+     * @param[in] inherit TaskGroup等创建的子协程是否继承父协程的值
+     */
+    explicit FiberLocal(bool inherit = false) : m_slot(Fiber::alloc_local_slot(inherit)) {
+    }
+
+    /*!
+     * @brief 当前协程的值, 没有设置时返回空指针
+     */
+    T* get() const {
+        return static_cast<T*>(Fiber::current()->get_local(m_slot).get());
+    }
+
+    /*!
+     * @brief 当前协程的值对象, 需要在协程结束后继续持有时使用
+     */
+    std::shared_ptr<T> get_shared() const {
+        return std::static_pointer_cast<T>(Fiber::current()->get_local(m_slot));
+    }
+
+    void set(T value) {
+        Fiber::current()->set_local(m_slot, std::make_shared<T>(std::move(value)));
+    }
+
+    /*!
+     * @brief 替换为已有的对象, 传入空指针时清除
+     */
+    void reset(std::shared_ptr<T> value = nullptr) {
+        Fiber::current()->set_local(m_slot, std::move(value));
+    }
+
+    T* operator->() const {
+        return get();
+    }
+
+    T& operator*() const {
+        return *get();
+    }
+
+private:
+    size_t m_slot;
+};
+
 }  // namespace acid
 
 #endif  // DF_FIBER_H
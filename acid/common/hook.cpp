@@ -10,6 +10,7 @@
 #include "fd_manager.h"
 #include "iomanager.h"
 #include "timer.h"
+#include "util.h"
 
 #include <bits/types/struct_timespec.h>
 #include <cstdarg>
@@ -275,6 +276,20 @@ int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addr_len
     // 用户默认为阻塞, 转为非阻塞处理
     int n = connect_f(fd, addr, addr_len);
 
+    // unix socket的连接在内核中同步完成, 对端监听队列满时返回EAGAIN而不是EINPROGRESS,
+    // 可写事件不会通知连接完成, 只能让出协程稍后重试
+    if (n == -1 && errno == EAGAIN && addr->sa_family == AF_UNIX) {
+        uint64_t start = acid::get_elapsed_ms();
+        while (n == -1 && errno == EAGAIN) {
+            if (timeout != static_cast<uint64_t>(-1) && acid::get_elapsed_ms() - start >= timeout) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            usleep(1000);
+            n = connect_f(fd, addr, addr_len);
+        }
+    }
+
     if (n == 0) {
         // 连接成功
         return 0;
@@ -457,6 +472,9 @@ int fcntl(int fd, int cmd, ...) {
         case F_NOTIFY:
 #ifdef F_SETPIPE_SZ
         case F_SETPIPE_SZ:
+#endif
+#ifdef F_ADD_SEALS
+        case F_ADD_SEALS:
 #endif
         {
             int arg = va_arg(va, int);
@@ -469,6 +487,9 @@ int fcntl(int fd, int cmd, ...) {
         case F_GETLEASE:
 #ifdef F_GETPIPE_SZ
         case F_GETPIPE_SZ:
+#endif
+#ifdef F_GET_SEALS
+        case F_GET_SEALS:
 #endif
         {
             va_end(va);
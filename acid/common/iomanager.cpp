@@ -1,18 +1,58 @@
 #include "iomanager.h"
 
 #include "acid/logger/logger.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "numa.h"
 
 #include <cassert>
+#include <csignal>
 #include <cstring>
 #include <fcntl.h>
+#include <mutex>
 #include <ostream>
 #include <stdexcept>
 #include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace acid {
 
 static auto logger = GET_LOGGER_BY_NAME("system");
 
+// tickle_thread在线程执行任务时送达的SIGURG, 下一次进入epoll_pwait之前检查
+static thread_local volatile sig_atomic_t t_tickled = 0;
+
+static void on_tickle_signal(int) {
+    t_tickled = 1;
+}
+
+/**
+ * @brief 安装SIGURG处理函数, 用户已经设置过处理函数时保留用户的
+ * 只在配置了CPU亲和性的IOManager中调用, 没有配置时进程的SIGURG保持原样
+ *
+ * @return 是否由本处理函数接收SIGURG, 为false时不能用SIGURG唤醒线程
+ */
+static bool install_tickle_signal() {
+    static std::once_flag s_once;
+    static bool s_installed = false;
+    std::call_once(s_once, [] {
+        struct sigaction old_action {};
+        sigaction(SIGURG, nullptr, &old_action);
+        if (old_action.sa_handler != SIG_DFL) {
+            LOG_WARN(logger) << "SIGURG handler already set, pinned tasks are woken by the pipe";
+            return;
+        }
+        struct sigaction action {};
+        action.sa_handler = on_tickle_signal;
+        // 任务执行期间收到信号时被打断的系统调用自动重启, epoll_pwait总是返回EINTR
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        s_installed = sigaction(SIGURG, &action, nullptr) == 0;
+    });
+    return s_installed;
+}
+
 enum class EpollCtlOp {
 
 };
@@ -79,6 +119,7 @@ void IOManager::FdContext::reset_event_context(IOManager::FdContext::EventContex
     ctx.scheduler = nullptr;
     ctx.fiber.reset();
     ctx.callback = nullptr;
+    ctx.handle = nullptr;
 }
 
 void IOManager::FdContext::trigger_event(IOManager::Event event) {
@@ -92,6 +133,9 @@ void IOManager::FdContext::trigger_event(IOManager::Event event) {
     if (ctx.callback) {
         ctx.scheduler->schedule(ctx.callback);
     }
+    else if (ctx.handle) {
+        ctx.scheduler->schedule(ctx.handle);
+    }
     else {
         ctx.scheduler->schedule(ctx.fiber);
     }
@@ -102,6 +146,8 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
     : Scheduler(threads, use_caller, name), m_epollfd(-1), m_pending_event_count(0) {
     m_epollfd = epoll_create1(EPOLL_CLOEXEC);
     assert(m_epollfd > 0);
+    // 只有配置了亲和性时才会把任务绑定到指定线程, 这时才需要用SIGURG唤醒
+    m_signal_tickle = has_affinity() && install_tickle_signal();
 
     int ret = pipe(m_tick_fds);
     assert(ret == 0);
@@ -130,24 +176,44 @@ IOManager::~IOManager() {
     close(m_epollfd);
     close(m_tick_fds[0]);
     close(m_tick_fds[1]);
-    for (size_t i = 0; i < m_fd_contexts.size(); ++i) {
-        if (m_fd_contexts[i]) {
-            delete m_fd_contexts[i];
+    for (auto &block : m_fd_context_blocks) {
+        for (size_t i = 0; i < block.second; ++i) {
+            block.first[i].~FdContext();
         }
+        Numa::free_on_node(block.first, block.second * sizeof(FdContext));
     }
 }
 
 void IOManager::context_resize(size_t size) {
+    size_t old_size = m_fd_contexts.size();
+    if (size <= old_size) {
+        return;
+    }
+    size_t count = size - old_size;
+    void *memory = Numa::alloc_on_node(count * sizeof(FdContext), get_numa_node());
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    FdContext *block = static_cast<FdContext *>(memory);
+    m_fd_context_blocks.emplace_back(block, count);
     m_fd_contexts.resize(size);
-    for (size_t i = 0; i < m_fd_contexts.size(); ++i) {
-        if (!m_fd_contexts[i]) {
-            m_fd_contexts[i] = new FdContext;
-            m_fd_contexts[i]->fd = i;
-        }
+    for (size_t i = 0; i < count; ++i) {
+        m_fd_contexts[old_size + i] = new (&block[i]) FdContext;
+        m_fd_contexts[old_size + i]->fd = old_size + i;
     }
 }
 
 int IOManager::add_event(int fd, Event event, std::function<void()> cb) {
+    return register_event(fd, event, cb, nullptr);
+}
+
+int IOManager::add_event(int fd, Event event, std::coroutine_handle<> handle) {
+    std::function<void()> cb;
+    return register_event(fd, event, cb, handle);
+}
+
+int IOManager::register_event(int fd, Event event, std::function<void()> &cb,
+                              std::coroutine_handle<> handle) {
     // 找到fd对应的FdContext, 没有则分配一个
     FdContext *fd_ctx = nullptr;
     ReadLockGuard lock(m_mutex);
@@ -190,7 +256,7 @@ int IOManager::add_event(int fd, Event event, std::function<void()> cb) {
     // 找到fd对应的事件上下文
     fd_ctx->events = (Event) (fd_ctx->events | event);
     FdContext::EventContext &event_ctx = fd_ctx->get_event_context(event);
-    assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.callback);
+    assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.callback && !event_ctx.handle);
 
     // 赋值scheduler和回调函数, 如果回调函数为空, 则把当前协程当成回调执行体
     event_ctx.scheduler = Scheduler::get_this();
@@ -198,6 +264,9 @@ int IOManager::add_event(int fd, Event event, std::function<void()> cb) {
         // 有回调就将回调加入调度
         event_ctx.callback.swap(cb);
     }
+    else if (handle) {
+        event_ctx.handle = handle;
+    }
     else {
         // 没有回调则将线程主协程作为事件
         event_ctx.fiber = Fiber::get_this();
@@ -332,6 +401,17 @@ void IOManager::tickle() {
     assert(ret == 1);
 }
 
+void IOManager::tickle_thread(int thread) {
+    if (!m_signal_tickle) {
+        tickle();
+        return;
+    }
+    if (!has_idle_thread()) {
+        return;
+    }
+    syscall(SYS_tgkill, getpid(), thread, SIGURG);
+}
+
 bool IOManager::stopping() {
     uint64_t timeout = 0;
     return stopping(timeout);
@@ -350,6 +430,19 @@ void IOManager::idle() {
     epoll_event *events = new epoll_event[MAX_EVENTS];
     std::shared_ptr<epoll_event> shared_events(events, [](epoll_event *ptr) { delete[] ptr; });
 
+    // idle协程中屏蔽SIGURG, 只在epoll_pwait期间打开, 信号不会在检查t_tickled和阻塞之间丢失
+    // 没有用SIGURG唤醒时不改动信号掩码
+    sigset_t wait_mask;
+    sigset_t *wait_mask_ptr = nullptr;
+    if (m_signal_tickle) {
+        sigset_t tickle_mask;
+        sigemptyset(&tickle_mask);
+        sigaddset(&tickle_mask, SIGURG);
+        pthread_sigmask(SIG_BLOCK, &tickle_mask, &wait_mask);
+        sigdelset(&wait_mask, SIGURG);
+        wait_mask_ptr = &wait_mask;
+    }
+
     while (true) {
         // 获取下一个定时器的超时时间, 顺便判断调度器是否停止
         uint64_t next_timeout = 0;
@@ -370,14 +463,20 @@ void IOManager::idle() {
                 next_timeout = MAX_TIMEOUT;
             }
 
-            ret = epoll_wait(m_epollfd, events, MAX_EVENTS, static_cast<int>(next_timeout));
+            if (t_tickled) {
+                // 执行任务期间有绑定给本线程的任务到来, 不阻塞
+                t_tickled = 0;
+                next_timeout = 0;
+            }
+
+            ret = epoll_pwait(m_epollfd, events, MAX_EVENTS, static_cast<int>(next_timeout), wait_mask_ptr);
 
             if (ret < 0 && errno == EINTR) {
-                continue;
-            }
-            else {
-                break;
+                // tickle_thread打断, 回到调度协程去取绑定给本线程的任务
+                t_tickled = 0;
+                ret = 0;
             }
+            break;
         } while (true);
 
         // 收集所有已经超时的事件
@@ -462,4 +561,146 @@ void IOManager::on_timer_inserted_at_front() {
     tickle();
 }
 
-}  // namespace acid
\ No newline at end of file
+IOManager::EventAwaiter::EventAwaiter(IOManager *iom, int fd, Event event, uint64_t timeout_ms)
+    : m_iom(iom), m_fd(fd), m_event(event), m_timeout_ms(timeout_ms) {
+}
+
+bool IOManager::EventAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    IOManager *iom = m_iom;
+    int fd = m_fd;
+    Event event = m_event;
+    std::shared_ptr<std::atomic<int>> cancelled;
+    if (m_timeout_ms != ~0ull) {
+        cancelled = m_cancelled = std::make_shared<std::atomic<int>>(0);
+        std::weak_ptr<std::atomic<int>> weak(cancelled);
+        m_timer = iom->add_condition_timer(
+            m_timeout_ms,
+            [weak, iom, fd, event]() {
+                auto state = weak.lock();
+                if (!state || state->exchange(ETIMEDOUT)) {
+                    return;
+                }
+                iom->cancel_event(fd, event);
+            },
+            weak);
+    }
+    if (iom->add_event(fd, event, handle)) {
+        m_error = errno;
+        if (m_timer) {
+            m_timer->cancel();
+        }
+        return false;
+    }
+    // 事件随时可能触发并在其它线程上恢复协程, 之后只能访问局部变量
+    // 定时器在添加事件之前到期时取消不到事件, 这里补一次
+    if (cancelled && cancelled->load()) {
+        iom->cancel_event(fd, event);
+    }
+    return true;
+}
+
+bool IOManager::EventAwaiter::await_resume() {
+    if (m_error) {
+        errno = m_error;
+        return false;
+    }
+    if (m_timer) {
+        m_timer->cancel();
+    }
+    if (m_cancelled && m_cancelled->load()) {
+        errno = ETIMEDOUT;
+        return false;
+    }
+    return true;
+}
+
+// 检查fd并确保socket处于非阻塞状态, 无效时返回false并设置errno
+static bool prepare_fd(int fd) {
+    FdCtx::ptr ctx = FdMgr::instance()->get(fd, true);
+    if (!ctx || ctx->is_close()) {
+        errno = EBADF;
+        return false;
+    }
+    return true;
+}
+
+Task<ssize_t> IOManager::co_read(int fd, void *buffer, size_t length, uint64_t timeout_ms) {
+    if (!prepare_fd(fd)) {
+        co_return -1;
+    }
+    while (true) {
+        ssize_t n = read_f(fd, buffer, length);
+        if (n >= 0 || errno != EAGAIN) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            co_return n;
+        }
+        if (!co_await co_wait_event(fd, READ, timeout_ms)) {
+            co_return -1;
+        }
+    }
+}
+
+Task<ssize_t> IOManager::co_write(int fd, const void *buffer, size_t length, uint64_t timeout_ms) {
+    if (!prepare_fd(fd)) {
+        co_return -1;
+    }
+    while (true) {
+        ssize_t n = write_f(fd, buffer, length);
+        if (n >= 0 || errno != EAGAIN) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            co_return n;
+        }
+        if (!co_await co_wait_event(fd, WRITE, timeout_ms)) {
+            co_return -1;
+        }
+    }
+}
+
+Task<int> IOManager::co_accept(int fd, sockaddr *addr, socklen_t *addr_len, uint64_t timeout_ms) {
+    if (!prepare_fd(fd)) {
+        co_return -1;
+    }
+    while (true) {
+        int client = accept_f(fd, addr, addr_len);
+        if (client >= 0) {
+            FdMgr::instance()->get(client, true);
+            co_return client;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN || !co_await co_wait_event(fd, READ, timeout_ms)) {
+            co_return -1;
+        }
+    }
+}
+
+Task<int> IOManager::co_connect(int fd, const sockaddr *addr, socklen_t addr_len, uint64_t timeout_ms) {
+    if (!prepare_fd(fd)) {
+        co_return -1;
+    }
+    int n = connect_f(fd, addr, addr_len);
+    if (n == 0 || errno != EINPROGRESS) {
+        co_return n;
+    }
+    // 连接完成时socket可写, 结果从SO_ERROR取得
+    if (!co_await co_wait_event(fd, WRITE, timeout_ms)) {
+        co_return -1;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        co_return -1;
+    }
+    if (error) {
+        errno = error;
+        co_return -1;
+    }
+    co_return 0;
+}
+
+}  // namespace acid
@@ -3,12 +3,15 @@
 
 #include "acid/common/mutex.h"
 #include "scheduler.h"
+#include "task.h"
 #include "timer.h"
 
 #include <atomic>
+#include <coroutine>
 #include <cstddef>
 #include <functional>
 #include <memory>
+#include <sys/socket.h>
 
 namespace acid {
 
@@ -46,6 +49,7 @@ private:
             Scheduler* scheduler = nullptr;
             Fiber::ptr fiber;
             std::function<void()> callback;
+            std::coroutine_handle<> handle;
         };
 
         /**
@@ -72,8 +76,8 @@ private:
 
         EventContext read;
         EventContext write;
-        int fd;
-        Event events;
+        int fd = 0;
+        Event events = NONE;  // context_resize中new出来的上下文不会清零, 必须显式初始化
         MutexType mutex;
     };  // struct FdContext
 
@@ -92,6 +96,16 @@ public:
      */
     int add_event(int fd, Event event, std::function<void()> cb = nullptr);
 
+    /**
+     * @brief 添加事件, 事件发生时在当前调度器上恢复C++20协程
+     *
+     * @param fd 对应的文件描述符
+     * @param event 文件描述符需要的事件类型
+     * @param handle 挂起的协程
+     * @return int 添加成功返回0, 失败返回-1
+     */
+    int add_event(int fd, Event event, std::coroutine_handle<> handle);
+
     /**
      * @brief 删除事件
      *
@@ -126,6 +140,53 @@ public:
 
     static IOManager* get_this();
 
+    /**
+     * @brief C++20协程等待fd上的事件
+     * @details co_await的结果为false表示超时或者添加事件失败, errno为ETIMEDOUT或epoll_ctl的错误
+     */
+    class EventAwaiter {
+    public:
+        EventAwaiter(IOManager* iom, int fd, Event event, uint64_t timeout_ms);
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        bool await_resume();
+
+    private:
+        IOManager* m_iom;
+        int m_fd;
+        Event m_event;
+        uint64_t m_timeout_ms;
+        int m_error = 0;
+        std::shared_ptr<std::atomic<int>> m_cancelled;  // 超时后由定时器设置为ETIMEDOUT
+        Timer::ptr m_timer;
+    };
+
+    EventAwaiter co_wait_event(int fd, Event event, uint64_t timeout_ms = ~0ull) {
+        return EventAwaiter(this, fd, event, timeout_ms);
+    }
+
+    /**
+     * @brief C++20协程版本的read, 没有数据时挂起协程, 语义与hook的read相同
+     * @details fd需要是socket或者已经设置为非阻塞
+     * @param[in] timeout_ms 每次等待的超时时间, 超时返回-1, errno为ETIMEDOUT
+     */
+    Task<ssize_t> co_read(int fd, void* buffer, size_t length, uint64_t timeout_ms = ~0ull);
+
+    Task<ssize_t> co_write(int fd, const void* buffer, size_t length, uint64_t timeout_ms = ~0ull);
+
+    /**
+     * @brief C++20协程版本的accept, 返回的fd与hook的accept一样已经设置为非阻塞
+     */
+    Task<int> co_accept(int fd, sockaddr* addr = nullptr, socklen_t* addr_len = nullptr,
+                        uint64_t timeout_ms = ~0ull);
+
+    Task<int> co_connect(int fd, const sockaddr* addr, socklen_t addr_len, uint64_t timeout_ms = ~0ull);
+
 protected:
     /**
      * @brief 通知调度器有任务需要调度
@@ -133,6 +194,14 @@ protected:
      */
     void tickle() override;
 
+    /**
+     * @brief 通知指定线程有绑定给它的任务
+     * @details 所有线程阻塞在同一个epoll上, 写pipe唤醒的是哪个线程不确定, 这里用SIGURG打断目标线程的epoll_pwait。
+     * SIGURG只在epoll_pwait期间打开, 不会打断其它系统调用。只有通过scheduler.affinity配置了亲和性,
+     * 并且进程没有设置过SIGURG的处理函数时才使用SIGURG, 否则与tickle相同
+     */
+    void tickle_thread(int thread) override;
+
     /**
      * @brief 判断是否可以停止
      * @details 条件是协程调度器可以停止并且无可调度IO事件
@@ -162,20 +231,30 @@ protected:
 
     /**
      * @brief 重置socket句柄上下文的容器大小
-     *
+     * @details 新增的上下文一次分配一整块, 工作线程都在同一个NUMA节点上时从该节点分配
      * @param size
      */
     void context_resize(size_t size);
 
+private:
+    /**
+     * @brief 把事件加入epoll, 并登记回调函数、协程句柄或当前协程中的一个
+     */
+    int register_event(int fd, Event event, std::function<void()>& cb, std::coroutine_handle<> handle);
+
 private:
     // epoll_fd
     int m_epollfd;
     // pipe文件句柄, fd[0]为读端, fd[1]为写端
     int m_tick_fds[2];
+    // 是否用SIGURG唤醒指定线程, 配置了亲和性时才开启
+    bool m_signal_tickle = false;
     // 当前等待执行的IO事件的数量
     std::atomic<size_t> m_pending_event_count;
     RWMutexType m_mutex;
     std::vector<FdContext*> m_fd_contexts;
+    // context_resize分配的内存块和块中上下文的数量
+    std::vector<std::pair<FdContext*, size_t>> m_fd_context_blocks;
 };
 
 };  // namespace acid
@@ -328,6 +328,11 @@ public:
         clock_gettime(CLOCK_REALTIME, &now);
         abs_time.tv_sec = now.tv_sec + ms / 1000;
         abs_time.tv_nsec = now.tv_nsec + ms % 1000 * 1000 * 1000;
+        // tv_nsec超过1秒时pthread_cond_timedwait直接返回EINVAL
+        if (abs_time.tv_nsec >= 1000 * 1000 * 1000) {
+            abs_time.tv_sec += 1;
+            abs_time.tv_nsec -= 1000 * 1000 * 1000;
+        }
         if (pthread_cond_timedwait(&m_cond, mutex->get(), &abs_time) == 0) {
             return true;
         }
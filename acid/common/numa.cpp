@@ -0,0 +1,196 @@
+/**
+ * @file numa.cpp
+ * @brief CPU与NUMA拓扑实现
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ */
+#include "numa.h"
+
+#include "acid/logger/logger.h"
+#include "config.h"
+
+#include <cstring>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace acid {
+
+static Logger::ptr logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<std::vector<std::string>>::ptr g_numa_simulated_nodes =
+    Config::look_up("numa.simulated_nodes", std::vector<std::string>(),
+                    "simulated numa topology, cpu list of each node");
+
+static std::string read_line(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+namespace {
+
+struct Topology {
+    bool simulated = false;
+    std::vector<std::vector<int>> nodes;
+    // CPU编号到节点的映射, 下标为CPU编号
+    std::vector<int> cpu_nodes;
+
+    Topology() {
+        std::vector<std::string> simulated_nodes = g_numa_simulated_nodes->get_value();
+        if (!simulated_nodes.empty()) {
+            simulated = true;
+            for (const auto& cpus : simulated_nodes) {
+                nodes.push_back(Numa::parse_cpu_list(cpus));
+            }
+        }
+        else {
+            std::vector<int> online = Numa::parse_cpu_list(read_line("/sys/devices/system/node/online"));
+            for (int node : online) {
+                if (node >= static_cast<int>(nodes.size())) {
+                    nodes.resize(node + 1);
+                }
+                nodes[node] = Numa::parse_cpu_list(
+                    read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            }
+        }
+        if (nodes.empty()) {
+            std::vector<int> cpus = Numa::parse_cpu_list(read_line("/sys/devices/system/cpu/online"));
+            if (cpus.empty()) {
+                for (long i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); ++i) {
+                    cpus.push_back(static_cast<int>(i));
+                }
+            }
+            nodes.push_back(cpus);
+        }
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            for (int cpu : nodes[node]) {
+                if (cpu >= static_cast<int>(cpu_nodes.size())) {
+                    cpu_nodes.resize(cpu + 1, -1);
+                }
+                // 模拟拓扑中同一个CPU可以出现在多个节点里, 以第一个为准
+                if (cpu_nodes[cpu] < 0) {
+                    cpu_nodes[cpu] = static_cast<int>(node);
+                }
+            }
+        }
+    }
+};
+
+}  // namespace
+
+static const Topology& topology() {
+    static Topology s_topology;
+    return s_topology;
+}
+
+/**
+ * @brief 只有一个节点位的nodemask, mbind和set_mempolicy的maxnode要比位数多1
+ */
+static std::vector<unsigned long> node_mask(int node, unsigned long& maxnode) {
+    const int bits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(node / bits + 1, 0);
+    mask[node / bits] = 1ul << (node % bits);
+    maxnode = mask.size() * bits + 1;
+    return mask;
+}
+
+std::vector<int> Numa::parse_cpu_list(const std::string& str) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        std::string item = str.substr(pos, end - pos);
+        pos = end + 1;
+        size_t dash = item.find('-');
+        try {
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(item));
+            }
+            else {
+                int first = std::stoi(item.substr(0, dash));
+                int last = std::stoi(item.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        catch (...) {
+            // 空项或格式错误的项直接忽略
+        }
+    }
+    return cpus;
+}
+
+int Numa::node_count() {
+    return static_cast<int>(topology().nodes.size());
+}
+
+const std::vector<int>& Numa::node_cpus(int node) {
+    static const std::vector<int> s_empty;
+    const Topology& topo = topology();
+    return node >= 0 && node < static_cast<int>(topo.nodes.size()) ? topo.nodes[node] : s_empty;
+}
+
+int Numa::cpu_node(int cpu) {
+    const Topology& topo = topology();
+    if (cpu < 0 || cpu >= static_cast<int>(topo.cpu_nodes.size()) || topo.cpu_nodes[cpu] < 0) {
+        return 0;
+    }
+    return topo.cpu_nodes[cpu];
+}
+
+int Numa::current_cpu() {
+    return sched_getcpu();
+}
+
+bool Numa::is_simulated() {
+    return topology().simulated;
+}
+
+bool Numa::set_preferred_node(int node) {
+    if (node < 0 || is_simulated()) {
+        return false;
+    }
+    unsigned long maxnode = 0;
+    std::vector<unsigned long> mask = node_mask(node, maxnode);
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), maxnode) != 0) {
+        LOG_WARN(logger) << "set_mempolicy(MPOL_PREFERRED, " << node << ") errno=" << errno
+                         << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void* Numa::alloc_on_node(size_t size, int node) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+    if (node >= 0 && !is_simulated()) {
+        unsigned long maxnode = 0;
+        std::vector<unsigned long> mask = node_mask(node, maxnode);
+        // 绑定失败时内存仍然可用, 只是按默认策略分配
+        if (syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask.data(), maxnode, 0) != 0) {
+            LOG_WARN(logger) << "mbind(" << node << ") errno=" << errno
+                             << " errstr=" << strerror(errno);
+        }
+    }
+    return ptr;
+}
+
+void Numa::free_on_node(void* ptr, size_t size) {
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
+
+}  // namespace acid
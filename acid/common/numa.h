@@ -0,0 +1,76 @@
+/**
+ * @file numa.h
+ * @brief CPU与NUMA拓扑, 线程绑核和按节点分配内存
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ */
+
+#ifndef ACID_NUMA_H
+#define ACID_NUMA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace acid {
+
+/**
+ * @brief NUMA拓扑和内存策略
+ * @details 拓扑从/sys/devices/system/node读取, 不依赖libnuma; 没有NUMA信息时认为只有一个节点包含全部CPU。
+ * 配置了numa.simulated_nodes时使用模拟拓扑, 每项是一个节点的CPU列表, 例如["0-3", "4-7"],
+ * 用来在单节点机器上验证线程放置, 这时不设置内存策略。拓扑在第一次使用时确定, 之后修改配置不生效
+ */
+class Numa {
+public:
+    /**
+     * @brief 解析"0-3,8,10-11"格式的CPU列表
+     */
+    static std::vector<int> parse_cpu_list(const std::string& str);
+
+    /**
+     * @brief 节点数量, 至少为1
+     */
+    static int node_count();
+
+    /**
+     * @brief 节点包含的CPU, 节点不存在时返回空
+     */
+    static const std::vector<int>& node_cpus(int node);
+
+    /**
+     * @brief CPU所在的节点, 未知的CPU返回0
+     */
+    static int cpu_node(int cpu);
+
+    /**
+     * @brief 当前线程正在运行的CPU
+     */
+    static int current_cpu();
+
+    /**
+     * @brief 是否为配置的模拟拓扑
+     */
+    static bool is_simulated();
+
+    /**
+     * @brief 当前线程之后缺页分配的内存优先放在node上, 节点内存不足时退回其他节点
+     * @return 模拟拓扑或设置失败时返回false
+     */
+    static bool set_preferred_node(int node);
+
+    /**
+     * @brief 用mmap分配内存并绑定到节点, node小于0或模拟拓扑时只分配不绑定
+     * @return 失败返回nullptr
+     */
+    static void* alloc_on_node(size_t size, int node);
+
+    /**
+     * @brief 释放alloc_on_node分配的内存
+     */
+    static void free_on_node(void* ptr, size_t size);
+};
+
+}  // namespace acid
+
+#endif  // ACID_NUMA_H
@@ -5,7 +5,9 @@
  *@date 2023-06-28
  */
 #include "scheduler.h"
+#include "config.h"
 #include "hook.h"
+#include "numa.h"
 
 #include "acid/logger/logger.h"
 
@@ -20,6 +22,14 @@ static auto logger = GET_LOGGER_BY_NAME("system");
 static thread_local Scheduler* t_scheduler = nullptr;
 // 当前线程的调度协程, 每个线程独有一份
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+// 当前工作线程所在的NUMA节点, 没有配置亲和性时为-1
+static thread_local int t_numa_node = -1;
+
+static ConfigVar<std::map<std::string, std::string>>::ptr g_scheduler_affinity =
+    Config::look_up("scheduler.affinity", std::map<std::string, std::string>(),
+                    "cpu affinity of scheduler worker threads, keyed by scheduler name. "
+                    "an IOManager with affinity wakes pinned tasks with SIGURG and installs "
+                    "a process-wide SIGURG handler unless one is already set");
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
     : m_name(name)
@@ -51,6 +61,73 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
         m_root_thread = -1;
     }
     m_thread_count = threads;
+    init_affinity();
+}
+
+void Scheduler::init_affinity() {
+    auto affinity = g_scheduler_affinity->get_value();
+    auto it = affinity.find(m_name);
+    if (it == affinity.end() || m_thread_count == 0) {
+        return;
+    }
+
+    // 展开成若干项, 每项是一组CPU和所在节点
+    std::vector<std::vector<int>> slot_cpus;
+    std::vector<int> slot_nodes;
+    std::stringstream ss(it->second);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.compare(0, 4, "node") == 0) {
+            int node = atoi(item.c_str() + 4);
+            if (node < Numa::node_count()) {
+                slot_cpus.push_back(Numa::node_cpus(node));
+                slot_nodes.push_back(node);
+            }
+            continue;
+        }
+        for (int cpu : Numa::parse_cpu_list(item)) {
+            slot_cpus.push_back({cpu});
+            slot_nodes.push_back(Numa::cpu_node(cpu));
+        }
+    }
+    if (slot_cpus.empty()) {
+        LOG_ERROR(logger) << "invalid scheduler.affinity for " << m_name << ": " << it->second;
+        return;
+    }
+
+    m_numa_node = slot_nodes[0];
+    for (size_t i = 0; i < m_thread_count; ++i) {
+        m_thread_cpus.push_back(slot_cpus[i % slot_cpus.size()]);
+        m_thread_nodes.push_back(slot_nodes[i % slot_nodes.size()]);
+        if (m_thread_nodes.back() != m_numa_node) {
+            m_numa_node = -1;
+        }
+    }
+}
+
+void Scheduler::place_thread(size_t index) {
+    if (index >= m_thread_cpus.size()) {
+        return;
+    }
+    if (!Thread::get_this()->set_affinity(m_thread_cpus[index])) {
+        // 模拟拓扑中的CPU可能不存在, 线程不绑核, 但仍按所在节点统计
+        LOG_WARN(logger) << Thread::get_name() << " runs without cpu affinity";
+    }
+    t_numa_node = m_thread_nodes[index];
+    Numa::set_preferred_node(t_numa_node);
+}
+
+int Scheduler::get_thread_for_cpu(int cpu) {
+    if (cpu < 0 || cpu >= static_cast<int>(m_cpu_threads.size()) || m_cpu_threads[cpu].empty()) {
+        return -1;
+    }
+    const std::vector<int>& threads = m_cpu_threads[cpu];
+    if (threads.size() == 1) {
+        return threads[0];
+    }
+    return threads[m_cpu_thread_cursor.fetch_add(1, std::memory_order_relaxed) % threads.size()];
 }
 
 Scheduler* Scheduler::get_this() {
@@ -86,20 +163,38 @@ void Scheduler::start() {
     assert(m_threadpool.empty());
     m_threadpool.resize(m_thread_count);
     for (size_t i = 0; i < m_thread_count; ++i) {
-        m_threadpool.at(i).reset(new Thread([this] { run(); }, m_name + "_" + std::to_string(i)));
+        m_threadpool.at(i).reset(new Thread(
+            [this, i] {
+                place_thread(i);
+                run();
+            },
+            m_name + "_" + std::to_string(i)));
         m_thread_ids.push_back(m_threadpool.at(i)->get_id());
     }
+    for (size_t i = 0; i < m_thread_cpus.size(); ++i) {
+        for (int cpu : m_thread_cpus[i]) {
+            if (cpu >= static_cast<int>(m_cpu_threads.size())) {
+                m_cpu_threads.resize(cpu + 1);
+            }
+            m_cpu_threads[cpu].push_back(m_threadpool.at(i)->get_id());
+        }
+    }
 }
 
 bool Scheduler::stopping() {
     LockGuard lock(m_mutex);
-    return m_stopping && m_tasklist.empty() && m_active_thread_count == 0;
+    return m_stopping && m_tasklist.empty() && m_active_thread_count == 0 &&
+           m_waiting_fiber_count == 0;
 }
 
 void Scheduler::tickle() {
     LOG_DEBUG(logger) << "Scheduler::tickle()";
 }
 
+void Scheduler::tickle_thread(int thread) {
+    tickle();
+}
+
 // 任务队列无任务，利用idle协程空转等待任务
 void Scheduler::idle() {
     LOG_DEBUG(logger) << "Scheduler::idle()";
@@ -159,8 +254,9 @@ void Scheduler::run() {
     set_hook_enable(true);
     // 设置调度器
     set_this();
+    const int thread_id = get_thread_id();
     // 设置调度协程，除了caller线程外，其余线程的调度协程都存储在线程主协程中
-    if (get_thread_id() != m_root_thread) {
+    if (thread_id != m_root_thread) {
         t_scheduler_fiber = Fiber::get_this().get();
     }
 
@@ -171,23 +267,26 @@ void Scheduler::run() {
     while (true) {
         task.reset();
         bool tickle_me = false; // 是否tickle其他线程进行任务调度
+        int pinned_thread = -1; // 跳过的绑定给其他线程的任务所在线程
         {
             LockGuard lock(m_mutex);
             auto it = m_tasklist.begin();
             while (it != m_tasklist.end()) {
-                if (it->thread != -1 && it->thread != get_thread_id()) {
-                    // 指定了调度线程, 但是指定的不是当前线程, 标记一下需要通知其他线程进行调度, 然后跳过这个任务, 进行下一个
+                if (it->thread != -1 && it->thread != thread_id) {
+                    // 指定了调度线程, 但是指定的不是当前线程, 记下需要通知的线程, 然后跳过这个任务, 进行下一个
+                    // 只能通知指定的线程, 随便通知一个空闲线程的话可能一直是当前线程和另一个线程互相唤醒
+                    pinned_thread = it->thread;
                     ++it;
-                    tickle_me = true;
                     continue;
                 }
 
                 // 找到的不是指定线程的任务或是指定当前线程执行的任务
-                assert(it->fiber || it->callback);
+                assert(it->fiber || it->callback || it->handle);
 
                 // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
                 // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
                 // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
+                // 协程让出后要等resume返回、上下文保存完毕才变为就绪态, 其它线程在这之前唤醒它时同样会跳过
                 if (it->fiber && it->fiber->get_state() == Fiber::State::RUNNING) {
                     ++it;
                     continue;
@@ -203,9 +302,17 @@ void Scheduler::run() {
         }
 
         if (tickle_me) tickle();
+        if (pinned_thread != -1) tickle_thread(pinned_thread);
 
         // task是协程类型或是回调函数类型
         if (task.fiber) {
+            if (t_numa_node != -1) {
+                int node = task.fiber->get_numa_node();
+                if (node != -1 && node != t_numa_node) {
+                    m_cross_node_resumes.fetch_add(1, std::memory_order_relaxed);
+                }
+                task.fiber->set_numa_node(t_numa_node);
+            }
             // resume唤醒协称, 不管是协称yield或是执行完毕都视为完成了当前任务
             task.fiber->resume();
             --m_active_thread_count;
@@ -219,11 +326,19 @@ void Scheduler::run() {
             else {
                 callback_fiber.reset(new Fiber(task.callback));
             }
+            callback_fiber->set_numa_node(t_numa_node);
             task.reset();
             callback_fiber->resume();
             --m_active_thread_count;
             callback_fiber.reset();
         }
+        else if (task.handle) {
+            // 无栈协程直接在调度协程上恢复, 运行到下一个挂起点或结束时返回这里
+            std::coroutine_handle<> handle = task.handle;
+            task.reset();
+            handle.resume();
+            --m_active_thread_count;
+        }
         else {
             // 任务队列为空
             if (idle_fiber->get_state() == Fiber::State::TERM) {
@@ -10,8 +10,10 @@
 #include "mutex.h"
 #include "thread.h"
 
+#include <coroutine>
 #include <list>
 #include <memory>
+#include <vector>
 
 namespace acid {
 class Scheduler {
@@ -22,6 +24,11 @@ public:
 
     /*!
      * @brief 创建调度器
+     * @details 配置项scheduler.affinity以调度器名称为键设置工作线程的CPU亲和性, 值是逗号分隔的列表,
+     * 每项是一个CPU("3")、一段CPU("0-3", 每个CPU一项)或一个NUMA节点("node1", 节点内的全部CPU算一项),
+     * 第i个工作线程绑定到第i % 项数项上, 并优先从所在节点分配内存。例如{io: "node0,node1"}让io调度器的线程
+     * 交替分布在两个节点上。caller线程不绑定。配置了亲和性的IOManager用SIGURG唤醒绑定到指定线程的任务,
+     * 进程没有设置过SIGURG的处理函数时会安装一个, 没有配置亲和性时不改动SIGURG
      * param[in] threads 线程数量
      * param[in] use_caller 是否使用当前线程作为调度线程
      * param[in] name 调度器名称
@@ -46,6 +53,7 @@ public:
 
     /*!
      * @brief 添加调度任务
+     * @details C++20协程句柄必须以std::coroutine_handle<>传入, 它直接在调度协程上恢复, 不分配协程栈
      * @param[in] fc 协程对象或函数指针
      * param[in] thread 指定运行该任务的线程号, -1表示任意线程
      */
@@ -58,7 +66,12 @@ public:
         }
 
         if (need_tickle) {
-            tickle();
+            if (thread == -1) {
+                tickle();
+            }
+            else {
+                tickle_thread(thread);
+            }
         }
     }
 
@@ -66,12 +79,57 @@ public:
 
     void stop();
 
+    /*!
+     * @brief 协程挂起等待同步原语之前调用, 有挂起的协程时调度器不会停止
+     */
+    void add_waiting_fiber() {
+        m_waiting_fiber_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief 挂起的协程被唤醒之后调用
+     */
+    void remove_waiting_fiber() {
+        m_waiting_fiber_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /*!
+     * @brief 返回绑定在cpu上的工作线程号, 有多个时轮流返回, 没有时返回-1
+     */
+    int get_thread_for_cpu(int cpu);
+
+    /*!
+     * @brief 是否通过scheduler.affinity为工作线程配置了亲和性
+     */
+    bool has_affinity() const {
+        return !m_thread_cpus.empty();
+    }
+
+    /*!
+     * @brief 工作线程都在同一个NUMA节点上时返回该节点, 否则返回-1
+     */
+    int get_numa_node() const {
+        return m_numa_node;
+    }
+
+    /*!
+     * @brief 协程在与上一次运行不同的NUMA节点上恢复的次数, 每次都意味着协程栈和它访问的数据在远端节点上
+     */
+    uint64_t get_cross_node_resumes() const {
+        return m_cross_node_resumes.load(std::memory_order_relaxed);
+    }
+
 protected:
     /*!
      * @brief 通知调度器有任务来了
      */
     virtual void tickle();
 
+    /*!
+     * @brief 通知指定线程有绑定给它的任务, 默认与tickle相同
+     */
+    virtual void tickle_thread(int thread);
+
     /*!
      * @brief 协程调度函数
      */
@@ -94,16 +152,28 @@ protected:
     }
 
 private:
+    /*!
+     * @brief 按配置计算每个工作线程绑定的CPU和所在节点
+     */
+    void init_affinity();
+
+    /*!
+     * @brief 在第index个工作线程中调用, 绑定CPU并设置内存分配策略
+     */
+    void place_thread(size_t index);
+
     /*!
      * @brief 添加调度任务, 无锁
      */
     template <class FiberOrCallback>
-    bool schedule_without_lock(FiberOrCallback fc, int thread) {
+    bool schedule_without_lock(FiberOrCallback fc, int& thread) {
         bool need_tickle = m_tasklist.empty();
         ScheduleTask task(fc, thread);
-        if (task.fiber || task.callback) {
+        if (task.fiber || task.callback || task.handle) {
             m_tasklist.push_back(task);
         }
+        // 返回实际运行的线程, 协程绑定了线程时由它决定
+        thread = task.thread;
         return need_tickle;
     }
 
@@ -111,16 +181,18 @@ private:
     struct ScheduleTask {
         Fiber::ptr fiber;
         std::function<void()> callback;
+        std::coroutine_handle<> handle;
         int thread;
 
+        // 绑定了线程的协程没有指定线程时回到绑定的线程上运行
         ScheduleTask(Fiber::ptr f, int thread) {
             fiber = f;
-            this->thread = thread;
+            this->thread = thread == -1 && fiber ? fiber->get_bound_thread() : thread;
         }
 
         ScheduleTask(Fiber::ptr* f, int thread) {
             fiber.swap(*f);
-            this->thread = thread;
+            this->thread = thread == -1 && fiber ? fiber->get_bound_thread() : thread;
         }
 
         ScheduleTask(std::function<void()> c, int thread) {
@@ -128,6 +200,11 @@ private:
             this->thread = thread;
         }
 
+        ScheduleTask(std::coroutine_handle<> h, int thread) {
+            handle = h;
+            this->thread = thread;
+        }
+
         ScheduleTask() {
             thread = -1;
         }
@@ -135,6 +212,7 @@ private:
         void reset() {
             fiber = nullptr;
             callback = nullptr;
+            handle = nullptr;
             thread = -1;
         }
     };
@@ -156,6 +234,8 @@ private:
     std::atomic<size_t> m_active_thread_count;
     // idle线程数
     std::atomic<size_t> m_idle_thread_count;
+    // 挂起在协程锁或条件变量上的协程数
+    std::atomic<size_t> m_waiting_fiber_count {0};
 
     // 是否使用主协程所在线程参与调度
     bool m_use_caller;
@@ -164,6 +244,17 @@ private:
     // 是否正在停止调度器
     bool m_stopping;
 
+    // 每个工作线程绑定的CPU, 为空表示没有配置亲和性
+    std::vector<std::vector<int>> m_thread_cpus;
+    // 每个工作线程所在的NUMA节点
+    std::vector<int> m_thread_nodes;
+    // 工作线程都在同一个节点上时为该节点, 否则为-1
+    int m_numa_node = -1;
+    // CPU编号到绑定在该CPU上的线程号
+    std::vector<std::vector<int>> m_cpu_threads;
+    std::atomic<size_t> m_cpu_thread_cursor {0};
+    std::atomic<uint64_t> m_cross_node_resumes {0};
+
 };  // class Scheduler
 
 }  // namespace acid
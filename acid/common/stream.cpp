@@ -2,13 +2,14 @@
 
 namespace acid {
 
+// read/write出错时返回-1, 转换成ssize_t判断, 否则会被当成读写了大量数据
 size_t Stream::read_fix_size(void *buffer, size_t length) {
     size_t offset = 0;
     size_t left = length;
     while (left > 0) {
-        size_t len = read((char*)buffer + offset, left);
+        ssize_t len = static_cast<ssize_t>(read((char*)buffer + offset, left));
         if (len <= 0) {
-            return len;
+            return static_cast<size_t>(len);
         }
         offset += len;
         left -= len;
@@ -20,9 +21,9 @@ size_t Stream::read_fix_size(void *buffer, size_t length) {
 size_t Stream::read_fix_size(ByteArray::ptr byte_array, size_t length) {
     size_t left = length;
     while (left > 0) {
-        size_t len = read(byte_array, left);
+        ssize_t len = static_cast<ssize_t>(read(byte_array, left));
         if (len <= 0) {
-            return len;
+            return static_cast<size_t>(len);
         }
         left -= len;
     }
@@ -34,9 +35,9 @@ size_t Stream::write_fix_size(const void *buffer, size_t length) {
     size_t left = length;
 
     while (left > 0) {
-        size_t len = write((const char*)buffer + offset, left);
+        ssize_t len = static_cast<ssize_t>(write((const char*)buffer + offset, left));
         if (len <= 0) {
-            return len;
+            return static_cast<size_t>(len);
         }
         offset += len;
         left -= len;
@@ -47,9 +48,9 @@ size_t Stream::write_fix_size(const void *buffer, size_t length) {
 size_t Stream::write_fix_size(ByteArray::ptr byte_array, size_t length) {
     size_t left = length;
     while (left > 0) {
-        size_t len = write(byte_array, left);
+        ssize_t len = static_cast<ssize_t>(write(byte_array, left));
         if (len <= 0) {
-            return len;
+            return static_cast<size_t>(len);
         }
         left -= len;
     }
@@ -0,0 +1,346 @@
+/**
+ * @file task.h
+ * @brief C++20无栈协程
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ */
+
+#ifndef ACID_TASK_H
+#define ACID_TASK_H
+
+#include "co_mutex.h"
+#include "noncopyable.h"
+#include "scheduler.h"
+
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace acid {
+
+template <class T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    // 结束后恢复等待它的协程, 对称转移不会让调用栈变深
+    struct FinalAwaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        template <class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() noexcept {
+        exception = std::current_exception();
+    }
+
+    void rethrow() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template <class T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object() noexcept;
+
+    template <class U>
+    void return_value(U&& value) {
+        result.emplace(std::forward<U>(value));
+    }
+
+    T take() {
+        rethrow();
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {
+    }
+
+    void take() {
+        rethrow();
+    }
+};
+
+/**
+ * @brief co_spawn和sync_wait用来启动Task的外层协程
+ * @details 创建后不执行, 由启动方resume或放入调度器; 结束时有等待组就通知等待方由它销毁, 否则自己销毁
+ */
+class StartTask {
+public:
+    struct promise_type {
+        StartTask get_return_object() noexcept {
+            return StartTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        auto final_suspend() noexcept {
+            struct Awaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                // 已经挂起之后才通知, 等待方醒来时可以立即销毁协程帧
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    if (CoWaitGroup* wait = handle.promise().wait) {
+                        wait->done();
+                    }
+                    else {
+                        handle.destroy();
+                    }
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+            return Awaiter {};
+        }
+
+        void return_void() noexcept {
+        }
+
+        void unhandled_exception() noexcept {
+            // 后台运行的Task没有人接收异常, 与协程中抛出未捕获的异常一样结束进程
+            std::terminate();
+        }
+
+        CoWaitGroup* wait = nullptr;
+    };
+
+    explicit StartTask(std::coroutine_handle<promise_type> handle) : m_handle(handle) {
+    }
+
+    std::coroutine_handle<promise_type> handle() const {
+        return m_handle;
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+}  // namespace detail
+
+/**
+ * @brief C++20无栈协程的返回类型
+ * @details 创建后不执行, 被co_await时才开始运行, 结束后直接恢复等待它的协程。挂起时只保留堆上的协程帧,
+ * 通常只有几百字节, 不占用协程栈, 适合大量同时挂起的调用。在调度器中恢复时运行在调度协程上,
+ * 不能调用会挂起Fiber的接口(hook的IO、CoMutex、Channel::pop等), 要用对应的co_await版本
+ *
+ * @code
+ * Task<int> add(int a, int b) {
+ *     co_await IOManager::get_this()->co_sleep(10);
+ *     co_return a + b;
+ * }
+ * Task<> run() {
+ *     int sum = co_await add(1, 2);
+ * }
+ * co_spawn(run());           // 在当前调度器上后台运行
+ * int sum = sync_wait(add(1, 2));  // 在Fiber中挂起等待结果
+ * @endcode
+ */
+template <class T>
+class Task : Noncopyable {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {
+    }
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool done() const {
+        return !m_handle || m_handle.done();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+                handle.promise().continuation = continuation;
+                return handle;
+            }
+
+            T await_resume() {
+                return handle.promise().take();
+            }
+
+            std::coroutine_handle<promise_type> handle;
+        };
+        assert(m_handle);
+        return Awaiter {m_handle};
+    }
+
+    auto operator co_await() & noexcept {
+        return std::move(*this).operator co_await();
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+
+template <class T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+inline StartTask run_task(Task<void> task) {
+    co_await std::move(task);
+}
+
+inline StartTask run_task(Task<void> task, std::exception_ptr& exception) {
+    try {
+        co_await std::move(task);
+    }
+    catch (...) {
+        exception = std::current_exception();
+    }
+}
+
+template <class T>
+StartTask run_task(Task<T> task, std::optional<T>& result, std::exception_ptr& exception) {
+    try {
+        result.emplace(co_await std::move(task));
+    }
+    catch (...) {
+        exception = std::current_exception();
+    }
+}
+
+}  // namespace detail
+
+/**
+ * @brief 把协程放回调度器, 在调度器的线程上继续执行
+ * @details 可以用来切换到另一个调度器, 也可以在长时间计算中让出当前线程
+ */
+inline auto resume_on(Scheduler* scheduler) {
+    struct Awaiter {
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            scheduler->schedule(handle);
+        }
+
+        void await_resume() noexcept {
+        }
+
+        Scheduler* scheduler;
+    };
+    return Awaiter {scheduler};
+}
+
+/**
+ * @brief 在调度器上后台运行Task, 不等待结果
+ * @param[in] scheduler 运行的调度器, 为空时使用当前线程的调度器
+ */
+inline void co_spawn(Task<void> task, Scheduler* scheduler = nullptr) {
+    scheduler = scheduler ? scheduler : Scheduler::get_this();
+    assert(scheduler);
+    std::coroutine_handle<> handle = detail::run_task(std::move(task)).handle();
+    scheduler->schedule(handle);
+}
+
+/**
+ * @brief 等待Task结束并返回结果, Task中抛出的异常在这里重新抛出
+ * @details 在调度器的Fiber中调用时Task在当前Fiber上开始运行, 第一次挂起后等待只挂起Fiber;
+ * 在调度器外的线程中调用时Task放到scheduler上运行, 线程让出CPU轮询。不能在C++20协程中调用
+ * @param[in] scheduler 调度器外的线程调用时Task运行的调度器
+ */
+template <class T>
+T sync_wait(Task<T> task, Scheduler* scheduler = nullptr) {
+    CoWaitGroup wait;
+    std::exception_ptr exception;
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+    detail::StartTask start = [&] {
+        if constexpr (std::is_void_v<T>) {
+            return detail::run_task(std::move(task), exception);
+        }
+        else {
+            return detail::run_task(std::move(task), result, exception);
+        }
+    }();
+    start.handle().promise().wait = &wait;
+    wait.add();
+    if (Scheduler::get_this()) {
+        start.handle().resume();
+    }
+    else {
+        assert(scheduler);
+        scheduler->schedule(std::coroutine_handle<>(start.handle()));
+    }
+    wait.wait();
+    start.handle().destroy();
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+    if constexpr (!std::is_void_v<T>) {
+        return std::move(*result);
+    }
+}
+
+}  // namespace acid
+
+#endif  // ACID_TASK_H
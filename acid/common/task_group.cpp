@@ -0,0 +1,68 @@
+#include "task_group.h"
+
+#include "iomanager.h"
+
+#include <cassert>
+
+namespace acid {
+
+FiberLocal<TaskGroup::State> TaskGroup::s_current;
+
+bool TaskGroup::State::is_cancelled() const {
+    for (const State* state = this; state; state = state->parent.get()) {
+        if (state->cancelled.load(std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskGroup::TaskGroup(IOManager* iom)
+    : m_iom(iom ? iom : IOManager::get_this()), m_state(std::make_shared<State>()) {
+    assert(m_iom);
+    if (State* parent = s_current.get()) {
+        m_state->parent = parent->shared_from_this();
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+bool TaskGroup::spawn(std::function<void()> task) {
+    if (m_state->is_cancelled()) {
+        return false;
+    }
+    m_wait.add();
+    Fiber::ptr fiber(new Fiber([this, task = std::move(task)]() mutable {
+        s_current.reset(m_state);
+        if (!m_state->is_cancelled()) {
+            task();
+        }
+        // 在done之前释放task捕获的对象, done之后任务组随时可能析构
+        task = nullptr;
+        m_wait.done();
+    }));
+    fiber->inherit_locals(*Fiber::current());
+    m_iom->schedule(fiber);
+    return true;
+}
+
+void TaskGroup::wait() {
+    m_wait.wait();
+}
+
+void TaskGroup::cancel() {
+    m_state->cancelled.store(true, std::memory_order_release);
+}
+
+bool TaskGroup::is_cancelled() const {
+    return m_state->is_cancelled();
+}
+
+bool TaskGroup::cancelled() {
+    State* state = s_current.get();
+    return state && state->is_cancelled();
+}
+
+}  // namespace acid
@@ -0,0 +1,100 @@
+/**
+ * @file task_group.h
+ * @brief 结构化的子任务组
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ */
+
+#ifndef ACID_TASK_GROUP_H
+#define ACID_TASK_GROUP_H
+
+#include "co_mutex.h"
+#include "fiber.h"
+#include "noncopyable.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace acid {
+
+class IOManager;
+
+/**
+ * @brief 在IOManager上并发执行一组子协程并等待它们全部结束
+ * @details 子协程继承创建者可继承的协程局部变量。wait只挂起当前协程, 不阻塞线程; 析构时会等待,
+ * 子任务不会活得比任务组长。取消是协作式的: 取消后尚未开始的子任务不再执行, 正在执行的子任务
+ * 通过TaskGroup::cancelled()发现取消并尽快返回; 子任务中创建的任务组挂在当前任务组下, 一起被取消
+ *
+ * @code
+ * TaskGroup group;
+ * for (auto& shard : shards) {
+ *     group.spawn([&shard] { shard.result = query(shard); });
+ * }
+ * group.wait();
+ * @endcode
+ */
+class TaskGroup : Noncopyable {
+public:
+    /**
+     * @param[in] iom 子协程运行的调度器, 为空时使用当前线程的IOManager
+     */
+    explicit TaskGroup(IOManager* iom = nullptr);
+
+    ~TaskGroup();
+
+    /**
+     * @brief 创建一个子协程执行task
+     * @return false 任务组已经取消, task不会执行
+     */
+    bool spawn(std::function<void()> task);
+
+    /**
+     * @brief 挂起当前协程, 直到所有子任务结束
+     */
+    void wait();
+
+    /**
+     * @brief 取消任务组和它下面的所有任务组
+     */
+    void cancel();
+
+    /**
+     * @brief 任务组自己或者上级任务组是否已经取消
+     */
+    bool is_cancelled() const;
+
+    /**
+     * @brief 还没有结束的子任务数量
+     */
+    int64_t running() const {
+        return m_wait.count();
+    }
+
+    /**
+     * @brief 当前协程所在的任务组或它的上级是否已经取消, 不在任务组中时返回false
+     */
+    static bool cancelled();
+
+private:
+    // 取消标志, 子任务组通过parent链看到上级的取消
+    struct State : std::enable_shared_from_this<State> {
+        std::atomic<bool> cancelled {false};
+        std::shared_ptr<State> parent;
+
+        bool is_cancelled() const;
+    };
+
+    // 当前协程所在的任务组, 由spawn在子协程中设置, 不继承给其它协程
+    static FiberLocal<State> s_current;
+
+private:
+    IOManager* m_iom;
+    std::shared_ptr<State> m_state;
+    CoWaitGroup m_wait;
+};
+
+}  // namespace acid
+
+#endif  // ACID_TASK_GROUP_H
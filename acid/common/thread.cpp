@@ -6,6 +6,7 @@
  */
 #include "thread.h"
 
+#include "acid/logger/log_context.h"
 #include "acid/logger/logger.h"
 
 namespace acid {
@@ -34,6 +35,7 @@ void Thread::set_name(const std::string& name) {
         t_thread->m_name = name;
     }
     t_thread_name = name;
+    LogContext::set_thread_name(name);
 }
 
  Thread::Thread(std::function<void()> cb, const std::string& name) : m_name(name), m_callback(cb), m_semaphore(0) {
@@ -63,9 +65,32 @@ void Thread::join() {
             LOG_ERROR(logger) << "pthread_join thread fail, rt=" << rt << " name=" << m_name;
             throw std::logic_error("pthread_join error");
         }
+        // 已经回收的线程不能再在析构时detach
+        m_thread = 0;
     }
 }
 
+bool Thread::set_affinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    // 在线程自己的执行函数里调用时m_thread可能还没有被pthread_create写入
+    pthread_t thread = this == t_thread ? pthread_self() : m_thread;
+    int rt = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rt) {
+        LOG_WARN(logger) << "pthread_setaffinity_np fail, rt=" << rt << " name=" << m_name;
+        return false;
+    }
+    return true;
+}
+
 void* Thread::run(void* arg) {
     Thread* thread = (Thread*) arg;
     t_thread = thread;
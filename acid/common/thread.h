@@ -13,6 +13,7 @@
 #include <functional>
 #include <memory>
 #include <pthread.h>
+#include <vector>
 
 namespace acid {
 
@@ -39,6 +40,13 @@ public:
 
     void join();
 
+    /*!
+     * @brief 把线程绑定到一组CPU上
+     * @param[in] cpus CPU编号, 为空时不做修改
+     * @return 设置失败(例如CPU不存在)时返回false
+     */
+    bool set_affinity(const std::vector<int>& cpus);
+
     static Thread* get_this();
 
     static const std::string& get_name();
@@ -191,7 +191,7 @@ void TimerManager::add_timer(Timer::ptr val, WriteLockGuard& lock) {
 
 bool TimerManager::detect_clock_rollover(uint64_t now_ms) {
     bool rollover = false;
-    if (now_ms < m_previous_time && now_ms < (m_previous_time - 60 * 60 * 1000)) {
+    if (now_ms < m_previous_time && now_ms + 60 * 60 * 1000 < m_previous_time) {
         rollover = true;
     }
     m_previous_time = now_ms;
@@ -14,6 +14,7 @@
 
 #include "mutex.h"
 
+#include <coroutine>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -111,6 +112,29 @@ public:
     Timer::ptr add_condition_timer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond,
                                    bool recurring = false);
 
+    /**
+     * @brief C++20协程中等待ms毫秒: co_await manager->co_sleep(ms)
+     * @details 到期后在执行定时器回调的协程上恢复, 不占用调度线程
+     */
+    auto co_sleep(uint64_t ms) {
+        struct Awaiter {
+            bool await_ready() const noexcept {
+                return ms == 0;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                manager->add_timer(ms, [handle] { handle.resume(); });
+            }
+
+            void await_resume() noexcept {
+            }
+
+            TimerManager* manager;
+            uint64_t ms;
+        };
+        return Awaiter {this, ms};
+    }
+
     /**
      * @brief 到最近的定时器执行的时间间隔
      *
@@ -38,6 +38,156 @@ uint64_t get_elapsed_ms() {
     return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t get_elapsed_us() {
+    timespec ts {0};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t get_current_ms() {
+    timespec ts {0};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char s_base64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const void *data, size_t len) {
+    const auto *src = static_cast<const uint8_t *>(data);
+    std::string result;
+    result.reserve((len + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t v = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+        result.push_back(s_base64_table[(v >> 18) & 0x3F]);
+        result.push_back(s_base64_table[(v >> 12) & 0x3F]);
+        result.push_back(s_base64_table[(v >> 6) & 0x3F]);
+        result.push_back(s_base64_table[v & 0x3F]);
+    }
+    if (i < len) {
+        uint32_t v = src[i] << 16;
+        if (i + 1 < len) {
+            v |= src[i + 1] << 8;
+        }
+        result.push_back(s_base64_table[(v >> 18) & 0x3F]);
+        result.push_back(s_base64_table[(v >> 12) & 0x3F]);
+        result.push_back(i + 1 < len ? s_base64_table[(v >> 6) & 0x3F] : '=');
+        result.push_back('=');
+    }
+    return result;
+}
+
+std::string base64_decode(const std::string &src) {
+    std::string result;
+    result.reserve(src.size() / 4 * 3 + 3);
+    uint32_t v = 0;
+    int bits = 0;
+    for (char c : src) {
+        int d;
+        if (c >= 'A' && c <= 'Z') {
+            d = c - 'A';
+        }
+        else if (c >= 'a' && c <= 'z') {
+            d = c - 'a' + 26;
+        }
+        else if (c >= '0' && c <= '9') {
+            d = c - '0' + 52;
+        }
+        else if (c == '+' || c == '-') {
+            d = 62;
+        }
+        else if (c == '/' || c == '_') {
+            d = 63;
+        }
+        else if (c == '=') {
+            break;
+        }
+        else {
+            return "";
+        }
+        v = (v << 6) | d;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            result.push_back(static_cast<char>((v >> bits) & 0xFF));
+        }
+    }
+    return result;
+}
+
+static inline uint32_t rotate_left(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+std::string sha1sum(const void *data, size_t len) {
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // 补上0x80和长度, 使总长度是64字节的整数倍
+    std::string message(static_cast<const char *>(data), len);
+    message.push_back(static_cast<char>(0x80));
+    while (message.size() % 64 != 56) {
+        message.push_back(0);
+    }
+    uint64_t bit_len = static_cast<uint64_t>(len) * 8;
+    for (int i = 7; i >= 0; --i) {
+        message.push_back(static_cast<char>((bit_len >> (i * 8)) & 0xFF));
+    }
+
+    const auto *p = reinterpret_cast<const uint8_t *>(message.data());
+    for (size_t offset = 0; offset < message.size(); offset += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (p[offset + i * 4] << 24) | (p[offset + i * 4 + 1] << 16) |
+                   (p[offset + i * 4 + 2] << 8) | p[offset + i * 4 + 3];
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t temp = rotate_left(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate_left(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::string result(20, '\0');
+    for (int i = 0; i < 5; ++i) {
+        result[i * 4] = static_cast<char>(h[i] >> 24);
+        result[i * 4 + 1] = static_cast<char>(h[i] >> 16);
+        result[i * 4 + 2] = static_cast<char>(h[i] >> 8);
+        result[i * 4 + 3] = static_cast<char>(h[i]);
+    }
+    return result;
+}
+
 void FSUtil::list_all_file(std::vector<std::string> &files,
                            const std::string &path, const std::string &subfix) {
     if (access(path.c_str(), 0) != 0) {
@@ -12,6 +12,8 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace acid {
 
@@ -58,6 +60,37 @@ std::string get_thread_name();
  */
 uint64_t get_elapsed_ms();
 
+/**
+ * @brief 获取当前启动的微秒数, 用于统计较短的耗时
+ *
+ * @return uint64_t
+ */
+uint64_t get_elapsed_us();
+
+/**
+ * @brief 获取当前的时间戳(ms), 用于跨进程传递的绝对时间
+ *
+ * @return uint64_t
+ */
+uint64_t get_current_ms();
+
+/**
+ * @brief base64编码
+ */
+std::string base64_encode(const void* data, size_t len);
+
+/**
+ * @brief base64解码, 同时接受url安全的字母表(-_)和省略了填充的输入
+ * @return 输入不合法时返回空字符串
+ */
+std::string base64_decode(const std::string& src);
+
+/**
+ * @brief 计算SHA-1摘要, 用于websocket握手
+ * @return 20字节的二进制摘要
+ */
+std::string sha1sum(const void* data, size_t len);
+
 template <class T>
 const char* type_to_name() {
     static const char* s_name = abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, nullptr);
@@ -121,7 +154,11 @@ public:
      * @note 内部仍然会判断一次文件是否真的不存在
      */
     static bool unlink(const std::string& filename, bool exist = false) {
-        // TODO unlink
+        struct stat st {};
+        if (!exist && lstat(filename.c_str(), &st) != 0) {
+            return true;
+        }
+        return ::unlink(filename.c_str()) == 0;
     }
 
     /*!
@@ -0,0 +1,522 @@
+#include "hpack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace acid::http {
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 附录B, 下标为符号, 256为EOS
+static const HuffmanCode s_huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+static const HPackHeader s_static_table[HPackTable::STATIC_SIZE] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+/**
+ * @brief Huffman解码树, 叶子节点保存符号
+ */
+struct HuffmanTree {
+    struct Node {
+        int16_t children[2] = {-1, -1};
+        int16_t symbol = -1;
+    };
+
+    HuffmanTree() {
+        nodes.emplace_back();
+        for (int symbol = 0; symbol < 257; ++symbol) {
+            const HuffmanCode& code = s_huffman_codes[symbol];
+            size_t node = 0;
+            for (int i = code.bits - 1; i >= 0; --i) {
+                int bit = (code.code >> i) & 1;
+                if (nodes[node].children[bit] < 0) {
+                    nodes[node].children[bit] = static_cast<int16_t>(nodes.size());
+                    nodes.emplace_back();
+                }
+                node = nodes[node].children[bit];
+            }
+            nodes[node].symbol = static_cast<int16_t>(symbol);
+        }
+    }
+
+    std::vector<Node> nodes;
+};
+
+static const HuffmanTree s_huffman_tree;
+
+/**
+ * @brief 静态表的查找索引
+ */
+struct StaticIndex {
+    StaticIndex() {
+        for (uint32_t i = HPackTable::STATIC_SIZE; i > 0; --i) {
+            const HPackHeader& header = s_static_table[i - 1];
+            names[header.first] = i;
+            fields[header.first + '\0' + header.second] = i;
+        }
+    }
+
+    std::unordered_map<std::string, uint32_t> names;
+    std::unordered_map<std::string, uint32_t> fields;
+};
+
+static const StaticIndex s_static_index;
+
+// 这些头部的值几乎每次都不同, 加入动态表只会淘汰有用的条目
+static bool should_index(const std::string& name, const std::string& value) {
+    static const char* s_volatile_names[] = {":path",  "content-length", "date", "etag",
+                                             "last-modified", "age", "expires", "set-cookie",
+                                             "cookie", "authorization"};
+    if (value.size() > 256) {
+        return false;
+    }
+    for (auto* item : s_volatile_names) {
+        if (name == item) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 按HPACK的整数编码写入, first中是前缀之外的标志位
+static void encode_integer(std::string& out, uint8_t first, int prefix, uint64_t value) {
+    uint64_t max_prefix = (1u << prefix) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(first | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first | max_prefix));
+    value -= max_prefix;
+    while (value >= 128) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool decode_integer(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value) {
+    if (p >= end) {
+        return false;
+    }
+    uint64_t max_prefix = (1u << prefix) - 1;
+    value = *p++ & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (int shift = 0; shift < 63; shift += 7) {
+        if (p >= end) {
+            return false;
+        }
+        uint8_t byte = *p++;
+        value += static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void encode_string(std::string& out, const std::string& value) {
+    size_t huffman_length = huffman_encoded_length(value);
+    if (huffman_length < value.size()) {
+        encode_integer(out, 0x80, 7, huffman_length);
+        huffman_encode(value, out);
+    }
+    else {
+        encode_integer(out, 0, 7, value.size());
+        out.append(value);
+    }
+}
+
+static bool decode_string(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    if (p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t length;
+    if (!decode_integer(p, end, 7, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    value.clear();
+    if (huffman) {
+        if (!huffman_decode(reinterpret_cast<const char*>(p), length, value)) {
+            return false;
+        }
+    }
+    else {
+        value.assign(reinterpret_cast<const char*>(p), length);
+    }
+    p += length;
+    return true;
+}
+
+size_t huffman_encoded_length(const std::string& src) {
+    size_t bits = 0;
+    for (unsigned char c : src) {
+        bits += s_huffman_codes[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(const std::string& src, std::string& out) {
+    uint64_t current = 0;
+    int bits = 0;
+    for (unsigned char c : src) {
+        const HuffmanCode& code = s_huffman_codes[c];
+        current = (current << code.bits) | code.code;
+        bits += code.bits;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>(current >> bits));
+        }
+    }
+    // 不足一个字节的部分用EOS的高位(全1)填充
+    if (bits > 0) {
+        current = (current << (8 - bits)) | (0xFF >> bits);
+        out.push_back(static_cast<char>(current));
+    }
+}
+
+bool huffman_decode(const char* data, size_t length, std::string& out) {
+    const auto& nodes = s_huffman_tree.nodes;
+    size_t node = 0;
+    int pending_bits = 0;     // 上一个符号之后读入的位数
+    bool pending_ones = true;  // 这些位是否全为1
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t byte = data[i];
+        for (int b = 7; b >= 0; --b) {
+            int bit = (byte >> b) & 1;
+            int16_t next = nodes[node].children[bit];
+            if (next < 0) {
+                return false;
+            }
+            node = next;
+            ++pending_bits;
+            pending_ones = pending_ones && bit;
+            int16_t symbol = nodes[node].symbol;
+            if (symbol >= 0) {
+                // 编码中不能出现EOS
+                if (symbol == 256) {
+                    return false;
+                }
+                out.push_back(static_cast<char>(symbol));
+                node = 0;
+                pending_bits = 0;
+                pending_ones = true;
+            }
+        }
+    }
+    // 结尾的填充不超过7位并且全为1
+    return pending_bits < 8 && pending_ones;
+}
+
+HPackTable::HPackTable(uint32_t max_size) : m_max_size(max_size) {
+}
+
+const HPackHeader* HPackTable::get(uint32_t index) const {
+    if (index == 0) {
+        return nullptr;
+    }
+    if (index <= STATIC_SIZE) {
+        return &s_static_table[index - 1];
+    }
+    index -= STATIC_SIZE + 1;
+    return index < m_entries.size() ? &m_entries[index] : nullptr;
+}
+
+uint32_t HPackTable::find(const std::string& name, const std::string& value,
+                          uint32_t& name_index) const {
+    name_index = 0;
+    auto it = s_static_index.fields.find(name + '\0' + value);
+    if (it != s_static_index.fields.end()) {
+        return it->second;
+    }
+    auto name_it = s_static_index.names.find(name);
+    if (name_it != s_static_index.names.end()) {
+        name_index = name_it->second;
+    }
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].first != name) {
+            continue;
+        }
+        uint32_t index = STATIC_SIZE + 1 + i;
+        if (m_entries[i].second == value) {
+            return index;
+        }
+        if (name_index == 0) {
+            name_index = index;
+        }
+    }
+    return 0;
+}
+
+void HPackTable::add(const std::string& name, const std::string& value) {
+    uint32_t size = name.size() + value.size() + 32;
+    // 比整个表还大的条目会清空动态表, 自己也不加入
+    if (size > m_max_size) {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    m_entries.emplace_front(name, value);
+    m_size += size;
+}
+
+void HPackTable::set_max_size(uint32_t max_size) {
+    m_max_size = max_size;
+    evict(max_size);
+}
+
+void HPackTable::evict(uint32_t max_size) {
+    while (m_size > max_size && !m_entries.empty()) {
+        auto& entry = m_entries.back();
+        m_size -= entry.first.size() + entry.second.size() + 32;
+        m_entries.pop_back();
+    }
+}
+
+HPackDecoder::HPackDecoder(uint32_t max_table_size, uint32_t max_header_list_size)
+    : m_table(max_table_size)
+    , m_max_table_size(max_table_size)
+    , m_max_header_list_size(max_header_list_size) {
+}
+
+bool HPackDecoder::decode(const char* data, size_t length, std::vector<HPackHeader>& headers) {
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    const auto* end = p + length;
+    bool header_seen = false;
+    // 一个索引只占一个字节却可以引用一个很长的条目, 需要限制解码后的大小, 只限制编码后的大小不够
+    uint64_t list_size = 0;
+    auto exceeds = [this, &list_size](const std::string& name, const std::string& value) {
+        list_size += name.size() + value.size() + 32;
+        m_too_large = list_size > m_max_header_list_size;
+        return m_too_large;
+    };
+    m_too_large = false;
+    std::string name;
+    std::string value;
+    while (p < end) {
+        uint8_t first = *p;
+        uint64_t index;
+        if (first & 0x80) {
+            // 索引的头部
+            if (!decode_integer(p, end, 7, index) || index > UINT32_MAX) {
+                return false;
+            }
+            const HPackHeader* header = m_table.get(index);
+            if (!header || exceeds(header->first, header->second)) {
+                return false;
+            }
+            headers.push_back(*header);
+            header_seen = true;
+            continue;
+        }
+        if ((first & 0xE0) == 0x20) {
+            // 动态表大小更新只能出现在头部块的开头
+            if (header_seen || !decode_integer(p, end, 5, index) || index > m_max_table_size) {
+                return false;
+            }
+            m_table.set_max_size(index);
+            continue;
+        }
+
+        // 字面量: 01加入动态表, 0000不加入, 0001永不加入
+        bool incremental = (first & 0xC0) == 0x40;
+        if (!decode_integer(p, end, incremental ? 6 : 4, index) || index > UINT32_MAX) {
+            return false;
+        }
+        if (index > 0) {
+            const HPackHeader* header = m_table.get(index);
+            if (!header) {
+                return false;
+            }
+            name = header->first;
+        }
+        else if (!decode_string(p, end, name)) {
+            return false;
+        }
+        if (!decode_string(p, end, value) || exceeds(name, value)) {
+            return false;
+        }
+        if (incremental) {
+            m_table.add(name, value);
+        }
+        headers.emplace_back(std::move(name), std::move(value));
+        header_seen = true;
+    }
+    return true;
+}
+
+HPackEncoder::HPackEncoder() : m_table(4096) {
+}
+
+void HPackEncoder::set_max_table_size(uint32_t max_size) {
+    // 编码器可以使用比对端上限更小的表, 超过4096的部分不使用
+    max_size = std::min<uint32_t>(max_size, 4096);
+    if (max_size != m_table.get_max_size()) {
+        m_table.set_max_size(max_size);
+        m_size_update = true;
+    }
+}
+
+void HPackEncoder::encode(const std::vector<HPackHeader>& headers, std::string& out) {
+    if (m_size_update) {
+        encode_integer(out, 0x20, 5, m_table.get_max_size());
+        m_size_update = false;
+    }
+    for (auto& header : headers) {
+        uint32_t name_index;
+        uint32_t index = m_table.find(header.first, header.second, name_index);
+        if (index > 0) {
+            encode_integer(out, 0x80, 7, index);
+            continue;
+        }
+        bool indexing = should_index(header.first, header.second);
+        if (indexing) {
+            encode_integer(out, 0x40, 6, name_index);
+        }
+        else {
+            encode_integer(out, 0x00, 4, name_index);
+        }
+        if (name_index == 0) {
+            encode_string(out, header.first);
+        }
+        encode_string(out, header.second);
+        if (indexing) {
+            m_table.add(header.first, header.second);
+        }
+    }
+}
+
+}  // namespace acid::http
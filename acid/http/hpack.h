@@ -0,0 +1,147 @@
+/*!
+ * @file hpack.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief HTTP/2的头部压缩(RFC 7541)
+ * @version 0.1
+ * @date 2023-08-18
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_HPACK_H
+#define DF_HPACK_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace acid::http {
+
+using HPackHeader = std::pair<std::string, std::string>;
+
+/**
+ * @brief HPACK的索引表, 静态表在前, 动态表在后
+ * 动态表中最新的条目索引最小, 超过大小上限时淘汰最旧的条目
+ */
+class HPackTable {
+public:
+    // 静态表的条目数, 动态表的索引从STATIC_SIZE + 1开始
+    static constexpr uint32_t STATIC_SIZE = 61;
+
+    explicit HPackTable(uint32_t max_size = 4096);
+
+    /**
+     * @brief 按索引获取条目, 索引从1开始
+     * @return 索引不存在返回nullptr
+     */
+    const HPackHeader* get(uint32_t index) const;
+
+    /**
+     * @brief 查找条目
+     * @param[out] name_index 只有名字匹配的条目的索引, 没有时为0
+     * @return 名字和值都匹配的条目的索引, 没有时为0
+     */
+    uint32_t find(const std::string& name, const std::string& value, uint32_t& name_index) const;
+
+    void add(const std::string& name, const std::string& value);
+
+    void set_max_size(uint32_t max_size);
+
+    uint32_t get_max_size() const {
+        return m_max_size;
+    }
+
+    uint32_t get_size() const {
+        return m_size;
+    }
+
+private:
+    // 淘汰旧条目直到大小不超过max_size
+    void evict(uint32_t max_size);
+
+private:
+    std::deque<HPackHeader> m_entries;
+    uint32_t m_size = 0;  // 每个条目的大小为名字和值的长度加32
+    uint32_t m_max_size;
+};
+
+/**
+ * @brief 头部块解码器, 一个连接上的所有头部块必须按收到的顺序解码
+ */
+class HPackDecoder {
+public:
+    /**
+     * @param max_table_size 通过SETTINGS_HEADER_TABLE_SIZE通告给对端的动态表上限
+     * @param max_header_list_size 解码后一个头部块的大小上限, 按名字和值的长度加32累计,
+     * 与SETTINGS_MAX_HEADER_LIST_SIZE的计算方式相同
+     */
+    explicit HPackDecoder(uint32_t max_table_size = 4096,
+                          uint32_t max_header_list_size = UINT32_MAX);
+
+    /**
+     * @brief 解码一个完整的头部块, 追加到headers中
+     * @return 头部块不合法或解码后超过大小上限返回false, 连接需要关闭;
+     * 超过上限时is_too_large返回true, 用ENHANCE_YOUR_CALM关闭, 否则用COMPRESSION_ERROR
+     */
+    bool decode(const char* data, size_t length, std::vector<HPackHeader>& headers);
+
+    uint32_t get_max_header_list_size() const {
+        return m_max_header_list_size;
+    }
+
+    /**
+     * @brief 上一次decode是否因为解码后的头部超过上限而失败
+     */
+    bool is_too_large() const {
+        return m_too_large;
+    }
+
+private:
+    HPackTable m_table;
+    uint32_t m_max_table_size;
+    uint32_t m_max_header_list_size;
+    bool m_too_large = false;
+};
+
+/**
+ * @brief 头部块编码器, 编码的顺序必须与头部块发送的顺序一致
+ */
+class HPackEncoder {
+public:
+    HPackEncoder();
+
+    /**
+     * @brief 编码一组头部, 追加到out中, 名字需要是小写
+     */
+    void encode(const std::vector<HPackHeader>& headers, std::string& out);
+
+    /**
+     * @brief 对端通过SETTINGS_HEADER_TABLE_SIZE修改了动态表上限, 下一个头部块开头发送大小更新
+     */
+    void set_max_table_size(uint32_t max_size);
+
+private:
+    HPackTable m_table;
+    bool m_size_update = false;
+};
+
+/**
+ * @brief Huffman编码, 追加到out中
+ */
+void huffman_encode(const std::string& src, std::string& out);
+
+/**
+ * @brief Huffman编码后的长度
+ */
+size_t huffman_encoded_length(const std::string& src);
+
+/**
+ * @brief Huffman解码, 追加到out中
+ * @return 编码不合法返回false
+ */
+bool huffman_decode(const char* data, size_t length, std::string& out);
+
+}  // namespace acid::http
+
+#endif  // DF_HPACK_H
@@ -2,7 +2,10 @@
 
 #include "acid/logger/logger.h"
 
+#include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <unistd.h>
 
 namespace acid::http {
 
@@ -86,6 +89,10 @@ bool CaseInsensitiveLess::operator()(const std::string& lhs, const std::string&
     return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
 }
 
+bool case_insensitive_equal(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
 HttpRequest::HttpRequest(uint8_t version, bool close)
     : m_method(HttpMethod::GET)
     , m_version(version)
@@ -94,70 +101,264 @@ HttpRequest::HttpRequest(uint8_t version, bool close)
     , m_path("/") {
 }
 
-std::string HttpRequest::get_header(const std::string& key, const std::string& def) {
-    auto it = m_headers.find(key);
-    return it == m_headers.end() ? def : it->second;
+const HttpRequest::FieldType* HttpRequest::find_field(const FieldList& fields,
+                                                      std::string_view key) {
+    for (auto& field : fields) {
+        if (case_insensitive_equal(field.first, key)) {
+            return &field;
+        }
+    }
+    return nullptr;
 }
 
-std::string HttpRequest::get_param(const std::string& key, const std::string& def) {
-    auto it = m_params.find(key);
-    return it == m_params.end() ? def : it->second;
+void HttpRequest::set_field(FieldList& fields, FieldType field) {
+    auto it = fields.begin();
+    while (it != fields.end() && !case_insensitive_equal(it->first, field.first)) {
+        ++it;
+    }
+    if (it == fields.end()) {
+        fields.push_back(field);
+        return;
+    }
+    *it = field;
+    // 解析得到的同名字段只保留第一个
+    fields.erase(std::remove_if(it + 1, fields.end(),
+                                [&field](const FieldType& other) {
+                                    return case_insensitive_equal(other.first, field.first);
+                                }),
+                 fields.end());
 }
 
-std::string HttpRequest::get_cookie(const std::string& key, const std::string& def) {
-    auto it = m_cookies.find(key);
-    return it == m_cookies.end() ? def : it->second;
+void HttpRequest::del_field(FieldList& fields, std::string_view key) {
+    fields.erase(std::remove_if(fields.begin(), fields.end(),
+                                [key](const FieldType& field) {
+                                    return case_insensitive_equal(field.first, key);
+                                }),
+                 fields.end());
 }
 
-void HttpRequest::set_header(const std::string& key, const std::string& val) {
-    m_headers[key] = val;
+std::string_view HttpRequest::store(std::string_view data) {
+    if (data.empty()) {
+        return {};
+    }
+    m_storage.emplace_front(data);
+    return m_storage.front();
 }
 
-void HttpRequest::set_param(const std::string& key, const std::string& val) {
-    m_params[key] = val;
+void HttpRequest::set_query(std::string_view query) {
+    m_query = store(query);
+    // 查询参数重新解析, set_param设置的参数(如路由参数)在解析后重新覆盖
+    if (m_params_parsed) {
+        m_params.clear();
+        m_params_parsed = false;
+    }
 }
 
-void HttpRequest::set_cookie(const std::string& key, const std::string& val) {
-    m_cookies[key] = val;
+std::string HttpRequest::get_header(std::string_view key, const std::string& def) const {
+    auto field = find_field(m_headers, key);
+    return field ? std::string(field->second) : def;
 }
 
-void HttpRequest::del_header(const std::string& key) {
-    m_headers.erase(key);
+std::string HttpRequest::get_param(std::string_view key, const std::string& def) {
+    parse_params();
+    auto field = find_field(m_params, key);
+    return field ? std::string(field->second) : def;
 }
 
-void HttpRequest::del_param(const std::string& key) {
-    m_params.erase(key);
+std::string HttpRequest::get_cookie(std::string_view key, const std::string& def) {
+    parse_cookies();
+    auto field = find_field(m_cookies, key);
+    return field ? std::string(field->second) : def;
 }
 
-void HttpRequest::del_cookie(const std::string& key) {
-    m_cookies.erase(key);
+std::string_view HttpRequest::get_header_view(std::string_view key, std::string_view def) const {
+    auto field = find_field(m_headers, key);
+    return field ? field->second : def;
 }
 
-bool HttpRequest::has_header(const std::string& key, const std::string* val) {
-    auto it = m_headers.find(key);
-    if (it == m_headers.end()) {
-        return false;
+std::string_view HttpRequest::get_param_view(std::string_view key, std::string_view def) {
+    parse_params();
+    auto field = find_field(m_params, key);
+    return field ? field->second : def;
+}
+
+std::string_view HttpRequest::get_cookie_view(std::string_view key, std::string_view def) {
+    parse_cookies();
+    auto field = find_field(m_cookies, key);
+    return field ? field->second : def;
+}
+
+void HttpRequest::set_header(std::string_view key, std::string_view val) {
+    // 名字和值拷贝到同一个节点中
+    m_storage.emplace_front();
+    std::string& data = m_storage.front();
+    data.reserve(key.size() + val.size());
+    data.append(key).append(val);
+    set_field(m_headers, {std::string_view(data.data(), key.size()),
+                          std::string_view(data.data() + key.size(), val.size())});
+    if (m_cookies_parsed && case_insensitive_equal(key, "cookie")) {
+        m_cookies.clear();
+        m_cookies_parsed = false;
     }
-    val = &(it->second);
-    return true;
 }
 
-bool HttpRequest::has_param(const std::string& key, const std::string* val) {
-    auto it = m_params.find(key);
-    if (it == m_params.end()) {
-        return false;
+void HttpRequest::set_param(std::string_view key, std::string_view val) {
+    parse_params();
+    FieldType field {store(key), store(val)};
+    set_field(m_params, field);
+    set_field(m_set_params, field);
+}
+
+void HttpRequest::set_cookie(std::string_view key, std::string_view val) {
+    parse_cookies();
+    set_field(m_cookies, {store(key), store(val)});
+}
+
+void HttpRequest::del_header(std::string_view key) {
+    del_field(m_headers, key);
+}
+
+void HttpRequest::del_param(std::string_view key) {
+    parse_params();
+    del_field(m_params, key);
+    del_field(m_set_params, key);
+}
+
+void HttpRequest::del_cookie(std::string_view key) {
+    parse_cookies();
+    del_field(m_cookies, key);
+}
+
+bool HttpRequest::has_header(std::string_view key, std::string_view* val) const {
+    auto field = find_field(m_headers, key);
+    if (field && val) {
+        *val = field->second;
     }
-    val = &(it->second);
-    return true;
+    return field;
 }
 
-bool HttpRequest::has_cookie(const std::string& key, const std::string* val) {
-    auto it = m_cookies.find(key);
-    if (it == m_cookies.end()) {
-        return false;
+bool HttpRequest::has_param(std::string_view key, std::string_view* val) {
+    parse_params();
+    auto field = find_field(m_params, key);
+    if (field && val) {
+        *val = field->second;
+    }
+    return field;
+}
+
+bool HttpRequest::has_cookie(std::string_view key, std::string_view* val) {
+    parse_cookies();
+    auto field = find_field(m_cookies, key);
+    if (field && val) {
+        *val = field->second;
+    }
+    return field;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::string_view HttpRequest::url_decode(std::string_view data) {
+    if (data.find_first_of("%+") == std::string_view::npos) {
+        return data;
+    }
+    m_storage.emplace_front();
+    std::string& decoded = m_storage.front();
+    decoded.reserve(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (data[i] == '+') {
+            decoded.push_back(' ');
+        }
+        else if (data[i] == '%' && i + 2 < data.size() && hex_value(data[i + 1]) >= 0 &&
+                 hex_value(data[i + 2]) >= 0) {
+            decoded.push_back(static_cast<char>(hex_value(data[i + 1]) << 4 |
+                                                hex_value(data[i + 2])));
+            i += 2;
+        }
+        else {
+            // 不完整的百分号编码按原样保留
+            decoded.push_back(data[i]);
+        }
+    }
+    return decoded;
+}
+
+void HttpRequest::parse_params() {
+    if (m_params_parsed) {
+        return;
+    }
+    m_params_parsed = true;
+    // a=1&b=2&flag, 没有'='的参数值为空
+    size_t begin = 0;
+    while (begin < m_query.size()) {
+        size_t end = m_query.find('&', begin);
+        if (end == std::string_view::npos) {
+            end = m_query.size();
+        }
+        std::string_view item = m_query.substr(begin, end - begin);
+        begin = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        size_t eq = item.find('=');
+        std::string_view key = url_decode(item.substr(0, eq));
+        std::string_view val =
+            eq == std::string_view::npos ? std::string_view() : url_decode(item.substr(eq + 1));
+        // 同名参数以第一个为准
+        if (!find_field(m_params, key)) {
+            m_params.emplace_back(key, val);
+        }
+    }
+    // set_param设置的参数优先于查询参数
+    for (auto& field : m_set_params) {
+        set_field(m_params, field);
+    }
+}
+
+void HttpRequest::parse_cookies() {
+    if (m_cookies_parsed) {
+        return;
+    }
+    m_cookies_parsed = true;
+    // Cookie: a=1; b=2, HTTP/1.1中也可能出现多个Cookie请求头
+    for (auto& header : m_headers) {
+        if (!case_insensitive_equal(header.first, "cookie")) {
+            continue;
+        }
+        std::string_view cookies = header.second;
+        size_t begin = 0;
+        while (begin < cookies.size()) {
+            size_t end = cookies.find(';', begin);
+            if (end == std::string_view::npos) {
+                end = cookies.size();
+            }
+            std::string_view item = cookies.substr(begin, end - begin);
+            begin = end + 1;
+            size_t first = item.find_first_not_of(' ');
+            if (first == std::string_view::npos) {
+                continue;
+            }
+            item = item.substr(first, item.find_last_not_of(' ') - first + 1);
+            size_t eq = item.find('=');
+            if (eq == std::string_view::npos || eq == 0) {
+                continue;
+            }
+            std::string_view key = item.substr(0, eq);
+            if (!find_field(m_cookies, key)) {
+                m_cookies.emplace_back(key, item.substr(eq + 1));
+            }
+        }
     }
-    val = &(it->second);
-    return true;
 }
 
 std::ostream& HttpRequest::dump(std::ostream& os) const {
@@ -181,7 +382,7 @@ std::ostream& HttpRequest::dump(std::ostream& os) const {
     }
 
     for (auto& header : m_headers) {
-        if (!m_websocket && strcasecmp(header.first.c_str(), "connection") == 0) {
+        if (!m_websocket && case_insensitive_equal(header.first, "connection")) {
             continue;
         }
         os << header.first << ": " << header.second << "\r\n";
@@ -209,14 +410,16 @@ std::string HttpRequest::to_string() const {
 }
 
 void HttpRequest::init() {
-    std::string connection = get_header("Connection");
+    // HTTP/1.1默认保持连接, HTTP/1.0默认关闭, Connection头可以覆盖默认行为
+    std::string_view connection = get_header_view("Connection");
     if (connection.empty()) {
-        if (strcasecmp(connection.c_str(), "keep-alive") == 0) {
-            m_close = false;
-        }
-        else {
-            m_close = true;
-        }
+        m_close = m_version < 0x11;
+    }
+    else if (case_insensitive_equal(connection, "keep-alive")) {
+        m_close = false;
+    }
+    else if (case_insensitive_equal(connection, "close")) {
+        m_close = true;
     }
 }
 
@@ -224,6 +427,15 @@ HttpResponse::HttpResponse(uint8_t version, bool close)
     : m_status(HttpStatus::OK), m_version(version), m_close(close), m_websocket(false) {
 }
 
+void HttpResponse::set_file_body(int fd, uint64_t offset, uint64_t length) {
+    m_file.reset(new int(fd), [](int* fd) {
+        ::close(*fd);
+        delete fd;
+    });
+    m_file_offset = offset;
+    m_file_length = length;
+}
+
 const std::string& HttpResponse::get_header(const std::string& key, const std::string& def) const {
     auto it = m_headers.find(key);
     return it == m_headers.end() ? def : it->second;
@@ -246,39 +458,113 @@ bool HttpResponse::has_header(const std::string& key, std::string* val) {
     return true;
 }
 std::ostream& HttpResponse::dump(std::ostream& os) const {
+    std::string head;
+    dump_head(head);
+    return os << head << m_body;
+}
+
+// 状态码对应的原因短语, 返回字面量避免构造string
+static const char* http_status_to_reason(HttpStatus status) {
+    switch (status) {
+#define XX(code, name, msg)  \
+    case HttpStatus::name: { \
+        return #msg;         \
+    }
+        HTTP_STATUS_MAP(XX)
+#undef XX
+        default:
+            return "<unknown>";
+    }
+}
+
+static void append_number(std::string& out, uint64_t value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr - buffer);
+}
+
+void HttpRequest::dump_head(std::string& out) const {
+    // GET /index.html?a=b HTTP/1.1
+    // Host: baidu.com
+    out.append(http_method_to_string(m_method));
+    out.push_back(' ');
+    out.append(m_path.empty() ? std::string_view("/") : m_path);
+    if (!m_query.empty()) {
+        out.push_back('?');
+        out.append(m_query);
+    }
+    out.append(" HTTP/");
+    out.push_back('0' + (m_version >> 4));
+    out.push_back('.');
+    out.push_back('0' + (m_version & 0xF));
+    out.append("\r\n");
+
+    if (!m_websocket) {
+        out.append(m_close ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+    }
+
+    bool has_content_length = false;
+    for (auto& header : m_headers) {
+        if (!m_websocket && case_insensitive_equal(header.first, "connection")) {
+            continue;
+        }
+        if (case_insensitive_equal(header.first, "content-length") ||
+            case_insensitive_equal(header.first, "transfer-encoding")) {
+            has_content_length = true;
+        }
+        out.append(header.first).append(": ").append(header.second).append("\r\n");
+    }
+    if (!has_content_length && !m_body.empty()) {
+        out.append("Content-Length: ");
+        append_number(out, m_body.size());
+        out.append("\r\n");
+    }
+    out.append("\r\n");
+}
+
+void HttpResponse::dump_head(std::string& out) const {
     // HTTP/1.1 200 OK
     // server: acid
-    // clang-format off
-    os  << "HTTP/"
-        << (static_cast<uint32_t>(m_version) >> 4)
-        << "."
-        << (static_cast<uint32_t>(m_version) & 0xF) << " "
-        << static_cast<uint32_t>(m_status) << " "
-        << (m_reason.empty() ? http_status_to_string(m_status) : m_reason)
-        << "\r\n";
-    // clang-format on
+    out.append("HTTP/");
+    out.push_back('0' + (m_version >> 4));
+    out.push_back('.');
+    out.push_back('0' + (m_version & 0xF));
+    out.push_back(' ');
+    append_number(out, static_cast<uint32_t>(m_status));
+    out.push_back(' ');
+    if (m_reason.empty()) {
+        out.append(http_status_to_reason(m_status));
+    }
+    else {
+        out.append(m_reason);
+    }
+    out.append("\r\n");
+
     if (!m_websocket) {
-        os << "Connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+        out.append(m_close ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
     }
 
+    bool has_content_length = false;
     for (auto& header : m_headers) {
         if (!m_websocket && strcasecmp(header.first.c_str(), "connection") == 0) {
             continue ;
         }
-        os << header.first << ": " << header.second << "\r\n";
+        // 分块传输时由响应体自己表示长度
+        if (strcasecmp(header.first.c_str(), "content-length") == 0 ||
+            strcasecmp(header.first.c_str(), "transfer-encoding") == 0) {
+            has_content_length = true;
+        }
+        out.append(header.first).append(": ").append(header.second).append("\r\n");
     }
     // TODO Cookies
-    if (m_body.empty()) {
-        os << "\r\n";
+    // 保持连接时客户端依赖Content-Length划分响应, 空响应体也需要写出长度
+    uint32_t status = static_cast<uint32_t>(m_status);
+    if (!has_content_length && !m_websocket && status >= 200 && status != 204 && status != 304) {
+        out.append("Content-Length: ");
+        append_number(out, m_file ? m_file_length : m_body.size());
+        out.append("\r\n");
     }
-    else {
-        if (get_header("Content-Length", "").empty()) {
-            os << "Content-Length: " << m_body.size() << "\r\n";
-        }
-        os << "\r\n" << m_body;
-    }
-
-    return os;
+    out.append("\r\n");
 }
 
 std::string HttpResponse::to_string() const {
@@ -12,7 +12,10 @@
 
 #include "acid/common/lexical_cast.h"
 
+#include <forward_list>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace acid {
 
@@ -216,13 +219,31 @@ namespace http {
         }
     }
 
+    /**
+     * @brief 忽略大小写比较两个字符串是否相等
+     */
+    bool case_insensitive_equal(std::string_view lhs, std::string_view rhs);
+
+    class HttpRequestParser;
+
+    /**
+     * @brief HTTP请求
+     * 解析得到的请求行和请求头按原样保存在一块连续的内存中, 路径, 请求头等字段都是指向其中的视图,
+     * 请求头按到达顺序保存在数组中, 按名字忽略大小写线性查找。查询参数和cookie在第一次访问时才解析。
+     * 解析之后通过set_*修改的字段单独保存, 不影响其他字段的视图, 直到请求销毁才释放
+     */
     class HttpRequest {
     public:
         using ptr = std::shared_ptr<HttpRequest>;
-        using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+        using FieldType = std::pair<std::string_view, std::string_view>;
+        using FieldList = std::vector<FieldType>;
 
         explicit HttpRequest(uint8_t version = 0x11, bool close = true);
 
+        // 字段的视图指向对象自己保存的数据, 不能拷贝
+        HttpRequest(const HttpRequest&) = delete;
+        HttpRequest& operator=(const HttpRequest&) = delete;
+
         HttpMethod get_method() const {
             return m_method;
         }
@@ -239,15 +260,15 @@ namespace http {
             return m_websocket;
         }
 
-        const std::string& get_path() const {
+        std::string_view get_path() const {
             return m_path;
         }
 
-        const std::string& get_query() const {
+        std::string_view get_query() const {
             return m_query;
         }
 
-        const std::string& get_fragment() const {
+        std::string_view get_fragment() const {
             return m_fragment;
         }
 
@@ -255,15 +276,17 @@ namespace http {
             return m_body;
         }
 
-        const MapType& get_headers() const {
+        const FieldList& get_headers() const {
             return m_headers;
         }
 
-        const MapType& get_params() const {
+        const FieldList& get_params() {
+            parse_params();
             return m_params;
         }
 
-        const MapType& get_cookies() const {
+        const FieldList& get_cookies() {
+            parse_cookies();
             return m_cookies;
         }
 
@@ -283,32 +306,26 @@ namespace http {
             m_websocket = websocket;
         }
 
-        void set_path(const std::string& path) {
-            m_path = path;
+        void set_path(std::string_view path) {
+            m_path = store(path);
         }
 
-        void set_query(const std::string& query) {
-            m_query = query;
-        }
+        /**
+         * @brief 设置查询字符串, 已经解析的查询参数失效, 下次访问时重新解析
+         * set_param设置的参数(如路由参数)保留, 仍然优先于同名的查询参数
+         */
+        void set_query(std::string_view query);
 
-        void set_fragment(const std::string& fragment) {
-            m_fragment = fragment;
+        void set_fragment(std::string_view fragment) {
+            m_fragment = store(fragment);
         }
 
         void set_body(const std::string& body) {
             m_body = body;
         }
 
-        void set_headers(const MapType& headers) {
-            m_headers = headers;
-        }
-
-        void set_params(const MapType& params) {
-            m_params = params;
-        }
-
-        void set_cookies(const MapType& cookies) {
-            m_cookies = cookies;
+        void append_body(const char* data, size_t len) {
+            m_body.append(data, len);
         }
 
         void set_content_type(HttpContentType content_type) {
@@ -319,82 +336,163 @@ namespace http {
             set_header("Content-Type", content_type);
         }
 
-        std::string get_header(const std::string& key, const std::string& def = "");
+        std::string get_header(std::string_view key, const std::string& def = "") const;
+
+        std::string get_param(std::string_view key, const std::string& def = "");
+
+        std::string get_cookie(std::string_view key, const std::string& def = "");
 
-        std::string get_param(const std::string& key, const std::string& def = "");
+        /**
+         * @brief 不拷贝的get_header, 返回的视图在请求销毁或者修改该字段之前有效
+         * @return 没有该字段时返回def
+         */
+        std::string_view get_header_view(std::string_view key, std::string_view def = {}) const;
 
-        std::string get_cookie(const std::string& key, const std::string& def = "");
+        std::string_view get_param_view(std::string_view key, std::string_view def = {});
 
-        HttpContentType get_content_type() {
+        std::string_view get_cookie_view(std::string_view key, std::string_view def = {});
+
+        HttpContentType get_content_type() const {
             return string_to_content_type(get_header("Content-Type"));
         }
 
-        void set_header(const std::string& key, const std::string& val);
+        /**
+         * @brief 设置请求头, 同名的请求头只保留这一个
+         */
+        void set_header(std::string_view key, std::string_view val);
 
-        void set_param(const std::string& key, const std::string& val);
+        void set_param(std::string_view key, std::string_view val);
 
-        void set_cookie(const std::string& key, const std::string& val);
+        void set_cookie(std::string_view key, std::string_view val);
 
-        void del_header(const std::string& key);
+        void del_header(std::string_view key);
 
-        void del_param(const std::string& key);
+        void del_param(std::string_view key);
 
-        void del_cookie(const std::string& key);
+        void del_cookie(std::string_view key);
 
-        bool has_header(const std::string& key, const std::string* val = nullptr);
+        /**
+         * @param[out] val 不为空时保存字段的值
+         */
+        bool has_header(std::string_view key, std::string_view* val = nullptr) const;
 
-        bool has_param(const std::string& key, const std::string* val = nullptr);
+        bool has_param(std::string_view key, std::string_view* val = nullptr);
 
-        bool has_cookie(const std::string& key, const std::string* val = nullptr);
+        bool has_cookie(std::string_view key, std::string_view* val = nullptr);
 
         template <class T>
-        T get_header_as(const std::string& key, const T& def = T()) {
-            return get_as(m_headers, key, def);
+        T get_header_as(std::string_view key, const T& def = T()) {
+            return field_as(find_field(m_headers, key), def);
         }
 
         template <class T>
-        T get_param_as(const std::string& key, const T& def = T()) {
-            return get_as(m_params, key, def);
+        T get_param_as(std::string_view key, const T& def = T()) {
+            parse_params();
+            return field_as(find_field(m_params, key), def);
         }
 
         template <class T>
-        T get_cookie_as(const std::string& key, const T& def = T()) {
-            return get_as(m_cookies, key, def);
+        T get_cookie_as(std::string_view key, const T& def = T()) {
+            parse_cookies();
+            return field_as(find_field(m_cookies, key), def);
         }
 
         template <class T>
-        bool check_and_get_header_as(const std::string& key, T& val, const T& def = T()) {
-            return check_and_get_as(m_headers, key, val, def);
+        bool check_and_get_header_as(std::string_view key, T& val, const T& def = T()) {
+            return check_and_field_as(find_field(m_headers, key), val, def);
         }
 
         template <class T>
-        bool check_and_get_param_as(const std::string& key, T& val, const T& def = T()) {
-            return check_and_get_as(m_params, key, val, def);
+        bool check_and_get_param_as(std::string_view key, T& val, const T& def = T()) {
+            parse_params();
+            return check_and_field_as(find_field(m_params, key), val, def);
         }
 
         template <class T>
-        bool check_and_get_cookie_as(const std::string& key, T& val, const T& def = T()) {
-            return check_and_get_as(m_cookies, key, val, def);
+        bool check_and_get_cookie_as(std::string_view key, T& val, const T& def = T()) {
+            parse_cookies();
+            return check_and_field_as(find_field(m_cookies, key), val, def);
         }
 
         std::ostream& dump(std::ostream& os) const;
 
         std::string to_string() const;
 
+        /**
+         * @brief 把请求行和请求头追加到out中, 不包含请求体
+         * 请求体不为空时补上Content-Length, 请求体由调用者单独发送
+         */
+        void dump_head(std::string& out) const;
+
         void init();
 
     private:
-        HttpMethod m_method;     // 请求方法
-        uint8_t m_version;       // http版本
-        bool m_close;            // 是否主动关闭
-        bool m_websocket;        // 是否使用websocket
-        std::string m_path;      // 请求路径
-        std::string m_query;     // 请求参数
-        std::string m_fragment;  // 请求fragment
-        std::string m_body;      // 请求体
-        MapType m_headers;       // 请求头map
-        MapType m_params;        // 请求参数map
-        MapType m_cookies;       // 请求cookies map
+        friend class HttpRequestParser;
+
+        // 忽略大小写查找第一个同名字段, 没有时返回nullptr
+        static const FieldType* find_field(const FieldList& fields, std::string_view key);
+
+        static void set_field(FieldList& fields, FieldType field);
+
+        static void del_field(FieldList& fields, std::string_view key);
+
+        template <class T>
+        static T field_as(const FieldType* field, const T& def) {
+            if (!field) {
+                return def;
+            }
+            try {
+                return lexical_cast<T>(std::string(field->second));
+            }
+            catch (...) {
+                return def;
+            }
+        }
+
+        template <class T>
+        static bool check_and_field_as(const FieldType* field, T& val, const T& def) {
+            if (!field) {
+                val = def;
+                return false;
+            }
+            try {
+                val = lexical_cast<T>(std::string(field->second));
+                return true;
+            }
+            catch (...) {
+                val = def;
+                return false;
+            }
+        }
+
+        // 拷贝一份数据单独保存, 返回指向副本的视图
+        std::string_view store(std::string_view data);
+
+        // 第一次访问时解析查询参数和Cookie请求头
+        void parse_params();
+
+        void parse_cookies();
+
+        // 百分号编码和'+'解码后的数据, 不需要解码时直接返回原视图
+        std::string_view url_decode(std::string_view data);
+
+    private:
+        HttpMethod m_method;              // 请求方法
+        uint8_t m_version;                // http版本
+        bool m_close;                     // 是否主动关闭
+        bool m_websocket;                 // 是否使用websocket
+        bool m_params_parsed = false;     // 查询参数已经解析
+        bool m_cookies_parsed = false;    // cookie已经解析
+        std::string m_raw;                // 解析器拷贝的url和请求头, 解析完成后不再修改
+        std::forward_list<std::string> m_storage;  // set_*设置和解码得到的数据, 节点地址不变
+        std::string_view m_path;          // 请求路径
+        std::string_view m_query;         // 请求参数
+        std::string_view m_fragment;      // 请求fragment
+        std::string m_body;               // 请求体
+        FieldList m_headers;              // 请求头
+        FieldList m_params;               // 请求参数
+        FieldList m_set_params;           // set_param设置的参数(如路由参数), 修改查询参数后保留
+        FieldList m_cookies;              // 请求cookies
 
     };  // class HttpRequest
 
@@ -465,6 +563,17 @@ namespace http {
             m_body = body;
         }
 
+        void append_body(const char* data, size_t len) {
+            m_body.append(data, len);
+        }
+
+        /**
+         * @brief 与body交换响应体, 替换响应体时不拷贝
+         */
+        void swap_body(std::string& body) {
+            m_body.swap(body);
+        }
+
         void set_reason(const std::string& reason) {
             m_reason = reason;
         }
@@ -506,6 +615,34 @@ namespace http {
         std::ostream& dump(std::ostream& os) const;
         std::string to_string() const;
 
+        /**
+         * @brief 以文件的一部分作为响应体, 由HttpSession通过sendfile发送, 不读入内存
+         * @param fd 响应接管fd, 不再使用时关闭
+         */
+        void set_file_body(int fd, uint64_t offset, uint64_t length);
+
+        bool has_file_body() const {
+            return m_file != nullptr;
+        }
+
+        int get_file_fd() const {
+            return m_file ? *m_file : -1;
+        }
+
+        uint64_t get_file_offset() const {
+            return m_file_offset;
+        }
+
+        uint64_t get_file_length() const {
+            return m_file_length;
+        }
+
+        /**
+         * @brief 把状态行和响应头追加到out中, 不包含响应体
+         * 不经过iostream, out可以在多次响应之间复用, 响应体由调用者单独发送
+         */
+        void dump_head(std::string& out) const;
+
     private:
         HttpStatus m_status;   // 响应状态码
         uint8_t m_version;     // http版本
@@ -515,6 +652,9 @@ namespace http {
         std::string m_reason;  // 响应原因
         MapType m_headers;     // 响应头map
         std::vector<std::string> m_cookies;
+        std::shared_ptr<int> m_file;  // 作为响应体的文件
+        uint64_t m_file_offset = 0;
+        uint64_t m_file_length = 0;
 
     };  // class HttpResponse
 
@@ -0,0 +1,817 @@
+#include "http2_session.h"
+
+#include "acid/common/config.h"
+#include "acid/common/iomanager.h"
+#include "acid/common/util.h"
+#include "acid/logger/logger.h"
+#include "http_compress.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+namespace acid::http {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<bool>::ptr g_http2_enable =
+    Config::look_up<bool>("http2.enable", true, "http server accept h2c connections");
+static ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams = Config::look_up<uint32_t>(
+    "http2.max_concurrent_streams", 128, "http2 max concurrent streams per connection");
+static ConfigVar<uint32_t>::ptr g_http2_initial_window_size = Config::look_up<uint32_t>(
+    "http2.initial_window_size", 1024 * 1024, "http2 receive window of streams and connection");
+static ConfigVar<uint32_t>::ptr g_http2_max_header_list_size = Config::look_up<uint32_t>(
+    "http2.max_header_list_size", 64 * 1024, "http2 max decoded header list size per header block");
+
+static bool s_http2_enable = true;
+static uint32_t s_http2_max_concurrent_streams = 0;
+static uint32_t s_http2_initial_window_size = 0;
+static uint32_t s_http2_max_header_list_size = 0;
+
+struct _Http2Initer {
+    _Http2Initer() {
+        s_http2_enable = g_http2_enable->get_value();
+        g_http2_enable->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "http2 enable change from " << old_val << " to " << new_val;
+            s_http2_enable = new_val;
+        });
+
+        s_http2_max_concurrent_streams = g_http2_max_concurrent_streams->get_value();
+        g_http2_max_concurrent_streams->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http2 max concurrent streams change from " << old_val
+                                 << " to " << new_val;
+                s_http2_max_concurrent_streams = new_val;
+            });
+
+        s_http2_initial_window_size = g_http2_initial_window_size->get_value();
+        g_http2_initial_window_size->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http2 initial window size change from " << old_val
+                                 << " to " << new_val;
+                s_http2_initial_window_size = new_val;
+            });
+
+        s_http2_max_header_list_size = g_http2_max_header_list_size->get_value();
+        g_http2_max_header_list_size->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http2 max header list size change from " << old_val
+                                 << " to " << new_val;
+                s_http2_max_header_list_size = new_val;
+            });
+    }
+};
+
+static _Http2Initer _http2_initer;
+
+const std::string Http2Session::PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// 通告给对端的SETTINGS_MAX_FRAME_SIZE, 使用协议的默认值
+static constexpr uint32_t MAX_FRAME_SIZE = 16384;
+static constexpr size_t FRAME_HEADER_SIZE = 9;
+static constexpr size_t READ_BUFFER_SIZE = 32 * 1024;
+// 头部块(包括CONTINUATION)编码后的大小上限, 解码后的大小由http2.max_header_list_size限制
+static constexpr size_t MAX_HEADER_BLOCK_SIZE = 256 * 1024;
+// 待写出的帧超过该大小时, 发送响应体的协程等待写协程写出
+static constexpr size_t MAX_PENDING_OUTPUT = 256 * 1024;
+static constexpr int64_t MAX_WINDOW_SIZE = 0x7FFFFFFF;
+static constexpr uint32_t DEFAULT_WINDOW_SIZE = 65535;
+
+enum Http2Setting : uint16_t {
+    HEADER_TABLE_SIZE = 0x1,
+    ENABLE_PUSH = 0x2,
+    MAX_CONCURRENT_STREAMS = 0x3,
+    INITIAL_WINDOW_SIZE = 0x4,
+    MAX_FRAME_SIZE_SETTING = 0x5,
+    MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+static uint32_t read_uint32(const char* data) {
+    const auto* p = reinterpret_cast<const uint8_t*>(data);
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void append_uint32(std::string& out, uint32_t value) {
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+static void append_setting(std::string& out, uint16_t id, uint32_t value) {
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    append_uint32(out, value);
+}
+
+Http2Stream::Http2Stream(uint32_t id, int64_t send_window) : m_id(id), m_send_window(send_window) {
+}
+
+Http2Session::Http2Session(Socket::ptr socket, ServletDispatch::ptr dispatch,
+                           const std::string& server_name, std::string buffer)
+    : SocketStream(socket)
+    , m_dispatch(dispatch)
+    , m_server_name(server_name)
+    , m_buffer(buffer.begin(), buffer.end())
+    , m_write_pos(buffer.size())
+    , m_decoder(4096, s_http2_max_header_list_size)
+    , m_recv_window(DEFAULT_WINDOW_SIZE) {
+    m_buffer.resize(std::max(m_buffer.size(), READ_BUFFER_SIZE));
+}
+
+bool Http2Session::is_enabled() {
+    return s_http2_enable;
+}
+
+Http2Session::ptr Http2Session::upgrade(HttpSession::ptr session, HttpRequest::ptr request,
+                                        ServletDispatch::ptr dispatch,
+                                        const std::string& server_name) {
+    // HTTP2-Settings是base64url编码的SETTINGS帧负载
+    std::string settings = base64_decode(request->get_header("HTTP2-Settings"));
+    if (settings.size() % 6 != 0 || !session->recv_body(request)) {
+        LOG_DEBUG(logger) << "invalid h2c upgrade request";
+        return nullptr;
+    }
+    static const std::string s_response =
+        "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    if (session->flush() < 0 ||
+        static_cast<ssize_t>(session->write_fix_size(s_response.data(), s_response.size())) <= 0) {
+        return nullptr;
+    }
+
+    auto h2 = std::make_shared<Http2Session>(session->get_socket(), dispatch, server_name,
+                                             session->take_buffer());
+    // 101响应就是对这些设置的确认, 不需要发送SETTINGS ACK
+    {
+        LockGuard lock(h2->m_mutex);
+        if (h2->apply_settings(settings.data(), settings.size()) != Http2Error::NO_ERROR) {
+            return nullptr;
+        }
+    }
+    // 升级请求成为流1, 客户端已经发送完毕
+    auto stream = std::make_shared<Http2Stream>(1, h2->m_initial_window);
+    request->set_version(0x20);
+    request->set_close(false);
+    stream->m_request = request;
+    stream->m_end_stream = true;
+    h2->m_streams[1] = stream;
+    h2->m_last_stream_id = 1;
+    h2->m_upgraded = true;
+    return h2;
+}
+
+void Http2Session::start() {
+    {
+        // 服务端的连接序言, 同时扩大连接的接收窗口
+        LockGuard lock(m_mutex);
+        std::string settings;
+        append_setting(settings, MAX_CONCURRENT_STREAMS, s_http2_max_concurrent_streams);
+        append_setting(settings, INITIAL_WINDOW_SIZE, s_http2_initial_window_size);
+        append_setting(settings, MAX_HEADER_LIST_SIZE, m_decoder.get_max_header_list_size());
+        append_setting(settings, ENABLE_PUSH, 0);
+        queue_frame(Http2FrameType::SETTINGS, 0, 0, settings.data(), settings.size());
+        if (s_http2_initial_window_size > DEFAULT_WINDOW_SIZE) {
+            queue_window_update(0, s_http2_initial_window_size - DEFAULT_WINDOW_SIZE);
+            m_recv_window = s_http2_initial_window_size;
+        }
+    }
+    if (m_upgraded) {
+        dispatch(m_streams[1]);
+    }
+
+    bool graceful = false;
+    if (fill_buffer(PREFACE.size()) &&
+        memcmp(m_buffer.data() + m_read_pos, PREFACE.data(), PREFACE.size()) == 0) {
+        m_read_pos += PREFACE.size();
+        while (fill_buffer(FRAME_HEADER_SIZE)) {
+            const char* header = m_buffer.data() + m_read_pos;
+            uint32_t length = (static_cast<uint8_t>(header[0]) << 16) |
+                              (static_cast<uint8_t>(header[1]) << 8) |
+                              static_cast<uint8_t>(header[2]);
+            auto type = static_cast<Http2FrameType>(header[3]);
+            uint8_t flags = header[4];
+            uint32_t stream_id = read_uint32(header + 5) & 0x7FFFFFFF;
+            if (length > MAX_FRAME_SIZE) {
+                connection_error(Http2Error::FRAME_SIZE_ERROR);
+                break;
+            }
+            if (!fill_buffer(FRAME_HEADER_SIZE + length)) {
+                break;
+            }
+            const char* payload = m_buffer.data() + m_read_pos + FRAME_HEADER_SIZE;
+            m_read_pos += FRAME_HEADER_SIZE + length;
+
+            // 头部块没有结束时只能收到同一个流的CONTINUATION
+            if (m_header_stream != 0 &&
+                (type != Http2FrameType::CONTINUATION || stream_id != m_header_stream)) {
+                connection_error(Http2Error::PROTOCOL_ERROR);
+                break;
+            }
+            if (type == Http2FrameType::GOAWAY) {
+                graceful = true;
+                break;
+            }
+            if (!handle_frame(type, flags, stream_id, payload, length)) {
+                break;
+            }
+        }
+    }
+
+    LockGuard lock(m_mutex);
+    // 对端发送GOAWAY时等已经接收的请求处理完, 连接出错或者断开时只写出剩余的帧
+    if (graceful && !m_error) {
+        while (m_running > 0 && !m_closed) {
+            m_idle_cond.wait(lock);
+        }
+    }
+    while (m_flushing) {
+        m_idle_cond.wait(lock);
+    }
+    m_closed = true;
+    m_window_cond.notify_all();
+    lock.unlock();
+    close();
+}
+
+bool Http2Session::fill_buffer(size_t length) {
+    if (m_write_pos - m_read_pos >= length) {
+        return true;
+    }
+    // 未处理的数据移到开头
+    if (m_read_pos > 0) {
+        memmove(m_buffer.data(), m_buffer.data() + m_read_pos, m_write_pos - m_read_pos);
+        m_write_pos -= m_read_pos;
+        m_read_pos = 0;
+    }
+    if (m_buffer.size() < length) {
+        m_buffer.resize(length);
+    }
+    while (m_write_pos < length) {
+        ssize_t len = static_cast<ssize_t>(
+            read(m_buffer.data() + m_write_pos, m_buffer.size() - m_write_pos));
+        if (len <= 0) {
+            return false;
+        }
+        m_write_pos += len;
+    }
+    return true;
+}
+
+bool Http2Session::handle_frame(Http2FrameType type, uint8_t flags, uint32_t stream_id,
+                                const char* payload, uint32_t length) {
+    switch (type) {
+        case Http2FrameType::DATA:
+            return handle_data(flags, stream_id, payload, length);
+        case Http2FrameType::HEADERS:
+            return handle_headers(flags, stream_id, payload, length);
+        case Http2FrameType::CONTINUATION:
+            return handle_continuation(flags, stream_id, payload, length);
+        case Http2FrameType::SETTINGS:
+            if (stream_id != 0) {
+                connection_error(Http2Error::PROTOCOL_ERROR);
+                return false;
+            }
+            return handle_settings(flags, payload, length);
+        case Http2FrameType::WINDOW_UPDATE:
+            return handle_window_update(stream_id, payload, length);
+        case Http2FrameType::RST_STREAM: {
+            if (length != 4 || stream_id == 0) {
+                connection_error(length != 4 ? Http2Error::FRAME_SIZE_ERROR
+                                             : Http2Error::PROTOCOL_ERROR);
+                return false;
+            }
+            LockGuard lock(m_mutex);
+            auto it = m_streams.find(stream_id);
+            if (it != m_streams.end()) {
+                it->second->m_reset = true;
+                m_streams.erase(it);
+                m_window_cond.notify_all();
+            }
+            return true;
+        }
+        case Http2FrameType::PING: {
+            if (length != 8 || stream_id != 0) {
+                connection_error(length != 8 ? Http2Error::FRAME_SIZE_ERROR
+                                             : Http2Error::PROTOCOL_ERROR);
+                return false;
+            }
+            if (!(flags & Http2Flag::ACK)) {
+                LockGuard lock(m_mutex);
+                queue_frame(Http2FrameType::PING, Http2Flag::ACK, 0, payload, length);
+            }
+            return true;
+        }
+        case Http2FrameType::PUSH_PROMISE:
+            // 客户端不能推送
+            connection_error(Http2Error::PROTOCOL_ERROR);
+            return false;
+        default:
+            // 不处理优先级, 未知类型的帧忽略
+            return true;
+    }
+}
+
+bool Http2Session::handle_headers(uint8_t flags, uint32_t stream_id, const char* payload,
+                                  uint32_t length) {
+    if (stream_id == 0 || !(stream_id & 1)) {
+        connection_error(Http2Error::PROTOCOL_ERROR);
+        return false;
+    }
+    uint32_t padding = 0;
+    if (flags & Http2Flag::PADDED) {
+        if (length < 1) {
+            connection_error(Http2Error::FRAME_SIZE_ERROR);
+            return false;
+        }
+        padding = static_cast<uint8_t>(payload[0]);
+        ++payload;
+        --length;
+    }
+    if (flags & Http2Flag::PRIORITY) {
+        if (length < 5) {
+            connection_error(Http2Error::FRAME_SIZE_ERROR);
+            return false;
+        }
+        payload += 5;
+        length -= 5;
+    }
+    if (padding > length) {
+        connection_error(Http2Error::PROTOCOL_ERROR);
+        return false;
+    }
+    m_header_block.assign(payload, length - padding);
+    m_header_stream = stream_id;
+    m_header_flags = flags;
+    if (flags & Http2Flag::END_HEADERS) {
+        return handle_header_block();
+    }
+    return true;
+}
+
+bool Http2Session::handle_continuation(uint8_t flags, uint32_t stream_id, const char* payload,
+                                       uint32_t length) {
+    if (m_header_stream == 0) {
+        connection_error(Http2Error::PROTOCOL_ERROR);
+        return false;
+    }
+    if (m_header_block.size() + length > MAX_HEADER_BLOCK_SIZE) {
+        connection_error(Http2Error::ENHANCE_YOUR_CALM);
+        return false;
+    }
+    m_header_block.append(payload, length);
+    if (flags & Http2Flag::END_HEADERS) {
+        return handle_header_block();
+    }
+    return true;
+}
+
+bool Http2Session::handle_header_block() {
+    uint32_t stream_id = m_header_stream;
+    m_header_stream = 0;
+    bool end_stream = m_header_flags & Http2Flag::END_STREAM;
+
+    // 即使流会被拒绝也要解码, 保持与对端一致的动态表
+    std::vector<HPackHeader> headers;
+    if (!m_decoder.decode(m_header_block.data(), m_header_block.size(), headers)) {
+        // 解码中途停止后动态表已经与对端不一致, 只能关闭连接
+        connection_error(m_decoder.is_too_large() ? Http2Error::ENHANCE_YOUR_CALM
+                                                  : Http2Error::COMPRESSION_ERROR);
+        return false;
+    }
+
+    LockGuard lock(m_mutex);
+    auto it = m_streams.find(stream_id);
+    if (it != m_streams.end()) {
+        // 请求体之后的trailer, 必须结束流
+        auto stream = it->second;
+        if (stream->m_end_stream || !end_stream) {
+            queue_rst_stream(stream_id, Http2Error::PROTOCOL_ERROR);
+            stream->m_reset = true;
+            m_streams.erase(it);
+            return true;
+        }
+        stream->m_end_stream = true;
+        lock.unlock();
+        dispatch(stream);
+        return true;
+    }
+    if (stream_id <= m_last_stream_id) {
+        lock.unlock();
+        connection_error(Http2Error::STREAM_CLOSED);
+        return false;
+    }
+    m_last_stream_id = stream_id;
+    if (m_streams.size() >= s_http2_max_concurrent_streams) {
+        queue_rst_stream(stream_id, Http2Error::REFUSED_STREAM);
+        return true;
+    }
+
+    auto stream = std::make_shared<Http2Stream>(stream_id, m_initial_window);
+    if (!build_request(stream, headers)) {
+        queue_rst_stream(stream_id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    m_streams[stream_id] = stream;
+    if (end_stream) {
+        stream->m_end_stream = true;
+        lock.unlock();
+        dispatch(stream);
+    }
+    return true;
+}
+
+bool Http2Session::build_request(Http2Stream::ptr stream, std::vector<HPackHeader>& headers) {
+    HttpRequest::ptr request(new HttpRequest(0x20, false));
+    std::string authority;
+    bool has_method = false;
+    bool has_path = false;
+    for (auto& header : headers) {
+        const std::string& name = header.first;
+        std::string& value = header.second;
+        if (!name.empty() && name[0] == ':') {
+            if (name == ":method") {
+                HttpMethod method = string_to_method(value);
+                if (method == HttpMethod::INVALID_METHOD) {
+                    return false;
+                }
+                request->set_method(method);
+                has_method = true;
+            }
+            else if (name == ":path") {
+                auto pos = value.find('#');
+                if (pos != std::string::npos) {
+                    request->set_fragment(value.substr(pos + 1));
+                    value.resize(pos);
+                }
+                pos = value.find('?');
+                if (pos != std::string::npos) {
+                    request->set_query(value.substr(pos + 1));
+                    value.resize(pos);
+                }
+                request->set_path(value);
+                has_path = !value.empty();
+            }
+            else if (name == ":authority") {
+                authority = value;
+            }
+            else if (name != ":scheme") {
+                return false;
+            }
+            continue;
+        }
+        // 拆开发送的cookie重新拼接
+        if (name == "cookie" && request->has_header("cookie")) {
+            request->set_header(name, request->get_header("cookie") + "; " + value);
+            continue;
+        }
+        request->set_header(name, value);
+    }
+    if (!has_method || !has_path) {
+        return false;
+    }
+    if (!authority.empty() && !request->has_header("host")) {
+        request->set_header("Host", authority);
+    }
+    stream->m_request = request;
+    return true;
+}
+
+bool Http2Session::handle_data(uint8_t flags, uint32_t stream_id, const char* payload,
+                               uint32_t length) {
+    if (stream_id == 0) {
+        connection_error(Http2Error::PROTOCOL_ERROR);
+        return false;
+    }
+    // 连接的流量控制按整个帧计算, 包括填充
+    m_recv_window -= length;
+    if (m_recv_window < 0) {
+        connection_error(Http2Error::FLOW_CONTROL_ERROR);
+        return false;
+    }
+    uint32_t padding = 0;
+    if (flags & Http2Flag::PADDED) {
+        if (length < 1 || static_cast<uint8_t>(payload[0]) >= length) {
+            connection_error(Http2Error::PROTOCOL_ERROR);
+            return false;
+        }
+        padding = static_cast<uint8_t>(payload[0]) + 1;
+    }
+
+    LockGuard lock(m_mutex);
+    // 请求体读入内存后就归还窗口, 请求体的大小由http.request.max_body_size限制
+    m_recv_unacked += length;
+    if (m_recv_unacked >= s_http2_initial_window_size / 2) {
+        queue_window_update(0, m_recv_unacked);
+        m_recv_window += m_recv_unacked;
+        m_recv_unacked = 0;
+    }
+    auto it = m_streams.find(stream_id);
+    if (it == m_streams.end() || it->second->m_end_stream) {
+        queue_rst_stream(stream_id, Http2Error::STREAM_CLOSED);
+        return true;
+    }
+    auto stream = it->second;
+    auto request = stream->m_request;
+    size_t size = length - padding;
+    if (!stream->m_too_large) {
+        if (request->get_body().size() + size > HttpRequestParser::get_http_request_max_body_size()) {
+            stream->m_too_large = true;
+            request->set_body("");
+        }
+        else {
+            request->append_body(payload + (padding ? 1 : 0), size);
+        }
+    }
+    if (flags & Http2Flag::END_STREAM) {
+        stream->m_end_stream = true;
+        lock.unlock();
+        dispatch(stream);
+        return true;
+    }
+    stream->m_recv_unacked += length;
+    if (stream->m_recv_unacked >= s_http2_initial_window_size / 2) {
+        queue_window_update(stream_id, stream->m_recv_unacked);
+        stream->m_recv_unacked = 0;
+    }
+    return true;
+}
+
+bool Http2Session::handle_settings(uint8_t flags, const char* payload, uint32_t length) {
+    if (flags & Http2Flag::ACK) {
+        if (length != 0) {
+            connection_error(Http2Error::FRAME_SIZE_ERROR);
+            return false;
+        }
+        return true;
+    }
+    if (length % 6 != 0) {
+        connection_error(Http2Error::FRAME_SIZE_ERROR);
+        return false;
+    }
+    LockGuard lock(m_mutex);
+    Http2Error error = apply_settings(payload, length);
+    if (error != Http2Error::NO_ERROR) {
+        lock.unlock();
+        connection_error(error);
+        return false;
+    }
+    queue_frame(Http2FrameType::SETTINGS, Http2Flag::ACK, 0, nullptr, 0);
+    return true;
+}
+
+Http2Error Http2Session::apply_settings(const char* payload, uint32_t length) {
+    for (uint32_t i = 0; i + 6 <= length; i += 6) {
+        uint16_t id = (static_cast<uint8_t>(payload[i]) << 8) | static_cast<uint8_t>(payload[i + 1]);
+        uint32_t value = read_uint32(payload + i + 2);
+        switch (id) {
+            case HEADER_TABLE_SIZE:
+                m_encoder.set_max_table_size(value);
+                break;
+            case ENABLE_PUSH:
+                if (value > 1) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                break;
+            case INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW_SIZE) {
+                    return Http2Error::FLOW_CONTROL_ERROR;
+                }
+                // 已经打开的流按差值调整发送窗口
+                int64_t delta = static_cast<int64_t>(value) - m_initial_window;
+                for (auto& item : m_streams) {
+                    item.second->m_send_window += delta;
+                }
+                m_initial_window = value;
+                break;
+            }
+            case MAX_FRAME_SIZE_SETTING:
+                if (value < 16384 || value > 16777215) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                m_max_frame_size = value;
+                break;
+            default:
+                // 服务端不推送, 也不限制并发流和头部列表大小, 未知的设置忽略
+                break;
+        }
+    }
+    m_window_cond.notify_all();
+    return Http2Error::NO_ERROR;
+}
+
+bool Http2Session::handle_window_update(uint32_t stream_id, const char* payload,
+                                        uint32_t length) {
+    if (length != 4) {
+        connection_error(Http2Error::FRAME_SIZE_ERROR);
+        return false;
+    }
+    uint32_t increment = read_uint32(payload) & 0x7FFFFFFF;
+    LockGuard lock(m_mutex);
+    if (stream_id == 0) {
+        m_send_window += increment;
+        if (increment == 0 || m_send_window > MAX_WINDOW_SIZE) {
+            lock.unlock();
+            connection_error(increment == 0 ? Http2Error::PROTOCOL_ERROR
+                                            : Http2Error::FLOW_CONTROL_ERROR);
+            return false;
+        }
+    }
+    else {
+        auto it = m_streams.find(stream_id);
+        if (it == m_streams.end()) {
+            return true;
+        }
+        auto stream = it->second;
+        stream->m_send_window += increment;
+        if (increment == 0 || stream->m_send_window > MAX_WINDOW_SIZE) {
+            queue_rst_stream(stream_id, increment == 0 ? Http2Error::PROTOCOL_ERROR
+                                                       : Http2Error::FLOW_CONTROL_ERROR);
+            stream->m_reset = true;
+            m_streams.erase(it);
+        }
+    }
+    m_window_cond.notify_all();
+    return true;
+}
+
+void Http2Session::dispatch(Http2Stream::ptr stream) {
+    {
+        LockGuard lock(m_mutex);
+        ++m_running;
+    }
+    auto self = shared_from_this();
+    IOManager::get_this()->schedule([self, stream]() { self->handle_stream(stream); });
+}
+
+void Http2Session::handle_stream(Http2Stream::ptr stream) {
+    auto request = stream->m_request;
+    HttpResponse::ptr response(new HttpResponse(0x20, false));
+    response->set_header("Server", m_server_name);
+    if (stream->m_too_large) {
+        response->set_status(HttpStatus::PAYLOAD_TOO_LARGE);
+    }
+    else {
+        Servlet::ptr servlet = m_dispatch->get_matched_servlet(request);
+        // 按流读写请求体和websocket依赖HTTP/1.1的连接
+        if (servlet->is_stream_body() || servlet->is_websocket()) {
+            response->set_status(HttpStatus::HTTP_VERSION_NOT_SUPPORTED);
+        }
+        else {
+            servlet->handle(request, response, nullptr);
+            compress_response(request, response);
+        }
+    }
+    send_response(stream, response);
+
+    LockGuard lock(m_mutex);
+    auto it = m_streams.find(stream->m_id);
+    if (it != m_streams.end() && it->second == stream) {
+        m_streams.erase(it);
+    }
+    if (--m_running == 0) {
+        m_idle_cond.notify_all();
+    }
+}
+
+void Http2Session::send_response(Http2Stream::ptr stream, HttpResponse::ptr response) {
+    uint32_t status = static_cast<uint32_t>(response->get_status());
+    std::vector<HPackHeader> headers;
+    headers.emplace_back(":status", std::to_string(status));
+    bool has_length = false;
+    for (auto& header : response->get_headers()) {
+        std::string name = header.first;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        // 连接相关的头部在HTTP/2中是非法的
+        if (name == "connection" || name == "keep-alive" || name == "transfer-encoding" ||
+            name == "upgrade" || name == "proxy-connection") {
+            continue;
+        }
+        has_length = has_length || name == "content-length";
+        headers.emplace_back(std::move(name), header.second);
+    }
+    const std::string& body = response->get_body();
+    bool file = response->has_file_body();
+    uint64_t body_length = file ? response->get_file_length() : body.size();
+    if (!has_length && status >= 200 && status != 204 && status != 304) {
+        headers.emplace_back("content-length", std::to_string(body_length));
+    }
+    if (stream->m_request->get_method() == HttpMethod::HEAD) {
+        body_length = 0;
+    }
+
+    LockGuard lock(m_mutex);
+    if (m_closed || stream->m_reset) {
+        return;
+    }
+    // 编码和入队在同一个锁内, 保证头部块的发送顺序与编码顺序一致
+    std::string block;
+    m_encoder.encode(headers, block);
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t length = std::min<size_t>(block.size() - offset, m_max_frame_size);
+        uint8_t flags = offset + length == block.size() ? Http2Flag::END_HEADERS : 0;
+        if (first && body_length == 0) {
+            flags |= Http2Flag::END_STREAM;
+        }
+        queue_frame(first ? Http2FrameType::HEADERS : Http2FrameType::CONTINUATION, flags,
+                    stream->m_id, block.data() + offset, length);
+        offset += length;
+        first = false;
+    } while (offset < block.size());
+
+    std::string chunk;
+    uint64_t sent = 0;
+    while (sent < body_length) {
+        while (!m_closed && !stream->m_reset &&
+               (m_send_window <= 0 || stream->m_send_window <= 0 ||
+                m_output.size() > MAX_PENDING_OUTPUT)) {
+            m_window_cond.wait(lock);
+        }
+        if (m_closed || stream->m_reset) {
+            return;
+        }
+        size_t length = std::min<uint64_t>(
+            {body_length - sent, static_cast<uint64_t>(m_max_frame_size),
+             static_cast<uint64_t>(m_send_window), static_cast<uint64_t>(stream->m_send_window)});
+        const char* data = body.data() + sent;
+        if (file) {
+            chunk.resize(length);
+            ssize_t len = pread(response->get_file_fd(), chunk.data(), length,
+                                response->get_file_offset() + sent);
+            if (len != static_cast<ssize_t>(length)) {
+                LOG_DEBUG(logger) << "read file body fail, errno = " << errno;
+                queue_rst_stream(stream->m_id, Http2Error::INTERNAL_ERROR);
+                return;
+            }
+            data = chunk.data();
+        }
+        sent += length;
+        queue_frame(Http2FrameType::DATA, sent == body_length ? Http2Flag::END_STREAM : 0,
+                    stream->m_id, data, length);
+        m_send_window -= length;
+        stream->m_send_window -= length;
+    }
+}
+
+void Http2Session::queue_frame(Http2FrameType type, uint8_t flags, uint32_t stream_id,
+                               const char* payload, size_t length) {
+    char header[FRAME_HEADER_SIZE] = {
+        static_cast<char>(length >> 16), static_cast<char>(length >> 8),
+        static_cast<char>(length),       static_cast<char>(type),
+        static_cast<char>(flags),        static_cast<char>((stream_id >> 24) & 0x7F),
+        static_cast<char>(stream_id >> 16), static_cast<char>(stream_id >> 8),
+        static_cast<char>(stream_id)};
+    m_output.append(header, FRAME_HEADER_SIZE);
+    if (length > 0) {
+        m_output.append(payload, length);
+    }
+    // 写协程排在当前已经就绪的协程之后, 同一轮中各个流产生的帧一起写出
+    if (!m_flushing && !m_closed) {
+        m_flushing = true;
+        auto self = shared_from_this();
+        IOManager::get_this()->schedule([self]() { self->flush_output(); });
+    }
+}
+
+void Http2Session::queue_rst_stream(uint32_t stream_id, Http2Error error) {
+    std::string payload;
+    append_uint32(payload, static_cast<uint32_t>(error));
+    queue_frame(Http2FrameType::RST_STREAM, 0, stream_id, payload.data(), payload.size());
+}
+
+void Http2Session::queue_window_update(uint32_t stream_id, uint32_t increment) {
+    std::string payload;
+    append_uint32(payload, increment);
+    queue_frame(Http2FrameType::WINDOW_UPDATE, 0, stream_id, payload.data(), payload.size());
+}
+
+void Http2Session::connection_error(Http2Error error) {
+    LOG_DEBUG(logger) << "http2 connection error: " << static_cast<uint32_t>(error);
+    LockGuard lock(m_mutex);
+    std::string payload;
+    append_uint32(payload, m_last_stream_id);
+    append_uint32(payload, static_cast<uint32_t>(error));
+    queue_frame(Http2FrameType::GOAWAY, 0, 0, payload.data(), payload.size());
+    m_error = true;
+}
+
+void Http2Session::flush_output() {
+    LockGuard lock(m_mutex);
+    while (!m_output.empty() && !m_closed) {
+        m_writing.swap(m_output);
+        lock.unlock();
+        ssize_t len = static_cast<ssize_t>(write_fix_size(m_writing.data(), m_writing.size()));
+        lock.lock();
+        m_writing.clear();
+        if (len <= 0) {
+            m_closed = true;
+        }
+        m_window_cond.notify_all();
+    }
+    m_output.clear();
+    m_flushing = false;
+    m_idle_cond.notify_all();
+}
+
+}  // namespace acid::http
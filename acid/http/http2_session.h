@@ -0,0 +1,222 @@
+/*!
+ * @file http2_session.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief HTTP/2服务端会话(h2c)
+ * @version 0.1
+ * @date 2023-08-18
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_HTTP2_SESSION_H
+#define DF_HTTP2_SESSION_H
+
+#include "acid/common/co_mutex.h"
+#include "acid/net/socket_stream.h"
+#include "hpack.h"
+#include "http.h"
+#include "http_session.h"
+#include "servlet.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace acid::http {
+
+enum class Http2FrameType : uint8_t {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9,
+};
+
+enum class Http2Error : uint32_t {
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    SETTINGS_TIMEOUT = 0x4,
+    STREAM_CLOSED = 0x5,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    CANCEL = 0x8,
+    COMPRESSION_ERROR = 0x9,
+    CONNECT_ERROR = 0xa,
+    ENHANCE_YOUR_CALM = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED = 0xd,
+};
+
+/**
+ * @brief 帧标志位
+ */
+struct Http2Flag {
+    static constexpr uint8_t END_STREAM = 0x1;
+    static constexpr uint8_t ACK = 0x1;
+    static constexpr uint8_t END_HEADERS = 0x4;
+    static constexpr uint8_t PADDED = 0x8;
+    static constexpr uint8_t PRIORITY = 0x20;
+};
+
+/**
+ * @brief 客户端发起的一个流
+ */
+class Http2Stream {
+public:
+    using ptr = std::shared_ptr<Http2Stream>;
+
+    Http2Stream(uint32_t id, int64_t send_window);
+
+    uint32_t get_id() const {
+        return m_id;
+    }
+
+    HttpRequest::ptr get_request() const {
+        return m_request;
+    }
+
+private:
+    friend class Http2Session;
+
+    uint32_t m_id;
+    HttpRequest::ptr m_request;
+    int64_t m_send_window;        // 还可以发送的响应体长度
+    uint32_t m_recv_unacked = 0;  // 收到的请求体中还没有通过WINDOW_UPDATE归还的长度
+    bool m_end_stream = false;    // 请求已经接收完
+    bool m_too_large = false;     // 请求体超过限制, 丢弃之后的数据
+    bool m_reset = false;         // 流已经被重置
+};
+
+/**
+ * @brief 服务端的HTTP/2连接
+ * 当前协程读取和分发帧, 每个请求接收完后在单独的协程中交给ServletDispatch处理。
+ * 所有帧都追加到同一个输出缓冲区, 由一个写协程合并写出, 同一轮调度中多个流的响应只需要一次写入。
+ * 发送的响应体受流和连接两级流量控制, 窗口用完时处理流的协程等待WINDOW_UPDATE
+ */
+class Http2Session : public SocketStream, public std::enable_shared_from_this<Http2Session> {
+public:
+    using ptr = std::shared_ptr<Http2Session>;
+    using MutexType = CoMutex;
+    using LockGuard = MutexType::Lock;
+
+    // 客户端连接序言
+    static const std::string PREFACE;
+
+    /**
+     * @param buffer 已经读入的数据, 以客户端连接序言开始
+     */
+    Http2Session(Socket::ptr socket, ServletDispatch::ptr dispatch, const std::string& server_name,
+                 std::string buffer = "");
+
+    /**
+     * @brief 处理h2c升级请求, 发送101响应, 请求作为流1处理
+     * @param session 收到升级请求的http会话, 之后不能再使用
+     * @return 请求中的HTTP2-Settings不合法时返回nullptr
+     */
+    static Http2Session::ptr upgrade(HttpSession::ptr session, HttpRequest::ptr request,
+                                     ServletDispatch::ptr dispatch,
+                                     const std::string& server_name);
+
+    /**
+     * @brief 是否接受HTTP/2连接, 由http2.enable配置
+     */
+    static bool is_enabled();
+
+    /**
+     * @brief 在当前协程中处理连接, 直到连接关闭
+     */
+    void start();
+
+private:
+    // 确保缓冲区中至少有length字节未处理的数据
+    bool fill_buffer(size_t length);
+
+    // 处理一个帧, 连接错误时返回false
+    bool handle_frame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const char* payload,
+                      uint32_t length);
+
+    bool handle_headers(uint8_t flags, uint32_t stream_id, const char* payload, uint32_t length);
+
+    bool handle_continuation(uint8_t flags, uint32_t stream_id, const char* payload,
+                             uint32_t length);
+
+    // 头部块接收完整后解码
+    bool handle_header_block();
+
+    bool handle_data(uint8_t flags, uint32_t stream_id, const char* payload, uint32_t length);
+
+    bool handle_settings(uint8_t flags, const char* payload, uint32_t length);
+
+    // 应用对端的设置, 需要持有m_mutex
+    Http2Error apply_settings(const char* payload, uint32_t length);
+
+    bool handle_window_update(uint32_t stream_id, const char* payload, uint32_t length);
+
+    // 按HPACK解码的头部构造请求
+    bool build_request(Http2Stream::ptr stream, std::vector<HPackHeader>& headers);
+
+    // 请求接收完, 调度到新的协程处理
+    void dispatch(Http2Stream::ptr stream);
+
+    // 在流的协程中执行servlet并发送响应
+    void handle_stream(Http2Stream::ptr stream);
+
+    void send_response(Http2Stream::ptr stream, HttpResponse::ptr response);
+
+    // 以下函数需要持有m_mutex
+    void queue_frame(Http2FrameType type, uint8_t flags, uint32_t stream_id, const char* payload,
+                     size_t length);
+
+    void queue_rst_stream(uint32_t stream_id, Http2Error error);
+
+    void queue_window_update(uint32_t stream_id, uint32_t increment);
+
+    // 发送GOAWAY后写出剩余的帧
+    void connection_error(Http2Error error);
+
+    // 写协程, 把输出缓冲区中的帧合并写出
+    void flush_output();
+
+private:
+    ServletDispatch::ptr m_dispatch;
+    std::string m_server_name;
+
+    // 读协程独占
+    std::vector<char> m_buffer;
+    size_t m_read_pos = 0;
+    size_t m_write_pos = 0;
+    HPackDecoder m_decoder;
+    std::string m_header_block;      // 正在接收的头部块
+    uint32_t m_header_stream = 0;    // 头部块所属的流, 为0时没有未结束的头部块
+    uint8_t m_header_flags = 0;      // 头部块第一个帧的标志
+    uint32_t m_last_stream_id = 0;   // 客户端创建过的最大流id
+    int64_t m_recv_window;           // 连接的接收窗口
+    uint32_t m_recv_unacked = 0;     // 连接上还没有归还的接收窗口
+    bool m_upgraded = false;         // 通过h2c升级建立, 流1已经存在
+
+    // 以下由m_mutex保护
+    MutexType m_mutex;
+    CoCond m_window_cond;            // 等待发送窗口
+    CoCond m_idle_cond;              // 等待全部流处理完
+    std::unordered_map<uint32_t, Http2Stream::ptr> m_streams;
+    size_t m_running = 0;            // 正在执行servlet的流数
+    HPackEncoder m_encoder;
+    std::string m_output;            // 待写出的帧
+    std::string m_writing;           // 正在写出的帧, 与m_output交换以复用内存
+    bool m_flushing = false;         // 写协程已经调度
+    bool m_closed = false;           // 连接已经关闭或者写出错
+    bool m_error = false;            // 因为连接错误发送了GOAWAY
+    int64_t m_send_window = 65535;   // 连接的发送窗口
+    int64_t m_initial_window = 65535;  // 对端的SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t m_max_frame_size = 16384;  // 对端的SETTINGS_MAX_FRAME_SIZE
+};
+
+}  // namespace acid::http
+
+#endif  // DF_HTTP2_SESSION_H
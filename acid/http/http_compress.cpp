@@ -0,0 +1,546 @@
+#include "http_compress.h"
+
+#include "acid/common/config.h"
+#include "acid/logger/logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <zlib.h>
+
+#if ACID_ENABLE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#if ACID_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace acid::http {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<bool>::ptr g_http_compress_enable =
+    Config::look_up<bool>("http.compress.enable", true, "http server compress response body");
+static ConfigVar<uint32_t>::ptr g_http_compress_min_size = Config::look_up<uint32_t>(
+    "http.compress.min_size", 1024, "http response body smaller than this is not compressed");
+static ConfigVar<std::map<std::string, int>>::ptr g_http_compress_levels =
+    Config::look_up<std::map<std::string, int>>("http.compress.levels",
+                                                {{"gzip", 6}, {"br", 5}, {"zstd", 3}},
+                                                "http compress level of each encoding");
+
+static bool s_http_compress_enable = true;
+static uint32_t s_http_compress_min_size = 0;
+// 压缩器创建或者重置时读取, 按编码索引
+static std::atomic<int> s_http_compress_levels[CONTENT_ENCODING_COUNT];
+
+static void set_compress_levels(const std::map<std::string, int>& levels) {
+    for (size_t i = 1; i < CONTENT_ENCODING_COUNT; ++i) {
+        auto it = levels.find(content_encoding_to_string(static_cast<ContentEncoding>(i)));
+        if (it != levels.end()) {
+            s_http_compress_levels[i] = it->second;
+        }
+    }
+}
+
+struct _HttpCompressIniter {
+    _HttpCompressIniter() {
+        s_http_compress_enable = g_http_compress_enable->get_value();
+        g_http_compress_enable->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "http compress enable change from " << old_val << " to "
+                             << new_val;
+            s_http_compress_enable = new_val;
+        });
+
+        s_http_compress_min_size = g_http_compress_min_size->get_value();
+        g_http_compress_min_size->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http compress min size change from " << old_val << " to "
+                                 << new_val;
+                s_http_compress_min_size = new_val;
+            });
+
+        s_http_compress_levels[static_cast<size_t>(ContentEncoding::GZIP)] = 6;
+        s_http_compress_levels[static_cast<size_t>(ContentEncoding::BROTLI)] = 5;
+        s_http_compress_levels[static_cast<size_t>(ContentEncoding::ZSTD)] = 3;
+        set_compress_levels(g_http_compress_levels->get_value());
+        g_http_compress_levels->add_listener([](const std::map<std::string, int>& old_val,
+                                                const std::map<std::string, int>& new_val) {
+            LOG_INFO(logger) << "http compress levels changed";
+            set_compress_levels(new_val);
+        });
+    }
+};
+
+static _HttpCompressIniter _http_compress_initer;
+
+// 每个线程每种编码最多缓存的压缩器数量
+static constexpr size_t MAX_POOLED_COMPRESSORS = 32;
+
+static int get_level(ContentEncoding encoding) {
+    return s_http_compress_levels[static_cast<size_t>(encoding)];
+}
+
+static uint64_t get_thread_cpu_ns() {
+    timespec ts {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+const char* content_encoding_to_string(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+            return "gzip";
+        case ContentEncoding::BROTLI:
+            return "br";
+        case ContentEncoding::ZSTD:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
+
+static bool is_encoding_available(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+            return true;
+#if ACID_ENABLE_BROTLI
+        case ContentEncoding::BROTLI:
+            return true;
+#endif
+#if ACID_ENABLE_ZSTD
+        case ContentEncoding::ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+static std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+ContentEncoding negotiate_content_encoding(const std::string& accept_encoding) {
+    // 下标为ContentEncoding, 负数表示没有出现
+    double q[CONTENT_ENCODING_COUNT] = {-1, -1, -1, -1};
+    double wildcard = -1;
+    size_t begin = 0;
+    while (begin < accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', begin);
+        if (end == std::string::npos) {
+            end = accept_encoding.size();
+        }
+        std::string token = accept_encoding.substr(begin, end - begin);
+        begin = end + 1;
+
+        size_t semicolon = token.find(';');
+        std::string name = trim(token.substr(0, semicolon));
+        double value = 1;
+        if (semicolon != std::string::npos) {
+            std::string param = trim(token.substr(semicolon + 1));
+            if (param.compare(0, 2, "q=") == 0) {
+                value = atof(param.c_str() + 2);
+            }
+        }
+        if (name == "*") {
+            wildcard = value;
+            continue;
+        }
+        for (size_t i = 1; i < CONTENT_ENCODING_COUNT; ++i) {
+            if (strcasecmp(name.c_str(), content_encoding_to_string(static_cast<ContentEncoding>(i))) ==
+                0) {
+                q[i] = value;
+            }
+        }
+    }
+
+    static const ContentEncoding s_preference[] = {ContentEncoding::BROTLI, ContentEncoding::ZSTD,
+                                                   ContentEncoding::GZIP};
+    ContentEncoding best = ContentEncoding::IDENTITY;
+    double best_q = 0;
+    for (auto encoding : s_preference) {
+        double value = q[static_cast<size_t>(encoding)];
+        if (value < 0) {
+            value = wildcard;
+        }
+        if (value > best_q && is_encoding_available(encoding)) {
+            best = encoding;
+            best_q = value;
+        }
+    }
+    return best;
+}
+
+namespace {
+
+class GzipCompressor : public HttpCompressor {
+public:
+    GzipCompressor() : HttpCompressor(ContentEncoding::GZIP) {
+        memset(&m_stream, 0, sizeof(m_stream));
+        m_level = get_level(ContentEncoding::GZIP);
+        // windowBits加16输出gzip格式
+        m_ok = deflateInit2(&m_stream, m_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) ==
+               Z_OK;
+    }
+
+    ~GzipCompressor() override {
+        if (m_ok) {
+            deflateEnd(&m_stream);
+        }
+    }
+
+protected:
+    bool do_compress(const char* data, size_t length, std::string& out, Operation op) override {
+        if (!m_ok) {
+            return false;
+        }
+        int flush = op == FINISH ? Z_FINISH : (op == FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = static_cast<uInt>(length);
+        while (true) {
+            size_t pos = out.size();
+            size_t avail = std::max<size_t>(deflateBound(&m_stream, m_stream.avail_in), 64);
+            out.resize(pos + avail);
+            m_stream.next_out = reinterpret_cast<Bytef*>(out.data() + pos);
+            m_stream.avail_out = static_cast<uInt>(avail);
+            int ret = deflate(&m_stream, flush);
+            out.resize(pos + avail - m_stream.avail_out);
+            if (ret == Z_STREAM_ERROR) {
+                return false;
+            }
+            if (op == FINISH ? ret == Z_STREAM_END
+                             : m_stream.avail_in == 0 && m_stream.avail_out != 0) {
+                return true;
+            }
+        }
+    }
+
+    void reset() override {
+        if (!m_ok) {
+            return;
+        }
+        int level = get_level(ContentEncoding::GZIP);
+        if (level != m_level) {
+            m_level = level;
+            deflateParams(&m_stream, m_level, Z_DEFAULT_STRATEGY);
+        }
+        deflateReset(&m_stream);
+    }
+
+private:
+    z_stream m_stream;
+    int m_level;
+    bool m_ok;
+};
+
+#if ACID_ENABLE_BROTLI
+// brotli没有重置接口, 只能在每个压缩流开始时重新创建状态
+class BrotliCompressor : public HttpCompressor {
+public:
+    BrotliCompressor() : HttpCompressor(ContentEncoding::BROTLI) {
+    }
+
+    ~BrotliCompressor() override {
+        reset();
+    }
+
+protected:
+    bool do_compress(const char* data, size_t length, std::string& out, Operation op) override {
+        if (!m_state) {
+            m_state = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+            if (!m_state) {
+                return false;
+            }
+            BrotliEncoderSetParameter(m_state, BROTLI_PARAM_QUALITY,
+                                      get_level(ContentEncoding::BROTLI));
+            // 整个响应体一次压缩时按长度选择窗口, 小响应体不需要分配大窗口
+            if (op == FINISH) {
+                BrotliEncoderSetParameter(m_state, BROTLI_PARAM_SIZE_HINT,
+                                          static_cast<uint32_t>(length));
+            }
+        }
+        BrotliEncoderOperation operation =
+            op == FINISH ? BROTLI_OPERATION_FINISH
+                         : (op == FLUSH ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_PROCESS);
+        size_t avail_in = length;
+        auto next_in = reinterpret_cast<const uint8_t*>(data);
+        while (true) {
+            size_t pos = out.size();
+            size_t avail = std::max<size_t>(BrotliEncoderMaxCompressedSize(avail_in), 1024);
+            out.resize(pos + avail);
+            auto next_out = reinterpret_cast<uint8_t*>(out.data() + pos);
+            size_t avail_out = avail;
+            bool ok = BrotliEncoderCompressStream(m_state, operation, &avail_in, &next_in,
+                                                  &avail_out, &next_out, nullptr);
+            out.resize(pos + avail - avail_out);
+            if (!ok) {
+                return false;
+            }
+            if (op == FINISH ? BrotliEncoderIsFinished(m_state)
+                             : avail_in == 0 && !BrotliEncoderHasMoreOutput(m_state)) {
+                return true;
+            }
+        }
+    }
+
+    void reset() override {
+        if (m_state) {
+            BrotliEncoderDestroyInstance(m_state);
+            m_state = nullptr;
+        }
+    }
+
+private:
+    BrotliEncoderState* m_state = nullptr;
+};
+#endif
+
+#if ACID_ENABLE_ZSTD
+class ZstdCompressor : public HttpCompressor {
+public:
+    ZstdCompressor() : HttpCompressor(ContentEncoding::ZSTD), m_ctx(ZSTD_createCCtx()) {
+        if (m_ctx) {
+            ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_compressionLevel,
+                                   get_level(ContentEncoding::ZSTD));
+        }
+    }
+
+    ~ZstdCompressor() override {
+        ZSTD_freeCCtx(m_ctx);
+    }
+
+protected:
+    bool do_compress(const char* data, size_t length, std::string& out, Operation op) override {
+        if (!m_ctx) {
+            return false;
+        }
+        // 整个响应体一次压缩时把长度写入帧头
+        if (m_first && op == FINISH) {
+            ZSTD_CCtx_setPledgedSrcSize(m_ctx, length);
+        }
+        m_first = false;
+        ZSTD_EndDirective directive =
+            op == FINISH ? ZSTD_e_end : (op == FLUSH ? ZSTD_e_flush : ZSTD_e_continue);
+        ZSTD_inBuffer input {data, length, 0};
+        while (true) {
+            size_t pos = out.size();
+            size_t avail = std::max<size_t>(ZSTD_compressBound(length - input.pos), 64);
+            out.resize(pos + avail);
+            ZSTD_outBuffer output {out.data() + pos, avail, 0};
+            size_t remaining = ZSTD_compressStream2(m_ctx, &output, &input, directive);
+            out.resize(pos + output.pos);
+            if (ZSTD_isError(remaining)) {
+                return false;
+            }
+            if (op == PROCESS ? input.pos == input.size : remaining == 0) {
+                return true;
+            }
+        }
+    }
+
+    void reset() override {
+        ZSTD_CCtx_reset(m_ctx, ZSTD_reset_session_only);
+        ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_compressionLevel, get_level(ContentEncoding::ZSTD));
+        m_first = true;
+    }
+
+private:
+    ZSTD_CCtx* m_ctx;
+    bool m_first = true;
+};
+#endif
+
+struct CompressStats {
+    std::atomic<uint64_t> responses {0};
+    std::atomic<uint64_t> input_bytes {0};
+    std::atomic<uint64_t> output_bytes {0};
+    std::atomic<uint64_t> cpu_ns {0};
+};
+
+CompressStats s_compress_stats[CONTENT_ENCODING_COUNT];
+
+// 当前线程空闲的压缩器, 按编码索引
+thread_local std::vector<std::unique_ptr<HttpCompressor>> t_compressor_pool[CONTENT_ENCODING_COUNT];
+
+}  // namespace
+
+void HttpCompressor::Releaser::operator()(HttpCompressor* compressor) const {
+    auto& pool = t_compressor_pool[static_cast<size_t>(compressor->get_encoding())];
+    // 出错的压缩器内部状态不确定, 不再复用
+    if (compressor->m_failed || pool.size() >= MAX_POOLED_COMPRESSORS) {
+        delete compressor;
+        return;
+    }
+    compressor->reset();
+    pool.emplace_back(compressor);
+}
+
+HttpCompressor::ptr HttpCompressor::acquire(ContentEncoding encoding) {
+    if (!is_encoding_available(encoding)) {
+        return nullptr;
+    }
+    auto& pool = t_compressor_pool[static_cast<size_t>(encoding)];
+    if (!pool.empty()) {
+        ptr compressor(pool.back().release());
+        pool.pop_back();
+        return compressor;
+    }
+    switch (encoding) {
+        case ContentEncoding::GZIP:
+            return ptr(new GzipCompressor);
+#if ACID_ENABLE_BROTLI
+        case ContentEncoding::BROTLI:
+            return ptr(new BrotliCompressor);
+#endif
+#if ACID_ENABLE_ZSTD
+        case ContentEncoding::ZSTD:
+            return ptr(new ZstdCompressor);
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+HttpCompressStats HttpCompressor::get_stats(ContentEncoding encoding) {
+    auto& stats = s_compress_stats[static_cast<size_t>(encoding)];
+    HttpCompressStats result;
+    result.responses = stats.responses.load(std::memory_order_relaxed);
+    result.input_bytes = stats.input_bytes.load(std::memory_order_relaxed);
+    result.output_bytes = stats.output_bytes.load(std::memory_order_relaxed);
+    result.cpu_us = stats.cpu_ns.load(std::memory_order_relaxed) / 1000;
+    return result;
+}
+
+bool HttpCompressor::compress(const void* data, size_t length, std::string& out, Operation op) {
+    if (m_failed) {
+        return false;
+    }
+    size_t old_size = out.size();
+    uint64_t start = get_thread_cpu_ns();
+    if (!do_compress(static_cast<const char*>(data), length, out, op)) {
+        m_failed = true;
+        out.resize(old_size);
+        return false;
+    }
+    auto& stats = s_compress_stats[static_cast<size_t>(m_encoding)];
+    stats.cpu_ns.fetch_add(get_thread_cpu_ns() - start, std::memory_order_relaxed);
+    stats.input_bytes.fetch_add(length, std::memory_order_relaxed);
+    stats.output_bytes.fetch_add(out.size() - old_size, std::memory_order_relaxed);
+    if (op == FINISH) {
+        stats.responses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+static bool is_compressible_type(const std::string& content_type) {
+    std::string type = trim(content_type.substr(0, content_type.find(';')));
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type.compare(0, 5, "text/") == 0) {
+        return true;
+    }
+    static const char* s_types[] = {"application/json", "application/javascript",
+                                    "application/x-javascript", "application/xml",
+                                    "image/svg+xml"};
+    for (auto t : s_types) {
+        if (type == t) {
+            return true;
+        }
+    }
+    // application/problem+json之类的结构化类型
+    return type.size() > 5 && (type.compare(type.size() - 5, 5, "+json") == 0 ||
+                               type.compare(type.size() - 4, 4, "+xml") == 0);
+}
+
+// 响应是否可以压缩, 不检查响应体长度
+static bool is_compressible(HttpResponse::ptr response) {
+    if (!s_http_compress_enable) {
+        return false;
+    }
+    auto status = static_cast<uint32_t>(response->get_status());
+    if (status < 200 || status == 204 || status == 206 || status == 304) {
+        return false;
+    }
+    if (response->has_file_body() || response->is_websocket() ||
+        response->has_header("Content-Encoding") || response->has_header("Content-Range")) {
+        return false;
+    }
+    return is_compressible_type(response->get_header("Content-Type"));
+}
+
+// 响应的内容取决于Accept-Encoding, 缓存需要区分
+static void add_vary(HttpResponse::ptr response) {
+    std::string vary = response->get_header("Vary");
+    if (vary.empty()) {
+        response->set_header("Vary", "Accept-Encoding");
+        return;
+    }
+    std::string lower = vary;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower.find("accept-encoding") == std::string::npos && lower != "*") {
+        response->set_header("Vary", vary + ", Accept-Encoding");
+    }
+}
+
+static void set_encoded_headers(HttpResponse::ptr response, ContentEncoding encoding) {
+    response->set_header("Content-Encoding", content_encoding_to_string(encoding));
+    response->del_header("Content-Length");
+    response->del_header("Accept-Ranges");
+    // 压缩后的字节与原来不同, 强校验的ETag不再成立
+    std::string etag = response->get_header("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        response->set_header("ETag", "W/" + etag);
+    }
+}
+
+bool compress_response(HttpRequest::ptr request, HttpResponse::ptr response) {
+    if (response->get_body().size() < std::max<uint32_t>(s_http_compress_min_size, 1) ||
+        !is_compressible(response)) {
+        return false;
+    }
+    add_vary(response);
+    ContentEncoding encoding = negotiate_content_encoding(request->get_header("Accept-Encoding"));
+    auto compressor = HttpCompressor::acquire(encoding);
+    if (!compressor) {
+        return false;
+    }
+    // 压缩结果与原来的响应体交换, 原响应体的内存留给本线程下一次压缩使用
+    static thread_local std::string t_output;
+    t_output.clear();
+    const std::string& body = response->get_body();
+    if (!compressor->compress(body.data(), body.size(), t_output, HttpCompressor::FINISH)) {
+        LOG_WARN(logger) << "compress response body fail, encoding: "
+                         << content_encoding_to_string(encoding);
+        return false;
+    }
+    // 压缩之后没有变小的数据(例如已经压缩过的内容)按原样发送
+    if (t_output.size() >= body.size()) {
+        return false;
+    }
+    set_encoded_headers(response, encoding);
+    response->swap_body(t_output);
+    return true;
+}
+
+HttpCompressor::ptr create_stream_compressor(HttpRequest::ptr request,
+                                             HttpResponse::ptr response) {
+    if (!request || !is_compressible(response)) {
+        return nullptr;
+    }
+    add_vary(response);
+    auto compressor =
+        HttpCompressor::acquire(negotiate_content_encoding(request->get_header("Accept-Encoding")));
+    if (compressor) {
+        set_encoded_headers(response, compressor->get_encoding());
+    }
+    return compressor;
+}
+
+}  // namespace acid::http
@@ -0,0 +1,138 @@
+/*!
+ * @file http_compress.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief 响应体压缩(gzip, brotli, zstd)
+ * @version 0.1
+ * @date 2023-08-20
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_HTTP_COMPRESS_H
+#define DF_HTTP_COMPRESS_H
+
+#include "http.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace acid::http {
+
+/**
+ * @brief 响应体的内容编码, brotli和zstd只有编译时找到对应的库才可用
+ */
+enum class ContentEncoding : uint8_t {
+    IDENTITY = 0,
+    GZIP,
+    BROTLI,
+    ZSTD,
+};
+
+static constexpr size_t CONTENT_ENCODING_COUNT = 4;
+
+const char* content_encoding_to_string(ContentEncoding encoding);
+
+/**
+ * @brief 按Accept-Encoding选择编码, q值相同时依次优先br, zstd, gzip
+ * @return 没有可用的编码时返回IDENTITY
+ */
+ContentEncoding negotiate_content_encoding(const std::string& accept_encoding);
+
+/**
+ * @brief 一种编码的累计统计
+ */
+struct HttpCompressStats {
+    uint64_t responses = 0;     // 压缩完成的响应数
+    uint64_t input_bytes = 0;   // 压缩前的字节数
+    uint64_t output_bytes = 0;  // 压缩后的字节数
+    uint64_t cpu_us = 0;        // 压缩消耗的线程CPU时间
+
+    /**
+     * @brief 压缩后与压缩前的长度比
+     */
+    double get_ratio() const {
+        return input_bytes == 0 ? 1.0 : static_cast<double>(output_bytes) / input_bytes;
+    }
+};
+
+/**
+ * @brief 流式压缩器
+ * 压缩器的上下文(zlib和zstd的内部状态有几百KB)按线程和编码缓存, 结束一个响应后重置并放回当前线程的池中,
+ * 下一个响应直接复用, 不需要重新分配和初始化
+ */
+class HttpCompressor {
+public:
+    /**
+     * @brief 析构时放回当前线程的池中
+     */
+    struct Releaser {
+        void operator()(HttpCompressor* compressor) const;
+    };
+
+    using ptr = std::unique_ptr<HttpCompressor, Releaser>;
+
+    enum Operation {
+        PROCESS,  // 压缩器可以缓存数据, 不一定有输出
+        FLUSH,    // 输出目前为止所有输入对应的数据, 对端收到后可以立即解压
+        FINISH,   // 结束压缩流
+    };
+
+    /**
+     * @brief 从当前线程的池中取出一个压缩器, 没有时新建
+     * @return 编码不可用返回nullptr
+     */
+    static ptr acquire(ContentEncoding encoding);
+
+    /**
+     * @brief 获取一种编码的累计统计
+     */
+    static HttpCompressStats get_stats(ContentEncoding encoding);
+
+    virtual ~HttpCompressor() = default;
+
+    ContentEncoding get_encoding() const {
+        return m_encoding;
+    }
+
+    /**
+     * @brief 压缩data, 结果追加到out中, 同时统计压缩比和CPU时间
+     * @return 出错返回false, 压缩器不能再使用
+     */
+    bool compress(const void* data, size_t length, std::string& out, Operation op);
+
+protected:
+    explicit HttpCompressor(ContentEncoding encoding) : m_encoding(encoding) {
+    }
+
+    virtual bool do_compress(const char* data, size_t length, std::string& out,
+                             Operation op) = 0;
+
+    /**
+     * @brief 重置为新的压缩流, 保留已经分配的内部状态
+     */
+    virtual void reset() = 0;
+
+private:
+    ContentEncoding m_encoding;
+    bool m_failed = false;
+};
+
+/**
+ * @brief HttpServer的响应过滤阶段, 按请求的Accept-Encoding压缩完整的响应体
+ * 只压缩http.compress.min_size以上的文本类响应, 已经编码的响应, 文件响应体和部分响应不处理,
+ * 压缩后的ETag改为弱校验, 去掉Content-Length和Accept-Ranges
+ * @return 是否压缩了响应体
+ */
+bool compress_response(HttpRequest::ptr request, HttpResponse::ptr response);
+
+/**
+ * @brief 为按流发送的响应体准备压缩器, 在发送响应头之前调用
+ * 满足条件时设置响应头, 响应体的长度事先未知, 不检查大小下限
+ * @return 不需要压缩时返回nullptr
+ */
+HttpCompressor::ptr create_stream_compressor(HttpRequest::ptr request,
+                                             HttpResponse::ptr response);
+
+}  // namespace acid::http
+
+#endif  // DF_HTTP_COMPRESS_H
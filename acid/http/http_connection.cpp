@@ -0,0 +1,809 @@
+#include "http_connection.h"
+
+#include "acid/common/config.h"
+#include "acid/common/iomanager.h"
+#include "acid/common/util.h"
+#include "acid/logger/logger.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+
+namespace acid::http {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_http_client_max_connections = Config::look_up<uint32_t>(
+    "http.client.max_connections", 64, "http client max connections per host");
+static ConfigVar<uint32_t>::ptr g_http_client_max_requests = Config::look_up<uint32_t>(
+    "http.client.max_requests_per_connection", 10000,
+    "http client max requests sent on one connection");
+static ConfigVar<uint64_t>::ptr g_http_client_idle_timeout = Config::look_up<uint64_t>(
+    "http.client.idle_timeout", 30 * 1000, "http client idle connection timeout ms");
+static ConfigVar<uint64_t>::ptr g_http_client_connect_timeout = Config::look_up<uint64_t>(
+    "http.client.connect_timeout", 3 * 1000, "http client connect timeout ms");
+
+static uint32_t s_http_client_max_connections = 0;
+static uint32_t s_http_client_max_requests = 0;
+static uint64_t s_http_client_idle_timeout = 0;
+static uint64_t s_http_client_connect_timeout = 0;
+
+struct _HttpClientIniter {
+    _HttpClientIniter() {
+        s_http_client_max_connections = g_http_client_max_connections->get_value();
+        g_http_client_max_connections->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http client max connections change from " << old_val
+                                 << " to " << new_val;
+                s_http_client_max_connections = new_val;
+            });
+
+        s_http_client_max_requests = g_http_client_max_requests->get_value();
+        g_http_client_max_requests->add_listener(
+            [](const uint32_t& old_val, const uint32_t& new_val) {
+                LOG_INFO(logger) << "http client max requests per connection change from "
+                                 << old_val << " to " << new_val;
+                s_http_client_max_requests = new_val;
+            });
+
+        s_http_client_idle_timeout = g_http_client_idle_timeout->get_value();
+        g_http_client_idle_timeout->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http client idle timeout change from " << old_val << " to "
+                                 << new_val;
+                s_http_client_idle_timeout = new_val;
+            });
+
+        s_http_client_connect_timeout = g_http_client_connect_timeout->get_value();
+        g_http_client_connect_timeout->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http client connect timeout change from " << old_val
+                                 << " to " << new_val;
+                s_http_client_connect_timeout = new_val;
+            });
+    }
+};
+
+static _HttpClientIniter s_initer;
+
+// 读缓冲区扩容上限的倍数
+static constexpr uint64_t MAX_BUFFER_MULTIPLE = 16;
+// 请求体不小于该大小时不拷贝, 与请求头一起通过writev发送
+static constexpr size_t MIN_IOVEC_BODY_SIZE = 4 * 1024;
+
+static const char* s_error_string[] = {
+    "ok",           "invalid url",   "invalid host",  "connect fail",
+    "send error",   "recv error",    "timeout",       "pool closed",
+};
+
+std::string HttpResult::to_string() const {
+    std::stringstream ss;
+    ss << "[HttpResult result=" << s_error_string[static_cast<int>(result)]
+       << " error=" << error << " response=" << (response ? response->to_string() : "nullptr")
+       << "]";
+    return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr socket, bool owner)
+    : SocketStream(socket, owner)
+    , m_buffer(HttpResponseParser::get_http_response_buffer_size())
+    , m_create_time(get_current_ms())
+    , m_last_active_time(m_create_time) {
+}
+
+HttpConnection::~HttpConnection() {
+    LOG_DEBUG(logger) << "HttpConnection::~HttpConnection";
+}
+
+ssize_t HttpConnection::send_request(HttpRequest::ptr request) {
+    ++m_request_count;
+    // 缓冲区中剩余的数据属于这个请求的响应
+    m_received = m_read_pos < m_write_pos;
+    m_output.clear();
+    request->dump_head(m_output);
+    const std::string& body = request->get_body();
+    if (body.size() < MIN_IOVEC_BODY_SIZE) {
+        m_output.append(body);
+        return static_cast<ssize_t>(write_fix_size(m_output.data(), m_output.size())) <= 0
+                   ? -1
+                   : static_cast<ssize_t>(m_output.size());
+    }
+
+    iovec iovs[2];
+    iovs[0].iov_base = m_output.data();
+    iovs[0].iov_len = m_output.size();
+    iovs[1].iov_base = const_cast<char*>(body.data());
+    iovs[1].iov_len = body.size();
+    iovec* iov = iovs;
+    size_t count = 2;
+    ssize_t total = 0;
+    while (count > 0) {
+        ssize_t len = get_socket()->send(iov, count);
+        if (len <= 0) {
+            return -1;
+        }
+        total += len;
+        while (len > 0) {
+            size_t n = std::min<size_t>(len, iov->iov_len);
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+            len -= n;
+            if (iov->iov_len == 0) {
+                ++iov;
+                --count;
+            }
+        }
+    }
+    return total;
+}
+
+ssize_t HttpConnection::send_requests(const std::vector<HttpRequest::ptr>& requests) {
+    m_request_count += requests.size();
+    m_received = m_read_pos < m_write_pos;
+    m_output.clear();
+    for (auto& request : requests) {
+        request->dump_head(m_output);
+        m_output.append(request->get_body());
+    }
+    return static_cast<ssize_t>(write_fix_size(m_output.data(), m_output.size())) <= 0
+               ? -1
+               : static_cast<ssize_t>(m_output.size());
+}
+
+HttpResponse::ptr HttpConnection::recv_response(bool head_request) {
+    if (!recv_response_head(head_request)) {
+        return nullptr;
+    }
+    if (parse_body(nullptr, 0) < 0) {
+        return nullptr;
+    }
+    return m_response;
+}
+
+HttpResponse::ptr HttpConnection::recv_response_head(bool head_request) {
+    m_parser.reset(head_request);
+    m_response.reset();
+
+    while (!m_parser.is_headers_finished()) {
+        if (m_read_pos == m_write_pos && !fill_buffer()) {
+            return nullptr;
+        }
+        // 对端关闭连接后长度为0, 通知解析器数据已经结束
+        size_t nparsed =
+            m_parser.execute(m_buffer.data() + m_read_pos, m_write_pos - m_read_pos);
+        if (m_parser.has_error()) {
+            LOG_DEBUG(logger) << "parse response error";
+            return nullptr;
+        }
+        m_read_pos += nparsed;
+        // 100 Continue之类的临时响应没有响应体, 解析完之后继续接收最终响应
+        if (m_parser.is_finished()) {
+            m_parser.reset(head_request);
+            continue;
+        }
+        if (m_parser.is_headers_finished()) {
+            if (static_cast<uint32_t>(m_parser.get_data()->get_status()) / 100 == 1) {
+                m_parser.set_headers_finished(false);
+            }
+        }
+        else if (m_eof) {
+            return nullptr;
+        }
+    }
+
+    m_response = m_parser.get_data();
+    return m_response;
+}
+
+ssize_t HttpConnection::read_body(void* buffer, size_t length) {
+    if (!m_response) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    return parse_body(static_cast<char*>(buffer), length);
+}
+
+bool HttpConnection::finish_response() {
+    if (!m_response || m_parser.has_error()) {
+        return false;
+    }
+    if (m_parser.is_finished()) {
+        return true;
+    }
+
+    uint64_t max_size = HttpResponseParser::get_http_response_max_body_size();
+    uint64_t content_length = m_parser.get_content_length();
+    if (!m_parser.is_chunked() && content_length != ULLONG_MAX && content_length > max_size) {
+        return false;
+    }
+    char buffer[4096];
+    uint64_t discarded = 0;
+    while (true) {
+        ssize_t len = parse_body(buffer, sizeof(buffer));
+        if (len < 0) {
+            return false;
+        }
+        if (len == 0) {
+            return true;
+        }
+        discarded += len;
+        if (discarded > max_size) {
+            return false;
+        }
+    }
+}
+
+bool HttpConnection::is_reusable() const {
+    return m_response && m_parser.is_finished() && !m_parser.has_error() &&
+           !m_response->is_close() && !m_eof && is_connected();
+}
+
+ssize_t HttpConnection::parse_body(char* output, size_t length) {
+    m_parser.set_body_output(output);
+    while (!m_parser.is_finished()) {
+        if (m_parser.has_error()) {
+            return -1;
+        }
+        if (m_read_pos == m_write_pos && !fill_buffer()) {
+            return -1;
+        }
+        // 响应体不会比原始数据长, 限制交给解析器的长度就不会超出output
+        size_t len = m_write_pos - m_read_pos;
+        if (output) {
+            len = std::min(len, length);
+        }
+        size_t nparsed = m_parser.execute(m_buffer.data() + m_read_pos, len);
+        if (m_parser.has_error()) {
+            LOG_DEBUG(logger) << "parse response body error";
+            return -1;
+        }
+        m_read_pos += nparsed;
+
+        size_t size = m_parser.get_body_output_size();
+        if (size > 0) {
+            return size;
+        }
+        // 没有长度的响应体以连接关闭结束, 其它响应体还没有结束连接就关闭了
+        if (len == 0 && !m_parser.is_finished()) {
+            m_parser.set_error(true);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+bool HttpConnection::fill_buffer() {
+    if (m_eof) {
+        return false;
+    }
+    m_read_pos = m_write_pos = 0;
+    ssize_t len = static_cast<ssize_t>(read(m_buffer.data(), m_buffer.size()));
+    if (len < 0) {
+        LOG_DEBUG(logger) << "recv response fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    if (len == 0) {
+        m_eof = true;
+        return true;
+    }
+    m_received = true;
+    m_write_pos = len;
+
+    if (m_write_pos == m_buffer.size() &&
+        m_buffer.size() <
+            HttpResponseParser::get_http_response_buffer_size() * MAX_BUFFER_MULTIPLE) {
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+    return true;
+}
+
+HttpResponseStream::HttpResponseStream(std::shared_ptr<HttpConnectionPool> pool,
+                                       HttpConnection::ptr connection)
+    : m_pool(pool), m_connection(connection) {
+}
+
+HttpResponseStream::~HttpResponseStream() {
+    close();
+}
+
+size_t HttpResponseStream::read(void* buffer, size_t length) {
+    if (!m_connection) {
+        return 0;
+    }
+    ssize_t len = m_connection->read_body(buffer, length);
+    // 响应体读完之后立即归还连接
+    if (len <= 0 && length > 0) {
+        close();
+    }
+    return len;
+}
+
+size_t HttpResponseStream::read(ByteArray::ptr byte_array, size_t length) {
+    std::vector<iovec> iovs;
+    byte_array->get_write_buffers(iovs, length);
+    ssize_t ret = read(iovs[0].iov_base, iovs[0].iov_len);
+    if (ret > 0) {
+        byte_array->set_position(byte_array->get_position() + ret);
+    }
+    return ret;
+}
+
+void HttpResponseStream::close() {
+    if (!m_connection) {
+        return;
+    }
+    m_connection->finish_response();
+    m_pool->release(m_connection);
+    m_connection.reset();
+}
+
+/**
+ * @brief 请求超时后关闭连接的读写, 阻塞在连接上的协程随之返回错误
+ */
+struct RequestTimeout {
+    RequestTimeout(HttpConnection::ptr connection, uint64_t timeout_ms) {
+        if (timeout_ms == static_cast<uint64_t>(-1)) {
+            return;
+        }
+        m_flag = std::make_shared<bool>(false);
+        std::weak_ptr<HttpConnection> weak_connection(connection);
+        std::weak_ptr<bool> weak_flag(m_flag);
+        m_timer = IOManager::get_this()->add_condition_timer(
+            timeout_ms,
+            [weak_connection, weak_flag]() {
+                auto connection = weak_connection.lock();
+                auto flag = weak_flag.lock();
+                if (!connection || !flag) {
+                    return;
+                }
+                *flag = true;
+                ::shutdown(connection->get_socket()->get_socketfd(), SHUT_RDWR);
+            },
+            m_flag);
+    }
+
+    ~RequestTimeout() {
+        if (m_timer) {
+            m_timer->cancel();
+        }
+    }
+
+    bool is_timeout() const {
+        return m_flag && *m_flag;
+    }
+
+    std::shared_ptr<bool> m_flag;
+    Timer::ptr m_timer;
+};
+
+// 剩余的超时时间, 已经超时返回0
+static uint64_t get_remain_ms(uint64_t deadline) {
+    if (deadline == static_cast<uint64_t>(-1)) {
+        return -1;
+    }
+    uint64_t now = get_current_ms();
+    return deadline > now ? deadline - now : 0;
+}
+
+HttpConnectionPool::HttpConnectionPool(const std::string& host, uint16_t port, uint32_t max_size,
+                                       uint32_t max_request)
+    : m_host(host), m_port(port), m_max_size(max_size), m_max_request(max_request) {
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+    LOG_DEBUG(logger) << "HttpConnectionPool::~HttpConnectionPool";
+}
+
+HttpResult::ptr HttpConnectionPool::do_request(HttpRequest::ptr request, uint64_t timeout_ms) {
+    prepare(request);
+    uint64_t deadline =
+        timeout_ms == static_cast<uint64_t>(-1) ? timeout_ms : get_current_ms() + timeout_ms;
+    // 复用的连接可能已经被服务端关闭, 这种情况下幂等的请求在新连接上重试一次
+    for (int i = 0; i < 2; ++i) {
+        HttpResult::Error error;
+        HttpConnection::ptr connection = get_connection(deadline, error);
+        if (!connection) {
+            return std::make_shared<HttpResult>(error, nullptr,
+                                                "get connection to " + m_host + " fail");
+        }
+        bool retry = false;
+        auto result = send_and_recv(connection, request, get_remain_ms(deadline), false, retry);
+        if (!retry) {
+            return result;
+        }
+    }
+    return std::make_shared<HttpResult>(HttpResult::Error::RECV_SOCKET_ERROR, nullptr,
+                                        "connection closed by peer");
+}
+
+HttpResult::ptr HttpConnectionPool::do_get(const std::string& path, uint64_t timeout_ms,
+                                           const std::map<std::string, std::string>& headers) {
+    HttpRequest::ptr request(new HttpRequest);
+    request->set_path(path);
+    for (auto& i : headers) {
+        request->set_header(i.first, i.second);
+    }
+    return do_request(request, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::do_post(const std::string& path, const std::string& body,
+                                            uint64_t timeout_ms,
+                                            const std::map<std::string, std::string>& headers) {
+    HttpRequest::ptr request(new HttpRequest);
+    request->set_method(HttpMethod::POST);
+    request->set_path(path);
+    request->set_body(body);
+    for (auto& i : headers) {
+        request->set_header(i.first, i.second);
+    }
+    return do_request(request, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::do_request_stream(HttpRequest::ptr request,
+                                                      uint64_t timeout_ms) {
+    prepare(request);
+    uint64_t deadline =
+        timeout_ms == static_cast<uint64_t>(-1) ? timeout_ms : get_current_ms() + timeout_ms;
+    for (int i = 0; i < 2; ++i) {
+        HttpResult::Error error;
+        HttpConnection::ptr connection = get_connection(deadline, error);
+        if (!connection) {
+            return std::make_shared<HttpResult>(error, nullptr,
+                                                "get connection to " + m_host + " fail");
+        }
+        bool retry = false;
+        auto result = send_and_recv(connection, request, get_remain_ms(deadline), true, retry);
+        if (!retry) {
+            return result;
+        }
+    }
+    return std::make_shared<HttpResult>(HttpResult::Error::RECV_SOCKET_ERROR, nullptr,
+                                        "connection closed by peer");
+}
+
+std::vector<HttpResult::ptr> HttpConnectionPool::do_pipeline(
+    const std::vector<HttpRequest::ptr>& requests, uint64_t timeout_ms) {
+    std::vector<HttpResult::ptr> results;
+    if (requests.empty()) {
+        return results;
+    }
+    for (auto& request : requests) {
+        prepare(request);
+    }
+
+    auto fail = [&results, &requests](HttpResult::Error error, const std::string& message) {
+        auto result = std::make_shared<HttpResult>(error, nullptr, message);
+        results.resize(requests.size(), result);
+        return results;
+    };
+
+    uint64_t deadline =
+        timeout_ms == static_cast<uint64_t>(-1) ? timeout_ms : get_current_ms() + timeout_ms;
+    HttpResult::Error error;
+    HttpConnection::ptr connection = get_connection(deadline, error);
+    if (!connection) {
+        return fail(error, "get connection to " + m_host + " fail");
+    }
+
+    RequestTimeout timeout(connection, get_remain_ms(deadline));
+    if (connection->send_requests(requests) < 0) {
+        connection->close();
+        release(connection);
+        return fail(timeout.is_timeout() ? HttpResult::Error::TIMEOUT
+                                         : HttpResult::Error::SEND_SOCKET_ERROR,
+                    "send pipeline requests fail");
+    }
+    for (auto& request : requests) {
+        auto response = connection->recv_response(request->get_method() == HttpMethod::HEAD);
+        if (!response) {
+            connection->close();
+            release(connection);
+            return fail(timeout.is_timeout() ? HttpResult::Error::TIMEOUT
+                                             : HttpResult::Error::RECV_SOCKET_ERROR,
+                        "recv pipeline response fail");
+        }
+        results.push_back(std::make_shared<HttpResult>(HttpResult::Error::OK, response, "ok"));
+    }
+    release(connection);
+    return results;
+}
+
+// 幂等的请求重复执行与执行一次的效果相同
+static bool is_idempotent(HttpMethod method) {
+    switch (method) {
+        case HttpMethod::GET:
+        case HttpMethod::HEAD:
+        case HttpMethod::PUT:
+        case HttpMethod::DELETE:
+        case HttpMethod::OPTIONS:
+        case HttpMethod::TRACE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+HttpResult::ptr HttpConnectionPool::send_and_recv(HttpConnection::ptr connection,
+                                                  HttpRequest::ptr request, uint64_t timeout_ms,
+                                                  bool stream, bool& retry) {
+    bool reused = connection->get_request_count() > 0;
+    if (timeout_ms == 0) {
+        release(connection);
+        return std::make_shared<HttpResult>(HttpResult::Error::TIMEOUT, nullptr, "request timeout");
+    }
+
+    RequestTimeout timeout(connection, timeout_ms);
+    auto fail = [&](HttpResult::Error error, const std::string& message) {
+        connection->close();
+        release(connection);
+        if (timeout.is_timeout()) {
+            return std::make_shared<HttpResult>(HttpResult::Error::TIMEOUT, nullptr,
+                                                "request timeout");
+        }
+        // 请求可能已经被服务端处理, 只有幂等的请求可以重发
+        retry = reused && !connection->has_received() && is_idempotent(request->get_method());
+        return std::make_shared<HttpResult>(error, nullptr, message);
+    };
+
+    if (connection->send_request(request) < 0) {
+        return fail(HttpResult::Error::SEND_SOCKET_ERROR, "send request fail");
+    }
+
+    bool head_request = request->get_method() == HttpMethod::HEAD;
+    HttpResponse::ptr response = stream ? connection->recv_response_head(head_request)
+                                        : connection->recv_response(head_request);
+    if (!response) {
+        return fail(HttpResult::Error::RECV_SOCKET_ERROR, "recv response fail");
+    }
+
+    auto result = std::make_shared<HttpResult>(HttpResult::Error::OK, response, "ok");
+    if (stream) {
+        result->stream = std::make_shared<HttpResponseStream>(shared_from_this(), connection);
+    }
+    else {
+        release(connection);
+    }
+    return result;
+}
+
+void HttpConnectionPool::prepare(HttpRequest::ptr request) {
+    if (request->get_header("Host").empty()) {
+        request->set_header("Host", m_port == 80 ? m_host : m_host + ":" + std::to_string(m_port));
+    }
+    request->set_close(false);
+}
+
+// 空闲连接上不应该有数据可读, 可读说明服务端已经关闭了连接
+static bool is_alive(HttpConnection::ptr connection) {
+    pollfd pfd {connection->get_socket()->get_socketfd(), POLLIN, 0};
+    return ::poll(&pfd, 1, 0) == 0;
+}
+
+HttpConnection::ptr HttpConnectionPool::get_connection(uint64_t deadline,
+                                                       HttpResult::Error& result) {
+    uint32_t max_size = m_max_size ? m_max_size : s_http_client_max_connections;
+    LockGuard lock(m_mutex);
+    while (true) {
+        if (m_closed) {
+            result = HttpResult::Error::POOL_CLOSED;
+            return nullptr;
+        }
+
+        uint64_t now = get_current_ms();
+        while (!m_idle.empty()) {
+            HttpConnection::ptr connection = m_idle.front();
+            m_idle.pop_front();
+            if (now - connection->get_last_active_time() < s_http_client_idle_timeout &&
+                is_alive(connection)) {
+                return connection;
+            }
+            --m_total;
+            connection->close();
+        }
+
+        if (m_total < max_size) {
+            ++m_total;
+            break;
+        }
+        // 连接数已经达到上限, 在超时之前等待其它请求归还连接
+        uint64_t remain = get_remain_ms(deadline);
+        if (remain == 0) {
+            result = HttpResult::Error::TIMEOUT;
+            return nullptr;
+        }
+        Timer::ptr timer;
+        if (remain != static_cast<uint64_t>(-1)) {
+            std::weak_ptr<HttpConnectionPool> weak_pool = shared_from_this();
+            timer = IOManager::get_this()->add_timer(remain, [weak_pool]() {
+                auto pool = weak_pool.lock();
+                if (!pool) {
+                    return;
+                }
+                // 加锁之后通知, 等待者一定已经在条件变量上
+                LockGuard lock(pool->m_mutex);
+                pool->m_cond.notify_all();
+            });
+        }
+        m_cond.wait(lock);
+        if (timer) {
+            timer->cancel();
+        }
+    }
+
+    if (!m_address) {
+        m_address = Address::look_up_any_ipaddress(m_host + ":" + std::to_string(m_port));
+    }
+    Address::ptr address = m_address;
+    lock.unlock();
+
+    if (!address) {
+        LOG_ERROR(logger) << "invalid host: " << m_host;
+        release(nullptr);
+        result = HttpResult::Error::INVALID_HOST;
+        return nullptr;
+    }
+    uint64_t remain = get_remain_ms(deadline);
+    if (remain == 0) {
+        release(nullptr);
+        result = HttpResult::Error::TIMEOUT;
+        return nullptr;
+    }
+    Socket::ptr socket = Socket::create_tcp(address);
+    if (!socket->connect(address, std::min(s_http_client_connect_timeout, remain))) {
+        LOG_DEBUG(logger) << "connect to " << address->to_string() << " fail";
+        release(nullptr);
+        result = get_remain_ms(deadline) == 0 ? HttpResult::Error::TIMEOUT
+                                              : HttpResult::Error::CONNECT_FAIL;
+        return nullptr;
+    }
+    return std::make_shared<HttpConnection>(socket);
+}
+
+void HttpConnectionPool::release(HttpConnection::ptr connection) {
+    uint32_t max_request = m_max_request ? m_max_request : s_http_client_max_requests;
+    LockGuard lock(m_mutex);
+    if (connection && !m_closed && connection->is_reusable() &&
+        connection->get_request_count() < max_request) {
+        connection->set_last_active_time(get_current_ms());
+        m_idle.push_front(connection);
+    }
+    else {
+        // connection为空表示新建连接失败, 只需要释放占用的名额
+        if (connection) {
+            connection->close();
+        }
+        --m_total;
+    }
+    m_cond.notify();
+}
+
+void HttpConnectionPool::close() {
+    LockGuard lock(m_mutex);
+    m_closed = true;
+    for (auto& connection : m_idle) {
+        connection->close();
+    }
+    m_total -= m_idle.size();
+    m_idle.clear();
+    m_cond.notify_all();
+}
+
+size_t HttpConnectionPool::get_idle_count() {
+    LockGuard lock(m_mutex);
+    return m_idle.size();
+}
+
+size_t HttpConnectionPool::get_total_count() {
+    LockGuard lock(m_mutex);
+    return m_total;
+}
+
+HttpClient::HttpClient(uint32_t max_size, uint32_t max_request)
+    : m_max_size(max_size), m_max_request(max_request) {
+}
+
+HttpClient::~HttpClient() {
+    close();
+}
+
+HttpResult::ptr HttpClient::do_get(const std::string& url, uint64_t timeout_ms,
+                                   const std::map<std::string, std::string>& headers) {
+    HttpRequest::ptr request(new HttpRequest);
+    for (auto& i : headers) {
+        request->set_header(i.first, i.second);
+    }
+    return do_request(url, request, timeout_ms);
+}
+
+HttpResult::ptr HttpClient::do_post(const std::string& url, const std::string& body,
+                                    uint64_t timeout_ms,
+                                    const std::map<std::string, std::string>& headers) {
+    HttpRequest::ptr request(new HttpRequest);
+    request->set_method(HttpMethod::POST);
+    request->set_body(body);
+    for (auto& i : headers) {
+        request->set_header(i.first, i.second);
+    }
+    return do_request(url, request, timeout_ms);
+}
+
+HttpResult::ptr HttpClient::do_request(const std::string& url, HttpRequest::ptr request,
+                                       uint64_t timeout_ms) {
+    HttpConnectionPool::ptr pool = parse_url(url, request);
+    if (!pool) {
+        return std::make_shared<HttpResult>(HttpResult::Error::INVALID_URL, nullptr,
+                                            "invalid url: " + url);
+    }
+    return pool->do_request(request, timeout_ms);
+}
+
+HttpResult::ptr HttpClient::do_request_stream(const std::string& url, HttpRequest::ptr request,
+                                              uint64_t timeout_ms) {
+    HttpConnectionPool::ptr pool = parse_url(url, request);
+    if (!pool) {
+        return std::make_shared<HttpResult>(HttpResult::Error::INVALID_URL, nullptr,
+                                            "invalid url: " + url);
+    }
+    return pool->do_request_stream(request, timeout_ms);
+}
+
+HttpConnectionPool::ptr HttpClient::get_pool(const std::string& host, uint16_t port) {
+    std::string key = host + ":" + std::to_string(port);
+    LockGuard lock(m_mutex);
+    auto it = m_pools.find(key);
+    if (it != m_pools.end()) {
+        return it->second;
+    }
+    auto pool = std::make_shared<HttpConnectionPool>(host, port, m_max_size, m_max_request);
+    m_pools.emplace(key, pool);
+    return pool;
+}
+
+void HttpClient::close() {
+    LockGuard lock(m_mutex);
+    for (auto& i : m_pools) {
+        i.second->close();
+    }
+    m_pools.clear();
+}
+
+HttpConnectionPool::ptr HttpClient::parse_url(const std::string& url, HttpRequest::ptr request) {
+    http_parser_url url_parser {};
+    http_parser_url_init(&url_parser);
+    if (http_parser_parse_url(url.data(), url.size(), 0, &url_parser) != 0 ||
+        !(url_parser.field_set & (1 << UF_HOST))) {
+        LOG_DEBUG(logger) << "parse url fail, url is: " << url;
+        return nullptr;
+    }
+    if (url_parser.field_set & (1 << UF_SCHEMA)) {
+        std::string schema = url.substr(url_parser.field_data[UF_SCHEMA].off,
+                                        url_parser.field_data[UF_SCHEMA].len);
+        if (strcasecmp(schema.c_str(), "http") != 0) {
+            LOG_DEBUG(logger) << "unsupported schema: " << schema;
+            return nullptr;
+        }
+    }
+
+    std::string host =
+        url.substr(url_parser.field_data[UF_HOST].off, url_parser.field_data[UF_HOST].len);
+    uint16_t port = (url_parser.field_set & (1 << UF_PORT)) ? url_parser.port : 80;
+    if (url_parser.field_set & (1 << UF_PATH)) {
+        request->set_path(url.substr(url_parser.field_data[UF_PATH].off,
+                                     url_parser.field_data[UF_PATH].len));
+    }
+    else {
+        request->set_path("/");
+    }
+    if (url_parser.field_set & (1 << UF_QUERY)) {
+        request->set_query(url.substr(url_parser.field_data[UF_QUERY].off,
+                                      url_parser.field_data[UF_QUERY].len));
+    }
+    return get_pool(host, port);
+}
+
+}  // namespace acid::http
@@ -0,0 +1,335 @@
+/*!
+ * @file http_connection.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief http客户端
+ * @version 0.1
+ * @date 2023-08-14
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_HTTP_CONNECTION_H
+#define DF_HTTP_CONNECTION_H
+
+#include "acid/common/co_mutex.h"
+#include "acid/common/stream.h"
+#include "acid/net/socket_stream.h"
+#include "http.h"
+#include "http_parse.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace acid::http {
+
+/**
+ * @brief http请求的结果
+ */
+struct HttpResult {
+    using ptr = std::shared_ptr<HttpResult>;
+
+    enum class Error {
+        OK = 0,
+        INVALID_URL,          // url不合法
+        INVALID_HOST,         // 无法解析的主机
+        CONNECT_FAIL,         // 连接失败
+        SEND_SOCKET_ERROR,    // 发送请求失败
+        RECV_SOCKET_ERROR,    // 接收响应失败, 包括对端关闭连接
+        TIMEOUT,              // 请求超时
+        POOL_CLOSED,          // 连接池已经关闭
+    };
+
+    HttpResult(Error result, HttpResponse::ptr response, const std::string& error)
+        : result(result), response(response), error(error) {
+    }
+
+    std::string to_string() const;
+
+    Error result;
+    HttpResponse::ptr response;
+    std::string error;
+    // 按流读取响应体时的输入流, 读完或者关闭后连接回到连接池
+    Stream::ptr stream;
+};
+
+/**
+ * @brief 客户端的一条http连接
+ * 读缓冲区和解析器在响应之间复用, 流水线发送的多个请求的响应按顺序依次接收
+ */
+class HttpConnection : public SocketStream {
+public:
+    using ptr = std::shared_ptr<HttpConnection>;
+
+    HttpConnection(Socket::ptr socket, bool owner = true);
+
+    ~HttpConnection() override;
+
+    /**
+     * @brief 发送一个请求, 请求体与请求头一起发送
+     * @return 发送的长度, 失败返回-1
+     */
+    ssize_t send_request(HttpRequest::ptr request);
+
+    /**
+     * @brief 把多个请求合并成一次写入, 用于流水线请求
+     * @return 发送的长度, 失败返回-1
+     */
+    ssize_t send_requests(const std::vector<HttpRequest::ptr>& requests);
+
+    /**
+     * @brief 接收一个完整的响应, 响应体大小受http.response.max_body_size限制
+     * @param head_request 对应的请求是HEAD请求, 响应没有响应体
+     * @return HttpResponse::ptr 连接关闭或者响应出错返回nullptr
+     */
+    HttpResponse::ptr recv_response(bool head_request = false);
+
+    /**
+     * @brief 只接收响应头, 响应体通过read_body按流读取
+     * @return HttpResponse::ptr 连接关闭或者响应出错返回nullptr
+     */
+    HttpResponse::ptr recv_response_head(bool head_request = false);
+
+    /**
+     * @brief 读取一部分响应体
+     * @return 读取的长度, 响应体已经读完返回0, 出错返回-1
+     */
+    ssize_t read_body(void* buffer, size_t length);
+
+    /**
+     * @brief 丢弃没有读取的响应体
+     * @return 连接可以继续发送下一个请求返回true
+     */
+    bool finish_response();
+
+    /**
+     * @brief 上一个响应结束之后连接是否还可以复用
+     */
+    bool is_reusable() const;
+
+    uint64_t get_create_time() const {
+        return m_create_time;
+    }
+
+    uint64_t get_last_active_time() const {
+        return m_last_active_time;
+    }
+
+    void set_last_active_time(uint64_t ms) {
+        m_last_active_time = ms;
+    }
+
+    uint64_t get_request_count() const {
+        return m_request_count;
+    }
+
+    /**
+     * @brief 发送最近的请求之后是否收到过响应的数据, 没有收到时幂等的请求可以在新连接上重试
+     */
+    bool has_received() const {
+        return m_received;
+    }
+
+private:
+    // 解析响应体, 参数与HttpSession::parse_body相同
+    ssize_t parse_body(char* output, size_t length);
+
+    // 缓冲区中的数据都已解析, 重新读取, 对端关闭连接时通知解析器, 连接出错返回false
+    bool fill_buffer();
+
+private:
+    HttpResponseParser m_parser;
+    std::vector<char> m_buffer;     // 读缓冲区, 只在装满时扩容
+    size_t m_read_pos = 0;          // 下一个待解析的位置
+    size_t m_write_pos = 0;         // 已读入数据的末尾
+    bool m_eof = false;             // 对端已经关闭连接
+    bool m_received = false;        // 发送最近的请求之后是否收到过响应的数据
+    std::string m_output;           // 待发送的请求头
+    HttpResponse::ptr m_response;   // 正在接收的响应
+    uint64_t m_create_time;
+    uint64_t m_last_active_time;
+    uint64_t m_request_count = 0;   // 已经发送的请求数
+};
+
+class HttpConnectionPool;
+
+/**
+ * @brief 从连接池中的连接上按流读取响应体
+ * 响应体读完或者关闭时连接回到连接池
+ */
+class HttpResponseStream : public Stream {
+public:
+    using ptr = std::shared_ptr<HttpResponseStream>;
+
+    HttpResponseStream(std::shared_ptr<HttpConnectionPool> pool, HttpConnection::ptr connection);
+
+    ~HttpResponseStream() override;
+
+    size_t read(void* buffer, size_t length) override;
+
+    size_t read(ByteArray::ptr byte_array, size_t length) override;
+
+    size_t write(const void* buffer, size_t length) override {
+        return -1;
+    }
+
+    size_t write(ByteArray::ptr byte_array, size_t length) override {
+        return -1;
+    }
+
+    /**
+     * @brief 丢弃剩余的响应体, 归还连接
+     */
+    void close() override;
+
+private:
+    std::shared_ptr<HttpConnectionPool> m_pool;
+    HttpConnection::ptr m_connection;
+};
+
+/**
+ * @brief 同一个主机的保持连接的连接池
+ * 空闲连接超过http.client.idle_timeout没有使用时关闭; 连接总数达到上限时请求等待其它请求归还连接;
+ * 一条连接发送的请求数达到上限后不再复用。复用的连接在收到响应之前出错时, 幂等的请求在新连接上重试一次
+ */
+class HttpConnectionPool : public std::enable_shared_from_this<HttpConnectionPool> {
+public:
+    using ptr = std::shared_ptr<HttpConnectionPool>;
+    using MutexType = CoMutex;
+    using LockGuard = MutexType::Lock;
+
+    /**
+     * @param host 主机名, 用于解析地址和设置Host请求头
+     * @param port 端口
+     * @param max_size 最大连接数, 为0时使用http.client.max_connections
+     * @param max_request 一条连接最多发送的请求数, 为0时使用http.client.max_requests_per_connection
+     */
+    HttpConnectionPool(const std::string& host, uint16_t port, uint32_t max_size = 0,
+                       uint32_t max_request = 0);
+
+    ~HttpConnectionPool();
+
+    /**
+     * @brief 发送请求并接收完整的响应
+     * @param timeout_ms 从获取连接到收到完整响应的超时时间, -1表示不超时
+     */
+    HttpResult::ptr do_request(HttpRequest::ptr request, uint64_t timeout_ms = -1);
+
+    HttpResult::ptr do_get(const std::string& path, uint64_t timeout_ms = -1,
+                           const std::map<std::string, std::string>& headers = {});
+
+    HttpResult::ptr do_post(const std::string& path, const std::string& body,
+                            uint64_t timeout_ms = -1,
+                            const std::map<std::string, std::string>& headers = {});
+
+    /**
+     * @brief 发送请求, 只接收响应头, 响应体通过HttpResult::stream读取
+     * @param timeout_ms 从获取连接到收到响应头的超时时间
+     */
+    HttpResult::ptr do_request_stream(HttpRequest::ptr request, uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 在一条连接上流水线发送多个请求
+     * 请求合并成一次写入, 响应按请求的顺序返回; 出错之后的请求都返回同样的错误
+     * @param timeout_ms 全部请求的超时时间
+     */
+    std::vector<HttpResult::ptr> do_pipeline(const std::vector<HttpRequest::ptr>& requests,
+                                             uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 归还连接, 不能复用的连接直接关闭
+     */
+    void release(HttpConnection::ptr connection);
+
+    /**
+     * @brief 关闭所有空闲连接, 之后的请求都失败
+     */
+    void close();
+
+    size_t get_idle_count();
+
+    size_t get_total_count();
+
+private:
+    /**
+     * @brief 取出一条空闲连接, 没有时新建, 达到最大连接数时等待
+     * @param deadline 超时的时间点(get_current_ms), -1表示不超时; 等待归还和新建连接都不超过这个时间
+     * @param[out] result 失败时的错误, 超时为TIMEOUT
+     */
+    HttpConnection::ptr get_connection(uint64_t deadline, HttpResult::Error& result);
+
+    // 补上Host头, 保持连接
+    void prepare(HttpRequest::ptr request);
+
+    // 发送请求并接收响应, 幂等的请求在复用的连接收到响应之前出错时retry为true
+    HttpResult::ptr send_and_recv(HttpConnection::ptr connection, HttpRequest::ptr request,
+                                  uint64_t timeout_ms, bool stream, bool& retry);
+
+private:
+    std::string m_host;
+    uint16_t m_port;
+    uint32_t m_max_size;
+    uint32_t m_max_request;
+    Address::ptr m_address;                 // 第一次连接时解析
+    MutexType m_mutex;
+    CoCond m_cond;                          // 等待其它请求归还连接
+    std::list<HttpConnection::ptr> m_idle;  // 最近归还的在前
+    uint32_t m_total = 0;                   // 空闲和正在使用的连接数
+    bool m_closed = false;
+};
+
+/**
+ * @brief 按主机管理连接池的http客户端
+ * 例如 client->do_get("http://127.0.0.1:8080/index.html", 1000)
+ */
+class HttpClient {
+public:
+    using ptr = std::shared_ptr<HttpClient>;
+    using MutexType = CoMutex;
+    using LockGuard = MutexType::Lock;
+
+    /**
+     * @param max_size 每个主机的最大连接数, 为0时使用http.client.max_connections
+     * @param max_request 一条连接最多发送的请求数
+     */
+    explicit HttpClient(uint32_t max_size = 0, uint32_t max_request = 0);
+
+    ~HttpClient();
+
+    HttpResult::ptr do_get(const std::string& url, uint64_t timeout_ms = -1,
+                           const std::map<std::string, std::string>& headers = {});
+
+    HttpResult::ptr do_post(const std::string& url, const std::string& body,
+                            uint64_t timeout_ms = -1,
+                            const std::map<std::string, std::string>& headers = {});
+
+    /**
+     * @brief 发送请求到url对应的主机, url中的路径和参数覆盖request中的
+     */
+    HttpResult::ptr do_request(const std::string& url, HttpRequest::ptr request,
+                               uint64_t timeout_ms = -1);
+
+    HttpResult::ptr do_request_stream(const std::string& url, HttpRequest::ptr request,
+                                      uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 获取主机对应的连接池, 没有时创建
+     */
+    HttpConnectionPool::ptr get_pool(const std::string& host, uint16_t port);
+
+    void close();
+
+private:
+    // 解析url, 设置request的路径和参数, 返回对应的连接池, url不合法返回nullptr
+    HttpConnectionPool::ptr parse_url(const std::string& url, HttpRequest::ptr request);
+
+private:
+    uint32_t m_max_size;
+    uint32_t m_max_request;
+    MutexType m_mutex;
+    std::unordered_map<std::string, HttpConnectionPool::ptr> m_pools;  // host:port到连接池
+};
+
+}  // namespace acid::http
+
+#endif  // DF_HTTP_CONNECTION_H
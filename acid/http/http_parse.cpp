@@ -1,15 +1,78 @@
 #include "http_parse.h"
 
+#include "acid/common/config.h"
 #include "acid/logger/logger.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace acid::http {
 
 static auto logger = GET_LOGGER_BY_NAME("system");
 
-static uint64_t s_http_request_buffer_size = 1024;
-static uint64_t s_http_request_max_body_size = 1024;
-static uint64_t s_http_response_buffer_size = 1024;
-static uint64_t s_http_response_max_body_size = 1024;
+static ConfigVar<uint64_t>::ptr g_http_request_buffer_size = Config::look_up<uint64_t>(
+    "http.request.buffer_size", 4 * 1024, "http request buffer size");
+static ConfigVar<uint64_t>::ptr g_http_request_max_body_size = Config::look_up<uint64_t>(
+    "http.request.max_body_size", 64 * 1024 * 1024, "http request max body size");
+static ConfigVar<uint64_t>::ptr g_http_request_max_stream_body_size = Config::look_up<uint64_t>(
+    "http.request.max_stream_body_size", 16ull * 1024 * 1024 * 1024,
+    "http request max body size when read as stream");
+static ConfigVar<uint64_t>::ptr g_http_response_buffer_size = Config::look_up<uint64_t>(
+    "http.response.buffer_size", 4 * 1024, "http response buffer size");
+static ConfigVar<uint64_t>::ptr g_http_response_max_body_size = Config::look_up<uint64_t>(
+    "http.response.max_body_size", 64 * 1024 * 1024, "http response max body size");
+
+static uint64_t s_http_request_buffer_size = 0;
+static uint64_t s_http_request_max_body_size = 0;
+static uint64_t s_http_request_max_stream_body_size = 0;
+static uint64_t s_http_response_buffer_size = 0;
+static uint64_t s_http_response_max_body_size = 0;
+
+struct _HttpSizeIniter {
+    _HttpSizeIniter() {
+        s_http_request_buffer_size = g_http_request_buffer_size->get_value();
+        g_http_request_buffer_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http request buffer size change from " << old_val << " to "
+                                 << new_val;
+                s_http_request_buffer_size = new_val;
+            });
+
+        s_http_request_max_body_size = g_http_request_max_body_size->get_value();
+        g_http_request_max_body_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http request max body size change from " << old_val
+                                 << " to " << new_val;
+                s_http_request_max_body_size = new_val;
+            });
+
+        s_http_request_max_stream_body_size = g_http_request_max_stream_body_size->get_value();
+        g_http_request_max_stream_body_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http request max stream body size change from " << old_val
+                                 << " to " << new_val;
+                s_http_request_max_stream_body_size = new_val;
+            });
+
+        s_http_response_buffer_size = g_http_response_buffer_size->get_value();
+        g_http_response_buffer_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http response buffer size change from " << old_val << " to "
+                                 << new_val;
+                s_http_response_buffer_size = new_val;
+            });
+
+        s_http_response_max_body_size = g_http_response_max_body_size->get_value();
+        g_http_response_max_body_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http response max body size change from " << old_val
+                                 << " to " << new_val;
+                s_http_response_max_body_size = new_val;
+            });
+    }
+};
+
+static _HttpSizeIniter s_initer;
 
 uint64_t HttpRequestParser::get_http_request_buffer_size() {
     return s_http_request_buffer_size;
@@ -19,6 +82,10 @@ uint64_t HttpRequestParser::get_http_request_max_body_size() {
     return s_http_request_max_body_size;
 }
 
+uint64_t HttpRequestParser::get_http_request_max_stream_body_size() {
+    return s_http_request_max_stream_body_size;
+}
+
 uint64_t HttpResponseParser::get_http_response_buffer_size() {
     return s_http_response_buffer_size;
 }
@@ -35,8 +102,20 @@ static int on_request_message_begin_cb(http_parser* hp) {
 static int on_request_headers_complete_cb(http_parser* hp) {
     LOG_DEBUG(logger) << "on_request_headers_complete_cb";
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
-    parser->get_data()->set_version((hp->http_major << 4) | (hp->http_major));
+    parser->commit_header();
+    if (!parser->parse_url()) {
+        return 1;
+    }
+    parser->get_data()->set_version((hp->http_major << 4) | (hp->http_minor));
     parser->get_data()->set_method(static_cast<HttpMethod>(hp->method));
+    // 带有Connection: Upgrade和Upgrade: websocket的请求
+    if (hp->upgrade &&
+        case_insensitive_equal(parser->get_data()->get_header_view("Upgrade"), "websocket")) {
+        parser->get_data()->set_websocket(true);
+    }
+    parser->set_headers_finished(true);
+    // 请求头解析完成后暂停, 由调用者决定请求体是整体读入还是按流读取
+    http_parser_pause(hp, 1);
     return 0;
 }
 
@@ -44,6 +123,8 @@ static int on_request_message_complete_cb(http_parser* hp) {
     LOG_DEBUG(logger) << "on_request_message_complete_cb";
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
     parser->set_finished(true);
+    // 一次只解析一个请求, 流水线中后续请求的数据留在缓冲区中, 等待下一次解析
+    http_parser_pause(hp, 1);
     return 0;
 }
 
@@ -57,47 +138,22 @@ static int on_request_chunk_complete_cb(http_parser* hp) {
     return 0;
 }
 
+// 以下数据回调在请求跨越多次读取时会分段到达, 需要先拼接完整再使用
 static int on_request_url_cb(http_parser* hp, const char* buffer, size_t len) {
-    LOG_DEBUG(logger) << "on_request_url_cb, url is: " << std::string(buffer, len);
-    int ret;
-    http_parser_url url_parser {};
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
-
-    http_parser_url_init(&url_parser);
-    ret = http_parser_parse_url(buffer, len, 0, &url_parser);
-    if (ret != 0) {
-        LOG_DEBUG(logger) << "parse url fail";
-        return 1;
-    }
-    if (url_parser.field_set & (1 << UF_PATH)) {
-        parser->get_data()->set_path(std::string(buffer + url_parser.field_data[UF_PATH].off,
-                                                 url_parser.field_data[UF_PATH].len));
-    }
-    if (url_parser.field_set & (1 << UF_QUERY)) {
-        parser->get_data()->set_query(std::string(buffer + url_parser.field_data[UF_QUERY].off,
-                                                  url_parser.field_data[UF_QUERY].len));
-    }
-    if (url_parser.field_set & (1 << UF_FRAGMENT)) {
-        parser->get_data()->set_fragment(
-            std::string(buffer + url_parser.field_data[UF_FRAGMENT].off,
-                        url_parser.field_data[UF_FRAGMENT].len));
-    }
+    parser->append_url(buffer, len);
     return 0;
 }
 
 static int on_request_header_field_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string field(buffer, len);
-    LOG_DEBUG(logger) << "on request header field cb, field is " << field;
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
-    parser->set_field(field);
+    parser->append_field(buffer, len);
     return 0;
 }
 
 static int on_request_header_value_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string value(buffer, len);
-    LOG_DEBUG(logger) << "on_request_header_value_cb, value is " << value;
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
-    parser->get_data()->set_header(parser->get_field(), value);
+    parser->append_value(buffer, len);
     return 0;
 }
 
@@ -107,10 +163,17 @@ static int on_request_status_cb(http_parser* hp, const char* buffer, size_t len)
 }
 
 static int on_request_body_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string body(buffer, len);
-    LOG_DEBUG(logger) << "on request body cb, body is " << body;
     auto* parser = static_cast<HttpRequestParser*>(hp->data);
-    parser->get_data()->set_body(body);
+    if (parser->is_body_output()) {
+        parser->append_body_output(buffer, len);
+        return 0;
+    }
+    HttpRequest::ptr request = parser->get_data();
+    if (request->get_body().size() + len > HttpRequestParser::get_http_request_max_body_size()) {
+        LOG_DEBUG(logger) << "request body too large";
+        return 1;
+    }
+    request->append_body(buffer, len);
     return 0;
 }
 
@@ -128,31 +191,115 @@ static http_parser_settings s_request_settings = {
 };
 
 HttpRequestParser::HttpRequestParser() {
+    reset();
+}
+
+void HttpRequestParser::reset() {
     http_parser_init(&m_parser, HTTP_REQUEST);
-    m_data.reset(new HttpRequest);
+    m_data = std::make_shared<HttpRequest>();
+    // 同一连接上的请求通常差不多大, 按上一个请求的长度分配, 解析过程中不需要再扩容
+    m_data->m_raw.reserve(std::max<size_t>(m_raw_size_hint, 256));
     m_parser.data = this;
     m_error = 0;
     m_finished = false;
+    m_url_length = 0;
+    m_fields.clear();
+    m_in_value = false;
+    m_headers_finished = false;
+    m_body_output = nullptr;
+    m_body_output_size = 0;
 }
 
-size_t HttpRequestParser::execute(char* data, size_t len) {
-    size_t nparsed = http_parser_execute(&m_parser, &s_request_settings, data, len);
-    if (m_parser.upgrade) {
-        // 处理新协议，暂时不处理
-        LOG_DEBUG(logger) << "found upgrade, ignore";
-        set_error(HPE_UNKNOWN);
+size_t HttpRequestParser::execute(const char* data, size_t len) {
+    // 从请求头结束处的暂停继续
+    if (HTTP_PARSER_ERRNO(&m_parser) == HPE_PAUSED) {
+        http_parser_pause(&m_parser, 0);
     }
-    else if (m_parser.http_errno != 0) {
+    m_body_output_size = 0;
+    size_t nparsed = http_parser_execute(&m_parser, &s_request_settings, data, len);
+    // 升级请求解析完后由servlet接管连接, 之后的数据属于新协议, 不再交给解析器
+    if (m_parser.http_errno != 0 && m_parser.http_errno != HPE_PAUSED) {
         LOG_DEBUG(logger) << "parse request fail: " << http_errno_name(HTTP_PARSER_ERRNO(&m_parser));
         set_error(static_cast<int8_t>(m_parser.http_errno));
     }
-    else {
-        if (nparsed < len) {
-            memmove(data, data + nparsed, (len - nparsed));
+
+    // 解析完一个请求后暂停, 未解析的数据由调用者保留
+    return nparsed;
+}
+
+void HttpRequestParser::append_body_output(const char* data, size_t len) {
+    memcpy(m_body_output + m_body_output_size, data, len);
+    m_body_output_size += len;
+}
+
+void HttpRequestParser::append_url(const char* data, size_t len) {
+    m_data->m_raw.append(data, len);
+    m_url_length += len;
+}
+
+void HttpRequestParser::append_field(const char* data, size_t len) {
+    // 上一个请求头的值已经结束, 开始新的请求头
+    if (m_fields.empty() || m_in_value) {
+        m_fields.push_back({m_data->m_raw.size(), 0, 0, 0});
+        m_in_value = false;
+    }
+    m_data->m_raw.append(data, len);
+    m_fields.back().name_length += len;
+}
+
+void HttpRequestParser::append_value(const char* data, size_t len) {
+    if (m_fields.empty()) {
+        return;
+    }
+    FieldOffset& field = m_fields.back();
+    if (!m_in_value) {
+        field.value_offset = m_data->m_raw.size();
+        m_in_value = true;
+    }
+    m_data->m_raw.append(data, len);
+    field.value_length += len;
+}
+
+void HttpRequestParser::commit_header() {
+    const char* raw = m_data->m_raw.data();
+    auto& headers = m_data->m_headers;
+    headers.reserve(m_fields.size());
+    for (auto& field : m_fields) {
+        if (field.name_length == 0) {
+            continue;
         }
+        headers.emplace_back(std::string_view(raw + field.name_offset, field.name_length),
+                             std::string_view(raw + field.value_offset, field.value_length));
     }
+    m_fields.clear();
+    m_in_value = false;
+    m_raw_size_hint = m_data->m_raw.size();
+}
 
-    return nparsed;
+bool HttpRequestParser::parse_url() {
+    std::string_view url(m_data->m_raw.data(), m_url_length);
+    http_parser_url url_parser {};
+    http_parser_url_init(&url_parser);
+    if (http_parser_parse_url(url.data(), url.size(), m_parser.method == HTTP_CONNECT,
+                              &url_parser) != 0) {
+        LOG_DEBUG(logger) << "parse url fail, url is: " << url;
+        return false;
+    }
+
+    // 路径等字段直接指向原始数据
+    if (url_parser.field_set & (1 << UF_PATH)) {
+        m_data->m_path =
+            url.substr(url_parser.field_data[UF_PATH].off, url_parser.field_data[UF_PATH].len);
+    }
+    if (url_parser.field_set & (1 << UF_QUERY)) {
+        m_data->m_query =
+            url.substr(url_parser.field_data[UF_QUERY].off, url_parser.field_data[UF_QUERY].len);
+    }
+    if (url_parser.field_set & (1 << UF_FRAGMENT)) {
+        m_data->m_fragment = url.substr(url_parser.field_data[UF_FRAGMENT].off,
+                                        url_parser.field_data[UF_FRAGMENT].len);
+    }
+    return true;
 }
 
 static int on_response_message_begin_cb(http_parser* hp) {
@@ -163,15 +310,24 @@ static int on_response_message_begin_cb(http_parser* hp) {
 static int on_response_headers_complete_cb(http_parser* hp) {
     LOG_DEBUG(logger) << "on_response_headers_complete_cb";
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
-    parser->get_data()->set_version((hp->http_major << 4) | (hp->http_major));
-    parser->get_data()->set_status(static_cast<HttpStatus>(hp->status_code));
-    return 0;
+    parser->commit_header();
+    HttpResponse::ptr response = parser->get_data();
+    response->set_version((hp->http_major << 4) | (hp->http_minor));
+    response->set_status(static_cast<HttpStatus>(hp->status_code));
+    response->set_close(!http_should_keep_alive(hp));
+    parser->set_headers_finished(true);
+    // 响应头解析完成后暂停, 由调用者决定响应体是整体读入还是按流读取
+    http_parser_pause(hp, 1);
+    // HEAD请求的响应带有Content-Length但是没有响应体
+    return parser->is_skip_body() ? 1 : 0;
 }
 
 static int on_response_message_complete_cb(http_parser* hp) {
     LOG_DEBUG(logger) << "on response message complete cb";
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
     parser->set_finished(true);
+    // 流水线中后续响应的数据留在缓冲区中, 等待下一次解析
+    http_parser_pause(hp, 1);
     return 0;
 }
 
@@ -191,34 +347,36 @@ static int on_response_url_cb(http_parser* hp, const char* buffer, size_t len) {
 }
 
 static int on_response_header_field_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string field(buffer, len);
-    LOG_DEBUG(logger) << "on response header field cb, field id " << field;
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
-    parser->set_field(field);
+    parser->append_field(buffer, len);
     return 0;
 }
 
 static int on_response_header_value_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string value(buffer, len);
-    LOG_DEBUG(logger) << "on response header value cb, value is " << value;
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
-    parser->get_data()->set_header(parser->get_field(), value);
+    parser->append_value(buffer, len);
     return 0;
 }
 
 static int on_response_status_cb(http_parser* hp, const char* buffer , size_t len) {
-    LOG_DEBUG(logger) << "on response status cb, status code is " << hp->status_code
-    << "status message is " << std::string(buffer, len);
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
-    parser->get_data()->set_status(static_cast<HttpStatus>(hp->status_code));
+    HttpResponse::ptr response = parser->get_data();
+    response->set_reason(response->get_reason() + std::string(buffer, len));
     return 0;
 }
 
 static int on_response_body_cb(http_parser* hp, const char* buffer, size_t len) {
-    std::string body(buffer, len);
-    LOG_DEBUG(logger) << "on response body cb, body is " << body;
     auto* parser = static_cast<HttpResponseParser*>(hp->data);
-    parser->get_data()->set_body(body);
+    if (parser->is_body_output()) {
+        parser->append_body_output(buffer, len);
+        return 0;
+    }
+    HttpResponse::ptr response = parser->get_data();
+    if (response->get_body().size() + len > HttpResponseParser::get_http_response_max_body_size()) {
+        LOG_DEBUG(logger) << "response body too large";
+        return 1;
+    }
+    response->append_body(buffer, len);
     return 0;
 }
 
@@ -236,25 +394,61 @@ static http_parser_settings s_response_settings = {
 };
 
 HttpResponseParser::HttpResponseParser() {
+    reset();
+}
+
+void HttpResponseParser::reset(bool skip_body) {
     http_parser_init(&m_parser, HTTP_RESPONSE);
     m_data.reset(new HttpResponse);
     m_parser.data = this;
     m_error = 0;
     m_finished = false;
+    m_field.clear();
+    m_value.clear();
+    m_in_value = false;
+    m_headers_finished = false;
+    m_skip_body = skip_body;
+    m_body_output = nullptr;
+    m_body_output_size = 0;
 }
 
-size_t HttpResponseParser::execute(char* data, size_t len) {
+size_t HttpResponseParser::execute(const char* data, size_t len) {
+    if (HTTP_PARSER_ERRNO(&m_parser) == HPE_PAUSED) {
+        http_parser_pause(&m_parser, 0);
+    }
+    m_body_output_size = 0;
     size_t nparsed = http_parser_execute(&m_parser, &s_response_settings, data, len);
-    if (m_parser.http_errno != 0) {
+    if (m_parser.http_errno != 0 && m_parser.http_errno != HPE_PAUSED) {
         LOG_DEBUG(logger) << "parse response fail: " << http_errno_name(HTTP_PARSER_ERRNO(&m_parser));
         set_error(static_cast<int8_t>(m_parser.http_errno));
     }
-    else {
-        if (nparsed < len) {
-            memmove(data, data + nparsed, (len - nparsed));
-        }
-    }
     return nparsed;
 }
 
+void HttpResponseParser::append_body_output(const char* data, size_t len) {
+    memcpy(m_body_output + m_body_output_size, data, len);
+    m_body_output_size += len;
+}
+
+void HttpResponseParser::append_field(const char* data, size_t len) {
+    if (m_in_value) {
+        commit_header();
+    }
+    m_field.append(data, len);
+}
+
+void HttpResponseParser::append_value(const char* data, size_t len) {
+    m_in_value = true;
+    m_value.append(data, len);
+}
+
+void HttpResponseParser::commit_header() {
+    if (!m_field.empty()) {
+        m_data->set_header(m_field, m_value);
+    }
+    m_field.clear();
+    m_value.clear();
+    m_in_value = false;
+}
+
 }  // namespace acid::http
\ No newline at end of file
@@ -22,12 +22,61 @@ namespace acid::http {
 
         HttpRequestParser();
 
-        size_t execute(char* data, size_t len);
+        /**
+         * @brief 重置解析器, 开始解析同一连接上的下一个请求
+         */
+        void reset();
+
+        /**
+         * @brief 解析数据, 请求头解析完成时和一个完整的请求解析完成时都会停止
+         * @return 已解析的字节数, 之后的数据属于请求体或者下一个请求
+         */
+        size_t execute(const char* data, size_t len);
 
         int is_finished() const {
             return m_finished;
         }
 
+        bool is_headers_finished() const {
+            return m_headers_finished;
+        }
+
+        void set_headers_finished(bool finished) {
+            m_headers_finished = finished;
+        }
+
+        /**
+         * @brief 设置请求体的输出位置
+         * 设置之后请求体不再保存到HttpRequest中, 而是拷贝到buffer, 调用者需要保证buffer不小于
+         * 交给execute的数据长度
+         * @param buffer 为nullptr时恢复保存到HttpRequest中
+         */
+        void set_body_output(char* buffer) {
+            m_body_output = buffer;
+            m_body_output_size = 0;
+        }
+
+        bool is_body_output() const {
+            return m_body_output;
+        }
+
+        // 把请求体拷贝到输出位置
+        void append_body_output(const char* data, size_t len);
+
+        // 上一次execute拷贝到输出位置的请求体长度
+        size_t get_body_output_size() const {
+            return m_body_output_size;
+        }
+
+        // 请求头中的Content-Length, 分块传输时没有意义
+        uint64_t get_content_length() const {
+            return m_parser.content_length;
+        }
+
+        bool is_chunked() const {
+            return m_parser.flags & F_CHUNKED;
+        }
+
         void set_finished(bool finished) {
             m_finished = finished;
         }
@@ -48,25 +97,46 @@ namespace acid::http {
             return m_parser;
         }
 
-        const std::string& get_field() const {
-            return m_field;
-        }
+        // url与请求头可能分多次回调, 依次追加到请求保存原始数据的内存中, 这里只记录位置
+        void append_url(const char* data, size_t len);
 
-        void set_field(const std::string& value) {
-            m_field = value;
-        }
+        void append_field(const char* data, size_t len);
+
+        void append_value(const char* data, size_t len);
+
+        // 请求头已经完整, 原始数据不再变化, 按记录的位置设置请求头
+        void commit_header();
+
+        // 请求行已经完整, 解析url
+        bool parse_url();
 
     public:
         static uint64_t get_http_request_buffer_size();
 
         static uint64_t get_http_request_max_body_size();
 
+        static uint64_t get_http_request_max_stream_body_size();
+
     private:
+        // 一个请求头在原始数据中的位置
+        struct FieldOffset {
+            size_t name_offset;
+            size_t name_length;
+            size_t value_offset;
+            size_t value_length;
+        };
+
         http_parser m_parser;
         HttpRequest::ptr m_data;
         int m_error;
         bool m_finished;
-        std::string m_field;
+        size_t m_url_length;                // url位于原始数据的开头
+        std::vector<FieldOffset> m_fields;  // 在多个请求之间复用
+        size_t m_raw_size_hint = 0;         // 上一个请求的原始数据长度, 用于预先分配
+        bool m_in_value;  // 上一次回调是请求头的值
+        bool m_headers_finished;
+        char* m_body_output;  // 请求体的输出位置, 为空时保存到HttpRequest中
+        size_t m_body_output_size;
 
     };  // class HttpRequestParser
 
@@ -76,7 +146,18 @@ namespace acid::http {
 
         HttpResponseParser();
 
-        size_t execute(char* data, size_t len);
+        /**
+         * @brief 重置解析器, 开始解析同一连接上的下一个响应
+         * @param skip_body 响应对应HEAD请求, 没有响应体
+         */
+        void reset(bool skip_body = false);
+
+        /**
+         * @brief 解析数据, 响应头解析完成时和一个完整的响应解析完成时都会停止
+         * len为0表示对端关闭了连接, 没有长度的响应体以此结束
+         * @return 已解析的字节数, 之后的数据属于响应体或者下一个响应
+         */
+        size_t execute(const char* data, size_t len);
 
         int is_finished() const {
             return m_finished;
@@ -86,6 +167,44 @@ namespace acid::http {
             m_finished = finished;
         }
 
+        bool is_headers_finished() const {
+            return m_headers_finished;
+        }
+
+        void set_headers_finished(bool finished) {
+            m_headers_finished = finished;
+        }
+
+        bool is_skip_body() const {
+            return m_skip_body;
+        }
+
+        /**
+         * @brief 设置响应体的输出位置, 用法与HttpRequestParser::set_body_output相同
+         */
+        void set_body_output(char* buffer) {
+            m_body_output = buffer;
+            m_body_output_size = 0;
+        }
+
+        bool is_body_output() const {
+            return m_body_output;
+        }
+
+        void append_body_output(const char* data, size_t len);
+
+        size_t get_body_output_size() const {
+            return m_body_output_size;
+        }
+
+        uint64_t get_content_length() const {
+            return m_parser.content_length;
+        }
+
+        bool is_chunked() const {
+            return m_parser.flags & F_CHUNKED;
+        }
+
         int has_error() const {
             return !!m_error;
         }
@@ -102,13 +221,12 @@ namespace acid::http {
             return m_parser;
         }
 
-        const std::string& get_field() const {
-            return m_field;
-        }
+        void append_field(const char* data, size_t len);
 
-        void set_field(const std::string& field) {
-            m_field = field;
-        }
+        void append_value(const char* data, size_t len);
+
+        // 当前响应头已经完整, 设置到响应中
+        void commit_header();
 
     public:
         static uint64_t get_http_response_buffer_size();
@@ -121,6 +239,12 @@ namespace acid::http {
         int m_error;
         bool m_finished;
         std::string m_field;
+        std::string m_value;
+        bool m_in_value;  // 上一次回调是响应头的值
+        bool m_headers_finished;
+        bool m_skip_body;
+        char* m_body_output;  // 响应体的输出位置, 为空时保存到HttpResponse中
+        size_t m_body_output_size;
 
     }; // class HttpResponseParser
 
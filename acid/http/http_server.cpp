@@ -1,5 +1,8 @@
 #include "http_server.h"
 
+#include "http2_session.h"
+#include "http_compress.h"
+
 namespace acid::http {
 
 static auto logger = GET_LOGGER_BY_NAME("system");
@@ -19,6 +22,14 @@ void HttpServer::set_name(std::string &name) {
 void HttpServer::handle_client(Socket::ptr client) {
     LOG_DEBUG(logger) << "handle client " << *client;
     HttpSession::ptr session(new HttpSession(client));
+    // 直接发送HTTP/2连接序言的客户端(prior knowledge)
+    if (Http2Session::is_enabled() && session->check_prefix(Http2Session::PREFACE)) {
+        auto h2 = std::make_shared<Http2Session>(client, m_servlet_dispatch, get_name(),
+                                                 session->take_buffer());
+        h2->start();
+        session->close();
+        return;
+    }
     do {
         auto request = session->recv_request();
         if (!request) {
@@ -30,10 +41,41 @@ void HttpServer::handle_client(Socket::ptr client) {
 
         HttpResponse::ptr response(new HttpResponse(request->get_version(), request->is_close() || !m_is_keep_alive));
         response->set_header("Server", get_name());
-        m_servlet_dispatch->handle(request, response, session);
+
+        // 通过Upgrade: h2c升级到HTTP/2, 当前请求作为流1处理
+        if (Http2Session::is_enabled() && request->get_version() == 0x11 &&
+            case_insensitive_equal(request->get_header_view("Upgrade"), "h2c") &&
+            request->has_header("HTTP2-Settings")) {
+            auto h2 = Http2Session::upgrade(session, request, m_servlet_dispatch, get_name());
+            if (h2) {
+                h2->start();
+            }
+            break;
+        }
+
+        // 匹配时把路由参数设置到请求中;
+        // 普通servlet在处理之前读入整个请求体, 按流处理的servlet自己读取
+        Servlet::ptr servlet = m_servlet_dispatch->get_matched_servlet(request);
+        // 升级到websocket后连接不再处理http请求
+        if (servlet->is_websocket()) {
+            handle_websocket(session, request, response,
+                             std::static_pointer_cast<WSServlet>(servlet));
+            break;
+        }
+        if (!servlet->is_stream_body() && !session->recv_body(request)) {
+            response->set_status(HttpStatus::PAYLOAD_TOO_LARGE);
+            response->set_close(true);
+            session->send_response(response);
+            break;
+        }
+        servlet->handle(request, response, session);
+        // 响应过滤阶段, 按Accept-Encoding压缩响应体
+        compress_response(request, response);
         session->send_response(response);
 
-        if (!m_is_keep_alive || request->is_close()) {
+        // servlet没有读完的请求体需要丢弃, 丢弃不了只能关闭连接
+        if (!m_is_keep_alive || request->is_close() || response->is_close() ||
+            !session->finish_request()) {
             break ;
         }
     } while (true);
@@ -41,4 +83,31 @@ void HttpServer::handle_client(Socket::ptr client) {
     session->close();
 }
 
+void HttpServer::handle_websocket(HttpSession::ptr session, HttpRequest::ptr request,
+                                  HttpResponse::ptr response, WSServlet::ptr servlet) {
+    if (!request->is_websocket()) {
+        response->set_status(HttpStatus::UPGRADE_REQUIRED);
+        response->set_header("Upgrade", "websocket");
+        response->set_close(true);
+        session->send_response(response);
+        return;
+    }
+    WSSession::ptr ws_session = WSSession::accept(session, request, response);
+    if (!ws_session) {
+        return;
+    }
+    if (servlet->on_connect(request, ws_session) != 0) {
+        ws_session->close(WSCloseCode::GOING_AWAY);
+        return;
+    }
+    while (true) {
+        auto message = ws_session->recv_message();
+        if (!message || servlet->handle(request, message, ws_session) != 0) {
+            break;
+        }
+    }
+    servlet->on_close(request, ws_session);
+    ws_session->close(WSCloseCode::NORMAL);
+}
+
 }  // namespace acid::http
\ No newline at end of file
@@ -37,6 +37,12 @@ public:
 protected:
     void handle_client(Socket::ptr client) override;
 
+    /**
+     * @brief 完成websocket握手, 之后在当前协程中循环接收消息交给servlet处理, 直到连接关闭
+     */
+    void handle_websocket(HttpSession::ptr session, HttpRequest::ptr request,
+                          HttpResponse::ptr response, WSServlet::ptr servlet);
+
 private:
     bool m_is_keep_alive;
     ServletDispatch::ptr m_servlet_dispatch;
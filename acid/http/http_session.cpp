@@ -1,61 +1,496 @@
 #include "http_session.h"
 
+#include "acid/common/iomanager.h"
 #include "acid/logger/logger.h"
-#include "http_parse.h"
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <sys/sendfile.h>
 
 namespace acid::http {
 
 static auto logger = GET_LOGGER_BY_NAME("system");
 
-HttpSession::HttpSession(Socket::ptr socket, bool owner) : SocketStream(socket, owner) {
+// 读缓冲区扩容上限的倍数, 超过后认为请求头过大
+static constexpr uint64_t MAX_BUFFER_MULTIPLE = 16;
+// 暂存的响应超过该大小时即使还有请求未处理也立即写出
+static constexpr size_t MAX_PENDING_OUTPUT = 64 * 1024;
+// 响应体不小于该大小时不再拷贝到输出缓冲区, 而是作为单独的iovec发送
+static constexpr size_t MIN_IOVEC_BODY_SIZE = 4 * 1024;
+
+HttpBodyStream::HttpBodyStream(HttpSession* session, HttpResponse::ptr response)
+    : m_session(session), m_response(response) {
+}
+
+size_t HttpBodyStream::read(void* buffer, size_t length) {
+    return m_session->read_body(buffer, length);
+}
+
+size_t HttpBodyStream::read(ByteArray::ptr byte_array, size_t length) {
+    std::vector<iovec> iovs;
+    byte_array->get_write_buffers(iovs, length);
+    ssize_t ret = m_session->read_body(iovs[0].iov_base, iovs[0].iov_len);
+    if (ret > 0) {
+        byte_array->set_position(byte_array->get_position() + ret);
+    }
+    return ret;
+}
+
+size_t HttpBodyStream::write(const void* buffer, size_t length) {
+    return m_session->write_chunk(m_response, buffer, length);
+}
+
+size_t HttpBodyStream::write(ByteArray::ptr byte_array, size_t length) {
+    std::vector<iovec> iovs;
+    byte_array->get_read_buffers(iovs, length);
+    ssize_t ret = m_session->write_chunk(m_response, iovs[0].iov_base, iovs[0].iov_len);
+    if (ret > 0) {
+        byte_array->set_position(byte_array->get_position() + ret);
+    }
+    return ret;
+}
+
+void HttpBodyStream::close() {
+    m_session->finish_chunk(m_response);
+}
+
+HttpSession::HttpSession(Socket::ptr socket, bool owner)
+    : SocketStream(socket, owner)
+    , m_buffer(HttpRequestParser::get_http_request_buffer_size()) {
 }
 
 HttpRequest::ptr HttpSession::recv_request() {
     LOG_DEBUG(logger) << "recv request from fd = " << get_socket()->get_socketfd();
-    HttpRequestParser::ptr parser(new HttpRequestParser);
-    uint64_t buffer_size = HttpRequestParser::get_http_request_buffer_size();
-    std::shared_ptr<char> buffer(new char[buffer_size], [](char* p) { delete[] p; });
+    m_parser.reset();
+    m_request.reset();
+    m_body_size = 0;
 
-    char* data = buffer.get();
-    int offset = 0;
+    while (true) {
+        if (m_read_pos < m_write_pos) {
+            size_t nparsed = m_parser.execute(m_buffer.data() + m_read_pos, m_write_pos - m_read_pos);
+            if (m_parser.has_error()) {
+                LOG_DEBUG(logger) << "parser has error";
+                close();
+                return nullptr;
+            }
+            m_read_pos += nparsed;
+            if (m_parser.is_headers_finished()) {
+                break;
+            }
+        }
 
-    do {
-        size_t len = read(data + offset, buffer_size - offset);
-        if (len == 0) {
-            LOG_DEBUG(logger) << "request len == 0 "
-                              << "socket is connected: " << get_socket()->is_connected();
+        if (!fill_buffer()) {
             close();
             return nullptr;
         }
-        len += offset;
-        size_t nparsed = parser->execute(data, len);
-        if (parser->has_error()) {
-            LOG_DEBUG(logger) << "parser has error";
-            close();
-            return nullptr;
+    }
+
+    m_request = m_parser.get_data();
+    m_request->init();
+    m_expect_continue = m_request->get_version() >= 0x11 &&
+                        case_insensitive_equal(m_request->get_header_view("Expect"), "100-continue");
+    return m_request;
+}
+
+bool HttpSession::recv_body(HttpRequest::ptr request) {
+    if (m_parser.is_finished()) {
+        return true;
+    }
+    // 声明的长度已经超过限制, 不再读取
+    uint64_t content_length = m_parser.get_content_length();
+    if (!m_parser.is_chunked() && content_length != ULLONG_MAX &&
+        content_length > HttpRequestParser::get_http_request_max_body_size()) {
+        LOG_DEBUG(logger) << "request body too large, content length: " << content_length;
+        return false;
+    }
+    return parse_body(nullptr, 0) == 0;
+}
+
+ssize_t HttpSession::read_body(void* buffer, size_t length) {
+    if (!m_request) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    return parse_body(static_cast<char*>(buffer), length);
+}
+
+bool HttpSession::finish_request() {
+    if (!m_request || m_parser.has_error()) {
+        return false;
+    }
+    if (m_parser.is_finished()) {
+        return true;
+    }
+    // 客户端还在等待100 Continue, 请求体没有发送, 无法丢弃
+    if (m_expect_continue) {
+        return false;
+    }
+
+    // 剩余的请求体不多时读出丢弃, 否则直接关闭连接
+    uint64_t max_size = HttpRequestParser::get_http_request_max_body_size();
+    uint64_t content_length = m_parser.get_content_length();
+    if (!m_parser.is_chunked() && content_length != ULLONG_MAX && content_length > max_size) {
+        return false;
+    }
+    char buffer[4096];
+    uint64_t discarded = 0;
+    while (true) {
+        ssize_t len = parse_body(buffer, sizeof(buffer));
+        if (len < 0) {
+            return false;
         }
+        if (len == 0) {
+            return true;
+        }
+        discarded += len;
+        if (discarded > max_size) {
+            return false;
+        }
+    }
+}
 
-        offset = len - nparsed;
-        if (offset == static_cast<int>(buffer_size)) {
-            LOG_DEBUG(logger) << "too large request";
-            close();
-            return nullptr;
+HttpBodyStream::ptr HttpSession::get_body_stream(HttpResponse::ptr response) {
+    return std::make_shared<HttpBodyStream>(this, response);
+}
+
+ssize_t HttpSession::write_chunk(HttpResponse::ptr response, const void* data, size_t length) {
+    if (m_stream_response != response) {
+        // 第一次写入, 响应头与第一个分块一起发送
+        m_stream_response = response;
+        m_stream_finished = false;
+        m_stream_compressor = create_stream_compressor(m_request, response);
+        if (response->get_version() >= 0x11) {
+            response->set_header("Transfer-Encoding", "chunked");
+        }
+        else {
+            response->set_close(true);
         }
+        response->dump_head(m_output);
+    }
+    if (m_stream_finished) {
+        return -1;
+    }
+    // 长度为0的分块表示响应体结束, 不能发送
+    if (length == 0) {
+        return 0;
+    }
 
-        if (parser->is_finished()) {
-            break;
+    if (m_stream_compressor) {
+        // 每个分块都刷新压缩器, 对端收到后可以立即解压
+        m_compress_output.clear();
+        if (!m_stream_compressor->compress(data, length, m_compress_output,
+                                           HttpCompressor::FLUSH) ||
+            send_chunk(response, m_compress_output.data(), m_compress_output.size()) < 0) {
+            return -1;
         }
-    } while (true);
+        return static_cast<ssize_t>(length);
+    }
+    return send_chunk(response, data, length) < 0 ? -1 : static_cast<ssize_t>(length);
+}
+
+ssize_t HttpSession::send_chunk(HttpResponse::ptr response, const void* data, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    bool chunked = response->get_version() >= 0x11;
+    iovec iovs[4];
+    size_t count = 0;
+    iovs[count].iov_base = m_output.data();
+    iovs[count++].iov_len = m_output.size();
+    char size_line[24];
+    if (chunked) {
+        auto result = std::to_chars(size_line, size_line + sizeof(size_line) - 2, length, 16);
+        memcpy(result.ptr, "\r\n", 2);
+        iovs[count].iov_base = size_line;
+        iovs[count++].iov_len = result.ptr + 2 - size_line;
+    }
+    iovs[count].iov_base = const_cast<void*>(data);
+    iovs[count++].iov_len = length;
+    if (chunked) {
+        iovs[count].iov_base = const_cast<char*>("\r\n");
+        iovs[count++].iov_len = 2;
+    }
 
-    parser->get_data()->init();
-    return parser->get_data();
+    ssize_t ret = write_iovec(iovs, count);
+    m_output.clear();
+    return ret;
+}
+
+ssize_t HttpSession::finish_chunk(HttpResponse::ptr response) {
+    if (m_stream_response != response || m_stream_finished) {
+        return 0;
+    }
+    m_stream_finished = true;
+    if (m_stream_compressor) {
+        // 压缩流的结尾作为最后一个分块
+        m_compress_output.clear();
+        bool ok = m_stream_compressor->compress(nullptr, 0, m_compress_output,
+                                                HttpCompressor::FINISH);
+        m_stream_compressor.reset();
+        if (!ok || send_chunk(response, m_compress_output.data(), m_compress_output.size()) < 0) {
+            return -1;
+        }
+    }
+    if (response->get_version() >= 0x11) {
+        m_output.append("0\r\n\r\n");
+    }
+    return flush();
 }
 
 ssize_t HttpSession::send_response(HttpResponse::ptr response) {
-    std::stringstream ss;
-    response->dump(ss);
-    std::string data = ss.str();
-    return write_fix_size(data.c_str(), data.size());
+    // 响应体已经按流发送, 只需要结束分块传输
+    if (m_stream_response) {
+        ssize_t ret = finish_chunk(m_stream_response);
+        m_stream_response.reset();
+        return ret;
+    }
+
+    // 响应头直接格式化到复用的输出缓冲区中
+    response->dump_head(m_output);
+    // HEAD请求的响应只有响应头, Content-Length仍然是响应体的长度
+    if (m_request && m_request->get_method() == HttpMethod::HEAD) {
+        if (m_read_pos < m_write_pos && !response->is_close() &&
+            m_output.size() < MAX_PENDING_OUTPUT) {
+            return 0;
+        }
+        return flush();
+    }
+    if (response->has_file_body()) {
+        // 文件由内核直接发送, 不经过用户态缓冲区
+        if (flush() < 0) {
+            return -1;
+        }
+        return send_file(response->get_file_fd(), response->get_file_offset(),
+                         response->get_file_length());
+    }
+
+    const std::string& body = response->get_body();
+    if (body.size() >= MIN_IOVEC_BODY_SIZE) {
+        // 暂存的响应, 响应头和响应体一次writev写出, 响应体不拷贝
+        iovec iovs[2];
+        iovs[0].iov_base = m_output.data();
+        iovs[0].iov_len = m_output.size();
+        iovs[1].iov_base = const_cast<char*>(body.data());
+        iovs[1].iov_len = body.size();
+        ssize_t len = write_iovec(iovs, 2);
+        m_output.clear();
+        return len;
+    }
+
+    m_output.append(body);
+    // 后面还有已经读入的请求时先不写, 等这一批请求都处理完再一起发送
+    if (m_read_pos < m_write_pos && !response->is_close() &&
+        m_output.size() < MAX_PENDING_OUTPUT) {
+        return 0;
+    }
+    return flush();
+}
+
+ssize_t HttpSession::flush() {
+    if (m_output.empty()) {
+        return 0;
+    }
+    size_t len = write_fix_size(m_output.data(), m_output.size());
+    m_output.clear();
+    return static_cast<ssize_t>(len) <= 0 ? -1 : static_cast<ssize_t>(len);
+}
+
+void HttpSession::close() {
+    flush();
+    SocketStream::close();
+}
+
+bool HttpSession::check_prefix(const std::string& prefix) {
+    while (m_write_pos - m_read_pos < prefix.size()) {
+        if (memcmp(m_buffer.data() + m_read_pos, prefix.data(), m_write_pos - m_read_pos) != 0) {
+            return false;
+        }
+        if (m_write_pos == m_buffer.size()) {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+        ssize_t len = static_cast<ssize_t>(
+            read(m_buffer.data() + m_write_pos, m_buffer.size() - m_write_pos));
+        if (len <= 0) {
+            return false;
+        }
+        m_write_pos += len;
+    }
+    return memcmp(m_buffer.data() + m_read_pos, prefix.data(), prefix.size()) == 0;
+}
+
+std::string HttpSession::take_buffer() {
+    std::string data(m_buffer.data() + m_read_pos, m_write_pos - m_read_pos);
+    m_read_pos = m_write_pos = 0;
+    std::vector<char>().swap(m_buffer);
+    return data;
+}
+
+ssize_t HttpSession::parse_body(char* output, size_t length) {
+    // 客户端等到100 Continue才会发送请求体, 在读取之前随暂存的响应一起写出
+    if (m_expect_continue) {
+        m_expect_continue = false;
+        m_output.append("HTTP/1.1 100 Continue\r\n\r\n");
+    }
+
+    m_parser.set_body_output(output);
+    while (!m_parser.is_finished()) {
+        if (m_parser.has_error()) {
+            return -1;
+        }
+        if (m_read_pos < m_write_pos) {
+            // 请求体不会比原始数据长, 限制交给解析器的长度就不会超出output
+            size_t len = m_write_pos - m_read_pos;
+            if (output) {
+                len = std::min(len, length);
+            }
+            size_t nparsed = m_parser.execute(m_buffer.data() + m_read_pos, len);
+            if (m_parser.has_error()) {
+                LOG_DEBUG(logger) << "parse request body error";
+                return -1;
+            }
+            m_read_pos += nparsed;
+
+            size_t size = m_parser.get_body_output_size();
+            if (size > 0) {
+                m_body_size += size;
+                if (m_body_size > HttpRequestParser::get_http_request_max_stream_body_size()) {
+                    LOG_DEBUG(logger) << "request body too large, read: " << m_body_size;
+                    m_parser.set_error(true);
+                    return -1;
+                }
+                return size;
+            }
+            continue;
+        }
+
+        if (!fill_buffer()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+ssize_t HttpSession::send_file(int fd, uint64_t offset, uint64_t length) {
+    // sendfile没有hook, socket在系统层面是非阻塞的, 发送缓冲区满时等待可写事件
+    int sockfd = get_socket()->get_socketfd();
+    off_t file_offset = offset;
+    uint64_t left = length;
+    while (left > 0) {
+        ssize_t len = ::sendfile(sockfd, fd, &file_offset, left);
+        if (len > 0) {
+            left -= len;
+            continue;
+        }
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len < 0 && errno == EAGAIN && IOManager::get_this()) {
+            if (!wait_writable(sockfd)) {
+                return -1;
+            }
+            continue;
+        }
+        // 返回0说明文件在发送过程中被截断了
+        LOG_DEBUG(logger) << "sendfile fail, len = " << len << " errno = " << errno;
+        return -1;
+    }
+    return length;
+}
+
+bool HttpSession::wait_writable(int sockfd) {
+    // 与hook的do_io一样按socket的发送超时设置条件定时器, 超时后取消事件唤醒协程
+    IOManager* iom = IOManager::get_this();
+    uint64_t timeout = get_socket()->get_send_timeout();
+    auto timed_out = std::make_shared<bool>(false);
+    Timer::ptr timer;
+    if (timeout != static_cast<uint64_t>(-1)) {
+        std::weak_ptr<bool> weak_timed_out(timed_out);
+        timer = iom->add_condition_timer(
+            timeout,
+            [weak_timed_out, iom, sockfd]() {
+                auto flag = weak_timed_out.lock();
+                if (!flag) {
+                    return;
+                }
+                *flag = true;
+                iom->cancel_event(sockfd, IOManager::WRITE);
+            },
+            weak_timed_out);
+    }
+    if (iom->add_event(sockfd, IOManager::WRITE) != 0) {
+        if (timer) {
+            timer->cancel();
+        }
+        return false;
+    }
+    Fiber::get_this()->yield();
+    if (timer) {
+        timer->cancel();
+    }
+    if (*timed_out) {
+        LOG_DEBUG(logger) << "sendfile timeout, fd = " << sockfd;
+        errno = ETIMEDOUT;
+        return false;
+    }
+    return true;
+}
+
+bool HttpSession::fill_buffer() {
+    // 缓冲区中的数据都已经交给解析器, 解析器自己保存了未完成的部分, 从头开始读
+    m_read_pos = m_write_pos = 0;
+    // 要阻塞等待新的数据了, 先把这一批请求的响应写出去
+    if (flush() < 0) {
+        return false;
+    }
+
+    ssize_t len = static_cast<ssize_t>(read(m_buffer.data(), m_buffer.size()));
+    if (len <= 0) {
+        LOG_DEBUG(logger) << "request len == " << len
+                          << " socket is connected: " << get_socket()->is_connected();
+        return false;
+    }
+    m_write_pos = len;
+
+    // 一次读满说明对端发送得更快, 扩大缓冲区以便一次读取更多流水线请求
+    if (m_write_pos == m_buffer.size() &&
+        m_buffer.size() < HttpRequestParser::get_http_request_buffer_size() * MAX_BUFFER_MULTIPLE) {
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+    return true;
+}
+
+ssize_t HttpSession::write_iovec(iovec* iovs, size_t count) {
+    ssize_t total = 0;
+    while (true) {
+        // 跳过已经写完的部分
+        while (count > 0 && iovs->iov_len == 0) {
+            ++iovs;
+            --count;
+        }
+        if (count == 0) {
+            return total;
+        }
+
+        ssize_t len = get_socket()->send(iovs, count);
+        if (len <= 0) {
+            return -1;
+        }
+        total += len;
+        while (len > 0) {
+            size_t n = std::min<size_t>(len, iovs->iov_len);
+            iovs->iov_base = static_cast<char*>(iovs->iov_base) + n;
+            iovs->iov_len -= n;
+            len -= n;
+            if (iovs->iov_len == 0) {
+                ++iovs;
+                --count;
+            }
+        }
+    }
 }
 
-}  // namespace acid::http
\ No newline at end of file
+}  // namespace acid::http
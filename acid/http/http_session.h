@@ -10,20 +10,167 @@
 #ifndef DF_HTTP_SESSION_H
 #define DF_HTTP_SESSION_H
 
+#include "acid/common/stream.h"
 #include "acid/net/socket_stream.h"
 #include "http.h"
+#include "http_compress.h"
+#include "http_parse.h"
+
+#include <string>
+#include <sys/uio.h>
+#include <vector>
 
 namespace acid::http {
 
+class HttpSession;
+
+/**
+ * @brief servlet按流读取请求体和发送响应体
+ * read按需从连接上拉取请求体, 读完返回0; write把数据作为一个分块立即发送, 第一次写入时先发送响应头,
+ * HTTP/1.0的客户端不支持分块传输, 改为发送完关闭连接。每个连接占用的内存与请求体和响应体的大小无关。
+ * 客户端接受压缩时, 每次write的数据压缩并刷新后作为一个分块发送
+ */
+class HttpBodyStream : public Stream {
+public:
+    using ptr = std::shared_ptr<HttpBodyStream>;
+
+    HttpBodyStream(HttpSession* session, HttpResponse::ptr response);
+
+    size_t read(void* buffer, size_t length) override;
+
+    size_t read(ByteArray::ptr byte_array, size_t length) override;
+
+    size_t write(const void* buffer, size_t length) override;
+
+    size_t write(ByteArray::ptr byte_array, size_t length) override;
+
+    /**
+     * @brief 结束响应体, 之后不能再写入
+     */
+    void close() override;
+
+private:
+    HttpSession* m_session;
+    HttpResponse::ptr m_response;
+};
+
 class HttpSession : public SocketStream {
 public:
     using ptr = std::shared_ptr<HttpSession>;
 
     HttpSession(Socket::ptr socket, bool owner = true);
 
+    /**
+     * @brief 接收一个请求的请求头
+     * 连接上的缓冲区和解析器在请求之间复用, 一次读取到的多个流水线请求依次返回, 不再重新读取。
+     * 请求体需要再调用recv_body整体读入, 或者通过get_body_stream按流读取
+     * @return HttpRequest::ptr 连接关闭或者请求出错返回nullptr
+     */
     HttpRequest::ptr recv_request();
 
+    /**
+     * @brief 把请求体整体读入request
+     * @return 请求体超过http.request.max_body_size或者连接出错返回false
+     */
+    bool recv_body(HttpRequest::ptr request);
+
+    /**
+     * @brief 读取一部分请求体
+     * @return 读取的长度, 请求体已经读完返回0, 出错返回-1
+     */
+    ssize_t read_body(void* buffer, size_t length);
+
+    /**
+     * @brief 丢弃servlet没有读取的请求体, 使连接可以继续接收下一个请求
+     * @return 请求体过大或者连接出错, 连接不能复用时返回false
+     */
+    bool finish_request();
+
+    /**
+     * @brief 获取servlet读写请求体和响应体的流
+     */
+    HttpBodyStream::ptr get_body_stream(HttpResponse::ptr response);
+
+    /**
+     * @brief 发送一个响应体分块, 第一次调用时先发送响应头
+     * @return 发送的长度, 失败返回-1
+     */
+    ssize_t write_chunk(HttpResponse::ptr response, const void* data, size_t length);
+
+    /**
+     * @brief 结束分块发送的响应体
+     */
+    ssize_t finish_chunk(HttpResponse::ptr response);
+
+    /**
+     * @brief 发送响应
+     * 缓冲区中还有未处理的流水线请求时, 响应先暂存, 处理完这一批请求后合并成一次写入;
+     * 较大的响应体不拷贝, 与响应头一起通过writev发送, 文件响应体通过sendfile发送。
+     * 响应体已经按流发送时只结束分块传输
+     */
     ssize_t send_response(HttpResponse::ptr response);
+
+    /**
+     * @brief 写出暂存的响应
+     * @return 失败返回-1
+     */
+    ssize_t flush();
+
+    /**
+     * @brief 先写出暂存的响应再关闭连接
+     * 流水线请求的响应可能还暂存着, 之后的请求体丢弃失败等原因关闭连接时不能丢掉已经生成的响应
+     */
+    void close() override;
+
+    /**
+     * @brief 连接上收到的数据是否以prefix开头, 数据留在缓冲区中, 不匹配时继续作为http请求解析
+     * 用于识别HTTP/2的连接序言, 第一个字节不匹配时不会多读
+     */
+    bool check_prefix(const std::string& prefix);
+
+    /**
+     * @brief 取出已经读入但是还没有解析的数据, 用于升级协议后交给新的会话
+     * 读缓冲区同时释放, 之后不能再接收请求
+     */
+    std::string take_buffer();
+
+private:
+    /**
+     * @brief 解析请求体
+     * @param output 为nullptr时请求体保存到请求中, 解析完整个请求体才返回;
+     *               否则最多拷贝length字节到output, 有数据就返回
+     * @return 拷贝的长度, 请求体已经结束返回0, 出错返回-1
+     */
+    ssize_t parse_body(char* output, size_t length);
+
+    // 发送一个响应体分块, 响应头还没有发送时一起发送, 失败返回-1
+    ssize_t send_chunk(HttpResponse::ptr response, const void* data, size_t length);
+
+    // 通过sendfile发送文件的一部分, 失败返回-1
+    ssize_t send_file(int fd, uint64_t offset, uint64_t length);
+
+    // 等待socket可写, 超过socket的发送超时返回false
+    bool wait_writable(int sockfd);
+
+    // 缓冲区中的数据都已解析, 写出暂存的响应后重新读取, 连接关闭或出错返回false
+    bool fill_buffer();
+
+    // 写出iovs中的全部数据, 会修改iovs, 失败返回-1
+    ssize_t write_iovec(iovec* iovs, size_t count);
+
+private:
+    HttpRequestParser m_parser;
+    std::vector<char> m_buffer;            // 读缓冲区, 只在装满时扩容
+    size_t m_read_pos = 0;                 // 下一个待解析的位置
+    size_t m_write_pos = 0;                // 已读入数据的末尾
+    std::string m_output;                  // 暂存的响应
+    HttpRequest::ptr m_request;            // 正在处理的请求
+    uint64_t m_body_size = 0;              // 已经读取的请求体长度
+    bool m_expect_continue = false;        // 客户端等待100 Continue后才发送请求体
+    HttpResponse::ptr m_stream_response;   // 正在按流发送的响应
+    bool m_stream_finished = false;        // 按流发送的响应是否已经结束
+    HttpCompressor::ptr m_stream_compressor;  // 按流发送的响应体的压缩器
+    std::string m_compress_output;         // 压缩后的分块, 在分块之间复用
 };
 
 }
@@ -0,0 +1,184 @@
+#include "route_tree.h"
+
+namespace acid::http {
+
+struct RouteTree::Node {
+    std::string prefix;                           // 静态文本, 相同前缀的路由共用节点
+    std::string indices;                          // 每个静态子节点前缀的首字符, 用于快速查找
+    std::vector<std::unique_ptr<Node>> children;  // 静态子节点
+    std::unique_ptr<Node> param;                  // :param子节点, 匹配一个路径段
+    std::unique_ptr<Node> wildcard;               // *wildcard子节点, 匹配剩余路径
+    std::vector<Handler> handlers;                // 在该节点结束的路由
+};
+
+RouteTree::RouteTree() : m_root(std::make_unique<Node>()) {
+}
+
+RouteTree::~RouteTree() = default;
+
+// :param只能出现在路径段开头, *wildcard出现在路径段开头或者路由末尾
+static bool is_param(std::string_view pattern, size_t pos) {
+    return pattern[pos] == ':' && (pos == 0 || pattern[pos - 1] == '/');
+}
+
+static bool is_wildcard(std::string_view pattern, size_t pos) {
+    return pattern[pos] == '*' &&
+           (pos == 0 || pattern[pos - 1] == '/' || pos + 1 == pattern.size());
+}
+
+RouteTree::AddResult RouteTree::add(std::string_view pattern, bool literal, bool any_method,
+                                    HttpMethod method, size_t id) {
+    Node* node = m_root.get();
+    std::vector<std::string> names;
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        if (!literal && is_param(pattern, pos)) {
+            size_t end = pattern.find('/', pos);
+            if (end == std::string_view::npos) {
+                end = pattern.size();
+            }
+            if (end == pos + 1) {
+                return INVALID_PATTERN;
+            }
+            names.emplace_back(pattern.substr(pos + 1, end - pos - 1));
+            if (!node->param) {
+                node->param = std::make_unique<Node>();
+            }
+            node = node->param.get();
+            pos = end;
+            continue;
+        }
+
+        if (!literal && is_wildcard(pattern, pos)) {
+            std::string_view name = pattern.substr(pos + 1);
+            if (name.find('/') != std::string_view::npos) {
+                return INVALID_PATTERN;
+            }
+            names.emplace_back(name.empty() ? "*" : name);
+            if (!node->wildcard) {
+                node->wildcard = std::make_unique<Node>();
+            }
+            node = node->wildcard.get();
+            break;
+        }
+
+        size_t end = pos;
+        while (end < pattern.size() &&
+               (literal || (!is_param(pattern, end) && !is_wildcard(pattern, end)))) {
+            ++end;
+        }
+        node = insert_static(node, pattern.substr(pos, end - pos));
+        pos = end;
+    }
+
+    for (auto& i : node->handlers) {
+        if (literal || i.literal ||
+            (i.any_method == any_method && (any_method || i.method == method))) {
+            return CONFLICT;
+        }
+    }
+    node->handlers.push_back({id, literal, any_method, method, std::move(names)});
+    return OK;
+}
+
+RouteTree::Node* RouteTree::insert_static(Node* node, std::string_view text) {
+    while (!text.empty()) {
+        size_t index = node->indices.find(text[0]);
+        if (index == std::string::npos) {
+            auto child = std::make_unique<Node>();
+            child->prefix = text;
+            Node* result = child.get();
+            node->indices.push_back(text[0]);
+            node->children.push_back(std::move(child));
+            return result;
+        }
+
+        Node* child = node->children[index].get();
+        size_t common = 0;
+        while (common < child->prefix.size() && common < text.size() &&
+               child->prefix[common] == text[common]) {
+            ++common;
+        }
+        // 只有一部分前缀相同, 把子节点拆成公共前缀和剩余部分两个节点
+        if (common < child->prefix.size()) {
+            auto split = std::make_unique<Node>();
+            split->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            split->indices.push_back(child->prefix[0]);
+            split->children.push_back(std::move(node->children[index]));
+            node->children[index] = std::move(split);
+            child = node->children[index].get();
+        }
+        node = child;
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+const RouteTree::Handler* RouteTree::match(HttpMethod method, std::string_view path,
+                                           std::vector<std::string_view>& values) const {
+    values.clear();
+    return match_node(m_root.get(), method, path, values);
+}
+
+const RouteTree::Handler* RouteTree::match_node(const Node* node, HttpMethod method,
+                                                std::string_view path,
+                                                std::vector<std::string_view>& values) {
+    const Handler* handler = nullptr;
+    if (path.empty()) {
+        if ((handler = find_handler(node, method))) {
+            return handler;
+        }
+    }
+    else {
+        // 静态文本优先
+        size_t index = node->indices.find(path[0]);
+        if (index != std::string::npos) {
+            const Node* child = node->children[index].get();
+            if (path.compare(0, child->prefix.size(), child->prefix) == 0 &&
+                (handler = match_node(child, method, path.substr(child->prefix.size()), values))) {
+                return handler;
+            }
+        }
+
+        // 再匹配一个路径段作为参数
+        if (node->param) {
+            size_t end = path.find('/');
+            if (end == std::string_view::npos) {
+                end = path.size();
+            }
+            if (end > 0) {
+                values.push_back(path.substr(0, end));
+                if ((handler = match_node(node->param.get(), method, path.substr(end), values))) {
+                    return handler;
+                }
+                values.pop_back();
+            }
+        }
+    }
+
+    // 最后由通配符匹配剩余的全部路径, 可以为空
+    if (node->wildcard && (handler = find_handler(node->wildcard.get(), method))) {
+        values.push_back(path);
+        return handler;
+    }
+    return nullptr;
+}
+
+const RouteTree::Handler* RouteTree::find_handler(const Node* node, HttpMethod method) {
+    const Handler* any = nullptr;
+    for (auto& handler : node->handlers) {
+        if (method == HttpMethod::INVALID_METHOD) {
+            return &handler;
+        }
+        if (handler.any_method) {
+            any = &handler;
+        }
+        else if (handler.method == method) {
+            return &handler;
+        }
+    }
+    return any;
+}
+
+}  // namespace acid::http
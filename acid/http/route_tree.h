@@ -0,0 +1,99 @@
+/*!
+ * @file route_tree.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief 压缩前缀树路由
+ * @version 0.1
+ * @date 2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_ROUTE_TREE_H
+#define DF_ROUTE_TREE_H
+
+#include "http.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace acid::http {
+
+/**
+ * @brief 压缩前缀树(radix tree)路由表
+ * 路由由静态文本, :param和*wildcard组成, 例如 /user/:id/profile, 或者在 /user/:id/files/ 后接 *path。
+ * :param匹配一个路径段, *wildcard匹配剩余的全部路径, 只能出现在末尾。
+ * 匹配时静态文本优先于参数, 参数优先于通配符, 不匹配时回溯尝试下一种。
+ * 建立之后只读, 多个线程可以同时匹配
+ */
+class RouteTree {
+public:
+    using ptr = std::shared_ptr<RouteTree>;
+
+    /**
+     * @brief 路由对应的处理者
+     */
+    struct Handler {
+        size_t id;                             // 调用者用来找到servlet的编号
+        bool literal;                          // 是否是精确路由, 精确路由独占所在节点
+        bool any_method;                       // 是否接受任意请求方法
+        HttpMethod method;                     // any_method为false时只接受该方法
+        std::vector<std::string> param_names;  // 按出现顺序的参数名
+    };
+
+    /**
+     * @brief 添加路由的结果
+     */
+    enum AddResult {
+        OK = 0,
+        INVALID_PATTERN,  // 路由不合法
+        CONFLICT,         // 与已添加的路由冲突, 保留先添加的
+    };
+
+    RouteTree();
+
+    ~RouteTree();
+
+    /**
+     * @brief 添加路由
+     * 同一节点上已有相同方法的处理者, 或者已有精确路由(精确路由接受任意方法且不让位于按方法的路由)时冲突,
+     * 先添加的优先, 不会被静默替换
+     *
+     * @param pattern 路由
+     * @param literal 为true时pattern中的:和*都是普通字符, 用于精确匹配
+     * @param any_method 是否接受任意请求方法
+     * @param method any_method为false时接受的请求方法
+     * @param id 匹配成功时返回给调用者的编号
+     */
+    AddResult add(std::string_view pattern, bool literal, bool any_method, HttpMethod method,
+                  size_t id);
+
+    /**
+     * @brief 匹配路径
+     *
+     * @param method 请求方法, 为INVALID_METHOD时不区分方法
+     * @param path 请求路径
+     * @param values 输出按出现顺序的参数值, 指向path内部
+     * @return const Handler* 没有匹配的路由返回nullptr
+     */
+    const Handler* match(HttpMethod method, std::string_view path,
+                         std::vector<std::string_view>& values) const;
+
+private:
+    struct Node;
+
+    // 在node下插入静态文本, 返回文本结尾对应的节点
+    static Node* insert_static(Node* node, std::string_view text);
+
+    static const Handler* match_node(const Node* node, HttpMethod method, std::string_view path,
+                                     std::vector<std::string_view>& values);
+
+    static const Handler* find_handler(const Node* node, HttpMethod method);
+
+private:
+    std::unique_ptr<Node> m_root;
+};
+
+}  // namespace acid::http
+
+#endif  // DF_ROUTE_TREE_H
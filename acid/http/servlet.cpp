@@ -1,10 +1,16 @@
 #include "servlet.h"
 
+#include "acid/logger/logger.h"
+
+#include <atomic>
 #include <fnmatch.h>
 
 namespace acid::http {
 
-FunctionServlet::FunctionServlet(callback cb) : Servlet("FunctionServlet"), m_cb(cb) {
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+FunctionServlet::FunctionServlet(callback cb, bool stream_body)
+    : Servlet("FunctionServlet"), m_cb(cb), m_stream_body(stream_body) {
 }
 
 int32_t FunctionServlet::handle(HttpRequest::ptr request, HttpResponse::ptr response,
@@ -12,13 +18,37 @@ int32_t FunctionServlet::handle(HttpRequest::ptr request, HttpResponse::ptr resp
     return m_cb(request, response, session);
 }
 
+FunctionWSServlet::FunctionWSServlet(callback cb, on_connect_cb connect_cb, on_close_cb close_cb)
+    : WSServlet("FunctionWSServlet")
+    , m_cb(cb)
+    , m_on_connect(connect_cb)
+    , m_on_close(close_cb) {
+}
+
+int32_t FunctionWSServlet::on_connect(HttpRequest::ptr request, WSSession::ptr session) {
+    return m_on_connect ? m_on_connect(request, session) : 0;
+}
+
+int32_t FunctionWSServlet::on_close(HttpRequest::ptr request, WSSession::ptr session) {
+    return m_on_close ? m_on_close(request, session) : 0;
+}
+
+int32_t FunctionWSServlet::handle(HttpRequest::ptr request, WSFrameMessage::ptr message,
+                                  WSSession::ptr session) {
+    return m_cb(request, message, session);
+}
+
+// 快照的代号, 所有ServletDispatch共用一个计数器, 线程缓存据此区分不同实例的快照
+static std::atomic<uint64_t> s_generation {0};
+
 ServletDispatch::ServletDispatch() : Servlet("ServletDispatch") {
     m_default.reset(new NotFoundServlet("acid"));
+    rebuild();
 }
 
 int32_t ServletDispatch::handle(HttpRequest::ptr request, HttpResponse::ptr response,
                                 HttpSession::ptr session) {
-    auto servlet = get_matched_servlet(request->get_path());
+    auto servlet = get_matched_servlet(request);
     if (servlet) {
         servlet->handle(request, response, session);
     }
@@ -26,13 +56,13 @@ int32_t ServletDispatch::handle(HttpRequest::ptr request, HttpResponse::ptr resp
 }
 
 void ServletDispatch::add_servlet(const std::string &uri, Servlet::ptr servlet) {
-    WriteLockGuard lock(m_mutex);
-    m_datas[uri] = std::make_shared<HoldServletCreator>(servlet);
+    add_servlet_creator(uri, std::make_shared<HoldServletCreator>(servlet));
 }
 
 void ServletDispatch::add_servlet_creator(const std::string &uri, IServletCreator::ptr creator) {
     WriteLockGuard lock(m_mutex);
     m_datas[uri] = creator;
+    rebuild();
 }
 
 void ServletDispatch::add_glob_servlet_creator(const std::string &uri,
@@ -45,31 +75,76 @@ void ServletDispatch::add_glob_servlet_creator(const std::string &uri,
         }
     }
     m_globs.emplace_back(uri, creator);
+    rebuild();
 }
 
 void ServletDispatch::add_servlet(const std::string &uri, FunctionServlet::callback cb) {
-    WriteLockGuard lock(m_mutex);
-    m_datas[uri] = std::make_shared<HoldServletCreator>(std::make_shared<FunctionServlet>(cb));
+    add_servlet(uri, std::make_shared<FunctionServlet>(cb));
 }
 
 void ServletDispatch::add_glob_servlet(const std::string &uri, Servlet::ptr servlet) {
+    add_glob_servlet_creator(uri, std::make_shared<HoldServletCreator>(servlet));
+}
+
+void ServletDispatch::add_glob_servlet(const std::string &uri, FunctionServlet::callback cb) {
+    add_glob_servlet(uri, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::add_stream_servlet(const std::string &uri, FunctionServlet::callback cb) {
+    add_servlet(uri, std::make_shared<FunctionServlet>(cb, true));
+}
+
+void ServletDispatch::add_ws_servlet(const std::string &uri, FunctionWSServlet::callback cb,
+                                     FunctionWSServlet::on_connect_cb connect_cb,
+                                     FunctionWSServlet::on_close_cb close_cb) {
+    add_servlet(uri, std::make_shared<FunctionWSServlet>(cb, connect_cb, close_cb));
+}
+
+void ServletDispatch::add_route(HttpMethod method, const std::string &pattern,
+                                Servlet::ptr servlet) {
     WriteLockGuard lock(m_mutex);
-    for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-        if (it->first == uri) {
-            m_globs.erase(it);
+    for (auto it = m_routes.begin(); it != m_routes.end(); ++it) {
+        if (it->pattern == pattern && !it->any_method && it->method == method) {
+            m_routes.erase(it);
             break;
         }
     }
-    m_globs.emplace_back(uri, std::make_shared<HoldServletCreator>(servlet));
+    m_routes.push_back({pattern, false, method, std::make_shared<HoldServletCreator>(servlet)});
+    rebuild();
 }
 
-void ServletDispatch::add_glob_servlet(const std::string &uri, FunctionServlet::callback cb) {
-    add_glob_servlet(uri, std::make_shared<FunctionServlet>(cb));
+void ServletDispatch::add_route(HttpMethod method, const std::string &pattern,
+                                FunctionServlet::callback cb) {
+    add_route(method, pattern, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::add_route(const std::string &pattern, Servlet::ptr servlet) {
+    WriteLockGuard lock(m_mutex);
+    for (auto it = m_routes.begin(); it != m_routes.end(); ++it) {
+        if (it->pattern == pattern && it->any_method) {
+            m_routes.erase(it);
+            break;
+        }
+    }
+    m_routes.push_back({pattern, true, HttpMethod::INVALID_METHOD,
+                        std::make_shared<HoldServletCreator>(servlet)});
+    rebuild();
+}
+
+void ServletDispatch::add_route(const std::string &pattern, FunctionServlet::callback cb) {
+    add_route(pattern, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::del_route(const std::string &pattern) {
+    WriteLockGuard lock(m_mutex);
+    std::erase_if(m_routes, [&pattern](const Route &route) { return route.pattern == pattern; });
+    rebuild();
 }
 
 void ServletDispatch::del_servlet(const std::string &uri) {
     WriteLockGuard lock(m_mutex);
     m_datas.erase(uri);
+    rebuild();
 }
 
 void ServletDispatch::del_glob_servlet(const std::string &uri) {
@@ -80,6 +155,7 @@ void ServletDispatch::del_glob_servlet(const std::string &uri) {
             break;
         }
     }
+    rebuild();
 }
 
 Servlet::ptr ServletDispatch::get_servlet(const std::string &uri) {
@@ -99,19 +175,90 @@ Servlet::ptr ServletDispatch::get_glob_servlet(const std::string &uri) {
 }
 
 Servlet::ptr ServletDispatch::get_matched_servlet(const std::string &uri) {
-    ReadLockGuard lock(m_mutex);
-    auto data_it = m_datas.find(uri);
-    if (data_it != m_datas.end()) {
-        return data_it->second->get();
+    return match(HttpMethod::INVALID_METHOD, uri, nullptr);
+}
+
+Servlet::ptr ServletDispatch::get_matched_servlet(HttpRequest::ptr request) {
+    return match(request->get_method(), request->get_path(), request.get());
+}
+
+Servlet::ptr ServletDispatch::match(HttpMethod method, std::string_view path,
+                                    HttpRequest *request) const {
+    // 每个线程缓存最近使用的快照, 代号没有变化时直接使用, 不加锁也不修改共享的引用计数;
+    // 路由修改后或者换了一个ServletDispatch时重新取一次, 旧的快照在这时释放
+    static thread_local std::shared_ptr<const Snapshot> t_snapshot;
+    if (!t_snapshot || t_snapshot->generation != m_generation.load(std::memory_order_acquire))
+        [[unlikely]] {
+        t_snapshot = m_snapshot.load(std::memory_order_acquire);
     }
-    for (auto &i : m_globs) {
-        if (fnmatch(i.first.c_str(), uri.c_str(), 0) == 0) {
+    const Snapshot* snapshot = t_snapshot.get();
+    static thread_local std::vector<std::string_view> values;
+    auto handler = snapshot->tree.match(method, path, values);
+    if (handler) {
+        auto &[creator, capture] = snapshot->handlers[handler->id];
+        if (capture && request) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                request->set_param(handler->param_names[i], values[i]);
+            }
+        }
+        return creator->get();
+    }
+    if (snapshot->globs.empty()) {
+        return m_default;
+    }
+    // fnmatch需要以'\0'结尾的字符串
+    std::string glob_path(path);
+    for (auto &i : snapshot->globs) {
+        if (fnmatch(i.first.c_str(), glob_path.c_str(), 0) == 0) {
             return i.second->get();
         }
     }
     return m_default;
 }
 
+// 只有结尾一个*的glob可以编入前缀树, 其它的仍然用fnmatch匹配
+static bool is_prefix_glob(const std::string &uri) {
+    return !uri.empty() && uri.back() == '*' &&
+           uri.find_first_of("*?[\\:") == uri.size() - 1;
+}
+
+void ServletDispatch::rebuild() {
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->generation = ++s_generation;
+    auto &handlers = snapshot->handlers;
+    // 按 精确路由, 前缀glob, add_route添加的路由 的顺序编入, 同一节点上冲突时先编入的优先
+    for (auto &i : m_datas) {
+        snapshot->tree.add(i.first, true, true, HttpMethod::INVALID_METHOD, handlers.size());
+        handlers.emplace_back(i.second, false);
+    }
+    for (auto &i : m_globs) {
+        if (!is_prefix_glob(i.first)) {
+            snapshot->globs.push_back(i);
+        }
+        else if (snapshot->tree.add(i.first, false, true, HttpMethod::INVALID_METHOD,
+                                    handlers.size()) == RouteTree::OK) {
+            handlers.emplace_back(i.second, false);
+        }
+    }
+    for (auto &i : m_routes) {
+        auto rt = snapshot->tree.add(i.pattern, false, i.any_method, i.method, handlers.size());
+        if (rt == RouteTree::INVALID_PATTERN) {
+            LOG_ERROR(logger) << "invalid route pattern: " << i.pattern;
+            continue;
+        }
+        if (rt == RouteTree::CONFLICT) {
+            LOG_WARN(logger) << "route " << i.pattern
+                             << " conflicts with an existing servlet or route, ignored";
+            continue;
+        }
+        handlers.emplace_back(i.creator, true);
+    }
+    uint64_t generation = snapshot->generation;
+    m_snapshot.store(std::move(snapshot), std::memory_order_release);
+    // 先发布快照再发布代号, 看到新代号的线程一定能取到对应的快照
+    m_generation.store(generation, std::memory_order_release);
+}
+
 void ServletDispatch::list_all_servlet_creator(std::map<std::string, IServletCreator::ptr> &infos) {
     ReadLockGuard lock(m_mutex);
     for (auto &i : m_datas) {
@@ -121,6 +268,7 @@ void ServletDispatch::list_all_servlet_creator(std::map<std::string, IServletCre
 
 void ServletDispatch::list_all_glob_servlet_creator(
     std::map<std::string, IServletCreator::ptr> &infos) {
+    ReadLockGuard lock(m_mutex);
     for (auto &i : m_globs) {
         infos[i.first] = i.second;
     }
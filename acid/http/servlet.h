@@ -12,8 +12,12 @@
 
 #include "http.h"
 #include "http_session.h"
+#include "route_tree.h"
+#include "ws_session.h"
 #include "acid/common/util.h"
 
+#include <atomic>
+
 namespace acid::http {
 
 class Servlet {
@@ -33,6 +37,21 @@ public:
         return m_name;
     }
 
+    /**
+     * @brief 是否由servlet通过HttpBodyStream自己读取请求体
+     * 为false时请求体在调用handle之前整体读入HttpRequest, 大小受http.request.max_body_size限制
+     */
+    virtual bool is_stream_body() const {
+        return false;
+    }
+
+    /**
+     * @brief 是否是处理websocket连接的WSServlet
+     */
+    virtual bool is_websocket() const {
+        return false;
+    }
+
 protected:
     std::string m_name;
 };
@@ -43,13 +62,73 @@ public:
     using callback = std::function<int32_t(HttpRequest::ptr request, HttpResponse::ptr response,
                                            HttpSession::ptr session)>;
 
-    explicit FunctionServlet(callback cb);
+    explicit FunctionServlet(callback cb, bool stream_body = false);
 
     int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
                            HttpSession::ptr session) override;
 
+    bool is_stream_body() const override {
+        return m_stream_body;
+    }
+
 private:
     callback m_cb;
+    bool m_stream_body;
+};
+
+/**
+ * @brief 处理websocket连接的servlet
+ * 握手成功后调用on_connect, 之后每收到一条消息调用一次handle, 返回非0时关闭连接;
+ * 连接关闭后调用on_close
+ */
+class WSServlet : public Servlet {
+public:
+    using ptr = std::shared_ptr<WSServlet>;
+
+    explicit WSServlet(const std::string& name) : Servlet(name) {
+    }
+
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                   HttpSession::ptr session) override {
+        return 0;
+    }
+
+    virtual int32_t on_connect(HttpRequest::ptr request, WSSession::ptr session) = 0;
+
+    virtual int32_t on_close(HttpRequest::ptr request, WSSession::ptr session) = 0;
+
+    virtual int32_t handle(HttpRequest::ptr request, WSFrameMessage::ptr message,
+                           WSSession::ptr session) = 0;
+
+    bool is_websocket() const override {
+        return true;
+    }
+};
+
+class FunctionWSServlet : public WSServlet {
+public:
+    using ptr = std::shared_ptr<FunctionWSServlet>;
+    using on_connect_cb = std::function<int32_t(HttpRequest::ptr request, WSSession::ptr session)>;
+    using on_close_cb = std::function<int32_t(HttpRequest::ptr request, WSSession::ptr session)>;
+    using callback = std::function<int32_t(HttpRequest::ptr request, WSFrameMessage::ptr message,
+                                           WSSession::ptr session)>;
+
+    explicit FunctionWSServlet(callback cb, on_connect_cb connect_cb = nullptr,
+                               on_close_cb close_cb = nullptr);
+
+    int32_t on_connect(HttpRequest::ptr request, WSSession::ptr session) override;
+
+    int32_t on_close(HttpRequest::ptr request, WSSession::ptr session) override;
+
+    int32_t handle(HttpRequest::ptr request, WSFrameMessage::ptr message,
+                   WSSession::ptr session) override;
+
+    using WSServlet::handle;
+
+private:
+    callback m_cb;
+    on_connect_cb m_on_connect;
+    on_close_cb m_on_close;
 };
 
 class IServletCreator {
@@ -101,6 +180,12 @@ class ServletCreator : public IServletCreator {
     }
 };
 
+/**
+ * @brief 按uri分发请求的servlet
+ * 精确路由, 形如"/prefix*"的glob和add_route添加的路由都编入一棵压缩前缀树,
+ * 其它glob按添加顺序用fnmatch匹配。同一路径上精确路由优先于前缀glob, 前缀glob优先于add_route,
+ * 冲突的后者被忽略并打印警告。修改时重建只读快照并原子替换, 匹配时使用线程缓存的快照, 不加锁
+ */
 class ServletDispatch : public Servlet {
 public:
     using ptr = std::shared_ptr<ServletDispatch>;
@@ -122,6 +207,40 @@ public:
 
     void add_glob_servlet(const std::string& uri, FunctionServlet::callback cb);
 
+    /**
+     * @brief 添加按流读取请求体的servlet, 用于上传大文件
+     */
+    void add_stream_servlet(const std::string& uri, FunctionServlet::callback cb);
+
+    /**
+     * @brief 添加websocket servlet, uri上的请求需要升级到websocket
+     */
+    void add_ws_servlet(const std::string& uri, FunctionWSServlet::callback cb,
+                        FunctionWSServlet::on_connect_cb connect_cb = nullptr,
+                        FunctionWSServlet::on_close_cb close_cb = nullptr);
+
+    /**
+     * @brief 添加带参数的路由, 例如 /user/:id/profile, 或者在 /user/:id/files/ 后接 *path
+     * :param匹配一个路径段, *wildcard匹配剩余的全部路径,
+     * 匹配成功时参数值通过HttpRequest::set_param设置到请求中
+     * @param method 只接受该请求方法
+     */
+    void add_route(HttpMethod method, const std::string& pattern, Servlet::ptr servlet);
+
+    void add_route(HttpMethod method, const std::string& pattern, FunctionServlet::callback cb);
+
+    /**
+     * @brief 添加接受任意请求方法的路由
+     */
+    void add_route(const std::string& pattern, Servlet::ptr servlet);
+
+    void add_route(const std::string& pattern, FunctionServlet::callback cb);
+
+    /**
+     * @brief 删除pattern的全部路由
+     */
+    void del_route(const std::string& pattern);
+
     void add_servlet_creator(const std::string& uri, IServletCreator::ptr creator);
 
     void add_glob_servlet_creator(const std::string& uri, IServletCreator::ptr creator);
@@ -152,15 +271,52 @@ public:
 
     Servlet::ptr get_glob_servlet(const std::string& uri);
 
+    /**
+     * @brief 不区分请求方法地匹配uri
+     */
     Servlet::ptr get_matched_servlet(const std::string& uri);
 
+    /**
+     * @brief 按请求方法和路径匹配, 并把路由参数设置到request中
+     */
+    Servlet::ptr get_matched_servlet(HttpRequest::ptr request);
+
     void list_all_servlet_creator(std::map<std::string, IServletCreator::ptr>& infos);
     void list_all_glob_servlet_creator(std::map<std::string, IServletCreator::ptr>& infos);
 
 private:
-    RwMutexType m_mutex;
+    struct Route {
+        std::string pattern;
+        bool any_method;
+        HttpMethod method;
+        IServletCreator::ptr creator;
+    };
+
+    /**
+     * @brief 路由表的只读快照
+     */
+    struct Snapshot {
+        uint64_t generation = 0;  // 全局唯一的代号
+        RouteTree tree;
+        // 按RouteTree::Handler::id索引, capture为false时不设置参数(来自glob的通配符)
+        std::vector<std::pair<IServletCreator::ptr, bool>> handlers;
+        // 无法编入前缀树的glob
+        std::vector<std::pair<std::string, IServletCreator::ptr>> globs;
+    };
+
+    // 根据当前路由表重建快照, 调用时需持有写锁
+    void rebuild();
+
+    // 在当前快照中匹配, request不为空时把路由参数设置到其中
+    Servlet::ptr match(HttpMethod method, std::string_view path, HttpRequest* request) const;
+
+private:
+    RwMutexType m_mutex;  // 只保护修改, 匹配时读快照
     std::unordered_map<std::string, IServletCreator::ptr> m_datas;
     std::vector<std::pair<std::string, IServletCreator::ptr>> m_globs;
+    std::vector<Route> m_routes;
+    std::atomic<std::shared_ptr<const Snapshot>> m_snapshot;
+    std::atomic<uint64_t> m_generation {0};  // m_snapshot的代号, 匹配时据此判断线程缓存是否过期
     Servlet::ptr m_default;
 };
 
@@ -0,0 +1,481 @@
+#include "static_file_servlet.h"
+
+#include "acid/common/config.h"
+#include "acid/logger/logger.h"
+
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace acid::http {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_http_static_cache_size = Config::look_up<uint64_t>(
+    "http.static.cache_size", 64 * 1024 * 1024, "http static file cache size");
+static ConfigVar<uint64_t>::ptr g_http_static_cache_max_file_size = Config::look_up<uint64_t>(
+    "http.static.cache_max_file_size", 64 * 1024,
+    "http static file max size to cache, larger files are sent by sendfile");
+
+static uint64_t s_http_static_cache_size = 0;
+static uint64_t s_http_static_cache_max_file_size = 0;
+
+struct _StaticFileIniter {
+    _StaticFileIniter() {
+        s_http_static_cache_size = g_http_static_cache_size->get_value();
+        g_http_static_cache_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http static cache size change from " << old_val << " to "
+                                 << new_val;
+                s_http_static_cache_size = new_val;
+            });
+
+        s_http_static_cache_max_file_size = g_http_static_cache_max_file_size->get_value();
+        g_http_static_cache_max_file_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "http static cache max file size change from " << old_val
+                                 << " to " << new_val;
+                s_http_static_cache_max_file_size = new_val;
+            });
+    }
+};
+
+static _StaticFileIniter s_initer;
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap(data, size);
+    }
+}
+
+MappedFile::ptr MappedFileCache::get(const std::string& path, int fd, const struct stat& st) {
+    bool writable = st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH);
+    MutexType::Lock lock(m_mutex);
+    auto it = m_index.find(path);
+    if (it != m_index.end()) {
+        MappedFile::ptr file = *it->second;
+        if (!writable && file->dev == st.st_dev && file->ino == st.st_ino &&
+            file->size == static_cast<uint64_t>(st.st_size) &&
+            file->mtime.tv_sec == st.st_mtim.tv_sec && file->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            m_files.splice(m_files.begin(), m_files, it->second);
+            return file;
+        }
+        // 文件已经修改或者替换, 丢弃旧的映射
+        m_size -= file->size;
+        m_files.erase(it->second);
+        m_index.erase(it);
+    }
+    lock.unlock();
+
+    if (writable) {
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        LOG_DEBUG(logger) << "mmap " << path << " fail, errno = " << errno;
+        return nullptr;
+    }
+    MappedFile::ptr file = std::make_shared<MappedFile>();
+    file->path = path;
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->mtime = st.st_mtim;
+    file->size = st.st_size;
+    file->data = data;
+
+    lock.lock();
+    // 其他协程可能已经映射了同一个文件
+    it = m_index.find(path);
+    if (it != m_index.end()) {
+        m_size -= (*it->second)->size;
+        m_files.erase(it->second);
+        m_index.erase(it);
+    }
+    m_files.push_front(file);
+    m_index[path] = m_files.begin();
+    m_size += file->size;
+    // 超出容量时淘汰最久没有使用的文件, 正在发送的文件由shared_ptr保证不会被提前解除映射
+    while (m_size > s_http_static_cache_size && m_files.size() > 1) {
+        MappedFile::ptr last = m_files.back();
+        m_size -= last->size;
+        m_index.erase(last->path);
+        m_files.pop_back();
+    }
+    return file;
+}
+
+static std::string format_http_time(time_t time) {
+    tm t {};
+    gmtime_r(&time, &t);
+    char buffer[64];
+    size_t len = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &t);
+    return std::string(buffer, len);
+}
+
+static bool parse_http_time(const std::string& str, time_t& time) {
+    tm t {};
+    if (!strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &t)) {
+        return false;
+    }
+    time = timegm(&t);
+    return true;
+}
+
+static std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+// Accept-Encoding中是否接受encoding, 忽略q=0的编码
+static bool accepts_encoding(const std::string& accept, const char* encoding) {
+    size_t begin = 0;
+    while (begin < accept.size()) {
+        size_t end = accept.find(',', begin);
+        if (end == std::string::npos) {
+            end = accept.size();
+        }
+        std::string token = accept.substr(begin, end - begin);
+        begin = end + 1;
+
+        size_t semicolon = token.find(';');
+        std::string name = trim(token.substr(0, semicolon));
+        if (strcasecmp(name.c_str(), encoding) != 0) {
+            continue;
+        }
+        if (semicolon != std::string::npos) {
+            std::string param = trim(token.substr(semicolon + 1));
+            if (param.compare(0, 2, "q=") == 0 && atof(param.c_str() + 2) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool parse_number(const std::string& str, uint64_t& value) {
+    auto result = std::from_chars(str.data(), str.data() + str.size(), value);
+    return result.ec == std::errc() && result.ptr == str.data() + str.size();
+}
+
+/**
+ * @brief 解析Range请求头, 只支持单个区间
+ * @return 1表示区间有效, 0表示忽略Range返回整个文件, -1表示区间无法满足
+ */
+static int parse_range(const std::string& range, uint64_t size, uint64_t& offset,
+                       uint64_t& length) {
+    if (range.compare(0, 6, "bytes=") != 0) {
+        return 0;
+    }
+    std::string spec = trim(range.substr(6));
+    // 多个区间需要multipart响应, 直接返回整个文件
+    size_t dash = spec.find('-');
+    if (spec.find(',') != std::string::npos || dash == std::string::npos) {
+        return 0;
+    }
+    std::string first = trim(spec.substr(0, dash));
+    std::string last = trim(spec.substr(dash + 1));
+
+    uint64_t start = 0;
+    uint64_t end = 0;
+    if (first.empty()) {
+        // bytes=-n 表示最后n个字节
+        if (!parse_number(last, end)) {
+            return 0;
+        }
+        if (end == 0 || size == 0) {
+            return -1;
+        }
+        length = std::min(end, size);
+        offset = size - length;
+        return 1;
+    }
+
+    if (!parse_number(first, start)) {
+        return 0;
+    }
+    if (start >= size) {
+        return -1;
+    }
+    if (last.empty()) {
+        end = size - 1;
+    }
+    else if (!parse_number(last, end) || end < start) {
+        return 0;
+    }
+    end = std::min(end, size - 1);
+    offset = start;
+    length = end - start + 1;
+    return 1;
+}
+
+// If-None-Match中是否包含etag, 使用弱比较
+static bool match_etag(const std::string& header, const std::string& etag) {
+    size_t begin = 0;
+    while (begin < header.size()) {
+        size_t end = header.find(',', begin);
+        if (end == std::string::npos) {
+            end = header.size();
+        }
+        std::string token = trim(header.substr(begin, end - begin));
+        begin = end + 1;
+        if (token.compare(0, 2, "W/") == 0) {
+            token = token.substr(2);
+        }
+        if (token == "*" || token == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* get_content_type(const std::string& path) {
+    static const std::unordered_map<std::string, const char*> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+    };
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        auto it = s_types.find(path.substr(dot + 1));
+        if (it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+namespace {
+
+// 打开的文件, 没有交给响应时析构关闭
+struct OpenFile {
+    ~OpenFile() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int release() {
+        int ret = fd;
+        fd = -1;
+        return ret;
+    }
+
+    int fd = -1;
+};
+
+}  // namespace
+
+StaticFileServlet::StaticFileServlet(const std::string& prefix, const std::string& root)
+    : Servlet("StaticFileServlet"), m_prefix(prefix), m_root(root) {
+    while (!m_root.empty() && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+bool StaticFileServlet::get_file_path(std::string_view uri, std::string& path) const {
+    if (uri.compare(0, m_prefix.size(), m_prefix) != 0) {
+        return false;
+    }
+
+    // 解码%XX
+    std::string relative;
+    for (size_t i = m_prefix.size(); i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size() && hex_value(uri[i + 1]) >= 0 &&
+            hex_value(uri[i + 2]) >= 0) {
+            relative.push_back(static_cast<char>(hex_value(uri[i + 1]) * 16 + hex_value(uri[i + 2])));
+            i += 2;
+        }
+        else {
+            relative.push_back(uri[i]);
+        }
+    }
+    if (relative.find('\0') != std::string::npos) {
+        return false;
+    }
+
+    // 不允许通过..访问root之外的文件
+    size_t begin = 0;
+    while (begin <= relative.size()) {
+        size_t end = relative.find('/', begin);
+        if (end == std::string::npos) {
+            end = relative.size();
+        }
+        if (relative.compare(begin, end - begin, "..") == 0 && end - begin == 2) {
+            return false;
+        }
+        begin = end + 1;
+    }
+
+    path = m_root;
+    if (relative.empty() || relative.front() != '/') {
+        path.push_back('/');
+    }
+    path.append(relative);
+    return true;
+}
+
+void StaticFileServlet::set_error(HttpResponse::ptr response, HttpStatus status) const {
+    response->set_status(status);
+    response->set_header("Content-Type", "text/plain; charset=utf-8");
+    response->set_body(http_status_to_string(status));
+}
+
+int32_t StaticFileServlet::handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                                  HttpSession::ptr session) {
+    HttpMethod method = request->get_method();
+    if (method != HttpMethod::GET && method != HttpMethod::HEAD) {
+        set_error(response, HttpStatus::METHOD_NOT_ALLOWED);
+        response->set_header("Allow", "GET, HEAD");
+        return 0;
+    }
+
+    std::string path;
+    struct stat st {};
+    if (!get_file_path(request->get_path(), path) || stat(path.c_str(), &st) != 0) {
+        set_error(response, HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        path.append(path.back() == '/' ? "index.html" : "/index.html");
+        if (stat(path.c_str(), &st) != 0) {
+            set_error(response, HttpStatus::NOT_FOUND);
+            return 0;
+        }
+    }
+    if (!S_ISREG(st.st_mode)) {
+        set_error(response, HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    response->set_header("Content-Type", get_content_type(path));
+
+    // 客户端接受时优先发送预先压缩好的文件, 压缩文件比原文件旧时认为已经过期
+    static const std::pair<const char*, const char*> s_encodings[] = {{"br", ".br"},
+                                                                      {"gzip", ".gz"}};
+    const std::string& accept = request->get_header("Accept-Encoding");
+    std::string encoding;
+    for (auto& [name, suffix] : s_encodings) {
+        struct stat compressed {};
+        std::string compressed_path = path + suffix;
+        if (accepts_encoding(accept, name) && stat(compressed_path.c_str(), &compressed) == 0 &&
+            S_ISREG(compressed.st_mode) && compressed.st_mtime >= st.st_mtime) {
+            path = compressed_path;
+            st = compressed;
+            encoding = name;
+            break;
+        }
+    }
+    response->set_header("Vary", "Accept-Encoding");
+
+    // 之后的响应头和内容都以打开的文件为准, 避免文件在stat之后被替换
+    OpenFile file;
+    file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0 || fstat(file.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        set_error(response, HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    if (!encoding.empty()) {
+        response->set_header("Content-Encoding", encoding);
+    }
+
+    // 不同编码是不同的表示, ETag需要区分
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx%s%s\"", static_cast<unsigned long>(st.st_mtime),
+             static_cast<unsigned long>(st.st_size), encoding.empty() ? "" : "-",
+             encoding.c_str());
+    std::string last_modified = format_http_time(st.st_mtime);
+    response->set_header("ETag", etag);
+    response->set_header("Last-Modified", last_modified);
+    response->set_header("Accept-Ranges", "bytes");
+
+    // 条件请求, If-None-Match优先于If-Modified-Since
+    const std::string& if_none_match = request->get_header("If-None-Match");
+    const std::string& if_modified_since = request->get_header("If-Modified-Since");
+    time_t since = 0;
+    if ((!if_none_match.empty() && match_etag(if_none_match, etag)) ||
+        (if_none_match.empty() && !if_modified_since.empty() &&
+         parse_http_time(if_modified_since, since) && st.st_mtime <= since)) {
+        response->set_status(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    uint64_t size = st.st_size;
+    uint64_t offset = 0;
+    uint64_t length = size;
+    const std::string& range = request->get_header("Range");
+    const std::string& if_range = request->get_header("If-Range");
+    // If-Range不匹配说明客户端的缓存已经过期, 返回整个文件
+    if (!range.empty() && (if_range.empty() || if_range == etag || if_range == last_modified)) {
+        int ret = parse_range(range, size, offset, length);
+        if (ret < 0) {
+            response->set_status(HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->set_header("Content-Range", "bytes */" + std::to_string(size));
+            return 0;
+        }
+        if (ret > 0) {
+            response->set_status(HttpStatus::PARTIAL_CONTENT);
+            response->set_header("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                                                      std::to_string(offset + length - 1) + "/" +
+                                                      std::to_string(size));
+        }
+    }
+
+    if (method == HttpMethod::HEAD) {
+        response->set_header("Content-Length", std::to_string(length));
+        return 0;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    // 小文件从缓存中拷贝, 省去读取文件的系统调用
+    if (size <= s_http_static_cache_max_file_size) {
+        MappedFile::ptr mapped = m_cache.get(path, file.fd, st);
+        if (mapped) {
+            response->set_body(std::string(static_cast<const char*>(mapped->data) + offset, length));
+            return 0;
+        }
+    }
+
+    response->set_file_body(file.release(), offset, length);
+    return 0;
+}
+
+}  // namespace acid::http
@@ -0,0 +1,96 @@
+/*!
+ * @file static_file_servlet.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief 静态文件Servlet
+ * @version 0.1
+ * @date 2023-08-10
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_STATIC_FILE_SERVLET_H
+#define DF_STATIC_FILE_SERVLET_H
+
+#include "acid/common/mutex.h"
+#include "servlet.h"
+
+#include <list>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace acid::http {
+
+/**
+ * @brief 映射到内存中的小文件
+ */
+struct MappedFile {
+    using ptr = std::shared_ptr<MappedFile>;
+
+    ~MappedFile();
+
+    std::string path;
+    dev_t dev = 0;      // 映射的文件, 路径指向其他文件时需要重新映射
+    ino_t ino = 0;
+    timespec mtime {};  // 映射时文件的修改时间, 与当前不同时需要重新映射
+    uint64_t size = 0;
+    void* data = nullptr;
+};
+
+/**
+ * @brief 按最近最少使用淘汰的文件映射缓存, 总大小不超过http.static.cache_size
+ */
+class MappedFileCache {
+public:
+    using MutexType = Mutex;
+
+    /**
+     * @brief 获取文件的映射, 文件已经修改或者不在缓存中时重新映射
+     * 只映射没有写权限的文件: 映射之后文件被截断, 访问截断部分会触发SIGBUS
+     * @param fd 调用者打开的文件
+     * @param st 对fd调用fstat得到的文件信息
+     * @return 文件可写或映射失败返回nullptr, 调用者改用sendfile发送
+     */
+    MappedFile::ptr get(const std::string& path, int fd, const struct stat& st);
+
+private:
+    MutexType m_mutex;
+    std::list<MappedFile::ptr> m_files;  // 最近使用的在前
+    std::unordered_map<std::string, std::list<MappedFile::ptr>::iterator> m_index;
+    uint64_t m_size = 0;
+};
+
+/**
+ * @brief 把uri前缀映射到本地目录的静态文件servlet
+ * 例如把 StaticFileServlet("/static", "/var/www") 用add_glob_servlet注册到 /static/ 下的所有uri。
+ * 大文件和可写的文件通过sendfile发送, 只读的小文件映射后缓存在内存中;
+ * 支持ETag/Last-Modified条件请求, 单个区间的Range请求, 以及预先压缩好的.br/.gz文件
+ */
+class StaticFileServlet : public Servlet {
+public:
+    using ptr = std::shared_ptr<StaticFileServlet>;
+
+    /**
+     * @param prefix uri前缀, 去掉前缀后的路径在root下查找
+     * @param root 本地目录
+     */
+    StaticFileServlet(const std::string& prefix, const std::string& root);
+
+    int32_t handle(HttpRequest::ptr request, HttpResponse::ptr response,
+                   HttpSession::ptr session) override;
+
+private:
+    // 把请求路径转换为本地文件路径, 路径不合法返回false
+    bool get_file_path(std::string_view uri, std::string& path) const;
+
+    // 设置错误响应
+    void set_error(HttpResponse::ptr response, HttpStatus status) const;
+
+private:
+    std::string m_prefix;
+    std::string m_root;
+    MappedFileCache m_cache;
+};
+
+}  // namespace acid::http
+
+#endif  // DF_STATIC_FILE_SERVLET_H
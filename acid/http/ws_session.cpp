@@ -0,0 +1,659 @@
+#include "ws_session.h"
+
+#include "acid/common/config.h"
+#include "acid/common/iomanager.h"
+#include "acid/common/util.h"
+#include "acid/logger/logger.h"
+
+#include <cstring>
+#include <vector>
+#include <sys/uio.h>
+#include <zlib.h>
+
+namespace acid::http {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_websocket_message_max_size = Config::look_up<uint64_t>(
+    "websocket.message.max_size", 32 * 1024 * 1024ull, "websocket message max size");
+static ConfigVar<bool>::ptr g_websocket_deflate = Config::look_up<bool>(
+    "websocket.deflate", true, "websocket accept permessage-deflate");
+
+static uint64_t s_websocket_message_max_size = 0;
+static bool s_websocket_deflate = true;
+
+struct _WSSessionIniter {
+    _WSSessionIniter() {
+        s_websocket_message_max_size = g_websocket_message_max_size->get_value();
+        g_websocket_message_max_size->add_listener(
+            [](const uint64_t& old_val, const uint64_t& new_val) {
+                LOG_INFO(logger) << "websocket message max size change from " << old_val
+                                 << " to " << new_val;
+                s_websocket_message_max_size = new_val;
+            });
+
+        s_websocket_deflate = g_websocket_deflate->get_value();
+        g_websocket_deflate->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "websocket deflate change from " << old_val << " to " << new_val;
+            s_websocket_deflate = new_val;
+        });
+    }
+};
+
+static _WSSessionIniter _ws_session_initer;
+
+static const char* WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+// 小于该大小的消息不压缩, 压缩的收益抵不上开销
+static constexpr size_t MIN_DEFLATE_SIZE = 256;
+// 直接读入消息的阈值, 较小的读取先读到临时缓冲区, 减少系统调用
+static constexpr size_t MIN_DIRECT_READ_SIZE = 4 * 1024;
+// 读缓冲区处理完后超过该容量就释放, 空闲连接不保留大块内存
+static constexpr size_t MAX_IDLE_BUFFER_CAPACITY = 1024;
+// 压缩数据块以这4个字节结尾, 发送时去掉, 接收时补上
+static const char DEFLATE_TAIL[4] = {0x00, 0x00, static_cast<char>(0xff), static_cast<char>(0xff)};
+
+/**
+ * @brief 每个线程一份的压缩和解压状态
+ * 协商时双方都不保留上下文, 每条消息都从初始状态开始, 不需要为每条连接保存zlib状态
+ */
+struct DeflateContext {
+    DeflateContext() {
+        memset(&deflater, 0, sizeof(deflater));
+        memset(&inflater, 0, sizeof(inflater));
+        deflate_ok = deflateInit2(&deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                                  Z_DEFAULT_STRATEGY) == Z_OK;
+        inflate_ok = inflateInit2(&inflater, -MAX_WBITS) == Z_OK;
+    }
+
+    ~DeflateContext() {
+        if (deflate_ok) {
+            deflateEnd(&deflater);
+        }
+        if (inflate_ok) {
+            inflateEnd(&inflater);
+        }
+    }
+
+    z_stream deflater;
+    z_stream inflater;
+    bool deflate_ok;
+    bool inflate_ok;
+};
+
+static DeflateContext& get_deflate_context() {
+    static thread_local DeflateContext context;
+    return context;
+}
+
+// 压缩一条消息, 去掉结尾的00 00 ff ff
+static bool deflate_message(const std::string& data, std::string& out) {
+    auto& context = get_deflate_context();
+    if (!context.deflate_ok) {
+        return false;
+    }
+    z_stream& zs = context.deflater;
+    deflateReset(&zs);
+    out.resize(deflateBound(&zs, data.size()) + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_SYNC_FLUSH);
+    if ((ret != Z_OK && ret != Z_BUF_ERROR) || zs.avail_in != 0) {
+        return false;
+    }
+    size_t len = out.size() - zs.avail_out;
+    if (len >= 4 && memcmp(out.data() + len - 4, DEFLATE_TAIL, 4) == 0) {
+        len -= 4;
+    }
+    out.resize(len);
+    return true;
+}
+
+// 解压一条消息, 解压后超过max_size返回false
+static bool inflate_message(const std::string& data, std::string& out, uint64_t max_size) {
+    auto& context = get_deflate_context();
+    if (!context.inflate_ok) {
+        return false;
+    }
+    z_stream& zs = context.inflater;
+    inflateReset(&zs);
+    out.clear();
+    char buffer[16 * 1024];
+    for (int i = 0; i < 2; ++i) {
+        if (i == 0) {
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            zs.avail_in = data.size();
+        }
+        else {
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(DEFLATE_TAIL));
+            zs.avail_in = sizeof(DEFLATE_TAIL);
+        }
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(buffer);
+            zs.avail_out = sizeof(buffer);
+            int ret = inflate(&zs, Z_SYNC_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                return false;
+            }
+            out.append(buffer, sizeof(buffer) - zs.avail_out);
+            if (out.size() > max_size) {
+                return false;
+            }
+            if (ret == Z_STREAM_END) {
+                return true;
+            }
+        } while (zs.avail_out == 0);
+    }
+    return true;
+}
+
+// 按4字节的掩码还原数据, 先按8字节处理
+static void unmask(char* data, size_t len, const uint8_t key[4]) {
+    uint64_t key64;
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t value;
+        memcpy(&value, data + i, 8);
+        value ^= key64;
+        memcpy(data + i, &value, 8);
+    }
+    for (; i < len; ++i) {
+        data[i] ^= key[i & 3];
+    }
+}
+
+// 检查是否是合法的UTF-8, 拒绝超长编码, 代理区的码点和超过U+10FFFF的码点
+static bool is_valid_utf8(const char* data, size_t len) {
+    auto p = reinterpret_cast<const uint8_t*>(data);
+    size_t i = 0;
+    while (i < len) {
+        uint8_t c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint8_t low = 0x80;  // 第二个字节的范围, 用来排除超长编码和非法码点
+        uint8_t high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            low = c == 0xE0 ? 0xA0 : 0x80;
+            high = c == 0xED ? 0x9F : 0xBF;
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            low = c == 0xF0 ? 0x90 : 0x80;
+            high = c == 0xF4 ? 0x8F : 0xBF;
+        }
+        else {
+            return false;
+        }
+        if (len - i <= n || p[i + 1] < low || p[i + 1] > high) {
+            return false;
+        }
+        for (size_t k = 2; k <= n; ++k) {
+            if ((p[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+// 关闭帧中可以出现的关闭码, 1005/1006/1015只在本地表示没有关闭码或者连接异常断开
+static bool is_valid_close_code(uint16_t code) {
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) ||
+           (code >= 3000 && code <= 4999);
+}
+
+// 写入服务端帧头, 返回帧头的长度
+static size_t encode_header(char* header, size_t length, WSOpcode opcode, bool fin, bool deflate) {
+    header[0] = static_cast<char>((fin ? 0x80 : 0) | (deflate ? 0x40 : 0) |
+                                  static_cast<uint8_t>(opcode));
+    if (length < 126) {
+        header[1] = static_cast<char>(length);
+        return 2;
+    }
+    if (length <= 0xFFFF) {
+        header[1] = 126;
+        header[2] = static_cast<char>(length >> 8);
+        header[3] = static_cast<char>(length);
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i) {
+        header[2 + i] = static_cast<char>(length >> (56 - 8 * i));
+    }
+    return 10;
+}
+
+// 写出iovs中的全部数据, 会修改iovs, 失败返回-1
+static ssize_t send_iovec(Socket::ptr socket, iovec* iovs, size_t count) {
+    ssize_t total = 0;
+    while (true) {
+        while (count > 0 && iovs->iov_len == 0) {
+            ++iovs;
+            --count;
+        }
+        if (count == 0) {
+            return total;
+        }
+        ssize_t len = socket->send(iovs, count);
+        if (len <= 0) {
+            return -1;
+        }
+        total += len;
+        while (len > 0) {
+            size_t n = std::min<size_t>(len, iovs->iov_len);
+            iovs->iov_base = static_cast<char*>(iovs->iov_base) + n;
+            iovs->iov_len -= n;
+            len -= n;
+            if (iovs->iov_len == 0) {
+                ++iovs;
+                --count;
+            }
+        }
+    }
+}
+
+// 按分隔符拆分请求头的值, 去掉每一项两端的空白和引号
+static std::vector<std::string> split_header(const std::string& value, char delimiter) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        size_t end = value.find(delimiter, begin);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        size_t first = value.find_first_not_of(" \t\"", begin);
+        size_t last = value.find_last_not_of(" \t\"", end == 0 ? 0 : end - 1);
+        if (first != std::string::npos && first < end && last != std::string::npos &&
+            last >= first) {
+            items.push_back(value.substr(first, last - first + 1));
+        }
+        begin = end + 1;
+    }
+    return items;
+}
+
+// 检查客户端提供的permessage-deflate参数, 只接受窗口为15的服务端压缩
+static bool accept_deflate_offer(const std::string& offer) {
+    auto params = split_header(offer, ';');
+    if (params.empty() || params[0] != "permessage-deflate") {
+        return false;
+    }
+    for (size_t i = 1; i < params.size(); ++i) {
+        auto pair = split_header(params[i], '=');
+        if (pair.empty()) {
+            return false;
+        }
+        const std::string& name = pair[0];
+        if (name == "server_no_context_takeover" || name == "client_no_context_takeover" ||
+            name == "client_max_window_bits") {
+            continue;
+        }
+        // 线程共享的压缩状态固定使用15位的窗口
+        if (name == "server_max_window_bits" && pair.size() == 2 && pair[1] == "15") {
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+WSSession::WSSession(Socket::ptr socket, bool deflate, std::string buffer)
+    : SocketStream(socket), m_deflate(deflate), m_buffer(std::move(buffer)) {
+}
+
+WSSession::ptr WSSession::accept(HttpSession::ptr session, HttpRequest::ptr request,
+                                 HttpResponse::ptr response) {
+    std::string key = request->get_header("Sec-WebSocket-Key");
+    if (!request->is_websocket() || key.empty() ||
+        request->get_header("Sec-WebSocket-Version") != "13" ||
+        base64_decode(key).size() != 16) {
+        LOG_DEBUG(logger) << "invalid websocket handshake, key: " << key;
+        response->set_status(HttpStatus::BAD_REQUEST);
+        response->set_header("Sec-WebSocket-Version", "13");
+        response->set_close(true);
+        session->send_response(response);
+        session->flush();
+        return nullptr;
+    }
+    // 让解析器处理完升级请求, 之后缓冲区中的数据都属于websocket
+    if (!session->recv_body(request)) {
+        return nullptr;
+    }
+
+    std::string accept_key = key + WEBSOCKET_GUID;
+    std::string digest = sha1sum(accept_key.data(), accept_key.size());
+    response->set_status(HttpStatus::SWITCHING_PROTOCOLS);
+    response->set_websocket(true);
+    response->set_header("Upgrade", "websocket");
+    response->set_header("Connection", "Upgrade");
+    response->set_header("Sec-WebSocket-Accept", base64_encode(digest.data(), digest.size()));
+
+    bool deflate = false;
+    if (s_websocket_deflate) {
+        for (auto& offer : split_header(request->get_header("Sec-WebSocket-Extensions"), ',')) {
+            if (accept_deflate_offer(offer)) {
+                deflate = true;
+                response->set_header(
+                    "Sec-WebSocket-Extensions",
+                    "permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+                break;
+            }
+        }
+    }
+
+    if (session->send_response(response) < 0 || session->flush() < 0) {
+        return nullptr;
+    }
+    return std::make_shared<WSSession>(session->get_socket(), deflate, session->take_buffer());
+}
+
+bool WSSession::read_exact(void* buffer, size_t length) {
+    char* out = static_cast<char*>(buffer);
+    size_t available = m_buffer.size() - m_read_pos;
+    size_t n = std::min(available, length);
+    memcpy(out, m_buffer.data() + m_read_pos, n);
+    m_read_pos += n;
+    out += n;
+    length -= n;
+
+    if (m_read_pos == m_buffer.size()) {
+        m_read_pos = 0;
+        if (m_buffer.capacity() > MAX_IDLE_BUFFER_CAPACITY) {
+            std::string().swap(m_buffer);
+        }
+        else {
+            m_buffer.clear();
+        }
+    }
+    if (length == 0) {
+        return true;
+    }
+
+    if (length >= MIN_DIRECT_READ_SIZE) {
+        return static_cast<ssize_t>(read_fix_size(out, length)) > 0;
+    }
+    // 小块数据先读到线程共享的临时缓冲区, 多读到的部分留给下一帧
+    // 协程只在read内部切换, 拷贝出去之前不会被其它协程覆盖
+    static thread_local char s_read_buffer[16 * 1024];
+    while (length > 0) {
+        ssize_t len = static_cast<ssize_t>(read(s_read_buffer, sizeof(s_read_buffer)));
+        if (len <= 0) {
+            return false;
+        }
+        size_t copy = std::min<size_t>(len, length);
+        memcpy(out, s_read_buffer, copy);
+        out += copy;
+        length -= copy;
+        if (copy < static_cast<size_t>(len)) {
+            m_buffer.assign(s_read_buffer + copy, len - copy);
+            m_read_pos = 0;
+        }
+    }
+    return true;
+}
+
+WSFrameMessage::ptr WSSession::recv_message() {
+    WSFrameMessage::ptr message;
+    bool compressed = false;
+    uint64_t max_size = s_websocket_message_max_size;
+
+    while (true) {
+        uint8_t head[2];
+        if (!read_exact(head, 2)) {
+            break;
+        }
+        bool fin = head[0] & 0x80;
+        bool rsv1 = head[0] & 0x40;
+        auto opcode = static_cast<WSOpcode>(head[0] & 0x0F);
+        bool control = head[0] & 0x08;
+        if (head[0] & 0x30) {
+            LOG_DEBUG(logger) << "websocket frame rsv2/rsv3 set";
+            close(WSCloseCode::PROTOCOL_ERROR);
+            break;
+        }
+        // 客户端发送的帧必须带掩码
+        if (!(head[1] & 0x80)) {
+            LOG_DEBUG(logger) << "websocket frame from client not masked";
+            close(WSCloseCode::PROTOCOL_ERROR);
+            break;
+        }
+
+        uint64_t length = head[1] & 0x7F;
+        if (length == 126) {
+            uint8_t ext[2];
+            if (!read_exact(ext, 2)) {
+                break;
+            }
+            length = (ext[0] << 8) | ext[1];
+        }
+        else if (length == 127) {
+            uint8_t ext[8];
+            if (!read_exact(ext, 8)) {
+                break;
+            }
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | ext[i];
+            }
+        }
+        uint8_t key[4];
+        if (!read_exact(key, 4)) {
+            break;
+        }
+
+        if (control) {
+            // 控制帧不能分片, 长度不超过125, 可以插在分片之间
+            if (!fin || length > 125 || rsv1) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            std::string payload(length, '\0');
+            if (!read_exact(payload.data(), length)) {
+                break;
+            }
+            unmask(payload.data(), length, key);
+            if (opcode == WSOpcode::PING) {
+                if (pong(payload) < 0) {
+                    break;
+                }
+            }
+            else if (opcode == WSOpcode::CLOSE) {
+                // 负载为空或者是合法的关闭码加UTF-8的原因, 回复同样的关闭码后关闭连接
+                if (payload.empty()) {
+                    close(WSCloseCode::NORMAL);
+                    break;
+                }
+                uint16_t code = payload.size() < 2 ? 0
+                                                   : (static_cast<uint8_t>(payload[0]) << 8) |
+                                                         static_cast<uint8_t>(payload[1]);
+                if (!is_valid_close_code(code) ||
+                    !is_valid_utf8(payload.data() + 2, payload.size() - 2)) {
+                    LOG_DEBUG(logger) << "websocket invalid close payload, code=" << code;
+                    close(WSCloseCode::PROTOCOL_ERROR);
+                }
+                else {
+                    close(static_cast<WSCloseCode>(code));
+                }
+                break;
+            }
+            else if (opcode != WSOpcode::PONG) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            continue;
+        }
+
+        if (opcode == WSOpcode::CONTINUE) {
+            if (!message || rsv1) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+        }
+        else if (opcode == WSOpcode::TEXT || opcode == WSOpcode::BINARY) {
+            if (message || (rsv1 && !m_deflate)) {
+                close(WSCloseCode::PROTOCOL_ERROR);
+                break;
+            }
+            message = std::make_shared<WSFrameMessage>(opcode);
+            compressed = rsv1;
+        }
+        else {
+            close(WSCloseCode::PROTOCOL_ERROR);
+            break;
+        }
+
+        std::string& data = message->get_data();
+        if (data.size() + length > max_size) {
+            LOG_DEBUG(logger) << "websocket message too large: " << data.size() + length;
+            close(WSCloseCode::MESSAGE_TOO_BIG);
+            break;
+        }
+        size_t offset = data.size();
+        data.resize(offset + length);
+        if (!read_exact(data.data() + offset, length)) {
+            break;
+        }
+        unmask(data.data() + offset, length, key);
+
+        if (fin) {
+            if (compressed) {
+                std::string inflated;
+                if (!inflate_message(data, inflated, max_size)) {
+                    LOG_DEBUG(logger) << "websocket inflate message fail";
+                    close(WSCloseCode::INVALID_DATA);
+                    break;
+                }
+                data.swap(inflated);
+            }
+            if (message->get_opcode() == WSOpcode::TEXT && !is_valid_utf8(data.data(), data.size())) {
+                LOG_DEBUG(logger) << "websocket text message is not utf-8";
+                close(WSCloseCode::INVALID_DATA);
+                break;
+            }
+            return message;
+        }
+    }
+    return nullptr;
+}
+
+int32_t WSSession::send_message(const std::string& data, WSOpcode opcode, bool fin) {
+    std::string compressed;
+    // 分片发送的消息不压缩
+    bool deflate = m_deflate && fin && opcode != WSOpcode::CONTINUE &&
+                   data.size() >= MIN_DEFLATE_SIZE && deflate_message(data, compressed);
+    const std::string& payload = deflate ? compressed : data;
+
+    char header[10];
+    iovec iovs[2];
+    iovs[0].iov_base = header;
+    iovs[0].iov_len = encode_header(header, payload.size(), opcode, fin, deflate);
+    iovs[1].iov_base = const_cast<char*>(payload.data());
+    iovs[1].iov_len = payload.size();
+
+    LockGuard lock(m_send_mutex);
+    if (m_closing) {
+        return -1;
+    }
+    return send_iovec(get_socket(), iovs, 2) < 0 ? -1 : static_cast<int32_t>(data.size());
+}
+
+int32_t WSSession::send_message(WSFrameMessage::ptr message, bool fin) {
+    return send_message(message->get_data(), message->get_opcode(), fin);
+}
+
+int32_t WSSession::send_frame(const WSFrame& frame) {
+    LockGuard lock(m_send_mutex);
+    if (m_closing) {
+        return -1;
+    }
+    size_t len = write_fix_size(frame->data(), frame->size());
+    return static_cast<ssize_t>(len) <= 0 ? -1 : static_cast<int32_t>(len);
+}
+
+int32_t WSSession::ping(const std::string& data) {
+    return send_control(WSOpcode::PING, data);
+}
+
+int32_t WSSession::pong(const std::string& data) {
+    return send_control(WSOpcode::PONG, data);
+}
+
+int32_t WSSession::send_control(WSOpcode opcode, const std::string& data) {
+    if (data.size() > 125) {
+        return -1;
+    }
+    return send_message(data, opcode, true);
+}
+
+void WSSession::close(WSCloseCode code, const std::string& reason) {
+    {
+        LockGuard lock(m_send_mutex);
+        if (!m_closing) {
+            std::string payload;
+            payload.push_back(static_cast<char>(static_cast<uint16_t>(code) >> 8));
+            payload.push_back(static_cast<char>(static_cast<uint16_t>(code)));
+            payload.append(reason, 0, 123);
+            char header[10];
+            iovec iovs[2];
+            iovs[0].iov_base = header;
+            iovs[0].iov_len = encode_header(header, payload.size(), WSOpcode::CLOSE, true, false);
+            iovs[1].iov_base = payload.data();
+            iovs[1].iov_len = payload.size();
+            send_iovec(get_socket(), iovs, 2);
+            m_closing = true;
+        }
+    }
+    SocketStream::close();
+}
+
+WSFrame WSSession::encode_frame(const std::string& data, WSOpcode opcode, bool fin,
+                                bool deflate) {
+    std::string compressed;
+    deflate = deflate && deflate_message(data, compressed);
+    const std::string& payload = deflate ? compressed : data;
+    auto frame = std::make_shared<std::string>();
+    frame->resize(10);
+    frame->resize(encode_header(frame->data(), payload.size(), opcode, fin, deflate));
+    frame->append(payload);
+    return frame;
+}
+
+size_t WSSession::broadcast(const std::vector<WSSession::ptr>& sessions, const std::string& data,
+                            WSOpcode opcode) {
+    WSFrame plain;
+    WSFrame compressed;
+    bool deflate = data.size() >= MIN_DEFLATE_SIZE;
+    IOManager* iom = IOManager::get_this();
+    size_t count = 0;
+    for (auto& session : sessions) {
+        if (!session || !session->is_connected()) {
+            continue;
+        }
+        WSFrame& frame = deflate && session->is_deflate() ? compressed : plain;
+        if (!frame) {
+            frame = encode_frame(data, opcode, true, &frame == &compressed);
+        }
+        if (iom) {
+            iom->schedule([session, frame]() { session->send_frame(frame); });
+        }
+        else {
+            session->send_frame(frame);
+        }
+        ++count;
+    }
+    return count;
+}
+
+}  // namespace acid::http
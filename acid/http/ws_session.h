@@ -0,0 +1,183 @@
+/*!
+ * @file ws_session.h
+ * @author kbjcx(lulu5v@163.com)
+ * @brief websocket会话
+ * @version 0.1
+ * @date 2023-08-16
+ *
+ * @copyright Copyright (c) 2023
+ */
+#ifndef DF_WS_SESSION_H
+#define DF_WS_SESSION_H
+
+#include "acid/common/co_mutex.h"
+#include "acid/net/socket_stream.h"
+#include "http.h"
+#include "http_session.h"
+
+#include <string>
+#include <vector>
+
+namespace acid::http {
+
+/**
+ * @brief websocket帧的操作码
+ */
+enum class WSOpcode : uint8_t {
+    CONTINUE = 0x0,
+    TEXT = 0x1,
+    BINARY = 0x2,
+    CLOSE = 0x8,
+    PING = 0x9,
+    PONG = 0xA,
+};
+
+/**
+ * @brief websocket关闭码
+ */
+enum class WSCloseCode : uint16_t {
+    NORMAL = 1000,
+    GOING_AWAY = 1001,
+    PROTOCOL_ERROR = 1002,
+    INVALID_DATA = 1007,
+    MESSAGE_TOO_BIG = 1009,
+};
+
+/**
+ * @brief 一条完整的websocket消息, 分片的消息已经拼接, 压缩的消息已经解压
+ */
+class WSFrameMessage {
+public:
+    using ptr = std::shared_ptr<WSFrameMessage>;
+
+    WSFrameMessage(WSOpcode opcode = WSOpcode::TEXT, const std::string& data = "")
+        : m_opcode(opcode), m_data(data) {
+    }
+
+    WSOpcode get_opcode() const {
+        return m_opcode;
+    }
+
+    void set_opcode(WSOpcode opcode) {
+        m_opcode = opcode;
+    }
+
+    const std::string& get_data() const {
+        return m_data;
+    }
+
+    std::string& get_data() {
+        return m_data;
+    }
+
+    void set_data(const std::string& data) {
+        m_data = data;
+    }
+
+private:
+    WSOpcode m_opcode;
+    std::string m_data;
+};
+
+/**
+ * @brief 编码好的服务端帧, 广播时同一个帧发送给多个连接
+ */
+using WSFrame = std::shared_ptr<const std::string>;
+
+/**
+ * @brief 服务端的websocket会话
+ * 接收时处理掩码, 分片, ping/pong和关闭握手; 协商了permessage-deflate时按消息压缩和解压,
+ * 两个方向都不保留压缩上下文, 连接上不需要常驻的zlib状态, 压缩后的帧也可以发送给多个连接。
+ * 空闲连接不占用读缓冲区, 发送由协程锁串行化, 可以在其它协程中推送消息
+ */
+class WSSession : public SocketStream {
+public:
+    using ptr = std::shared_ptr<WSSession>;
+    using MutexType = CoMutex;
+    using LockGuard = MutexType::Lock;
+
+    /**
+     * @param socket 已经完成握手的连接
+     * @param deflate 是否协商了permessage-deflate
+     * @param buffer 握手时已经读入的websocket数据
+     */
+    WSSession(Socket::ptr socket, bool deflate, std::string buffer = "");
+
+    /**
+     * @brief 处理升级请求, 成功时发送101响应并返回会话, 失败时发送400响应
+     * @param session 收到升级请求的http会话, 之后不能再使用
+     * @param response 用于握手的响应, 可以预先设置Server等响应头
+     */
+    static WSSession::ptr accept(HttpSession::ptr session, HttpRequest::ptr request,
+                                 HttpResponse::ptr response);
+
+    /**
+     * @brief 接收一条消息, ping在内部回复pong
+     * @return WSFrameMessage::ptr 连接关闭, 收到关闭帧或者协议错误返回nullptr
+     */
+    WSFrameMessage::ptr recv_message();
+
+    /**
+     * @brief 发送一条消息
+     * @param fin 为false时作为分片发送, 之后用WSOpcode::CONTINUE发送剩余的分片
+     * @return 失败返回-1
+     */
+    int32_t send_message(const std::string& data, WSOpcode opcode = WSOpcode::TEXT,
+                         bool fin = true);
+
+    int32_t send_message(WSFrameMessage::ptr message, bool fin = true);
+
+    /**
+     * @brief 发送编码好的帧
+     */
+    int32_t send_frame(const WSFrame& frame);
+
+    int32_t ping(const std::string& data = "");
+
+    int32_t pong(const std::string& data = "");
+
+    /**
+     * @brief 发送关闭帧并关闭连接
+     */
+    void close(WSCloseCode code, const std::string& reason = "");
+
+    bool is_deflate() const {
+        return m_deflate;
+    }
+
+    /**
+     * @brief 编码服务端帧
+     * @param deflate 压缩消息, 只能发送给协商了permessage-deflate的连接
+     */
+    static WSFrame encode_frame(const std::string& data, WSOpcode opcode, bool fin = true,
+                                bool deflate = false);
+
+    /**
+     * @brief 把一条消息广播给多个连接
+     * 消息只编码一次(需要时再压缩一次), 每个连接的发送调度到当前IOManager中执行,
+     * 发送缓慢的连接不会阻塞其它连接
+     * @return 调度发送的连接数
+     */
+    static size_t broadcast(const std::vector<WSSession::ptr>& sessions, const std::string& data,
+                            WSOpcode opcode = WSOpcode::TEXT);
+
+    using SocketStream::close;
+
+private:
+    // 读取length字节, 先使用缓冲区中的数据, 失败返回false
+    bool read_exact(void* buffer, size_t length);
+
+    // 发送控制帧
+    int32_t send_control(WSOpcode opcode, const std::string& data);
+
+private:
+    bool m_deflate;
+    std::string m_buffer;   // 已经读入但是还没有处理的数据
+    size_t m_read_pos = 0;  // m_buffer中下一个待处理的位置
+    MutexType m_send_mutex;
+    bool m_closing = false;  // 已经发送了关闭帧
+};
+
+}  // namespace acid::http
+
+#endif  // DF_WS_SESSION_H
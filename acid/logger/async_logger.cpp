@@ -1,78 +1,226 @@
 #include "async_logger.h"
 
-#include <cassert>
+#include "acid/common/hook.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 
 namespace acid {
 
-LogBuffer::LogBuffer() : m_data(), m_cur_ptr(m_data) {
+// 后台线程空闲时最长的等待时间, 日志最多延迟这么久写到文件
+static constexpr int FLUSH_INTERVAL_MS = 50;
+
+LogRing::LogRing(size_t capacity) : m_capacity(1) {
+    while (m_capacity < capacity) {
+        m_capacity <<= 1;
+    }
+    m_data = new char[m_capacity];
+}
+
+LogRing::~LogRing() {
+    delete[] m_data;
 }
 
-LogBuffer::~LogBuffer() = default;
+bool LogRing::push(const char* data, size_t len) {
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (m_capacity - (head - m_cached_tail) < len) {
+        m_cached_tail = m_tail.load(std::memory_order_acquire);
+        if (m_capacity - (head - m_cached_tail) < len) {
+            return false;
+        }
+    }
+    size_t offset = head & (m_capacity - 1);
+    size_t first = std::min(len, m_capacity - offset);
+    memcpy(m_data + offset, data, first);
+    memcpy(m_data, data + first, len - first);
+    m_head.store(head + len, std::memory_order_release);
+    return true;
+}
 
-void LogBuffer::append(const char* buffer, size_t len) {
-    if (available() > len) {
-        memcpy(m_cur_ptr, buffer, len);
-        m_cur_ptr += len;
+size_t LogRing::peek(iovec* iov, int& count) const {
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t len = m_head.load(std::memory_order_acquire) - tail;
+    count = 0;
+    if (len == 0) {
+        return 0;
     }
+    size_t offset = tail & (m_capacity - 1);
+    size_t first = std::min(len, m_capacity - offset);
+    iov[count++] = {m_data + offset, first};
+    if (len > first) {
+        iov[count++] = {m_data, len - first};
+    }
+    return len;
 }
 
-AsyncLogger::AsyncLogger(std::string file)
-    : file_(file)
-    , run_(true)
-    , m_mutex(Mutex())
-    , m_cond(Cond())
-    , file_fd(nullptr)
-    , cur_buffer_(nullptr) {
-    file_fd = fopen(file_.c_str(), "w");
-    assert(file_fd);
+namespace {
 
-    for (auto& buffer : buffers_) {
-        free_buffers_.push(&buffer);
+/**
+ * @brief 当前线程在各个AsyncLogger中的环, 线程退出时关闭
+ */
+struct ThreadRings {
+    ~ThreadRings() {
+        for (auto& i : rings) {
+            i.second->close();
+        }
+        destroyed = true;
     }
 
-    cur_buffer_ = free_buffers_.front();
+    std::vector<std::pair<uint64_t, LogRing::ptr>> rings;
+    static thread_local bool destroyed;
+};
+
+thread_local bool ThreadRings::destroyed = false;
+
+}  // namespace
+
+static thread_local ThreadRings t_rings;
+
+static std::atomic<uint64_t> s_logger_id {0};
+
+AsyncLogger::AsyncLogger(std::string file, OverflowPolicy policy, size_t ring_size)
+    : m_id(++s_logger_id), m_file(std::move(file)), m_ring_size(ring_size), m_policy(policy) {
+    open_file();
+    start();
+}
 
+AsyncLogger::AsyncLogger(Writer writer, OverflowPolicy policy, size_t ring_size)
+    : m_id(++s_logger_id), m_writer(std::move(writer)), m_ring_size(ring_size), m_policy(policy) {
     start();
 }
 
 AsyncLogger::~AsyncLogger() {
-    while (!flush_buffers_.empty()) {
-        LogBuffer* buffer = flush_buffers_.front();
-        fwrite(buffer->data(), 1, buffer->length(), file_fd);
-        flush_buffers_.pop();
+    {
+        Mutex::Lock lock(m_mutex);
+        m_running.store(false, std::memory_order_release);
+        m_cond.signal();
     }
+    m_thread->join();
 
-    // 将当前buffer存在部分写入文件
-    fwrite(cur_buffer_->data(), 1, cur_buffer_->length(), file_fd);
+    if (m_archive_thread) {
+        {
+            Mutex::Lock lock(m_archive_mutex);
+            m_archive_stop = true;
+            m_archive_cond.signal();
+        }
+        m_archive_thread->join();
+    }
 
-    fflush(file_fd);
-    fclose(file_fd);
+    // 还在缓存中的环不会再被写入
+    Mutex::Lock lock(m_rings_mutex);
+    for (auto& ring : m_rings) {
+        ring->close();
+    }
+    if (m_fd >= 0) {
+        close_f(m_fd);
+    }
+}
 
-    run_ = false;
+LogRing* AsyncLogger::get_ring() {
+    // 线程退出过程中线程局部的环已经销毁
+    if (ThreadRings::destroyed) {
+        return nullptr;
+    }
+    for (auto& i : t_rings.rings) {
+        if (i.first == m_id) {
+            return i.second.get();
+        }
+    }
 
-    // 释放所有等待写的日志写入
-    m_cond.broadcast();
+    // 去掉已经销毁的AsyncLogger留下的环
+    auto& rings = t_rings.rings;
+    rings.erase(std::remove_if(rings.begin(), rings.end(),
+                               [](const std::pair<uint64_t, LogRing::ptr>& i) {
+                                   return i.second->is_closed();
+                               }),
+                rings.end());
+    auto ring = std::make_shared<LogRing>(m_ring_size);
+    {
+        Mutex::Lock lock(m_rings_mutex);
+        m_rings.push_back(ring);
+    }
+    rings.emplace_back(m_id, ring);
+    return ring.get();
 }
 
-void AsyncLogger::append(const std::string log_line) {
-    int len = log_line.size();
-    Mutex::Lock lock(m_mutex);
-    if (cur_buffer_->available() > len) {
-        cur_buffer_->append(log_line.c_str(), len);
+void AsyncLogger::append(const char* data, size_t len) {
+    LogRing* ring = get_ring();
+    if (ring && !ring->is_spilled()) {
+        if (ring->push(data, len)) {
+            // 超过一半时提前唤醒后台线程, 尽量不让环写满
+            if (ring->get_size() > ring->get_capacity() / 2) {
+                wake_up();
+            }
+            return;
+        }
+
+        OverflowPolicy policy = get_overflow_policy();
+        if (policy == OverflowPolicy::DROP) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            wake_up();
+            return;
+        }
+        // 比整个环还长的日志只能写入溢出缓冲区
+        if (policy == OverflowPolicy::BLOCK && len <= ring->get_capacity()) {
+            for (int i = 0; !ring->push(data, len); ++i) {
+                wake_up();
+                if (i < 16) {
+                    sched_yield();
+                }
+                else {
+                    usleep(100);
+                }
+            }
+            return;
+        }
     }
-    else {
-        free_buffers_.pop();
-        flush_buffers_.push(cur_buffer_);
 
-        while (free_buffers_.empty()) {
-            // 通知写出线程将已有buffer写入文件
-            m_cond.signal();
-            m_cond.wait(&m_mutex);
+    {
+        Mutex::Lock lock(m_spill_mutex);
+        if (ring) {
+            ring->set_spilled(true);
+        }
+        m_spill_buffer.append(data, len);
+        m_has_spill.store(true, std::memory_order_release);
+    }
+    m_spilled.fetch_add(1, std::memory_order_relaxed);
+    wake_up();
+}
+
+void AsyncLogger::flush() {
+    // 环中的数据写出之后才会释放, 所有环都为空时之前的日志都已经写出
+    while (true) {
+        bool empty = !m_has_spill.load(std::memory_order_acquire);
+        if (empty) {
+            Mutex::Lock lock(m_rings_mutex);
+            for (auto& ring : m_rings) {
+                if (ring->get_size() != 0) {
+                    empty = false;
+                    break;
+                }
+            }
+        }
+        if (empty) {
+            return;
         }
+        wake_up();
+        usleep(1000);
+    }
+}
 
-        cur_buffer_ = free_buffers_.front();
-        cur_buffer_->append(log_line.c_str(), len);
-        // 通知其他线程可写
+void AsyncLogger::wake_up() {
+    // 只有一个写入线程去唤醒, 其他线程不访问m_mutex
+    if (m_sleeping.load(std::memory_order_relaxed) &&
+        m_sleeping.exchange(false, std::memory_order_acq_rel)) {
+        Mutex::Lock lock(m_mutex);
         m_cond.signal();
     }
 }
@@ -82,35 +230,341 @@ void AsyncLogger::start() {
 }
 
 void AsyncLogger::run() {
-    while (run_) {
-        Mutex::Lock lock_guard(m_mutex);
-        bool ret = m_cond.wait_timeout(&m_mutex, 3000);
-        if (!run_) break;
-
-        if (ret) {
-            bool empty = free_buffers_.empty();
-
-            while (!flush_buffers_.empty()) {
-                LogBuffer* buffer = flush_buffers_.front();
-                fwrite(buffer->data(), 1, buffer->length(), file_fd);
-                flush_buffers_.pop();
-                buffer->reset();
-                free_buffers_.push(buffer);
-                fflush(file_fd);
-            }
+    while (true) {
+        drain();
+        Mutex::Lock lock(m_mutex);
+        if (!m_running.load(std::memory_order_acquire)) {
+            break;
+        }
+        m_sleeping.store(true, std::memory_order_release);
+        m_cond.wait_timeout(&m_mutex, FLUSH_INTERVAL_MS);
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+    drain();
+}
+
+size_t AsyncLogger::drain() {
+    {
+        Mutex::Lock lock(m_rings_mutex);
+        // 写入线程已经退出并且数据已经写出的环不再需要
+        m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(),
+                                     [](const LogRing::ptr& ring) {
+                                         return ring->is_closed() && ring->get_size() == 0;
+                                     }),
+                      m_rings.end());
+        m_draining = m_rings;
+    }
 
-            // 当free为空时说明写入日志在wait，需要唤醒
-            if (empty) m_cond.signal();
+    // 所有环的数据合并为一次writev, 超过IOV_MAX时分批
+    iovec iov[IOV_MAX];
+    size_t lengths[IOV_MAX / 2];
+    size_t total = 0;
+    for (size_t begin = 0; begin < m_draining.size(); begin += IOV_MAX / 2) {
+        size_t end = std::min(m_draining.size(), begin + IOV_MAX / 2);
+        int count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            int n = 0;
+            lengths[i - begin] = m_draining[i]->peek(iov + count, n);
+            count += n;
+            total += lengths[i - begin];
         }
-        else {
-            if (cur_buffer_->length() == 0) {
+        if (count == 0) {
+            continue;
+        }
+        write(iov, count);
+        for (size_t i = begin; i < end; ++i) {
+            m_draining[i]->consume(lengths[i - begin]);
+        }
+    }
+
+    if (m_has_spill.load(std::memory_order_acquire)) {
+        Mutex::Lock lock(m_spill_mutex);
+        // 开始溢出之前写入环中的数据先写出, 保证同一线程的日志顺序
+        for (auto& ring : m_draining) {
+            if (!ring->is_spilled()) {
+                continue;
+            }
+            int n = 0;
+            size_t len = ring->peek(iov, n);
+            write(iov, n);
+            ring->consume(len);
+            ring->set_spilled(false);
+            total += len;
+        }
+        iov[0] = {m_spill_buffer.data(), m_spill_buffer.size()};
+        write(iov, 1);
+        total += m_spill_buffer.size();
+        m_spill_buffer.clear();
+        m_has_spill.store(false, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reported_dropped) {
+        std::string line = "[AsyncLogger] " + std::to_string(dropped - m_reported_dropped) +
+                           " log lines dropped\n";
+        iov[0] = {line.data(), line.size()};
+        write(iov, 1);
+        m_reported_dropped = dropped;
+    }
+    m_draining.clear();
+
+    if (!m_writer) {
+        check_rotate();
+    }
+    return total;
+}
+
+void AsyncLogger::write(iovec* iov, int count) {
+    if (m_writer) {
+        m_writer(iov, count);
+    }
+    else {
+        // 每批写出前检查, 文件最多超出max_size一批的大小
+        check_rotate();
+        write_all(iov, count);
+    }
+}
+
+void AsyncLogger::write_all(iovec* iov, int count) {
+    if (m_fd < 0) {
+        return;
+    }
+    while (count > 0) {
+        // 不经过hook, hook中会写日志, 并且进程退出时它用到的单例可能已经析构
+        ssize_t len = writev_f(m_fd, iov, count);
+        if (len < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-            fwrite(cur_buffer_->data(), 1, cur_buffer_->length(), file_fd);
-            cur_buffer_->reset();
-            fflush(file_fd);
+            // 写文件出错时丢弃这批日志
+            return;
+        }
+        m_file_size += len;
+        while (count > 0 && static_cast<size_t>(len) >= iov->iov_len) {
+            len -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + len;
+            iov->iov_len -= len;
+        }
+    }
+}
+
+void AsyncLogger::set_rotate_config(const LogRotateConfig& config) {
+    Mutex::Lock lock(m_rotate_mutex);
+    m_rotate_config = config;
+}
+
+LogRotateConfig AsyncLogger::get_rotate_config() {
+    Mutex::Lock lock(m_rotate_mutex);
+    return m_rotate_config;
+}
+
+void AsyncLogger::reopen() {
+    // 后台线程最多FLUSH_INTERVAL_MS之后处理
+    m_reopen.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::open_file() {
+    if (m_fd >= 0) {
+        close_f(m_fd);
+    }
+    m_fd = ::open(m_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        std::cerr << "[AsyncLogger] open " << m_file << " failed: " << strerror(errno) << std::endl;
+        m_file_size = 0;
+        return;
+    }
+    struct stat st {};
+    m_file_size = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+}
+
+// 下一个按本地时间对齐的切分时间
+static time_t next_rotate_time(time_t now, uint32_t interval) {
+    tm local {};
+    localtime_r(&now, &local);
+    time_t offset = local.tm_gmtoff;
+    return ((now + offset) / interval + 1) * interval - offset;
+}
+
+void AsyncLogger::check_rotate() {
+    LogRotateConfig config = get_rotate_config();
+    time_t now = time(nullptr);
+    if (config.interval != m_rotate_interval) {
+        m_rotate_interval = config.interval;
+        m_next_rotate_time = config.interval ? next_rotate_time(now, config.interval) : 0;
+    }
+
+    bool by_size = config.max_size && m_file_size >= config.max_size;
+    bool by_time = config.interval && now >= m_next_rotate_time;
+    if (by_time) {
+        m_next_rotate_time = next_rotate_time(now, config.interval);
+    }
+    // 空文件不按时间切分
+    if (by_size || (by_time && m_file_size > 0)) {
+        m_reopen.store(false, std::memory_order_relaxed);
+        rotate(config, now);
+    }
+    else if (m_reopen.exchange(false, std::memory_order_acq_rel)) {
+        open_file();
+    }
+}
+
+void AsyncLogger::rotate(const LogRotateConfig& config, time_t now) {
+    tm local {};
+    localtime_r(&now, &local);
+    char suffix[32];
+    strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &local);
+    // 一秒内多次切分时加上递增的序号, 跳过已经存在的文件
+    m_rotate_seq = m_rotate_suffix == suffix ? m_rotate_seq + 1 : 0;
+    m_rotate_suffix = suffix;
+    std::string rotated;
+    for (;; ++m_rotate_seq) {
+        rotated = m_file + suffix;
+        if (m_rotate_seq) {
+            rotated += "." + std::to_string(m_rotate_seq);
         }
+        if (access(rotated.c_str(), F_OK) != 0 && access((rotated + ".gz").c_str(), F_OK) != 0) {
+            break;
+        }
+    }
+    if (::rename(m_file.c_str(), rotated.c_str()) != 0) {
+        std::cerr << "[AsyncLogger] rename " << m_file << " failed: " << strerror(errno)
+                  << std::endl;
+        open_file();
+        return;
+    }
+    open_file();
+
+    if (!config.compress && !config.keep) {
+        return;
+    }
+    Mutex::Lock lock(m_archive_mutex);
+    m_archive_jobs.emplace_back(rotated, config);
+    if (!m_archive_thread) {
+        m_archive_thread.reset(new Thread([this]() { run_archiver(); }, "log_archiver"));
+    }
+    m_archive_cond.signal();
+}
+
+void AsyncLogger::run_archiver() {
+    while (true) {
+        std::pair<std::string, LogRotateConfig> job;
+        {
+            Mutex::Lock lock(m_archive_mutex);
+            while (m_archive_jobs.empty() && !m_archive_stop) {
+                m_archive_cond.wait(&m_archive_mutex);
+            }
+            // 退出前处理完所有历史文件
+            if (m_archive_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_archive_jobs.front());
+            m_archive_jobs.pop_front();
+        }
+        archive(job.first, job.second);
+    }
+}
+
+// 压缩为from.gz, 成功后删除原文件
+static bool gzip_file(const std::string& from) {
+    std::string to = from + ".gz";
+    std::string tmp = to + ".tmp";
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    int out = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close_f(in);
+        return false;
+    }
+
+    z_stream stream {};
+    bool ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                           Z_DEFAULT_STRATEGY) == Z_OK;
+    std::string input(64 * 1024, '\0');
+    std::string output(64 * 1024, '\0');
+    int flush = Z_NO_FLUSH;
+    while (ok && flush != Z_FINISH) {
+        ssize_t n = read_f(in, &input[0], input.size());
+        if (n < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef*>(&input[0]);
+        stream.avail_in = n;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+            stream.avail_out = output.size();
+            deflate(&stream, flush);
+            size_t len = output.size() - stream.avail_out;
+            for (size_t written = 0; ok && written < len;) {
+                ssize_t w = write_f(out, &output[written], len - written);
+                if (w < 0 && errno != EINTR) {
+                    ok = false;
+                }
+                written += std::max<ssize_t>(w, 0);
+            }
+        } while (ok && stream.avail_out == 0);
+    }
+    deflateEnd(&stream);
+    close_f(in);
+    close_f(out);
+
+    if (!ok || ::rename(tmp.c_str(), to.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    ::unlink(from.c_str());
+    return true;
+}
+
+void AsyncLogger::sort_rotated(const std::string& prefix, std::vector<std::string>& names) {
+    auto key = [&prefix](const std::string& name) {
+        size_t seq = prefix.size() + 16;
+        return std::make_pair(name.substr(std::min(prefix.size(), name.size()), 15),
+                              seq < name.size() ? atoi(name.c_str() + seq) : 0);
+    };
+    std::sort(names.begin(), names.end(),
+              [&key](const std::string& a, const std::string& b) { return key(a) < key(b); });
+}
+
+void AsyncLogger::archive(const std::string& file, const LogRotateConfig& config) {
+    if (config.compress && !gzip_file(file)) {
+        std::cerr << "[AsyncLogger] compress " << file << " failed" << std::endl;
+    }
+    if (!config.keep) {
+        return;
+    }
+
+    // 历史文件名为 文件名.时间[.序号][.gz]
+    size_t pos = m_file.find_last_of('/');
+    std::string dir = pos == std::string::npos ? "." : m_file.substr(0, pos + 1);
+    std::string prefix = (pos == std::string::npos ? m_file : m_file.substr(pos + 1)) + ".";
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    std::vector<std::string> rotated;
+    while (dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            isdigit(name[prefix.size()]) && name.find(".tmp") == std::string::npos) {
+            rotated.push_back(std::move(name));
+        }
+    }
+    closedir(d);
+    if (rotated.size() <= config.keep) {
+        return;
+    }
+    sort_rotated(prefix, rotated);
+    for (size_t i = 0; i + config.keep < rotated.size(); ++i) {
+        ::unlink((pos == std::string::npos ? rotated[i] : dir + rotated[i]).c_str());
     }
 }
 
-};  // namespace acid
\ No newline at end of file
+};  // namespace acid
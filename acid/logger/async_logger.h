@@ -5,92 +5,274 @@
 #include "acid/common/singleton.h"
 #include "acid/common/thread.h"
 
+#include <atomic>
 #include <cstring>
-#include <queue>
+#include <ctime>
+#include <deque>
+#include <functional>
 #include <string>
+#include <sys/uio.h>
+#include <vector>
 
 namespace acid {
 
-class LogBuffer {
+/**
+ * @brief 单生产者单消费者的字节环形缓冲区
+ * 每个写日志的线程在每个AsyncLogger中各有一个, 写入线程和后台线程只通过head和tail同步, 不加锁
+ */
+class LogRing {
 public:
-    using ptr = std::shared_ptr<LogBuffer>;
+    using ptr = std::shared_ptr<LogRing>;
 
-    LogBuffer();
-    ~LogBuffer();
+    /**
+     * @param capacity 容量, 向上取整为2的幂
+     */
+    explicit LogRing(size_t capacity);
 
-    void append(const char* buffer, size_t len);
+    ~LogRing();
 
-    const char* data() const {
-        return m_data;
-    }
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    /**
+     * @brief 写入线程调用, 剩余空间足够时拷贝整条日志
+     * @return 空间不足返回false, 不写入任何数据
+     */
+    bool push(const char* data, size_t len);
+
+    /**
+     * @brief 后台线程调用, 取出所有已写入的数据, 环回时分为两段
+     * @param[out] iov 至少两个元素
+     * @param[out] count 使用的iov个数
+     * @return 数据长度, 写出后用consume释放
+     */
+    size_t peek(iovec* iov, int& count) const;
 
-    int length() const {
-        return (int) (m_cur_ptr - m_data);
+    void consume(size_t len) {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
     }
 
-    char* current() {
-        return m_cur_ptr;
+    size_t get_capacity() const {
+        return m_capacity;
     }
 
-    int available() const {
-        return (int) (end() - m_cur_ptr);
+    size_t get_size() const {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
     }
 
-    void add(int len) {
-        m_cur_ptr += len;
+    // 写入线程退出或者AsyncLogger销毁后关闭, 另一方不再使用
+    void close() {
+        m_closed.store(true, std::memory_order_release);
     }
 
-    void reset() {
-        m_cur_ptr = m_data;
+    bool is_closed() const {
+        return m_closed.load(std::memory_order_acquire);
     }
 
-    void bzero() {
-        memset(m_data, 0, BUFFER_SIZE);
+    // 环满时写入线程把日志写到了溢出缓冲区, 之后的日志也写到溢出缓冲区以保持顺序
+    void set_spilled(bool spilled) {
+        m_spilled.store(spilled, std::memory_order_release);
     }
 
+    bool is_spilled() const {
+        return m_spilled.load(std::memory_order_acquire);
+    }
 
 private:
-    enum { BUFFER_SIZE = 1024 * 1024 };
+    char* m_data;
+    size_t m_capacity;
+    std::atomic<bool> m_closed {false};
+    std::atomic<bool> m_spilled {false};
+    // 写入线程和后台线程各自修改的位置放在不同的缓存行中
+    alignas(64) std::atomic<uint64_t> m_head {0};  // 已写入的总长度, 只由写入线程修改
+    uint64_t m_cached_tail = 0;                    // 写入线程缓存的tail, 空间不足时才重新读取
+    alignas(64) std::atomic<uint64_t> m_tail {0};  // 已写出的总长度, 只由后台线程修改
+};
 
-    const char* end() const {
-        return m_data + BUFFER_SIZE;
-    }
+/**
+ * @brief 日志文件的切分方式
+ * 切分在后台线程中写完一批日志之后进行, 只是重命名和重新打开文件, 压缩和删除历史文件在单独的线程中进行
+ */
+struct LogRotateConfig {
+    uint64_t max_size = 0;  // 文件达到这个大小后切分, 0表示不按大小切分
+    uint32_t interval = 0;  // 按本地时间每隔多少秒切分, 86400为每天零点切分, 0表示不按时间切分
+    uint32_t keep = 0;      // 保留的历史文件个数, 0表示全部保留
+    bool compress = false;  // 是否用gzip压缩历史文件
 
-private:
-    char m_data[BUFFER_SIZE];
-    char* m_cur_ptr;
+    bool operator==(const LogRotateConfig& other) const {
+        return max_size == other.max_size && interval == other.interval && keep == other.keep &&
+               compress == other.compress;
+    }
 };
 
+/**
+ * @brief 异步写日志文件
+ * 每个写日志的线程把日志追加到自己的LogRing中, 不加锁也不拷贝到共享的缓冲区,
+ * 后台线程轮流取出各个环中的数据, 用一次writev写出。不同线程的日志按批次交错, 同一线程内保持顺序
+ */
 class AsyncLogger {
 public:
     using ptr = std::shared_ptr<AsyncLogger>;
+    // 代替写文件, 在后台线程中处理取出的数据, 每个环的数据都是若干次完整的append, 环回处分为两段
+    using Writer = std::function<void(const iovec* iov, int count)>;
+
+    /**
+     * @brief 写入线程的环满时的处理方式
+     */
+    enum class OverflowPolicy {
+        BLOCK,  // 等待后台线程写出, 不丢失日志
+        DROP,   // 丢弃并计数, 后台线程在文件中记录丢弃的条数
+        SPILL,  // 写入不限长度的溢出缓冲区, 只在环满时加锁
+    };
+
+    /**
+     * @param file 日志文件, 追加写入, 打开失败时丢弃日志, 切分或者reopen时重试
+     * @param ring_size 每个写入线程的环的容量
+     */
+    explicit AsyncLogger(std::string file, OverflowPolicy policy = OverflowPolicy::BLOCK,
+                         size_t ring_size = 256 * 1024);
 
-    AsyncLogger();
-    explicit AsyncLogger(std::string file);
+    /**
+     * @param writer 处理写入的数据, 使用DROP策略时丢弃的统计行也会交给writer
+     */
+    explicit AsyncLogger(Writer writer, OverflowPolicy policy = OverflowPolicy::BLOCK,
+                         size_t ring_size = 256 * 1024);
+
+    /**
+     * @brief 停止后台线程, 写出所有剩余的日志
+     */
     ~AsyncLogger();
 
-    void append(const std::string log_line);
+    void append(const char* data, size_t len);
+
+    void append(const std::string& log_line) {
+        append(log_line.data(), log_line.size());
+    }
+
+    /**
+     * @brief 等待调用之前写入的日志全部写出
+     */
+    void flush();
+
+    void set_overflow_policy(OverflowPolicy policy) {
+        m_policy.store(policy, std::memory_order_relaxed);
+    }
+
+    OverflowPolicy get_overflow_policy() const {
+        return m_policy.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 设置日志文件的切分方式, 下一次写出时生效
+     */
+    void set_rotate_config(const LogRotateConfig& config);
+
+    LogRotateConfig get_rotate_config();
 
+    /**
+     * @brief 让后台线程重新打开日志文件, 用于外部工具移走日志文件之后, 不等待完成
+     */
+    void reopen();
+
+    // 因为环满丢弃的日志条数
+    uint64_t get_dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    // 写入溢出缓冲区的日志条数
+    uint64_t get_spilled() const {
+        return m_spilled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 把历史文件名按切分的先后排序, 历史文件名为 文件名.时间[.序号][.gz]
+     * 先比较时间再比较同一秒内的序号, 没有序号的是这一秒内的第一个
+     *
+     * @param prefix 日志文件名(不含目录)加上'.'
+     * @param names 不含目录的历史文件名
+     */
+    static void sort_rotated(const std::string& prefix, std::vector<std::string>& names);
+
+private:
     void start();
 
     void run();
 
+    // 当前线程的环, 第一次调用时创建并注册
+    LogRing* get_ring();
+
+    // 唤醒等待中的后台线程
+    void wake_up();
+
+    // 写出所有环和溢出缓冲区中的数据, 返回写出的字节数
+    size_t drain();
+
+    // 交给writer或者写到文件
+    void write(iovec* iov, int count);
+
+    // 以追加方式打开日志文件, 只在构造函数和后台线程中调用
+    void open_file();
+
+    // 检查是否需要切分或者重新打开, 只在后台线程中调用
+    void check_rotate();
+
+    // 重命名当前文件并打开新文件, 历史文件交给归档线程
+    void rotate(const LogRotateConfig& config, time_t now);
+
+    // 归档线程, 压缩历史文件并删除超出保留个数的文件
+    void run_archiver();
+
+    void archive(const std::string& file, const LogRotateConfig& config);
+
+    // 写出iov中的所有数据, 处理部分写入
+    void write_all(iovec* iov, int count);
+
 private:
-    enum { BUFFER_NUM = 4 };
+    uint64_t m_id;  // 区分线程局部缓存中不同的AsyncLogger
+    std::string m_file;
+    int m_fd = -1;
+    Writer m_writer;
+    size_t m_ring_size;
+    std::atomic<OverflowPolicy> m_policy;
+    std::atomic<uint64_t> m_dropped {0};
+    std::atomic<uint64_t> m_spilled {0};
+    uint64_t m_reported_dropped = 0;  // 已经记录到文件中的丢弃条数, 只由后台线程使用
+
+    // 注册的环, 只在线程第一次写日志和后台线程取出时加锁
+    Mutex m_rings_mutex;
+    std::vector<LogRing::ptr> m_rings;
+    std::vector<LogRing::ptr> m_draining;  // 后台线程使用的副本
 
+    // 溢出缓冲区
+    Mutex m_spill_mutex;
+    std::string m_spill_buffer;
+    std::atomic<bool> m_has_spill {false};
+
+    // 后台线程空闲时在m_cond上等待, 写入线程的环超过一半时唤醒
     Mutex m_mutex;
     Cond m_cond;
-    std::string file_;
-    FILE* file_fd;
-    bool run_;
+    std::atomic<bool> m_sleeping {false};
+    std::atomic<bool> m_running {true};
     Thread::ptr m_thread;
 
-    LogBuffer buffers_[BUFFER_NUM];
-    LogBuffer* cur_buffer_;
-    std::queue<LogBuffer*> free_buffers_;
-    std::queue<LogBuffer*> flush_buffers_;
+    // 切分, 除配置外只由后台线程使用
+    Mutex m_rotate_mutex;
+    LogRotateConfig m_rotate_config;  // 由m_rotate_mutex保护
+    std::atomic<bool> m_reopen {false};
+    uint64_t m_file_size = 0;
+    uint32_t m_rotate_interval = 0;  // 计算m_next_rotate_time时使用的间隔
+    time_t m_next_rotate_time = 0;
+    std::string m_rotate_suffix;  // 上一次切分的时间后缀
+    int m_rotate_seq = 0;         // 同一秒内切分的序号, 不复用已被清理的文件名
+
+    // 归档线程在第一次切分时创建
+    Mutex m_archive_mutex;
+    Cond m_archive_cond;
+    std::deque<std::pair<std::string, LogRotateConfig>> m_archive_jobs;
+    bool m_archive_stop = false;
+    Thread::ptr m_archive_thread;
 };
 
 };  // namespace acid
 
-#endif
\ No newline at end of file
+#endif
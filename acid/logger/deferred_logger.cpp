@@ -0,0 +1,455 @@
+#include "deferred_logger.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace acid {
+
+namespace {
+
+void append_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_string(std::string& out, const std::string& str) {
+    append_u32(out, str.size());
+    out.append(str);
+}
+
+/**
+ * @brief 按顺序读取记录中的字段, 越界后所有读取都失败
+ */
+class RecordReader {
+public:
+    RecordReader(const char* data, size_t len) : m_data(data), m_len(len) {
+    }
+
+    bool read_u32(uint32_t& value) {
+        return read(&value, sizeof(value));
+    }
+
+    bool read_u64(uint64_t& value) {
+        return read(&value, sizeof(value));
+    }
+
+    bool read_string(std::string_view& str) {
+        uint32_t len = 0;
+        if (!read_u32(len) || m_len - m_offset < len) {
+            m_offset = m_len + 1;
+            return false;
+        }
+        str = std::string_view(m_data + m_offset, len);
+        m_offset += len;
+        return true;
+    }
+
+    bool read(void* value, size_t len) {
+        if (m_offset > m_len || m_len - m_offset < len) {
+            m_offset = m_len + 1;
+            return false;
+        }
+        memcpy(value, m_data + m_offset, len);
+        m_offset += len;
+        return true;
+    }
+
+private:
+    const char* m_data;
+    size_t m_len;
+    size_t m_offset = 0;
+};
+
+// 调用点记录的参数: 编号, 级别, 行号, 参数类型, 文件名, 格式字符串, 日志器名称
+std::string encode_format_record(const LogFormatInfo& info) {
+    std::string payload;
+    append_u32(payload, info.id);
+    append_u32(payload, info.level);
+    append_u32(payload, info.line);
+    append_u32(payload, info.arg_types.size());
+    for (auto type : info.arg_types) {
+        payload.push_back(static_cast<char>(type));
+    }
+    append_string(payload, info.file);
+    append_string(payload, info.format);
+    append_string(payload, info.logger_name);
+
+    DeferredRecordHeader header {static_cast<uint32_t>(sizeof(header) + payload.size()),
+                                 FORMAT_RECORD, 0, 0, 0, 0};
+    std::string record(reinterpret_cast<const char*>(&header), sizeof(header));
+    record.append(payload);
+    return record;
+}
+
+LogFormatInfo::ptr decode_format_record(const char* data, size_t len) {
+    RecordReader reader(data, len);
+    auto info = std::make_shared<LogFormatInfo>();
+    uint32_t level = 0;
+    uint32_t line = 0;
+    uint32_t count = 0;
+    if (!reader.read_u32(info->id) || !reader.read_u32(level) || !reader.read_u32(line) ||
+        !reader.read_u32(count) || count > len) {
+        return nullptr;
+    }
+    info->level = static_cast<LogLevel::Level>(level);
+    info->line = line;
+    info->arg_types.resize(count);
+    std::string_view file, format, logger_name;
+    if (!reader.read(info->arg_types.data(), count) || !reader.read_string(file) ||
+        !reader.read_string(format) || !reader.read_string(logger_name)) {
+        return nullptr;
+    }
+    info->file = file;
+    info->format = format;
+    info->logger_name = logger_name;
+    info->parse();
+    return info;
+}
+
+/**
+ * @brief 记录中的一个参数
+ */
+struct LogArg {
+    LogArgType type;
+    uint64_t value;
+    std::string_view str;
+};
+
+}  // namespace
+
+void LogFormatInfo::parse() {
+    segments.clear();
+    valid = false;
+    std::string text;
+    size_t arg = 0;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%') {
+            text.push_back(format[i]);
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%') {
+            text.push_back('%');
+            ++i;
+            continue;
+        }
+
+        // 标志, 宽度和精度原样保留, 长度修饰符按参数的存储类型重新生成
+        Segment segment;
+        segment.text = "%";
+        size_t j = i + 1;
+        while (j < format.size() && strchr("-+ #0'", format[j])) {
+            segment.text.push_back(format[j++]);
+        }
+        while (j < format.size() && (isdigit(format[j]) || format[j] == '.')) {
+            segment.text.push_back(format[j++]);
+        }
+        while (j < format.size() && strchr("hlLqjzt", format[j])) {
+            ++j;
+        }
+        // 不支持*指定的宽度和精度
+        if (j >= format.size() || arg >= arg_types.size()) {
+            return;
+        }
+        char conversion = format[j];
+        LogArgType type = arg_types[arg];
+        bool match = false;
+        if (strchr("diouxXc", conversion)) {
+            match = type == LogArgType::INT || type == LogArgType::UINT;
+            if (conversion != 'c') {
+                segment.text.append("ll");
+            }
+        }
+        else if (strchr("eEfFgGaA", conversion)) {
+            match = type == LogArgType::DOUBLE;
+        }
+        else if (conversion == 's') {
+            match = type == LogArgType::STRING;
+        }
+        else if (conversion == 'p') {
+            match = type == LogArgType::POINTER;
+        }
+        if (!match) {
+            return;
+        }
+        segment.text.push_back(conversion);
+        segment.arg = arg++;
+        segment.conversion = conversion;
+
+        if (!text.empty()) {
+            segments.push_back({std::move(text)});
+            text.clear();
+        }
+        segments.push_back(std::move(segment));
+        i = j;
+    }
+    if (!text.empty()) {
+        segments.push_back({std::move(text)});
+    }
+    valid = arg == arg_types.size();
+}
+
+void DeferredLogDecoder::format(const LogFormatInfo& info, const char* args, size_t len,
+                                std::string& out) {
+    RecordReader reader(args, len);
+    std::vector<LogArg> values(info.arg_types.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i].type = info.arg_types[i];
+        bool ok = values[i].type == LogArgType::STRING ? reader.read_string(values[i].str)
+                                                       : reader.read_u64(values[i].value);
+        if (!ok) {
+            out.append(info.format).append(" [truncated]");
+            return;
+        }
+    }
+
+    if (!info.valid) {
+        // 格式与参数不匹配时不调用snprintf, 原样输出
+        out.append(info.format).append(" [args:");
+        for (auto& value : values) {
+            out.push_back(' ');
+            if (value.type == LogArgType::STRING) {
+                out.append(value.str);
+            }
+            else {
+                out.append(std::to_string(value.value));
+            }
+        }
+        out.push_back(']');
+        return;
+    }
+
+    char buffer[128];
+    for (auto& segment : info.segments) {
+        if (segment.arg < 0) {
+            out.append(segment.text);
+            continue;
+        }
+        const LogArg& value = values[segment.arg];
+        if (value.type == LogArgType::STRING && segment.text == "%s") {
+            out.append(value.str);
+            continue;
+        }
+        auto print = [&segment, &value](char* dst, size_t size) {
+            const char* spec = segment.text.c_str();
+            switch (value.type) {
+                case LogArgType::STRING:
+                    return snprintf(dst, size, spec, std::string(value.str).c_str());
+                case LogArgType::DOUBLE: {
+                    double d;
+                    memcpy(&d, &value.value, sizeof(d));
+                    return snprintf(dst, size, spec, d);
+                }
+                case LogArgType::POINTER:
+                    return snprintf(dst, size, spec, reinterpret_cast<void*>(value.value));
+                default:
+                    if (segment.conversion == 'c') {
+                        return snprintf(dst, size, spec, static_cast<int>(value.value));
+                    }
+                    return snprintf(dst, size, spec, static_cast<unsigned long long>(value.value));
+            }
+        };
+        int n = print(buffer, sizeof(buffer));
+        if (n < 0) {
+            continue;
+        }
+        if (static_cast<size_t>(n) < sizeof(buffer)) {
+            out.append(buffer, n);
+        }
+        else {
+            // 很宽的字段
+            std::string wide(n + 1, '\0');
+            print(&wide[0], wide.size());
+            out.append(wide.data(), n);
+        }
+    }
+}
+
+LogFormatInfo::ptr DeferredLogDecoder::get_format(uint32_t id) {
+    if (id < m_formats.size() && m_formats[id]) {
+        return m_formats[id];
+    }
+    LogFormatInfo::ptr info = m_resolver ? m_resolver(id) : nullptr;
+    if (info) {
+        if (m_formats.size() <= id) {
+            m_formats.resize(id + 1);
+        }
+        m_formats[id] = info;
+    }
+    return info;
+}
+
+size_t DeferredLogDecoder::decode(const char* data, size_t len, const Callback& cb) {
+    size_t offset = 0;
+    std::string content;
+    while (len - offset >= sizeof(DeferredRecordHeader)) {
+        DeferredRecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.size < sizeof(header)) {
+            // 数据损坏, 无法找到下一条记录的开头
+            return len;
+        }
+        if (header.size > len - offset) {
+            break;
+        }
+        const char* args = data + offset + sizeof(header);
+        size_t args_len = header.size - sizeof(header);
+        offset += header.size;
+
+        if (header.format_id == THREAD_RECORD) {
+            RecordReader reader(args, args_len);
+            std::string_view name;
+            if (reader.read_string(name)) {
+                m_thread_names[header.thread_id] = std::string(name);
+            }
+            continue;
+        }
+        if (header.format_id == FORMAT_RECORD) {
+            auto info = decode_format_record(args, args_len);
+            if (info && !get_format(info->id)) {
+                if (m_formats.size() <= info->id) {
+                    m_formats.resize(info->id + 1);
+                }
+                m_formats[info->id] = info;
+            }
+            continue;
+        }
+        if (header.format_id < FIRST_FORMAT_ID || !cb) {
+            continue;
+        }
+        auto info = get_format(header.format_id);
+        if (!info) {
+            continue;
+        }
+
+        content.clear();
+        format(*info, args, args_len, content);
+        auto event = std::make_shared<LogEvent>(
+            info->logger_name, info->level, info->file.c_str(), info->line, 0, header.thread_id,
+            header.fiber_id, static_cast<time_t>(header.time / 1000000000),
+            m_thread_names[header.thread_id]);
+        event->ssout() << content;
+        cb(*info, event);
+    }
+    return offset;
+}
+
+void DeferredLogDecoder::feed(const char* data, size_t len, const Callback& cb) {
+    if (m_pending.empty()) {
+        size_t n = decode(data, len, cb);
+        m_pending.assign(data + n, len - n);
+        return;
+    }
+    m_pending.append(data, len);
+    size_t n = decode(m_pending.data(), m_pending.size(), cb);
+    m_pending.erase(0, n);
+}
+
+bool DeferredLogDecoder::load_formats(const char* data, size_t len) {
+    if (len < sizeof(DEFERRED_LOG_MAGIC) ||
+        memcmp(data, DEFERRED_LOG_MAGIC, sizeof(DEFERRED_LOG_MAGIC)) != 0) {
+        return false;
+    }
+    decode(data + sizeof(DEFERRED_LOG_MAGIC), len - sizeof(DEFERRED_LOG_MAGIC), nullptr);
+    return true;
+}
+
+thread_local uint32_t DeferredLogger::t_thread_id = 0;
+
+DeferredLogger::~DeferredLogger() {
+    // 先停止后台线程, 它会写出剩余的日志并用到解码器
+    m_sink.store(nullptr, std::memory_order_release);
+    m_async_logger.reset();
+}
+
+bool DeferredLogger::open_binary(const std::string& file) {
+    Mutex::Lock lock(m_mutex);
+    if (m_sink.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    m_binary = true;
+    // AsyncLogger追加写入, 二进制文件必须从魔数开始
+    ::unlink(file.c_str());
+    m_async_logger = std::make_shared<AsyncLogger>(file);
+    // 第一个注册的环最先写出, 文件以魔数开头
+    m_async_logger->append(DEFERRED_LOG_MAGIC, sizeof(DEFERRED_LOG_MAGIC));
+    for (auto& info : m_formats) {
+        m_async_logger->append(encode_format_record(*info));
+    }
+    m_sink.store(m_async_logger.get(), std::memory_order_release);
+    return true;
+}
+
+void DeferredLogger::flush() {
+    AsyncLogger* sink = m_sink.load(std::memory_order_acquire);
+    if (sink) {
+        sink->flush();
+    }
+}
+
+uint32_t DeferredLogger::register_site(LogSite& site, const Logger::ptr& logger,
+                                       std::vector<LogArgType> arg_types) {
+    Mutex::Lock lock(m_mutex);
+    uint32_t id = site.id.load(std::memory_order_relaxed);
+    if (id != 0) {
+        return id;
+    }
+
+    auto info = std::make_shared<LogFormatInfo>();
+    info->id = FIRST_FORMAT_ID + m_formats.size();
+    info->level = site.level;
+    info->file = site.file;
+    info->line = site.line;
+    info->format = site.format;
+    info->logger_name = logger->get_name();
+    info->arg_types = std::move(arg_types);
+    info->logger = logger;
+    info->parse();
+    m_formats.push_back(info);
+    if (m_binary) {
+        m_async_logger->append(encode_format_record(*info));
+    }
+
+    site.id.store(info->id, std::memory_order_release);
+    return info->id;
+}
+
+uint32_t DeferredLogger::register_thread(AsyncLogger* sink) {
+    const LogContext& context = LogContext::current();
+    t_thread_id = context.thread_id;
+    std::string name = context.thread_name;
+    DeferredRecordHeader header {
+        static_cast<uint32_t>(sizeof(header) + sizeof(uint32_t) + name.size()), THREAD_RECORD, 0, 0,
+        t_thread_id, 0};
+    std::string record(reinterpret_cast<const char*>(&header), sizeof(header));
+    append_string(record, name);
+    sink->append(record);
+    return t_thread_id;
+}
+
+AsyncLogger* DeferredLogger::start() {
+    Mutex::Lock lock(m_mutex);
+    AsyncLogger* sink = m_sink.load(std::memory_order_relaxed);
+    if (sink) {
+        return sink;
+    }
+    m_decoder.reset(new DeferredLogDecoder([this](uint32_t id) {
+        Mutex::Lock lock(m_mutex);
+        return id >= FIRST_FORMAT_ID && id - FIRST_FORMAT_ID < m_formats.size()
+                   ? m_formats[id - FIRST_FORMAT_ID]
+                   : nullptr;
+    }));
+    m_async_logger = std::make_shared<AsyncLogger>(
+        [this](const iovec* iov, int count) { write(iov, count); });
+    m_sink.store(m_async_logger.get(), std::memory_order_release);
+    return m_async_logger.get();
+}
+
+void DeferredLogger::write(const iovec* iov, int count) {
+    for (int i = 0; i < count; ++i) {
+        m_decoder->feed(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len,
+                        [](const LogFormatInfo& info, LogEvent::ptr event) {
+                            info.logger->log(info.level, event);
+                        });
+    }
+}
+
+}  // namespace acid
@@ -0,0 +1,346 @@
+#ifndef ACID_DEFERRED_LOGGER_H
+#define ACID_DEFERRED_LOGGER_H
+
+#include "async_logger.h"
+#include "logger.h"
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 延迟格式化的日志, 用法与LOG_FMT_LEVEL相同
+ * @details 调用点只记录调用点编号和参数的原始字节, 后台线程或者log_decoder工具再格式化。
+ * fmt必须是字符串字面量, 参数只能是整数, 浮点数, 字符串指针和其他指针,
+ * std::string需要传入c_str(), 字符串在调用时拷贝。if (false)中的调用只用于让编译器检查格式
+ */
+#define LOG_DEFER_LEVEL(logger, level, fmt, ...)                                            \
+    do {                                                                                     \
+        if (level <= logger->get_level()) {                                                  \
+            if (false) {                                                                     \
+                acid::check_log_format(fmt, ##__VA_ARGS__);                                  \
+            }                                                                                \
+            static acid::LogSite s_acid_log_site(level, __FILE__, __LINE__, fmt);            \
+            acid::DeferredLoggerMgr::instance()->log(s_acid_log_site, logger, ##__VA_ARGS__); \
+        }                                                                                    \
+    } while (0)
+
+#define LOG_DEFER_FATAL(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_ALERT(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::ALERT, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_CRIT(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::CRIT, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_ERROR(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_WARN(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_NOTICE(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::NOTICE, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_INFO(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEFER_DEBUG(logger, fmt, ...) \
+    LOG_DEFER_LEVEL(logger, acid::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+
+namespace acid {
+
+/**
+ * @brief 只用于编译期检查格式字符串和参数是否匹配, 不会被调用
+ */
+__attribute__((format(printf, 1, 2))) inline void check_log_format(const char*, ...) {
+}
+
+/**
+ * @brief 参数在记录中的存储类型
+ */
+enum class LogArgType : uint8_t {
+    INT,      // int64_t, 包括bool和char
+    UINT,     // uint64_t
+    DOUBLE,   // double
+    STRING,   // uint32_t长度 + 内容
+    POINTER,  // uint64_t
+};
+
+/**
+ * @brief 调用点的静态信息, 常量初始化, 第一次执行时注册得到编号
+ */
+struct LogSite {
+    constexpr LogSite(LogLevel::Level level, const char* file, int32_t line, const char* format)
+        : level(level), file(file), line(line), format(format) {
+    }
+
+    LogLevel::Level level;
+    const char* file;
+    int32_t line;
+    const char* format;
+    std::atomic<uint32_t> id {0};
+};
+
+/**
+ * @brief 注册后的调用点, 解码时使用
+ */
+struct LogFormatInfo {
+    using ptr = std::shared_ptr<LogFormatInfo>;
+
+    // 格式字符串中的一段, 普通文本或者一个转换说明
+    struct Segment {
+        std::string text;     // 普通文本, 或者去掉长度修饰符的转换说明
+        int arg = -1;         // 对应的参数下标, 普通文本为-1
+        char conversion = 0;  // 转换字符
+    };
+
+    uint32_t id = 0;
+    LogLevel::Level level = LogLevel::DEBUG;
+    std::string file;
+    int32_t line = 0;
+    std::string format;
+    std::string logger_name;
+    std::vector<LogArgType> arg_types;
+    // 进程内解码时输出到的日志器, 离线解码时为空
+    Logger::ptr logger;
+    // 解析后的格式, 转换说明与参数类型不匹配时为空, 解码时原样输出格式字符串和参数
+    std::vector<Segment> segments;
+    bool valid = false;
+
+    // 解析格式字符串, 检查转换说明与参数类型
+    void parse();
+};
+
+/**
+ * @brief 每条记录的头部, 后面是按顺序编码的参数
+ */
+struct DeferredRecordHeader {
+    uint32_t size;       // 整条记录的长度, 包括头部
+    uint32_t format_id;  // 调用点编号, 小于FIRST_FORMAT_ID的是特殊记录
+    uint64_t time;       // CLOCK_REALTIME, 纳秒
+    uint64_t fiber_id;
+    uint32_t thread_id;
+    uint32_t reserved;
+};
+
+/**
+ * @brief 二进制日志文件中的特殊记录
+ */
+enum DeferredRecordType : uint32_t {
+    THREAD_RECORD = 0,  // 线程第一次写日志时记录线程名, 参数为一个字符串
+    FORMAT_RECORD = 1,  // 调用点第一次执行时记录静态信息, 之后的记录只使用编号
+    FIRST_FORMAT_ID = 16,
+};
+
+// 二进制日志文件的开头
+static constexpr char DEFERRED_LOG_MAGIC[8] = {'A', 'C', 'I', 'D', 'L', 'O', 'G', '1'};
+
+namespace detail {
+
+template <class T>
+constexpr LogArgType log_arg_type() {
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, char*> || std::is_same_v<U, const char*>) {
+        return LogArgType::STRING;
+    }
+    else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>) {
+        return LogArgType::POINTER;
+    }
+    else if constexpr (std::is_floating_point_v<U>) {
+        return LogArgType::DOUBLE;
+    }
+    else if constexpr (std::is_enum_v<U>) {
+        return std::is_signed_v<std::underlying_type_t<U>> ? LogArgType::INT : LogArgType::UINT;
+    }
+    else if constexpr (std::is_integral_v<U>) {
+        return std::is_signed_v<U> || std::is_same_v<U, bool> ? LogArgType::INT
+                                                              : LogArgType::UINT;
+    }
+    else {
+        static_assert(std::is_pointer_v<U>,
+                      "deferred log only supports integers, floating point numbers and pointers, "
+                      "pass c_str() for std::string");
+        return LogArgType::POINTER;
+    }
+}
+
+template <class T>
+inline size_t log_arg_size(const T& arg) {
+    if constexpr (log_arg_type<T>() == LogArgType::STRING) {
+        // 字符串字面量以数组引用传入, 先转成指针再判空
+        const char* str = arg;
+        return sizeof(uint32_t) + (str ? strlen(str) : 0);
+    }
+    else {
+        return sizeof(uint64_t);
+    }
+}
+
+template <class T>
+inline char* encode_log_arg(char* ptr, const T& arg) {
+    constexpr LogArgType type = log_arg_type<T>();
+    if constexpr (type == LogArgType::STRING) {
+        const char* str = arg;
+        uint32_t len = str ? strlen(str) : 0;
+        memcpy(ptr, &len, sizeof(len));
+        if (len > 0) {
+            memcpy(ptr + sizeof(len), str, len);
+        }
+        return ptr + sizeof(len) + len;
+    }
+    else {
+        uint64_t value;
+        if constexpr (type == LogArgType::DOUBLE) {
+            double d = arg;
+            memcpy(&value, &d, sizeof(value));
+        }
+        else if constexpr (type == LogArgType::POINTER) {
+            value = reinterpret_cast<uintptr_t>(arg);
+        }
+        else if constexpr (type == LogArgType::INT) {
+            value = static_cast<int64_t>(arg);
+        }
+        else {
+            value = static_cast<uint64_t>(arg);
+        }
+        memcpy(ptr, &value, sizeof(value));
+        return ptr + sizeof(value);
+    }
+}
+
+}  // namespace detail
+
+/**
+ * @brief 解码延迟格式化的记录
+ * 进程内由后台线程解码后交给调用点的日志器输出, 二进制文件由log_decoder离线解码
+ */
+class DeferredLogDecoder {
+public:
+    // 解码得到的日志, info为调用点信息
+    using Callback = std::function<void(const LogFormatInfo& info, LogEvent::ptr event)>;
+    // 查找还没有缓存的调用点
+    using Resolver = std::function<LogFormatInfo::ptr(uint32_t id)>;
+
+    explicit DeferredLogDecoder(Resolver resolver = nullptr) : m_resolver(std::move(resolver)) {
+    }
+
+    /**
+     * @brief 解码data开头的完整记录, 不完整的记录留给下一次
+     * @return 解码的字节数
+     */
+    size_t decode(const char* data, size_t len, const Callback& cb);
+
+    /**
+     * @brief 解码可能在任意位置断开的数据流, 不完整的记录暂存到下一次调用
+     */
+    void feed(const char* data, size_t len, const Callback& cb);
+
+    /**
+     * @brief 离线解码时先扫描整个文件中的调用点记录,
+     * 多个线程的日志按批次交错写出, 使用调用点的记录可能在注册记录之前
+     * @return 文件格式是否正确
+     */
+    bool load_formats(const char* data, size_t len);
+
+    /**
+     * @brief 按调用点的格式和记录中的参数格式化日志内容
+     */
+    static void format(const LogFormatInfo& info, const char* args, size_t len, std::string& out);
+
+private:
+    LogFormatInfo::ptr get_format(uint32_t id);
+
+private:
+    Resolver m_resolver;
+    std::vector<LogFormatInfo::ptr> m_formats;  // 下标为调用点编号
+    std::unordered_map<uint32_t, std::string> m_thread_names;
+    std::string m_pending;  // feed中不完整的记录
+};
+
+/**
+ * @brief 延迟格式化日志的后端
+ * 默认在后台线程格式化后交给调用点的日志器, 由日志器的appender输出。
+ * 在第一条日志之前调用open_binary之后只写二进制记录, 不在进程内格式化
+ */
+class DeferredLogger {
+public:
+    DeferredLogger() = default;
+
+    ~DeferredLogger();
+
+    /**
+     * @brief 改为写二进制日志文件, 只能在第一条延迟日志之前调用
+     * @return 已经开始写日志返回false
+     */
+    bool open_binary(const std::string& file);
+
+    /**
+     * @brief 等待之前的日志全部写出
+     */
+    void flush();
+
+    template <class... Args>
+    void log(LogSite& site, const Logger::ptr& logger, const Args&... args) {
+        uint32_t id = site.id.load(std::memory_order_acquire);
+        if (id == 0) {
+            id = register_site(site, logger, {detail::log_arg_type<Args>()...});
+        }
+        AsyncLogger* sink = m_sink.load(std::memory_order_acquire);
+        if (!sink) {
+            sink = start();
+        }
+        uint32_t thread_id = t_thread_id;
+        if (thread_id == 0) {
+            thread_id = register_thread(sink);
+        }
+
+        size_t size = sizeof(DeferredRecordHeader) + (0 + ... + detail::log_arg_size(args));
+        char stack_buffer[256];
+        std::string heap_buffer;
+        char* buffer = stack_buffer;
+        if (size > sizeof(stack_buffer)) {
+            heap_buffer.resize(size);
+            buffer = &heap_buffer[0];
+        }
+
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        DeferredRecordHeader header {static_cast<uint32_t>(size), id,
+                                     static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec,
+                                     LogContext::current().fiber_id, thread_id, 0};
+        memcpy(buffer, &header, sizeof(header));
+        [[maybe_unused]] char* ptr = buffer + sizeof(header);
+        ((ptr = detail::encode_log_arg(ptr, args)), ...);
+        sink->append(buffer, size);
+    }
+
+private:
+    // 注册调用点, 二进制模式下同时写入调用点记录
+    uint32_t register_site(LogSite& site, const Logger::ptr& logger,
+                           std::vector<LogArgType> arg_types);
+
+    // 当前线程第一次写日志时写入线程记录
+    uint32_t register_thread(AsyncLogger* sink);
+
+    // 没有打开二进制文件时创建进程内格式化的后台线程
+    AsyncLogger* start();
+
+    // 进程内格式化, 在后台线程中调用
+    void write(const iovec* iov, int count);
+
+private:
+    static thread_local uint32_t t_thread_id;
+
+    Mutex m_mutex;  // 保护注册和启动
+    std::vector<LogFormatInfo::ptr> m_formats;
+    bool m_binary = false;
+    AsyncLogger::ptr m_async_logger;
+    std::atomic<AsyncLogger*> m_sink {nullptr};
+    std::unique_ptr<DeferredLogDecoder> m_decoder;  // 只由后台线程使用
+};
+
+/// @brief 延迟格式化日志的单例
+using DeferredLoggerMgr = Singleton<DeferredLogger>;
+
+}  // namespace acid
+
+#endif
@@ -0,0 +1,80 @@
+#include "log_context.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace acid {
+
+constinit thread_local LogContext LogContext::t_context;
+
+void LogContext::init() {
+    // fork之后子进程只剩调用fork的线程, 它的线程id变了, 下次使用时重新获取
+    [[maybe_unused]] static bool s_registered =
+        pthread_atfork(nullptr, nullptr, []() { t_context.thread_id = 0; }) == 0;
+    t_context.thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    // 已经通过set_thread_name设置过的线程名不覆盖
+    if (!t_context.thread_name[0]) {
+        pthread_getname_np(pthread_self(), t_context.thread_name, sizeof(t_context.thread_name));
+    }
+}
+
+void LogContext::set_thread_name(const std::string& name) {
+    size_t len = std::min(name.size(), sizeof(t_context.thread_name) - 1);
+    memcpy(t_context.thread_name, name.data(), len);
+    t_context.thread_name[len] = '\0';
+}
+
+namespace {
+
+// 每个线程缓存最近使用的几种格式, 一般一个进程只用到一两种日期格式
+struct TimeFormatCache {
+    static constexpr int SIZE = 4;
+
+    struct Entry {
+        uint64_t id = 0;
+        time_t time = -1;
+        std::string text;
+    };
+
+    Entry entries[SIZE];
+    int next = 0;
+};
+
+}  // namespace
+
+const std::string& LogClock::format(uint64_t id, time_t time, const std::string& format) {
+    static thread_local TimeFormatCache t_cache;
+    TimeFormatCache::Entry* entry = nullptr;
+    for (auto& e : t_cache.entries) {
+        if (e.id == id) {
+            entry = &e;
+            break;
+        }
+    }
+    if (!entry) {
+        entry = &t_cache.entries[t_cache.next];
+        t_cache.next = (t_cache.next + 1) % TimeFormatCache::SIZE;
+        entry->id = id;
+        entry->time = -1;
+    }
+    if (entry->time != time) {
+        tm local {};
+        localtime_r(&time, &local);
+        char buffer[64];
+        size_t len = strftime(buffer, sizeof(buffer), format.c_str(), &local);
+        entry->text.assign(buffer, len);
+        entry->time = time;
+    }
+    return entry->text;
+}
+
+uint64_t LogClock::next_id() {
+    static std::atomic<uint64_t> s_id {0};
+    return ++s_id;
+}
+
+}  // namespace acid
@@ -0,0 +1,81 @@
+#ifndef ACID_LOG_CONTEXT_H
+#define ACID_LOG_CONTEXT_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <sys/types.h>
+
+namespace acid {
+
+/**
+ * @brief 当前线程写日志时用到的上下文
+ * @details 线程id和线程名第一次使用时各通过一次系统调用获取, 之后每条日志只读线程局部变量;
+ * 线程名由Thread::set_name更新, 协程id由Fiber切换时更新。fork之后子进程重新获取线程id
+ */
+struct LogContext {
+    pid_t thread_id = 0;
+    uint64_t fiber_id = 0;
+    // 与pthread_getname_np一致, 最多15个字符
+    char thread_name[16] {};
+
+    /**
+     * @brief 当前线程的上下文, 第一次调用时初始化
+     */
+    static LogContext& current() {
+        if (__builtin_expect(t_context.thread_id == 0, 0)) {
+            init();
+        }
+        return t_context;
+    }
+
+    /**
+     * @brief 切换协程时调用, 不触发初始化
+     */
+    static void set_fiber_id(uint64_t fiber_id) {
+        t_context.fiber_id = fiber_id;
+    }
+
+    /**
+     * @brief 当前线程改名时调用, 之后的日志使用新的线程名, 超过15个字符的部分截断
+     */
+    static void set_thread_name(const std::string& name);
+
+private:
+    static void init();
+
+    static constinit thread_local LogContext t_context;
+};
+
+/**
+ * @brief 日志使用的粗粒度时钟
+ */
+class LogClock {
+public:
+    /**
+     * @brief 当前UTC秒数, CLOCK_REALTIME_COARSE通过vDSO读取, 不进入内核
+     */
+    static time_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return ts.tv_sec;
+    }
+
+    /**
+     * @brief 按strftime格式化time, 同一线程中同一个id在同一秒内只格式化一次
+     * @param[in] id 调用方的唯一id, 用于区分不同的格式
+     * @param[in] time UTC秒数
+     * @param[in] format strftime格式
+     * @return 格式化后的字符串, 在同一线程下一次调用之前有效
+     */
+    static const std::string& format(uint64_t id, time_t time, const std::string& format);
+
+    /**
+     * @brief 分配format使用的id
+     */
+    static uint64_t next_id();
+};
+
+}  // namespace acid
+
+#endif  // ACID_LOG_CONTEXT_H
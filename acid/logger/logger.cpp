@@ -1,5 +1,6 @@
 #include "logger.h"
 
+#include "acid/common/config.h"
 #include "async_logger.h"
 
 #include <algorithm>
@@ -58,6 +59,19 @@ LogEvent::LogEvent(const std::string &logger_name, LogLevel::Level level, const
     , logger_name_(logger_name) {
 }
 
+LogEvent::LogEvent(const std::string &logger_name, LogLevel::Level level, const char *file,
+                   int32_t line, int64_t elapse, const LogContext &context, time_t time)
+    : level_(level)
+    , file_(file)
+    , line_(line)
+    , elapse_(elapse)
+    , thread_id_(context.thread_id)
+    , fiber_id_(context.fiber_id)
+    , time_(time)
+    , thread_name_(context.thread_name)
+    , logger_name_(logger_name) {
+}
+
 void LogEvent::printf(const char *format, ...) {
     va_list ap;
     va_start(ap, format);
@@ -145,20 +159,19 @@ public:
 
 class DateTimeFormatItem : public LogFormatter::FormatItem {
 public:
-    DateTimeFormatItem(const std::string &format = "%Y-%m-%d %H:%M:%S") : format_(format) {
+    DateTimeFormatItem(const std::string &format = "%Y-%m-%d %H:%M:%S")
+        : format_(format)
+        , id_(LogClock::next_id()) {
     }
 
     void format(std::ostream &os, LogEvent::ptr event) override {
-        tm struct_tm {};
-        time_t time = event->get_time();
-        localtime_r(&time, &struct_tm);
-        char buffer[64];
-        strftime(buffer, sizeof(buffer), format_.c_str(), &struct_tm);
-        os << buffer;
+        // 同一秒内的日志复用格式化好的字符串
+        os << LogClock::format(id_, event->get_time(), format_);
     }
 
 private:
     std::string format_;
+    uint64_t id_;
 };
 
 class FileNameFormatItem : public LogFormatter::FormatItem {
@@ -410,45 +423,22 @@ LogAppender::ptr FileLogAppender::create(const std::string &filename, LogLevel::
     return std::make_shared<FileLogAppender>(filename, level);
 }
 
-FileLogAppender::FileLogAppender(const std::string &filename, LogLevel::Level level)
-    : filename_(filename)
-    , LogAppender(level, std::make_shared<LogFormatter>())
-    , m_async_logger_appender(new AsyncLogger(filename)) {
-    // if (!reopen()) {
-    //     std::cout << "log file open error" << std::endl;
-    // }
+FileLogAppender::FileLogAppender(const std::string &filename, LogLevel::Level level,
+                                 AsyncLogger::OverflowPolicy policy)
+    : LogAppender(level, std::make_shared<LogFormatter>())
+    , filename_(filename)
+    , m_async_logger_appender(new AsyncLogger(filename, policy)) {
 }
 
-FileLogAppender::~FileLogAppender() {
-    // if (file_stream_) {
-    //     file_stream_.close();
-    // }
-}
+FileLogAppender::~FileLogAppender() = default;
 
 bool FileLogAppender::reopen() {
-    LockGuard lock(m_mutex);
-    if (file_stream_) {
-        file_stream_.close();
-    }
-    file_stream_.open(filename_, std::ios::app);
-
-    // 将非bool类型强转为bool类型, 0为false, 其余为true
-    return !file_stream_.bad();
+    m_async_logger_appender->reopen();
+    return true;
 }
 
 void FileLogAppender::log(LogLevel::Level level, LogEvent::ptr event) {
     if (level <= level_) {
-        // time_t time = event->get_time();
-        // if (time > last_time_ + 3) {
-        //     if (!reopen()) {
-        //         std::cout << "log file open error" << std::endl;
-        //     }
-        //     last_time_ = time;
-        // }
-
-        // LockGuard lock(m_mutex);
-        // std::cout << formatter_->format(event) << std::endl;
-        // file_stream_ << formatter_->format(event);
         m_async_logger_appender->append(formatter_->format(event));
     }
 }
@@ -458,54 +448,239 @@ std::string FileLogAppender::to_yaml_string() {
     return {};
 }
 
-Logger::Logger(LogLevel::Level level, const std::string &name) : level_(level), name_(name) {
+namespace {
+
+/**
+ * @brief 当前线程使用的各个日志器的appender列表, 按日志器的槽位编号索引
+ * 所有线程的缓存登记在一起, appender修改后由修改者释放各线程缓存的旧列表,
+ * 不写日志的线程不会一直持有已经删除的appender
+ */
+class AppenderCache {
+public:
+    using MutexType = Spinlock;
+
+    struct Entry {
+        uint64_t version = 0;  // 0表示没有缓存
+        uint32_t using_count = 0;  // 正在遍历列表的次数, appender中再写日志时会嵌套
+        std::shared_ptr<const Logger::AppenderList> appenders;
+    };
+
+    AppenderCache() {
+        Mutex::Lock lock(get_registry_mutex());
+        get_registry().push_back(this);
+    }
+
+    ~AppenderCache() {
+        {
+            Mutex::Lock lock(get_registry_mutex());
+            auto& caches = get_registry();
+            caches.erase(std::find(caches.begin(), caches.end(), this));
+        }
+        destroyed = true;
+    }
+
+    Entry& entry(size_t slot) {
+        if (slot >= m_entries.size()) [[unlikely]] {
+            m_entries.resize(slot + 1);
+        }
+        return m_entries[slot];
+    }
+
+    /**
+     * @brief 释放所有线程缓存的slot的列表, 正在使用的由该线程用完之后自己释放
+     *
+     * @param version 与之相同的缓存仍然有效, 为0时全部释放
+     */
+    static void release(size_t slot, uint64_t version) {
+        std::vector<std::shared_ptr<const Logger::AppenderList>> released;
+        {
+            Mutex::Lock lock(get_registry_mutex());
+            for (auto cache : get_registry()) {
+                MutexType::Lock cache_lock(cache->m_mutex);
+                if (slot >= cache->m_entries.size()) {
+                    continue;
+                }
+                Entry& entry = cache->m_entries[slot];
+                if (entry.using_count == 0 && entry.version != version) {
+                    released.push_back(std::move(entry.appenders));
+                    entry.version = 0;
+                }
+            }
+        }
+        // appender可能在析构时等待后台线程退出, 不在锁内析构
+    }
+
+    static size_t alloc_slot() {
+        Mutex::Lock lock(get_registry_mutex());
+        auto& free_slots = get_free_slots();
+        if (free_slots.empty()) {
+            return s_slots++;
+        }
+        size_t slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+
+    static void free_slot(size_t slot) {
+        release(slot, 0);
+        Mutex::Lock lock(get_registry_mutex());
+        get_free_slots().push_back(slot);
+    }
+
+    MutexType m_mutex;  // 只在本线程写日志和修改者释放缓存时使用, 基本没有竞争
+    std::vector<Entry> m_entries;
+    static thread_local bool destroyed;
+
+private:
+    // 线程退出时仍然可能写日志, 登记表不析构
+    static std::vector<AppenderCache*>& get_registry() {
+        static auto* s_caches = new std::vector<AppenderCache*>;
+        return *s_caches;
+    }
+
+    static std::vector<size_t>& get_free_slots() {
+        static auto* s_free_slots = new std::vector<size_t>;
+        return *s_free_slots;
+    }
+
+    static Mutex& get_registry_mutex() {
+        static auto* s_mutex = new Mutex;
+        return *s_mutex;
+    }
+
+    static size_t s_slots;  // 由registry_mutex保护
+};
+
+thread_local bool AppenderCache::destroyed = false;
+size_t AppenderCache::s_slots = 0;
+
+}  // namespace
+
+static thread_local AppenderCache t_appender_cache;
+
+Logger::Logger(LogLevel::Level level, const std::string &name)
+    : m_slot(AppenderCache::alloc_slot())
+    , name_(name)
+    , level_(level)
+    , appenders_(std::make_shared<const AppenderList>()) {
+}
+
+Logger::Logger(const std::string &name) : Logger(LogLevel::DEBUG, name) {
 }
 
-Logger::Logger(const std::string &name) : level_(LogLevel::DEBUG), name_(name) {
+Logger::~Logger() {
+    AppenderCache::free_slot(m_slot);
 }
 
 void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
-    LockGuard lock(m_mutex);
-    if (level <= level_) {
-        for (auto &appender : appenders_) {
+    if (level > get_level()) {
+        return;
+    }
+    // 线程退出过程中缓存已经销毁, 直接加锁获取
+    if (AppenderCache::destroyed) {
+        std::shared_ptr<const AppenderList> appenders;
+        {
+            LockGuard lock(m_mutex);
+            appenders = appenders_;
+        }
+        for (auto &appender : *appenders) {
             appender->log(level, event);
         }
+        return;
     }
-}
 
-void Logger::add_appender(LogAppender::ptr appender) {
-    LockGuard lock(m_mutex);
-    appenders_.push_back(appender);
-}
+    AppenderCache &cache = t_appender_cache;
+    const AppenderList *appenders = nullptr;
+    // 嵌套写日志时外层正在遍历缓存的列表, 不能替换, 这次单独持有新列表
+    std::shared_ptr<const AppenderList> holder;
+    {
+        AppenderCache::MutexType::Lock cache_lock(cache.m_mutex);
+        AppenderCache::Entry &entry = cache.entry(m_slot);
+        if (entry.version != m_version.load(std::memory_order_acquire)) [[unlikely]] {
+            LockGuard lock(m_mutex);
+            if (entry.using_count == 0) {
+                entry.appenders = appenders_;
+                entry.version = m_version.load(std::memory_order_relaxed);
+            }
+            else {
+                holder = appenders_;
+            }
+        }
+        if (!holder) {
+            ++entry.using_count;
+            appenders = entry.appenders.get();
+        }
+    }
+    if (holder) {
+        for (auto &appender : *holder) {
+            appender->log(level, event);
+        }
+        return;
+    }
 
-void Logger::delete_appender(LogAppender::ptr appender) {
-    LockGuard lock(m_mutex);
-    for (auto it = appenders_.begin(); it != appenders_.end(); ++it) {
-        if (*it == appender) {
-            appenders_.erase(it);
-            break;
+    for (auto &appender : *appenders) {
+        appender->log(level, event);
+    }
+
+    // 遍历期间列表被替换时由本线程释放旧列表
+    std::shared_ptr<const AppenderList> released;
+    {
+        AppenderCache::MutexType::Lock cache_lock(cache.m_mutex);
+        AppenderCache::Entry &entry = cache.entry(m_slot);
+        if (--entry.using_count == 0 &&
+            entry.version != m_version.load(std::memory_order_acquire)) [[unlikely]] {
+            released = std::move(entry.appenders);
+            entry.version = 0;
         }
     }
 }
 
-void Logger::clear_appender() {
-    LockGuard lock(m_mutex);
-    appenders_.clear();
+void Logger::update_appenders(const std::function<void(AppenderList &)> &update) {
+    auto appenders = std::make_shared<AppenderList>(*appenders_);
+    update(*appenders);
+    appenders_ = std::move(appenders);
+    m_version.fetch_add(1, std::memory_order_release);
 }
 
-LogLevel::Level Logger::get_level() {
-    LockGuard lock(m_mutex);
-    return level_;
+void Logger::release_cached() {
+    AppenderCache::release(m_slot, m_version.load(std::memory_order_acquire));
 }
 
-void Logger::set_level(LogLevel::Level level) {
-    LockGuard lock(m_mutex);
-    level_ = level;
+void Logger::add_appender(LogAppender::ptr appender) {
+    {
+        LockGuard lock(m_mutex);
+        update_appenders([&appender](AppenderList &appenders) { appenders.push_back(appender); });
+    }
+    release_cached();
 }
 
-std::string Logger::get_name() {
-    LockGuard lock(m_mutex);
-    return name_;
+void Logger::delete_appender(LogAppender::ptr appender) {
+    {
+        LockGuard lock(m_mutex);
+        update_appenders([&appender](AppenderList &appenders) {
+            auto it = std::find(appenders.begin(), appenders.end(), appender);
+            if (it != appenders.end()) {
+                appenders.erase(it);
+            }
+        });
+    }
+    release_cached();
+}
+
+void Logger::clear_appender() {
+    {
+        LockGuard lock(m_mutex);
+        update_appenders([](AppenderList &appenders) { appenders.clear(); });
+    }
+    release_cached();
+}
+
+void Logger::set_appenders(AppenderList appenders) {
+    {
+        LockGuard lock(m_mutex);
+        update_appenders([&appenders](AppenderList &list) { list.swap(appenders); });
+    }
+    release_cached();
 }
 
 void Logger::set_name(std::string name) {
@@ -543,4 +718,246 @@ std::string LoggerManager::to_yaml_string() {
     return {};
 }
 
+/**
+ * @brief 配置文件中的appender
+ */
+struct LogAppenderDefine {
+    int type = 0;  // 1 FileLogAppender, 2 StdoutLogAppender
+    LogLevel::Level level = LogLevel::DEBUG;
+    std::string formatter;
+    std::string file;
+    AsyncLogger::OverflowPolicy overflow = AsyncLogger::OverflowPolicy::BLOCK;
+    LogRotateConfig rotate;
+
+    bool operator==(const LogAppenderDefine &other) const {
+        return type == other.type && level == other.level && formatter == other.formatter &&
+               file == other.file && overflow == other.overflow && rotate == other.rotate;
+    }
+};
+
+/**
+ * @brief 配置文件中的日志器
+ */
+struct LogDefine {
+    std::string name;
+    LogLevel::Level level = LogLevel::DEBUG;
+    std::string formatter;
+    std::vector<LogAppenderDefine> appenders;
+
+    bool operator==(const LogDefine &other) const {
+        return name == other.name && level == other.level && formatter == other.formatter &&
+               appenders == other.appenders;
+    }
+};
+
+static const char *s_overflow_names[] = {"block", "drop", "spill"};
+
+// 支持K, M, G后缀
+static uint64_t parse_size(const std::string &str) {
+    size_t pos = 0;
+    uint64_t size = std::stoull(str, &pos);
+    switch (pos < str.size() ? toupper(str[pos]) : 0) {
+        case 'G':
+            size <<= 10;
+            [[fallthrough]];
+        case 'M':
+            size <<= 10;
+            [[fallthrough]];
+        case 'K':
+            size <<= 10;
+            break;
+        default:
+            break;
+    }
+    return size;
+}
+
+// 支持秒数, hourly和daily
+static uint32_t parse_interval(const std::string &str) {
+    if (str == "hourly") {
+        return 3600;
+    }
+    if (str == "daily") {
+        return 86400;
+    }
+    return std::stoul(str);
+}
+
+/**
+ * @brief 日志配置, 例如
+ * logs:
+ *   - name: root
+ *     level: info
+ *     appenders:
+ *       - type: FileLogAppender
+ *         file: /var/log/acid/root.log
+ *         overflow: block
+ *         rotate:
+ *           max_size: 100M
+ *           interval: daily
+ *           keep: 7
+ *           compress: true
+ *       - type: StdoutLogAppender
+ *         level: error
+ */
+template <>
+class LexicalCast<std::string, LogDefine> {
+public:
+    LogDefine operator()(const std::string &str) {
+        YAML::Node node = YAML::Load(str);
+        LogDefine define;
+        if (!node["name"].IsDefined()) {
+            throw std::invalid_argument("log config error: name is null, " + str);
+        }
+        define.name = node["name"].as<std::string>();
+        if (node["level"].IsDefined()) {
+            define.level = LogLevel::from_string(node["level"].as<std::string>());
+        }
+        if (node["formatter"].IsDefined()) {
+            define.formatter = node["formatter"].as<std::string>();
+        }
+        for (auto item : node["appenders"]) {
+            LogAppenderDefine appender;
+            std::string type = item["type"].IsDefined() ? item["type"].as<std::string>() : "";
+            if (type == "FileLogAppender") {
+                appender.type = 1;
+                if (!item["file"].IsDefined()) {
+                    throw std::invalid_argument("log config error: file is null, " + str);
+                }
+                appender.file = item["file"].as<std::string>();
+            }
+            else if (type == "StdoutLogAppender") {
+                appender.type = 2;
+            }
+            else {
+                throw std::invalid_argument("log config error: invalid appender type " + type);
+            }
+            if (item["level"].IsDefined()) {
+                appender.level = LogLevel::from_string(item["level"].as<std::string>());
+            }
+            if (item["formatter"].IsDefined()) {
+                appender.formatter = item["formatter"].as<std::string>();
+            }
+            if (item["overflow"].IsDefined()) {
+                std::string overflow = item["overflow"].as<std::string>();
+                auto it = std::find(std::begin(s_overflow_names), std::end(s_overflow_names),
+                                    overflow);
+                if (it == std::end(s_overflow_names)) {
+                    throw std::invalid_argument("log config error: invalid overflow " + overflow);
+                }
+                appender.overflow = static_cast<AsyncLogger::OverflowPolicy>(
+                    it - std::begin(s_overflow_names));
+            }
+            YAML::Node rotate = item["rotate"];
+            if (rotate.IsDefined()) {
+                if (rotate["max_size"].IsDefined()) {
+                    appender.rotate.max_size = parse_size(rotate["max_size"].as<std::string>());
+                }
+                if (rotate["interval"].IsDefined()) {
+                    appender.rotate.interval = parse_interval(rotate["interval"].as<std::string>());
+                }
+                if (rotate["keep"].IsDefined()) {
+                    appender.rotate.keep = rotate["keep"].as<uint32_t>();
+                }
+                if (rotate["compress"].IsDefined()) {
+                    appender.rotate.compress = rotate["compress"].as<bool>();
+                }
+            }
+            define.appenders.push_back(std::move(appender));
+        }
+        return define;
+    }
+};
+
+template <>
+class LexicalCast<LogDefine, std::string> {
+public:
+    std::string operator()(const LogDefine &define) {
+        YAML::Node node;
+        node["name"] = define.name;
+        node["level"] = LogLevel::to_string(define.level);
+        if (!define.formatter.empty()) {
+            node["formatter"] = define.formatter;
+        }
+        for (auto &appender : define.appenders) {
+            YAML::Node item;
+            item["type"] = appender.type == 1 ? "FileLogAppender" : "StdoutLogAppender";
+            item["level"] = LogLevel::to_string(appender.level);
+            if (!appender.formatter.empty()) {
+                item["formatter"] = appender.formatter;
+            }
+            if (appender.type == 1) {
+                item["file"] = appender.file;
+                item["overflow"] = s_overflow_names[static_cast<int>(appender.overflow)];
+                item["rotate"]["max_size"] = appender.rotate.max_size;
+                item["rotate"]["interval"] = appender.rotate.interval;
+                item["rotate"]["keep"] = appender.rotate.keep;
+                item["rotate"]["compress"] = appender.rotate.compress;
+            }
+            node["appenders"].push_back(item);
+        }
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+};
+
+static ConfigVar<std::vector<LogDefine>>::ptr g_log_defines =
+    Config::look_up("logs", std::vector<LogDefine>(), "logs config");
+
+// 按配置重建日志器的appender
+static void apply_log_define(const LogDefine &define) {
+    Logger::ptr logger = GET_LOGGER_BY_NAME(define.name);
+    logger->set_level(define.level);
+    Logger::AppenderList appenders;
+    for (auto &item : define.appenders) {
+        LogAppender::ptr appender;
+        if (item.type == 1) {
+            auto file_appender =
+                std::make_shared<FileLogAppender>(item.file, item.level, item.overflow);
+            file_appender->set_rotate_config(item.rotate);
+            appender = file_appender;
+        }
+        else {
+            appender = std::make_shared<StdoutLogAppender>(item.level);
+        }
+        const std::string &pattern = item.formatter.empty() ? define.formatter : item.formatter;
+        if (!pattern.empty()) {
+            auto formatter = std::make_shared<LogFormatter>(pattern);
+            if (!formatter->is_error()) {
+                appender->set_formatter(formatter);
+            }
+        }
+        appenders.push_back(appender);
+    }
+    logger->set_appenders(std::move(appenders));
+}
+
+struct _LogIniter {
+    _LogIniter() {
+        g_log_defines->add_listener(
+            [](const std::vector<LogDefine> &old_val, const std::vector<LogDefine> &new_val) {
+                for (auto &define : new_val) {
+                    auto it = std::find_if(
+                        old_val.begin(), old_val.end(),
+                        [&define](const LogDefine &old) { return old.name == define.name; });
+                    if (it == old_val.end() || !(*it == define)) {
+                        apply_log_define(define);
+                    }
+                }
+                // 从配置中删除的日志器不再输出
+                for (auto &define : old_val) {
+                    auto it = std::find_if(
+                        new_val.begin(), new_val.end(),
+                        [&define](const LogDefine &now) { return now.name == define.name; });
+                    if (it == new_val.end()) {
+                        GET_LOGGER_BY_NAME(define.name)->clear_appender();
+                    }
+                }
+            });
+    }
+};
+
+static _LogIniter _log_initer;
+
 }  // namespace acid
\ No newline at end of file
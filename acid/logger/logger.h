@@ -9,8 +9,12 @@
 #include "acid/common/mutex.h"
 #include "acid/common/singleton.h"
 #include "acid/common/util.h"
+#include "async_logger.h"
+#include "log_context.h"
 
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <sstream>
@@ -36,8 +40,8 @@
     if (level <= logger->get_level())                                                        \
     acid::LogEventWrap(                                                                      \
         logger, acid::LogEvent::ptr(new acid::LogEvent(                                      \
-                    logger->get_name(), level, __FILE__, __LINE__, 0, acid::get_thread_id(), \
-                    acid::get_fiber_id(), time(0), acid::get_thread_name())))                \
+                    logger->get_name(), level, __FILE__, __LINE__, 0,                        \
+                    acid::LogContext::current(), acid::LogClock::now())))                    \
         .get_log_event()                                                                     \
         ->ssout()
 
@@ -58,8 +62,8 @@
     if (level <= logger->get_level())                                                        \
     acid::LogEventWrap(                                                                      \
         logger, acid::LogEvent::ptr(new acid::LogEvent(                                      \
-                    logger->get_name(), level, __FILE__, __LINE__, 0, acid::get_thread_id(), \
-                    acid::get_fiber_id(), time(0), acid::get_thread_name())))                \
+                    logger->get_name(), level, __FILE__, __LINE__, 0,                        \
+                    acid::LogContext::current(), acid::LogClock::now())))                    \
         .get_log_event()                                                                     \
         ->printf(fmt, ##__VA_ARGS__)
 
@@ -141,6 +145,14 @@ public:
              int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time,
              const std::string& thread_name);
 
+    /**
+     * @brief 使用当前线程缓存的上下文构造, 写日志的宏使用这个版本
+     * @param[in] context 当前线程的日志上下文
+     * @param[in] time UTC时间
+     */
+    LogEvent(const std::string& logger_name, LogLevel::Level level, const char* file, int32_t line,
+             int64_t elapse, const LogContext& context, time_t time);
+
     LogLevel::Level get_level() const {
         return level_;
     }
@@ -345,13 +357,16 @@ public:
 /*!
  * @brief 输出到文件
  */
-class AsyncLogger;
 class FileLogAppender : public LogAppender {
 public:
     static LogAppender::ptr create(const std::string& filename,
                                    LogLevel::Level level = LogLevel::DEBUG);
 
-    FileLogAppender(const std::string& filename, LogLevel::Level level);
+    /**
+     * @param policy 写日志的线程的缓冲区满时的处理方式
+     */
+    FileLogAppender(const std::string& filename, LogLevel::Level level,
+                    AsyncLogger::OverflowPolicy policy = AsyncLogger::OverflowPolicy::BLOCK);
 
     ~FileLogAppender();
 
@@ -359,29 +374,47 @@ public:
 
     std::string to_yaml_string() override;
 
+    /**
+     * @brief 让后台线程重新打开日志文件, 用于外部工具切分日志之后
+     */
     bool reopen();
 
+    /**
+     * @brief 设置日志文件的切分方式, 在后台线程中切分和压缩
+     */
+    void set_rotate_config(const LogRotateConfig& config) {
+        m_async_logger_appender->set_rotate_config(config);
+    }
+
+    std::shared_ptr<AsyncLogger> get_async_logger() const {
+        return m_async_logger_appender;
+    }
+
 private:
     std::string filename_;
-    std::ofstream file_stream_;
-    uint64_t last_time_;
     std::shared_ptr<AsyncLogger> m_async_logger_appender;
 
 };  // class FileLogAppender : public LogAppender
 
 /*!
  * @brief 日志器, 可以同时输出日志到多个appender
+ * 写日志时不加日志器的锁: 级别是原子变量, appender列表写时复制, 修改时替换为新的列表并增加版本号。
+ * 每个线程按日志器的槽位缓存自己使用的列表, 版本号变化时才加锁重新获取。
+ * 修改appender后释放各线程缓存的旧列表, 删除的appender在正在用它写日志的线程写完后析构
  */
 class Logger {
 public:
     using ptr = std::shared_ptr<Logger>;
     using MutexType = Spinlock;
     using LockGuard = MutexType::Lock;
+    using AppenderList = std::vector<LogAppender::ptr>;
 
     Logger(LogLevel::Level level, const std::string& name = "root");
 
     Logger(const std::string& name);
 
+    ~Logger();
+
     void log(LogLevel::Level level, LogEvent::ptr event);
 
     void add_appender(LogAppender::ptr appender);
@@ -390,21 +423,44 @@ public:
 
     void clear_appender();
 
-    LogLevel::Level get_level();
+    /**
+     * @brief 一次替换全部appender, 写日志的线程不会看到只替换了一部分的列表
+     */
+    void set_appenders(AppenderList appenders);
 
-    void set_level(LogLevel::Level level);
+    LogLevel::Level get_level() const {
+        return level_.load(std::memory_order_relaxed);
+    }
+
+    void set_level(LogLevel::Level level) {
+        level_.store(level, std::memory_order_relaxed);
+    }
 
-    std::string get_name();
+    /**
+     * @brief 名字在写日志时读取, 不加锁, 只应在开始写日志之前修改
+     */
+    const std::string& get_name() const {
+        return name_;
+    }
 
     void set_name(std::string name);
 
     std::string to_yaml_string();
 
 private:
+    // 复制当前的appender列表, 修改后替换, 需要持有m_mutex
+    void update_appenders(const std::function<void(AppenderList&)>& update);
+
+    // 修改appender之后释放各线程缓存的旧列表, 不能持有m_mutex
+    void release_cached();
+
+private:
+    size_t m_slot;  // 线程局部缓存中的槽位, 日志器析构后回收
     std::string name_;
-    LogLevel::Level level_;
-    std::vector<LogAppender::ptr> appenders_;
-    MutexType m_mutex;
+    std::atomic<LogLevel::Level> level_;
+    std::atomic<uint64_t> m_version {1};            // appender列表的版本, 线程缓存用0表示空
+    std::shared_ptr<const AppenderList> appenders_;  // 由m_mutex保护
+    MutexType m_mutex;  // 只在修改appender和线程缓存失效时使用
 
 };  // class Logger
 
@@ -4,12 +4,17 @@
 #include <ifaddrs.h>
 #include <netdb.h>
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include "acid/logger/logger.h"
 
 namespace acid {
 static auto logger = GET_LOGGER_BY_NAME("system");
 
+static constexpr uint32_t MAX_PATH_LEN =
+    sizeof(((sockaddr_un*) 0)->sun_path) - 1;
+
 Address::ptr Address::create(const sockaddr* addr, socklen_t addr_len) {
     if (addr == nullptr) {
         return nullptr;
@@ -24,6 +29,12 @@ Address::ptr Address::create(const sockaddr* addr, socklen_t addr_len) {
         case AF_INET6:
             result.reset(new IPv6Address(*(const sockaddr_in6*) addr));
             break;
+        case AF_UNIX: {
+            UnixAddress::ptr unix_address(new UnixAddress);
+            memcpy(unix_address->get_addr(), addr, std::min<size_t>(addr_len, sizeof(sockaddr_un)));
+            unix_address->set_addr_len(addr_len);
+            result = unix_address;
+        } break;
         default: result.reset(new UnknownAddress(*addr)); break;
     }
 
@@ -74,6 +85,19 @@ bool Address::look_up(std::vector<Address::ptr>& result,
     hints.ai_addr = nullptr;
     hints.ai_next = nullptr;
 
+    // unix:/path 或 unix:@name 表示unix socket地址, 前缀已经指明协议族, 不再检查family
+    if (host.compare(0, UnixAddress::UNIX_PREFIX.size(), UnixAddress::UNIX_PREFIX) == 0) {
+        std::string path = host.substr(UnixAddress::UNIX_PREFIX.size());
+        if (path.empty() || path.size() > MAX_PATH_LEN) {
+            return false;
+        }
+        if (path[0] == '@') {
+            path[0] = '\0';
+        }
+        result.push_back(std::make_shared<UnixAddress>(path));
+        return true;
+    }
+
     std::string node;
     const char* service = nullptr;
 
@@ -450,9 +474,6 @@ IPAddress::ptr IPv6Address::subnet_mask(uint32_t prefix_len) {
     * ------------------------------------------------------------------------
     */
 
-static constexpr uint32_t MAX_PATH_LEN =
-    sizeof(((sockaddr_un*) 0)->sun_path) - 1;
-
 UnixAddress::UnixAddress() {
     memset(&addr_, 0, sizeof(addr_));
     addr_.sun_family = AF_UNIX;
@@ -485,8 +506,27 @@ const socklen_t UnixAddress::get_addr_len() const {
     return len_;
 }
 
+std::string UnixAddress::get_path() const {
+    if (len_ <= offsetof(sockaddr_un, sun_path)) {
+        return {};
+    }
+    if (is_abstract()) {
+        return {addr_.sun_path, len_ - offsetof(sockaddr_un, sun_path)};
+    }
+    return addr_.sun_path;
+}
+
+bool UnixAddress::is_abstract() const {
+    return len_ > offsetof(sockaddr_un, sun_path) && addr_.sun_path[0] == '\0';
+}
+
 std::ostream& UnixAddress::insert(std::ostream& out) {
-    // TODO 输出Unix地址
+    // 与look_up接受的格式一致, 抽象命名空间的地址以@代替开头的'\0'
+    out << UNIX_PREFIX;
+    if (is_abstract()) {
+        return out << '@' << get_path().substr(1);
+    }
+    return out << get_path();
 }
 
 void UnixAddress::set_addr_len(uint32_t len) {
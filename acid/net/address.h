@@ -6,6 +6,7 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -60,7 +61,7 @@ namespace acid {
         /*!
          * @brief 通过host地址返回所有Address
          * @param[out] result 保存满足条件的所有Address
-         * @param[in] host 域名
+         * @param[in] host 域名, unix:/path 或 unix:@name 表示unix socket地址(@表示抽象命名空间)
          * @param[in] family 协议族(AF_INT, AF_INT6, AF_UNIX)
          * @param[in] type socket类型SOCK_STREAM、SOCK_DGRAM 等
          * @param[in] protocol 协议IPPROTO_TCP、IPPROTO_UDP 等
@@ -226,6 +227,9 @@ namespace acid {
     public:
         using ptr = std::shared_ptr<UnixAddress>;
 
+        // 字符串形式的unix socket地址前缀
+        static constexpr std::string_view UNIX_PREFIX = "unix:";
+
         UnixAddress();
 
         UnixAddress(const std::string &path);
@@ -238,9 +242,15 @@ namespace acid {
 
         void set_addr_len(uint32_t len);
 
-        std::string get_path() const {
-            // TODO get_path
-        }
+        /**
+         * @brief 获取unix socket路径, 抽象命名空间的地址以'\0'开头
+         */
+        std::string get_path() const;
+
+        /**
+         * @brief 是否是抽象命名空间的地址, 不对应文件系统中的文件
+         */
+        bool is_abstract() const;
 
         std::ostream &insert(std::ostream &out) override;
 
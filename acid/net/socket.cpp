@@ -11,6 +11,7 @@
 
 #include <netinet/tcp.h>
 #include <sstream>
+#include <sys/stat.h>
 
 namespace acid {
 
@@ -165,13 +166,22 @@ bool Socket::bind(const Address::ptr addr) {
         return false;
     }
 
+    // 抽象命名空间的地址在socket关闭时自动释放, 只有文件路径可能残留上次运行的socket文件
     UnixAddress::ptr u_addr = std::dynamic_pointer_cast<UnixAddress>(addr);
-    if (u_addr) {
-        Socket::ptr sock = Socket::create_unix_tcp_socket();
-        if (sock->connect(u_addr)) {
-            return false;
-        }
-        else {
+    if (u_addr && !u_addr->is_abstract()) {
+        struct stat st {};
+        if (lstat(u_addr->get_path().c_str(), &st) == 0) {
+            // 能连接上说明仍有进程在监听, 否则是残留的文件, 删除后才能绑定
+            int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            bool in_use = probe != -1 && ::connect(probe, addr->get_addr(), addr->get_addr_len()) == 0;
+            if (probe != -1) {
+                ::close(probe);
+            }
+            if (in_use) {
+                LOG_ERROR(logger) << "bind address in use, addr=" << addr->to_string();
+                errno = EADDRINUSE;
+                return false;
+            }
             FSUtil::unlink(u_addr->get_path(), true);
         }
     }
@@ -363,7 +373,11 @@ Address::ptr Socket::get_remote_address() {
         case Family::IPv6:
             result.reset(new IPv6Address);
             break;
+        case Family::Unix:
+            result.reset(new UnixAddress);
+            break;
         default:
+            result.reset(new UnknownAddress(m_family));
             break;
     }
 
@@ -375,6 +389,10 @@ Address::ptr Socket::get_remote_address() {
                           << " errstr=" << strerror(errno);
         return nullptr;
     }
+    // unix socket的地址长度取决于路径长度
+    if (m_family == Family::Unix) {
+        std::static_pointer_cast<UnixAddress>(result)->set_addr_len(addr_len);
+    }
     m_remote_addr = result;
     return m_remote_addr;
 }
@@ -392,7 +410,11 @@ Address::ptr Socket::get_local_address() {
         case Family::IPv6:
             result.reset(new IPv6Address);
             break;
+        case Family::Unix:
+            result.reset(new UnixAddress);
+            break;
         default:
+            result.reset(new UnknownAddress(m_family));
             break;
     }
 
@@ -404,6 +426,9 @@ Address::ptr Socket::get_local_address() {
                           << " errstr=" << strerror(errno);
         return nullptr;
     }
+    if (m_family == Family::Unix) {
+        std::static_pointer_cast<UnixAddress>(result)->set_addr_len(addr_len);
+    }
 
     m_local_addr = result;
     return m_local_addr;
@@ -456,7 +481,8 @@ bool Socket::cancel_all() {
 void Socket::init_socket() {
     int val = 1;
     set_option(SOL_SOCKET, SO_REUSEADDR, val);
-    if (m_type == TCP) {
+    // unix socket没有tcp协议栈
+    if (m_type == TCP && m_family != Unix) {
         set_option(IPPROTO_TCP, TCP_NODELAY, val);
     }
 }
@@ -4,6 +4,17 @@ namespace acid {
 
 static auto logger = GET_LOGGER_BY_NAME("system");
 
+/**
+ * @brief 关闭监听socket, 绑定在文件路径上的unix socket需要同时删除socket文件
+ */
+static void close_listen_socket(Socket::ptr socket) {
+    UnixAddress::ptr address = std::dynamic_pointer_cast<UnixAddress>(socket->get_local_address());
+    socket->close();
+    if (address && !address->is_abstract()) {
+        FSUtil::unlink(address->get_path());
+    }
+}
+
 TcpServer::TcpServer() = default;
 
 TcpServer::TcpServer(const std::string &server_name, acid::IOManager *worker,
@@ -23,7 +34,7 @@ TcpServer::TcpServer(const std::string &server_name, acid::IOManager *worker,
 
 TcpServer::~TcpServer() {
     for (auto &socket : m_sockets) {
-        socket->close();
+        close_listen_socket(socket);
     }
     m_sockets.clear();
 }
@@ -81,8 +92,21 @@ void TcpServer::start_accept(Socket::ptr socket) {
 
         if (client) {
             client->set_recv_timeout(m_recv_timeout);
+            client->set_send_timeout(m_send_timeout);
             auto self = shared_from_this();
-            m_io_worker->schedule([self, client] { self->handle_client(client); });
+            int thread = m_incoming_cpu ? incoming_thread(client) : -1;
+            if (thread == -1) {
+                m_io_worker->schedule([self, client] { self->handle_client(client); });
+            }
+            else {
+                m_io_worker->schedule(
+                    [self, client, thread] {
+                        // 处理连接的协程绑定在这个线程上, IO事件和锁唤醒后都回到这里
+                        Fiber::get_this()->bind_thread(thread);
+                        self->handle_client(client);
+                    },
+                    thread);
+            }
         }
         else {
             LOG_ERROR(logger) << "accept errno=" << errno
@@ -91,6 +115,16 @@ void TcpServer::start_accept(Socket::ptr socket) {
     }
 }
 
+int TcpServer::incoming_thread(Socket::ptr client) {
+#ifdef SO_INCOMING_CPU
+    int cpu = -1;
+    if (client->get_option(SOL_SOCKET, SO_INCOMING_CPU, cpu)) {
+        return m_io_worker->get_thread_for_cpu(cpu);
+    }
+#endif
+    return -1;
+}
+
 bool TcpServer::start() {
     if (!m_is_stop) {
         return true;
@@ -111,7 +145,7 @@ void TcpServer::stop() {
     m_accept_worker->schedule([self]() {
         for (auto& socket : self->m_sockets) {
             socket->cancel_all();
-            socket->close();
+            close_listen_socket(socket);
         }
         self->m_sockets.clear();
     });
@@ -107,6 +107,17 @@ public:
         m_recv_timeout = timeout;
     }
 
+    uint64_t get_send_timeout() const {
+        return m_send_timeout;
+    }
+
+    /**
+     * @brief 连接的发送超时, 对端一直不读取时写操作超时失败, 不会永远占着处理连接的协程
+     */
+    void set_send_timeout(uint64_t timeout) {
+        m_send_timeout = timeout;
+    }
+
     virtual void set_name(std::string& name) {
         m_name = name;
     }
@@ -115,6 +126,19 @@ public:
         return m_is_stop;
     }
 
+    /**
+     * @brief 是否把连接交给绑定在接收该连接的CPU(SO_INCOMING_CPU, 即处理网卡中断的CPU)上的IO线程
+     * @details 需要io_worker通过scheduler.affinity绑核, 连接的协程之后的IO都留在这个线程上, 数据不跨NUMA节点;
+     * 没有线程绑定在该CPU上时与关闭时一样由任意线程处理
+     */
+    void set_incoming_cpu(bool v) {
+        m_incoming_cpu = v;
+    }
+
+    bool is_incoming_cpu() const {
+        return m_incoming_cpu;
+    }
+
     std::vector<Socket::ptr> get_sockets() const {
         return m_sockets;
     }
@@ -124,16 +148,23 @@ protected:
 
     virtual void start_accept(Socket::ptr socket);
 
+    /**
+     * @brief 返回绑定在接收client的CPU上的IO线程号, 没有时返回-1
+     */
+    int incoming_thread(Socket::ptr client);
+
 protected:
     std::vector<Socket::ptr> m_sockets;
     IOManager* m_worker = nullptr;
     IOManager* m_io_worker = nullptr;
     IOManager* m_accept_worker = nullptr;
     uint64_t m_recv_timeout{};
+    uint64_t m_send_timeout = 1000 * 60 * 2;
     std::string m_name;
     std::string m_type = "tcp";
     bool m_is_stop{};
     bool m_ssl = false;
+    bool m_incoming_cpu = false;
 };
 }  // namespace acid
 
@@ -4,12 +4,14 @@
 
 namespace acid::rpc {
 
-Protocol::ptr Protocol::create(MessageType type, const std::string& content, uint32_t id) {
+Protocol::ptr Protocol::create(MessageType type, const std::string& content, uint32_t id,
+                               uint64_t deadline) {
     Protocol::ptr protocol = std::make_shared<Protocol>();
     protocol->set_message_type(type);
     protocol->set_content(content);
     protocol->set_content_length(content.size());
     protocol->set_sequence_id(id);
+    protocol->set_deadline(deadline);
     return protocol;
 }
 
@@ -25,6 +27,7 @@ ByteArray::ptr Protocol::encode_meta() {
     byte_array->write_fix_uint8(m_version);
     byte_array->write_fix_uint8(m_type);
     byte_array->write_fix_uint32(m_sequence_id);
+    byte_array->write_fix_uint64(m_deadline);
     byte_array->write_fix_uint32(m_content.size());
     byte_array->set_position(0);
     return byte_array;
@@ -36,6 +39,7 @@ ByteArray::ptr Protocol::encode() {
     byte_array->write_fix_uint8(m_version);
     byte_array->write_fix_uint8(m_type);
     byte_array->write_fix_uint32(m_sequence_id);
+    byte_array->write_fix_uint64(m_deadline);
     byte_array->write_string_f32(m_content);
     byte_array->set_position(0);
     return byte_array;
@@ -46,6 +50,7 @@ void Protocol::decode_meta(ByteArray::ptr byte_array) {
     m_version = byte_array->read_fix_uint8();
     m_type = byte_array->read_fix_uint8();
     m_sequence_id = byte_array->read_fix_uint32();
+    m_deadline = byte_array->read_fix_uint64();
     m_content_length = byte_array->read_fix_uint32();
 }
 
@@ -54,6 +59,7 @@ void Protocol::decode(ByteArray::ptr byte_array) {
     m_version = byte_array->read_fix_uint8();
     m_type = byte_array->read_fix_uint8();
     m_sequence_id = byte_array->read_fix_uint32();
+    m_deadline = byte_array->read_fix_uint64();
     m_content = byte_array->read_string_f32();
     m_content_length = m_content.size();
 }
@@ -65,6 +71,7 @@ std::string Protocol::to_string() {
         << " version = " << m_version 
         << " type = " << m_type
         << " sequence id = " << m_sequence_id
+        << " deadline = " << m_deadline
         << " length = " << m_content_length
         << " content = " << m_content << "]";
     // clang-format on
@@ -19,18 +19,17 @@
 namespace acid::rpc {
 /*
  * 私有通信协议
- * +--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+
- * |  BYTE  |        |        |        |        |        |        |        |        |        | |
- * ........                                                           |
- * +--------------------------------------------+--------+--------------------------+--------+-----------------+--------+--------+--------+--------+--------+--------+-----------------+
- * |  magic | version|  type  |          sequence id              |          content length |
- * content byte[]                                                     |
- * +--------+-----------------------------------------------------------------------------------------------------------------------------+--------------------------------------------+
+ * +--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+--------+
+ * |  BYTE  |        |        |        |        |        |        |        |        |        |        |        |        |
+ * +--------------------------------------------+--------+--------------------------+--------+-----------------+--------+
+ * |  magic | version|  type  |   sequence id (4B)       |   deadline (8B)          |  content length (4B)     | content |
+ * +--------+-----------------------------------------------------------------------------------------------------------+
  * 第一个字节是魔法数。
  * 第二个字节代表协议版本号，以便对协议进行扩展，使用不同的协议解析器。
  * 第三个字节是请求类型，如心跳包，rpc请求。
  * 第四个字节开始是一个32位序列号。
- * 第七个字节开始的四字节表示消息长度，即后面要接收的内容长度。
+ * 第八个字节开始是一个64位的截止时间, 为绝对时间戳(ms), 0表示没有截止时间。
+ * 第十六个字节开始的四字节表示消息长度，即后面要接收的内容长度。
  */
 
 class Protocol {
@@ -38,8 +37,8 @@ public:
     using ptr = std::shared_ptr<Protocol>;
 
     static constexpr uint8_t MAGIC = 0xcc;
-    static constexpr uint8_t DEFAULT_VERSION = 0x01;
-    static constexpr uint8_t BASE_LENGTH = 11;
+    static constexpr uint8_t DEFAULT_VERSION = 0x02;
+    static constexpr uint8_t BASE_LENGTH = 19;
 
     enum class MessageType : uint8_t {
         HEARTBEAT_PACKET,  // 心跳包
@@ -62,10 +61,16 @@ public:
         RPC_SUBSCRIBE_RESPONSE,
 
         RPC_PUBLISH_REQUEST,  // 发布
-        RPC_PUBLISH_RESPONSE
+        RPC_PUBLISH_RESPONSE,
+
+        RPC_CANCEL_REQUEST,  // 取消调用, 序列号为要取消的请求的序列号
+
+        RPC_BATCH_REQUEST,  // 批量调用, 消息体为多个调用请求
+        RPC_BATCH_RESPONSE  // 批量调用响应, 消息体为与请求一一对应的调用结果
     };
 
-    static Protocol::ptr create(MessageType type, const std::string& content, uint32_t id = 0);
+    static Protocol::ptr create(MessageType type, const std::string& content, uint32_t id = 0,
+                                uint64_t deadline = 0);
 
     /**
      * @brief 创建一个type为HEARTBEAT_PACKET, content为空字符串的消息
@@ -90,6 +95,10 @@ public:
         return m_sequence_id;
     }
 
+    uint64_t get_deadline() const {
+        return m_deadline;
+    }
+
     uint32_t get_content_length() const {
         return m_content_length;
     }
@@ -114,6 +123,10 @@ public:
         m_sequence_id = sequence_id;
     }
 
+    void set_deadline(uint64_t deadline) {
+        m_deadline = deadline;
+    }
+
     void set_content_length(uint32_t content_length) {
         m_content_length = content_length;
     }
@@ -148,6 +161,7 @@ private:
     uint8_t m_version = DEFAULT_VERSION;
     uint8_t m_type = 0;
     uint32_t m_sequence_id = 0;
+    uint64_t m_deadline = 0;  // 截止时间(ms), 0表示不限
     uint32_t m_content_length = 0;
     std::string m_content;
 };
@@ -50,7 +50,9 @@ enum RpcState : uint16_t {
     RPC_NO_MATCH,     // 函数不匹配(找到了函数, 但是参数不匹配)
     RPC_NO_METHOD,    // 没有找到调用函数
     RPC_CLOSED,       // RCP连接关闭
-    RPC_TIMEOUT       // RPC调用超时
+    RPC_TIMEOUT,      // RPC调用超时
+    RPC_CANCELLED,    // RPC调用被取消(上游调用已被取消)
+    RPC_OVERLOAD      // 服务端过载, 请求被拒绝, 可以换一个服务端重试
 };
 
 /**
@@ -161,9 +163,37 @@ private:
     // 调用消息
     message_type m_message;
     // 调用结果
-    type m_value;
+    type m_value {};
 };
 
+/**
+ * @brief 将服务端返回的内容反序列化为调用结果
+ *
+ * @tparam R 返回值类型
+ * @param content 响应内容, 为空说明服务端没有找到调用函数
+ * @return Result<R>
+ */
+template <class R>
+Result<R> parse_result(const std::string& content) {
+    Result<R> ret;
+    if (content.empty()) {
+        ret.set_code(RPC_NO_METHOD);
+        ret.set_message("method not found");
+        return ret;
+    }
+
+    Serializer serializer(content);
+    try {
+        serializer >> ret;
+    }
+    catch (...) {
+        // 返回的结果类型不匹配
+        ret.set_code(RPC_NO_MATCH);
+        ret.set_message("return value not match");
+    }
+    return ret;
+}
+
 
 
 };  // namespace acid::rpc
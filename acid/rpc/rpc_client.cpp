@@ -1,6 +1,7 @@
 #include "rpc_client.h"
 
 #include "acid/common/config.h"
+#include "acid/rpc/shm_session.h"
 
 #include <cstddef>
 #include <cstdint>
@@ -69,8 +70,11 @@ void RpcClient::close() {
         m_heart_timer->cancel();
         m_heart_timer.reset();
     }
-    IOManager::get_this()->del_event(m_session->get_socket()->get_socketfd(),
-                                     IOManager::Event::READ);
+    // 共享内存连接的socket由监视协程等待, 关闭socket时需要唤醒它退出
+    if (!std::dynamic_pointer_cast<ShmSession>(m_session)) {
+        IOManager::get_this()->del_event(m_session->get_socket()->get_socketfd(),
+                                         IOManager::Event::READ);
+    }
     m_session->close();
 }
 
@@ -85,9 +89,37 @@ bool RpcClient::connect(Address::ptr address) {
         return false;
     }
 
+    m_address = address;
+    start(std::make_shared<RpcSession>(sock));
+    return true;
+}
+
+bool RpcClient::connect_shm(Address::ptr address) {
+    IPAddress::ptr ip_address = std::dynamic_pointer_cast<IPAddress>(address);
+    if (!ip_address) {
+        return false;
+    }
+
+    // 服务端在tcp端口对应的unix socket上交换共享内存
+    Address::ptr shm_address = ShmSession::get_address(ip_address->get_port());
+    Socket::ptr sock = Socket::create_tcp(shm_address);
+    if (!sock->connect(shm_address, m_timeout)) {
+        return false;
+    }
+    RpcSession::ptr session = ShmSession::connect(sock);
+    if (!session) {
+        return false;
+    }
+
+    m_address = address;
+    start(session);
+    return true;
+}
+
+void RpcClient::start(RpcSession::ptr session) {
     m_is_heart_close = false;
     m_is_close = false;
-    m_session = std::make_shared<RpcSession>(sock);
+    m_session = session;
     // 一个rpc连接会接受多个调用请求, 通过channel来区分不同的调用请求
     m_channel = Channel<Protocol::ptr>(s_channel_capacity);
     IOManager::get_this()->schedule([this]() { handle_recv(); });
@@ -112,8 +144,6 @@ bool RpcClient::connect(Address::ptr address) {
             },
             true);
     }
-
-    return true;
 }
 
 void RpcClient::handle_send() {
@@ -152,6 +182,7 @@ void RpcClient::handle_recv() {
                 m_is_heart_close = false;
                 break;
             case Protocol::MessageType::RPC_METHOD_RESPONSE:
+            case Protocol::MessageType::RPC_BATCH_RESPONSE:
                 // 处理调用结果
                 handle_method_response(response);
                 break;
@@ -167,6 +198,212 @@ void RpcClient::handle_recv() {
     }
 }
 
+bool RpcClient::prepare_call(uint64_t& deadline, Result<>& status) {
+    // 连接关闭直接返回RPC_CLOSED
+    if (is_close()) {
+        status.set_code(RPC_CLOSED);
+        status.set_message("socket closed");
+        return false;
+    }
+
+    // 本次调用的截止时间, 在服务端处理函数中发起的调用会继承上游的截止时间
+    deadline = 0;
+    if (m_timeout != static_cast<uint64_t>(-1)) {
+        deadline = get_current_ms() + m_timeout;
+    }
+    if (RpcContext::ptr context = RpcContext::get_this()) {
+        if (context->is_cancelled()) {
+            status.set_code(RPC_CANCELLED);
+            status.set_message("call cancelled");
+            return false;
+        }
+        if (context->get_deadline() && (!deadline || context->get_deadline() < deadline)) {
+            deadline = context->get_deadline();
+        }
+    }
+
+    if (deadline && get_current_ms() >= deadline) {
+        // 预算已经耗尽, 不再发送请求
+        status.set_code(RPC_TIMEOUT);
+        status.set_message("call timeout");
+        return false;
+    }
+    return true;
+}
+
+Protocol::ptr RpcClient::invoke(Protocol::MessageType type, const std::string& content,
+                                Result<>& status) {
+    uint64_t deadline = 0;
+    if (!prepare_call(deadline, status)) {
+        return nullptr;
+    }
+    uint64_t now = get_current_ms();
+
+    // 开启一个channel, 接收消息
+    Channel<Protocol::ptr> channel(1);
+    // 本次调用的序列号
+    uint32_t id = 0;
+    // 将调用的channel插入到映射, 根据序列号区分不同的调用协程
+    std::map<uint32_t, Channel<Protocol::ptr>>::iterator it;
+    {
+        LockGuard lock(m_mutex);
+
+        id = m_sequence_id;
+        // 将请求序列号与接收的channel相关联, 用来获取结果
+        it = m_response_handle.emplace(m_sequence_id, channel).first;
+        // 序列号到头则重新开始循环
+        if (++m_sequence_id == UINT32_MAX) {
+            m_sequence_id = 0;
+        }
+    }
+
+    // 创建请求协议, 附带上请求ID和截止时间, 请求调用
+    Protocol::ptr request = Protocol::create(type, content, id, deadline);
+    // 向send协程的channel发送消息
+    m_channel << request;
+
+    Timer::ptr timer;
+    bool timeout = false;
+    if (deadline) {
+        // 如果超时还没有获取到response则关闭channel
+        timer = IOManager::get_this()->add_timer(
+            deadline > now ? deadline - now : 0,
+            [channel, &timeout]() mutable {
+                timeout = true;
+                channel.close();
+            },
+            false);
+    }
+
+    Protocol::ptr response;
+    // 等待 response，Channel内部会挂起协程，如果有消息到达或者被关闭则会被唤醒
+    channel >> response;
+    // 收到回复取消定时器
+    if (timer) {
+        timer->cancel();
+    }
+    // 清除该channel的映射
+    {
+        LockGuard lock(m_mutex);
+        if (!m_is_close) {
+            m_response_handle.erase(it);
+        }
+    }
+
+    if (timeout) {
+        // 超时, 通知服务端放弃该调用
+        m_channel << Protocol::create(Protocol::MessageType::RPC_CANCEL_REQUEST, "", id);
+        status.set_code(RPC_TIMEOUT);
+        status.set_message("call timeout");
+        return nullptr;
+    }
+
+    if (!response) {
+        status.set_code(RPC_CLOSED);
+        status.set_message("socket closed");
+        return nullptr;
+    }
+
+    return response;
+}
+
+Task<Protocol::ptr> RpcClient::co_invoke(Protocol::MessageType type, std::string content,
+                                         Result<>& status) {
+    uint64_t deadline = 0;
+    if (!prepare_call(deadline, status)) {
+        co_return nullptr;
+    }
+
+    Channel<Protocol::ptr> channel(1);
+    uint32_t id = 0;
+    std::map<uint32_t, Channel<Protocol::ptr>>::iterator it;
+    co_await m_mutex.co_lock();
+    id = m_sequence_id;
+    it = m_response_handle.emplace(m_sequence_id, channel).first;
+    if (++m_sequence_id == UINT32_MAX) {
+        m_sequence_id = 0;
+    }
+    m_mutex.unlock();
+
+    co_await m_channel.co_push(Protocol::create(type, content, id, deadline));
+
+    // 超时由channel的等待超时处理, 不需要关闭channel的定时器
+    Protocol::ptr response;
+    uint64_t now = get_current_ms();
+    uint64_t timeout_ms = !deadline ? ~0ull : deadline > now ? deadline - now : 0;
+    bool received = co_await channel.co_pop(response, timeout_ms);
+
+    co_await m_mutex.co_lock();
+    if (!m_is_close) {
+        m_response_handle.erase(it);
+    }
+    m_mutex.unlock();
+
+    if (!received) {
+        co_await m_channel.co_push(Protocol::create(Protocol::MessageType::RPC_CANCEL_REQUEST, "", id));
+        status.set_code(RPC_TIMEOUT);
+        status.set_message("call timeout");
+        co_return nullptr;
+    }
+
+    if (!response) {
+        status.set_code(RPC_CLOSED);
+        status.set_message("socket closed");
+        co_return nullptr;
+    }
+
+    co_return response;
+}
+
+std::vector<std::string> RpcClient::call_batch(const RpcBatch& batch) {
+    if (batch.empty()) {
+        return {};
+    }
+
+    Serializer s;
+    s << batch.get_calls();
+    s.reset();
+
+    Result<> status;
+    Protocol::ptr response = invoke(Protocol::MessageType::RPC_BATCH_REQUEST, s.to_string(), status);
+
+    std::vector<std::string> contents;
+    if (response) {
+        Serializer serializer(response->get_content());
+        try {
+            serializer >> contents;
+        }
+        catch (...) {
+            contents.clear();
+            status.set_code(RPC_FAIL);
+            status.set_message("batch response broken");
+        }
+    }
+
+    // 整体失败时每个调用都返回相同的失败状态
+    if (contents.size() != batch.size()) {
+        if (status.get_code() == RPC_SUCCESS) {
+            status.set_code(RPC_FAIL);
+            status.set_message("batch response size not match");
+        }
+        Serializer failure;
+        failure << status;
+        failure.reset();
+        contents.assign(batch.size(), failure.to_string());
+    }
+    return contents;
+}
+
+void RpcClient::batch_call(const RpcBatch& batch) {
+    std::vector<std::string> contents = call_batch(batch);
+    auto& callbacks = batch.get_callbacks();
+    for (size_t i = 0; i < contents.size(); ++i) {
+        if (callbacks[i]) {
+            callbacks[i](contents[i]);
+        }
+    }
+}
+
 void RpcClient::handle_method_response(Protocol::ptr response) {
     // 获取该调用结果的序列号
     uint32_t id = response->get_sequence_id();
@@ -16,12 +16,15 @@
 #include "acid/common/co_mutex.h"
 #include "acid/common/iomanager.h"
 #include "acid/common/mutex.h"
+#include "acid/common/task.h"
 #include "acid/common/traits.h"
+#include "acid/common/util.h"
 #include "acid/net/socket.h"
 #include "acid/net/socket_stream.h"
 #include "protocol.h"
 #include "route_strategy.h"
 #include "rpc.h"
+#include "rpc_context.h"
 #include "rpc_session.h"
 
 #include <cassert>
@@ -29,9 +32,91 @@
 #include <functional>
 #include <future>
 #include <memory>
+#include <vector>
 
 namespace acid::rpc {
 
+/**
+ * @brief 批量调用, 将多个相互独立的调用打包到一个请求中发送, 服务端并行执行后一次性返回
+ */
+class RpcBatch {
+public:
+    // 处理单个调用响应内容的回调
+    using Callback = std::function<void(const std::string&)>;
+
+    /**
+     * @brief 加入一个调用, 结果通过batch_call<R>的返回值获取
+     *
+     * @tparam Params 参数类型
+     * @param name 函数名
+     * @param params 参数
+     * @return RpcBatch&
+     */
+    template <class... Params>
+    RpcBatch& add(const std::string& name, Params... params) {
+        using args_type = std::tuple<typename std::decay<Params>::type...>;
+        args_type args = std::make_tuple(params...);
+        Serializer s;
+        s << name << args;
+        s.reset();
+        m_calls.push_back(s.to_string());
+        m_callbacks.emplace_back(nullptr);
+        return *this;
+    }
+
+    /**
+     * @brief 加入一个调用, 最后一个参数为接收Result<R>的回调函数, 结果到达后回调
+     *
+     * @tparam Params
+     * @param name 函数名
+     * @param params 参数以及回调函数
+     * @return RpcBatch&
+     */
+    template <class... Params>
+    RpcBatch& add_callback(const std::string& name, Params... params) {
+        static_assert(sizeof...(params), "without a callback function");
+        auto tp = std::make_tuple(params...);
+        constexpr auto size = std::tuple_size<typename std::decay<decltype(tp)>::type>::value;
+        auto cb = std::get<size - 1>(tp);
+        static_assert(function_traits<decltype(cb)> {}.arity == 1, "callback type not support");
+        using res = typename function_traits<decltype(cb)>::template args<0>::type;
+        using ret = typename res::raw_type;
+        static_assert(std::is_invocable_v<decltype(cb), Result<ret>>, "callback type not support");
+
+        auto proxy = [&name, &tp, this ]<std::size_t... Index>(std::index_sequence<Index...>) {
+            add(name, std::get<Index>(tp)...);
+        };
+        proxy(std::make_index_sequence<size - 1> {});
+        m_callbacks.back() = [cb](const std::string& content) { cb(parse_result<ret>(content)); };
+        return *this;
+    }
+
+    size_t size() const {
+        return m_calls.size();
+    }
+
+    bool empty() const {
+        return m_calls.empty();
+    }
+
+    const std::vector<std::string>& get_calls() const {
+        return m_calls;
+    }
+
+    const std::vector<Callback>& get_callbacks() const {
+        return m_callbacks;
+    }
+
+    void clear() {
+        m_calls.clear();
+        m_callbacks.clear();
+    }
+
+private:
+    std::vector<std::string> m_calls;   // 序列化后的调用请求
+    std::vector<Callback> m_callbacks;  // 与调用一一对应的回调, 可以为空
+};
+
 class RpcClient : public std::enable_shared_from_this<RpcClient> {
 public:
     using ptr = std::shared_ptr<RpcClient>;
@@ -46,6 +131,20 @@ public:
 
     bool connect(Address::ptr address);
 
+    /**
+     * @brief 通过共享内存连接同一主机上的服务端, 报文格式与tcp连接相同
+     *
+     * @param address 服务端的tcp地址, 用端口找到对应的共享内存握手地址
+     * @return true 连接成功
+     * @return false 服务端不在本机或者没有开启共享内存连接
+     */
+    bool connect_shm(Address::ptr address);
+
+    // 连接的服务端地址, 共享内存连接时是服务端的tcp地址
+    Address::ptr get_address() const {
+        return m_address;
+    }
+
     void set_timeout(uint64_t timeout_ms) {
         m_timeout = timeout_ms;
     }
@@ -85,6 +184,29 @@ public:
         return call<R>(s);
     }
 
+    /**
+     * @brief C++20协程中调用: Result<int> r = co_await client->co_call<int>("add", 1, 2);
+     * @details 等待响应时只挂起协程, 每个进行中的调用只占用协程帧和响应channel, 不占用协程栈。
+     * 截止时间、超时取消和连接关闭的处理与call相同
+     */
+    template <class R, class... Params>
+    Task<Result<R>> co_call(const std::string& name, Params... params) {
+        using args_type = std::tuple<typename std::decay<Params>::type...>;
+        args_type args = std::make_tuple(params...);
+        Serializer s;
+        s << name << args;
+        s.reset();
+        return co_call<R>(s);
+    }
+
+    template <class R>
+    Task<Result<R>> co_call(const std::string& name) {
+        Serializer s;
+        s << name;
+        s.reset();
+        return co_call<R>(s);
+    }
+
     /**
      * @brief 异步回调模式
      *
@@ -145,6 +267,30 @@ public:
         return channel;
     }
 
+    /**
+     * @brief 批量调用, 所有调用的返回值类型相同
+     *
+     * @tparam R 返回值类型
+     * @param batch
+     * @return std::vector<Result<R>> 与加入顺序一致的调用结果
+     */
+    template <class R>
+    std::vector<Result<R>> batch_call(const RpcBatch& batch) {
+        std::vector<Result<R>> results;
+        results.reserve(batch.size());
+        for (auto& content : call_batch(batch)) {
+            results.push_back(parse_result<R>(content));
+        }
+        return results;
+    }
+
+    /**
+     * @brief 批量调用, 结果交给add_callback时传入的回调处理
+     *
+     * @param batch
+     */
+    void batch_call(const RpcBatch& batch);
+
     /**
      * @brief 订阅消息
      *
@@ -185,6 +331,9 @@ public:
     }
 
 private:
+    // 在建立好的连接上开启收发协程和心跳
+    void start(RpcSession::ptr session);
+
     void handle_send();
 
     void handle_recv();
@@ -195,103 +344,71 @@ private:
 
     template <class R>
     Result<R> call(Serializer s) {
-        Result<R> ret;
-        // 连接关闭直接返回RPC_CLOSED
-        if (is_close()) {
-            ret.set_code(RPC_CLOSED);
-            ret.set_message("socket closed");
+        Result<> status;
+        Protocol::ptr response =
+            invoke(Protocol::MessageType::RPC_METHOD_REQUEST, s.to_string(), status);
+        if (!response) {
+            Result<R> ret;
+            ret.set_code(status.get_code());
+            ret.set_message(status.get_message());
             return ret;
         }
+        return parse_result<R>(response->get_content());
+    }
 
-        // 开启一个channel, 接收消息
-        Channel<Protocol::ptr> channel(1);
-        // 本次调用的序列号
-        uint32_t id = 0;
-        // 将调用的channel插入到映射, 根据序列号区分不同的调用协程
-        std::map<uint32_t, Channel<Protocol::ptr>>::iterator it;
-        {
-            LockGuard lock(m_mutex);
-
-            id = m_sequence_id;
-            // 将请求序列号与接收的channel相关联, 用来获取结果
-            it = m_response_handle.emplace(m_sequence_id, channel).first;
-            // 序列号到头则重新开始循环
-            if (++m_sequence_id == UINT32_MAX) {
-                m_sequence_id = 0;
-            }
-        }
-
-        // 创建请求协议, 附带上请求ID, 请求调用
-        Protocol::ptr request =
-            Protocol::create(Protocol::MessageType::RPC_METHOD_REQUEST, s.to_string(), id);
-        // 向send协程的channel发送消息
-        m_channel << request;
-
-        Timer::ptr timer;
-        bool timeout = false;
-        if (m_timeout != static_cast<uint64_t>(-1)) {
-            // 如果超时还没有获取到response则关闭channel
-            timer = IOManager::get_this()->add_timer(
-                m_timeout,
-                [channel, &timeout]() mutable {
-                    timeout = true;
-                    channel.close();
-                },
-                false);
-        }
-
-        Protocol::ptr response;
-        // 等待 response，Channel内部会挂起协程，如果有消息到达或者被关闭则会被唤醒
-        channel >> response;
-        // 收到回复取消定时器
-        if (timer) {
-            timer->cancel();
-        }
-        // 清除该channel的映射
-        {
-            LockGuard lock(m_mutex);
-            if (!m_is_close) {
-                m_response_handle.erase(it);
-            }
+    template <class R>
+    Task<Result<R>> co_call(Serializer s) {
+        Result<> status;
+        Protocol::ptr response =
+            co_await co_invoke(Protocol::MessageType::RPC_METHOD_REQUEST, s.to_string(), status);
+        if (!response) {
+            Result<R> ret;
+            ret.set_code(status.get_code());
+            ret.set_message(status.get_message());
+            co_return ret;
         }
+        co_return parse_result<R>(response->get_content());
+    }
 
-        if (timeout) {
-            // 超时
-            ret.set_code(RPC_TIMEOUT);
-            ret.set_message("call timeout");
-            return ret;
-        }
+    /**
+     * @brief 发送批量调用请求, 并等待响应
+     *
+     * @param batch
+     * @return std::vector<std::string> 每个调用的响应内容, 整体失败时为序列化的失败结果
+     */
+    std::vector<std::string> call_batch(const RpcBatch& batch);
 
-        if (!response) {
-            ret.set_code(RPC_CLOSED);
-            ret.set_message("socket closed");
-            return ret;
-        }
+    /**
+     * @brief 检查连接和上游调用的状态, 计算本次调用的截止时间
+     *
+     * @param[out] deadline 截止时间, 0表示没有截止时间
+     * @param[out] status 不能发起调用时的调用状态
+     * @return false 不能发起调用
+     */
+    bool prepare_call(uint64_t& deadline, Result<>& status);
 
-        if (response->get_content().empty()) {
-            ret.set_code(RPC_NO_METHOD);
-            ret.set_message("method not found");
-            return ret;
-        }
+    /**
+     * @brief 发送请求并等待对应序列号的响应, 处理截止时间与超时取消
+     *
+     * @param type 请求类型
+     * @param content 请求内容
+     * @param[out] status 失败时的调用状态
+     * @return Protocol::ptr 响应, 失败返回nullptr
+     */
+    Protocol::ptr invoke(Protocol::MessageType type, const std::string& content, Result<>& status);
 
-        Serializer serializer(response->get_content());
-        try {
-            serializer >> ret;
-        }
-        catch (...) {
-            // 返回的结果类型不匹配
-            ret.set_code(RPC_NO_MATCH);
-            ret.set_message("return value not match");
-        }
-        return ret;
-    }
+    /**
+     * @brief invoke的C++20协程版本, 等待响应时挂起协程而不是Fiber
+     */
+    Task<Protocol::ptr> co_invoke(Protocol::MessageType type, std::string content, Result<>& status);
 
 private:
     bool m_auto_heartbeat = true;  // 是否自动开启心跳包
     bool m_is_close = true;        // 是否结束运行
     bool m_is_heart_close = true;
-    uint64_t m_timeout;          // 超时时间
+    uint64_t m_timeout = -1;     // 超时时间, -1表示不超时
     RpcSession::ptr m_session;   // 服务器的连接
+    Address::ptr m_address;      // 服务器的地址
     uint32_t m_sequence_id = 0;  // 序列号
     // uint32_t m_sequence_id_upper_bound;  // 序列号的上线, 限制了一个client能够建立的连接数量
     // 序列号到对应调用者协程的Channel映射
@@ -10,6 +10,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -21,6 +22,10 @@ static ConfigVar<size_t>::ptr g_channel_capacity = Config::look_up<size_t>(
     "rpc.connection_pool.channel_capacity", 1024, "rpc connection pool channel capacity");
 static uint64_t s_channel_capacity = 1;
 
+static ConfigVar<bool>::ptr g_shm_enable = Config::look_up<bool>(
+    "rpc.connection_pool.shm", true, "rpc connection pool use shared memory for local service");
+static bool s_shm_enable = true;
+
 struct _RpcConnectionPoolIniter {
     _RpcConnectionPoolIniter() {
         s_channel_capacity = g_channel_capacity->get_value();
@@ -29,11 +34,42 @@ struct _RpcConnectionPoolIniter {
                              << " to " << new_val;
             s_channel_capacity = new_val;
         });
+
+        s_shm_enable = g_shm_enable->get_value();
+        g_shm_enable->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "rpc connection pool shm enable changed from " << old_val
+                             << " to " << new_val;
+            s_shm_enable = new_val;
+        });
     }
 };
 
 static _RpcConnectionPoolIniter s_initer;
 
+/**
+ * @brief 服务地址是否是本机的某个网卡地址
+ */
+static bool is_local_address(Address::ptr address) {
+    IPAddress::ptr ip = std::dynamic_pointer_cast<IPAddress>(
+        Address::create(address->get_addr(), address->get_addr_len()));
+    if (!ip) {
+        return false;
+    }
+    // 网卡地址的端口为0
+    ip->set_port(0);
+
+    std::multimap<std::string, std::pair<Address::ptr, uint32_t>> interfaces;
+    if (!Address::get_interface_address(interfaces, ip->get_family())) {
+        return false;
+    }
+    for (auto& item : interfaces) {
+        if (*item.second.first == *ip) {
+            return true;
+        }
+    }
+    return false;
+}
+
 RpcConnectionPool::RpcConnectionPool(uint64_t timeout_ms)
     : m_is_close(false), m_timeout_ms(timeout_ms), m_channel(s_channel_capacity) {
 }
@@ -160,6 +196,66 @@ void RpcConnectionPool::handle_recv() {
     }
 }
 
+RpcClient::ptr RpcConnectionPool::get_connection(const std::string& name, Result<>& status) {
+    LockGuard lock(m_connections_mutex);
+    // 如果连接池中存在已有连接, 则直接使用
+    auto connection = m_connections.find(name);
+    if (connection != m_connections.end()) {
+        return connection->second;
+    }
+
+    std::vector<std::string>& addrs = m_service_cache[name];
+    // 如果服务地址缓存为空则重新向服务中心请求服务发现
+    if (addrs.empty()) {
+        if (!m_registry || !m_registry->is_connected()) {
+            status.set_code(RPC_CLOSED);
+            status.set_message("registry closed");
+            return nullptr;
+        }
+        addrs = discover(name);
+        // 如果没有发现服务返回错误
+        if (addrs.empty()) {
+            status.set_code(RPC_NO_METHOD);
+            status.set_message("no method: " + name);
+            return nullptr;
+        }
+    }
+
+    // 若地址列表不为空,则选择客户端负载均衡策略，根据路由策略选择服务地址
+    RouteStrategy<std::string>::ptr strategy =
+        RouteEngine<std::string>::query_strategy(Strategy::RANDOM);
+    const std::string ip = strategy->select(addrs);
+    Address::ptr address = Address::look_up_any(ip);
+    // 选择的服务地址有效
+    if (address) {
+        RpcClient::ptr client = std::make_shared<RpcClient>();
+        client->set_timeout(m_timeout_ms);
+        // 服务在本机时优先使用共享内存连接, 服务端未开启时退回tcp
+        bool connected = s_shm_enable && is_local_address(address) && client->connect_shm(address);
+        // 成功连接上服务器
+        if (connected || client->connect(address)) {
+            m_connections.emplace(name, client);
+            return client;
+        }
+    }
+
+    status.set_code(RPC_FAIL);
+    status.set_message("call fail");
+    return nullptr;
+}
+
+void RpcConnectionPool::remove_connection(const std::string& name, RpcClient::ptr client) {
+    LockGuard lock(m_connections_mutex);
+    auto connection = m_connections.find(name);
+    if (connection == m_connections.end() || connection->second != client) {
+        return;
+    }
+    // 将失效的远程连接从地址列表中移除
+    std::vector<std::string>& addrs = m_service_cache[name];
+    std::erase(addrs, client->get_address()->to_string());
+    m_connections.erase(connection);
+}
+
 void RpcConnectionPool::handle_service_discover(Protocol::ptr response) {
     Serializer s(response->get_content());
     std::string service;
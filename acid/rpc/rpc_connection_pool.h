@@ -99,67 +99,59 @@ public:
      */
     template <class R, class... Params>
     Result<R> call(const std::string& name, Params... params) {
-        LockGuard lock(m_connections_mutex);
-        // 从连接池中取出服务连接
-        auto connection = m_connections.find(name);
         Result<R> result;
-        // 如果连接池中存在已有连接, 则直接调用
-        if (connection != m_connections.end()) {
-            lock.unlock();
-            result = connection->second->template call<R>(name, params...);
+        Result<> status;
+        // 从连接池中取出服务连接, 没有则通过服务发现建立连接
+        RpcClient::ptr client = get_connection(name, status);
+        if (client) {
+            result = client->template call<R>(name, params...);
             // 调用成功则返回结果, 对端关闭则移除该地址,
             // 重新从保存的服务地址列表中通过路由策略选择服务地址
             if (result.get_code() != RPC_CLOSED) {
                 return result;
             }
-            lock.lock();
-            // 移除失效连接
-            std::vector<std::string>& addrs = m_service_cache[name];
-            // 将失效的远程连接从addrs中移除
-            std::erase(addrs, connection->second->get_socket()->get_remote_address()->to_string());
-            m_connections.erase(name);
+            remove_connection(name, client);
+            client = get_connection(name, status);
+            if (client) {
+                return client->template call<R>(name, params...);
+            }
         }
 
-        // 移除地址后, 地址列表可能是空的
-        std::vector<std::string>& addrs = m_service_cache[name];
-        // 如果服务地址缓存为空则重新向服务中心请求服务发现
-        if (addrs.empty()) {
-            if (!m_registry || !m_registry->is_connected()) {
-                result.set_code(RPC_CLOSED);
-                result.set_message("registry closed");
-                return result;
+        result.set_code(status.get_code());
+        result.set_message(status.get_message());
+        return result;
+    }
+
+    /**
+     * @brief 批量远程过程调用, 批量中的调用必须属于同一个服务
+     *
+     * @tparam R 返回值类型
+     * @param name 服务名, 用于选择服务连接
+     * @param batch
+     * @return std::vector<Result<R>> 与加入顺序一致的调用结果
+     */
+    template <class R>
+    std::vector<Result<R>> batch_call(const std::string& name, const RpcBatch& batch) {
+        Result<> status;
+        RpcClient::ptr client = get_connection(name, status);
+        if (client) {
+            std::vector<Result<R>> results = client->template batch_call<R>(batch);
+            if (results.empty() || results.front().get_code() != RPC_CLOSED) {
+                return results;
             }
-            addrs = discover(name);
-            // 如果没有发现服务返回错误
-            if (addrs.empty()) {
-                result.set_code(RPC_NO_METHOD);
-                result.set_message("no method: " + name);
-                return result;
+            remove_connection(name, client);
+            client = get_connection(name, status);
+            if (client) {
+                return client->template batch_call<R>(batch);
             }
         }
 
-        // 若地址列表不为空,则选择客户端负载均衡策略，根据路由策略选择服务地址
-        RouteStrategy<std::string>::ptr strategy =
-            RouteEngine<std::string>::query_strategy(Strategy::RANDOM);
-        if (!addrs.empty()) {
-            const std::string ip = strategy->select(addrs);
-            Address::ptr address = Address::look_up_any(ip);
-            // 选择的服务地址有效
-            if (address) {
-                RpcClient::ptr client = std::make_shared<RpcClient>();
-                // 成功连接上服务器
-                if (client->connect(address)) {
-                    m_connections.emplace(name, client);
-                    lock.unlock();
-                    return client->template call<R>(name, params...);
-                }
-            }
+        std::vector<Result<R>> results(batch.size());
+        for (auto& result : results) {
+            result.set_code(status.get_code());
+            result.set_message(status.get_message());
         }
-
-        // 服务发现之后发现地址仍然为空, 怎调用错误
-        result.set_code(RPC_FAIL);
-        result.set_message("call fail");
-        return result;
+        return results;
     }
 
     /**
@@ -193,6 +185,23 @@ public:
     void close();
 
 private:
+    /**
+     * @brief 获取服务的连接, 连接池中没有时通过服务发现和路由策略选择地址建立连接
+     *
+     * @param name 服务名称
+     * @param[out] status 失败时的调用状态
+     * @return RpcClient::ptr 失败返回nullptr
+     */
+    RpcClient::ptr get_connection(const std::string& name, Result<>& status);
+
+    /**
+     * @brief 移除失效的连接, 并将其地址从服务地址缓存中移除
+     *
+     * @param name 服务名称
+     * @param client 失效的连接
+     */
+    void remove_connection(const std::string& name, RpcClient::ptr client);
+
     /**
      * @brief 服务发现
      *
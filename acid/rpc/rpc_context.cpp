@@ -0,0 +1,34 @@
+#include "rpc_context.h"
+
+#include "acid/common/fiber.h"
+#include "acid/common/util.h"
+
+namespace acid::rpc {
+
+// 当前协程的调用上下文, 子协程继承, 下游调用同样受截止时间约束
+static FiberLocal<RpcContext> s_context(true);
+
+RpcContext::RpcContext(uint64_t deadline) : m_deadline(deadline) {
+}
+
+uint64_t RpcContext::remaining_ms() const {
+    if (m_deadline == 0) {
+        return UINT64_MAX;
+    }
+    uint64_t now = get_current_ms();
+    return now >= m_deadline ? 0 : m_deadline - now;
+}
+
+bool RpcContext::is_expired() const {
+    return m_deadline != 0 && get_current_ms() >= m_deadline;
+}
+
+RpcContext::ptr RpcContext::get_this() {
+    return s_context.get_shared();
+}
+
+void RpcContext::set_this(RpcContext::ptr context) {
+    s_context.reset(std::move(context));
+}
+
+}  // namespace acid::rpc
@@ -0,0 +1,112 @@
+/**
+ * @file rpc_context.h
+ * @author kbjcx (lulu5v@163.com)
+ * @brief rpc调用上下文, 携带截止时间与取消状态
+ * @version 0.1
+ * @date 2023-08-02
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ACID_RPC_CONTEXT_H
+#define ACID_RPC_CONTEXT_H
+
+#include "acid/common/noncopyable.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace acid::rpc {
+
+/**
+ * @brief 一次rpc调用的上下文
+ * 服务端在执行注册函数前为当前协程绑定上下文, 注册函数可以通过RpcContext::get_this()
+ * 获取剩余的时间预算, 并在被取消或超时后提前结束; 在该协程中发起的下游调用会继承截止时间
+ */
+class RpcContext {
+public:
+    using ptr = std::shared_ptr<RpcContext>;
+
+    /**
+     * @brief 构造函数
+     *
+     * @param deadline 绝对截止时间(ms), 0表示没有截止时间
+     */
+    explicit RpcContext(uint64_t deadline = 0);
+
+    uint64_t get_deadline() const {
+        return m_deadline;
+    }
+
+    /**
+     * @brief 获取剩余的时间预算(ms)
+     *
+     * @return uint64_t 没有截止时间时返回UINT64_MAX, 已超时返回0
+     */
+    uint64_t remaining_ms() const;
+
+    /**
+     * @brief 是否已经超过截止时间
+     */
+    bool is_expired() const;
+
+    bool is_cancelled() const {
+        return m_cancelled;
+    }
+
+    /**
+     * @brief 取消本次调用, 客户端放弃等待时由cancel消息触发
+     */
+    void cancel() {
+        m_cancelled = true;
+    }
+
+    /**
+     * @brief 本次调用是否已经没有必要继续执行(被取消或者已超时)
+     */
+    bool is_done() const {
+        return is_cancelled() || is_expired();
+    }
+
+    /**
+     * @brief 获取当前协程绑定的调用上下文
+     *
+     * @return RpcContext::ptr 没有绑定时返回nullptr
+     */
+    static RpcContext::ptr get_this();
+
+    /**
+     * @brief 为当前协程绑定调用上下文, 协程可能在线程间迁移, 因此保存在协程局部存储中,
+     * TaskGroup创建的子协程继承父协程的上下文
+     *
+     * @param context 为nullptr时解除绑定
+     */
+    static void set_this(RpcContext::ptr context);
+
+    /**
+     * @brief 在作用域内为当前协程绑定调用上下文, 离开作用域时恢复原来的上下文, 处理函数抛出异常时也会恢复
+     */
+    class Scope : Noncopyable {
+    public:
+        explicit Scope(RpcContext::ptr context) : m_prev(get_this()) {
+            set_this(std::move(context));
+        }
+
+        ~Scope() {
+            set_this(std::move(m_prev));
+        }
+
+    private:
+        RpcContext::ptr m_prev;
+    };
+
+private:
+    uint64_t m_deadline;
+    std::atomic<bool> m_cancelled {false};
+};
+
+}  // namespace acid::rpc
+
+#endif
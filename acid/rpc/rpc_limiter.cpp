@@ -0,0 +1,162 @@
+#include "rpc_limiter.h"
+
+#include "acid/common/util.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace acid::rpc {
+
+// 统计窗口的长度(us)与最少样本数
+static constexpr uint64_t WINDOW_US = 100'000;
+static constexpr uint64_t WINDOW_MIN_SAMPLES = 10;
+// 平均延迟不超过最小延迟的TOLERANCE倍时不收缩
+static constexpr double TOLERANCE = 2.0;
+// 新的并发上限占平滑结果的比重
+static constexpr double SMOOTHING = 0.2;
+// 每隔PROBE_WINDOWS个窗口重新探测最小延迟, 避免处理耗时变化后一直使用过时的基准
+static constexpr uint32_t PROBE_WINDOWS = 600;
+
+ConcurrencyLimiter::ConcurrencyLimiter(uint32_t max_limit, bool adaptive)
+    : m_max_limit(max_limit), m_adaptive(adaptive) {
+    m_estimated_limit = adaptive ? std::min(INITIAL_LIMIT, get_ceiling()) : max_limit;
+    m_limit = static_cast<uint32_t>(m_estimated_limit);
+}
+
+bool ConcurrencyLimiter::try_acquire() {
+    uint32_t limit = m_limit;
+    if (limit == 0) {
+        ++m_inflight;
+        return true;
+    }
+
+    uint32_t inflight = m_inflight;
+    do {
+        if (inflight >= limit) {
+            return false;
+        }
+    } while (!m_inflight.compare_exchange_weak(inflight, inflight + 1));
+    return true;
+}
+
+void ConcurrencyLimiter::release(uint64_t latency_us, bool sampled) {
+    uint32_t inflight = m_inflight--;
+    if (!m_adaptive || !sampled) {
+        return;
+    }
+
+    MutexType::Lock lock(m_mutex);
+    uint64_t now = get_elapsed_us();
+    if (m_window_start == 0) {
+        m_window_start = now;
+    }
+    m_window_sum += latency_us;
+    ++m_window_count;
+    m_window_max_inflight = std::max(m_window_max_inflight, inflight);
+
+    if (now - m_window_start >= WINDOW_US && m_window_count >= WINDOW_MIN_SAMPLES) {
+        update();
+        m_window_start = now;
+        m_window_sum = 0;
+        m_window_count = 0;
+        m_window_max_inflight = 0;
+    }
+}
+
+void ConcurrencyLimiter::set_max_limit(uint32_t max_limit) {
+    configure(max_limit, m_adaptive);
+}
+
+void ConcurrencyLimiter::configure(uint32_t max_limit, bool adaptive) {
+    MutexType::Lock lock(m_mutex);
+    if (adaptive != m_adaptive) {
+        // 切换模式后之前的统计没有意义
+        m_adaptive = adaptive;
+        m_estimated_limit = INITIAL_LIMIT;
+        m_min_latency = 0;
+        m_window_start = 0;
+        m_window_sum = 0;
+        m_window_count = 0;
+        m_window_max_inflight = 0;
+        m_windows = 0;
+    }
+    m_max_limit = max_limit;
+    if (m_adaptive) {
+        m_estimated_limit = std::min(m_estimated_limit, static_cast<double>(get_ceiling()));
+    }
+    else {
+        m_estimated_limit = max_limit;
+    }
+    m_limit = static_cast<uint32_t>(m_estimated_limit);
+}
+
+void ConcurrencyLimiter::update() {
+    uint64_t avg = std::max<uint64_t>(m_window_sum / m_window_count, 1);
+    if (m_min_latency == 0 || avg < m_min_latency) {
+        m_min_latency = avg;
+    }
+
+    // 延迟接近最小延迟时梯度为1, 排队越严重梯度越小
+    double gradient = std::clamp(TOLERANCE * m_min_latency / avg, 0.5, 1.0);
+    // 梯度为1且并发远未达到上限时, 说明负载本身不高, 不必继续增长
+    if (gradient < 1.0 || m_window_max_inflight * 2 >= m_estimated_limit) {
+        double target = m_estimated_limit * gradient + std::sqrt(m_estimated_limit);
+        m_estimated_limit = m_estimated_limit * (1 - SMOOTHING) + target * SMOOTHING;
+    }
+
+    if (++m_windows >= PROBE_WINDOWS) {
+        // 降低并发让排队消失, 下一个窗口重新测量最小延迟
+        m_windows = 0;
+        m_min_latency = 0;
+        m_estimated_limit /= 2;
+    }
+
+    m_estimated_limit = std::clamp(m_estimated_limit, static_cast<double>(MIN_LIMIT),
+                                   static_cast<double>(get_ceiling()));
+    m_limit = static_cast<uint32_t>(m_estimated_limit);
+}
+
+CoDelShedder::CoDelShedder(uint64_t target_ms, uint64_t interval_ms)
+    : m_target_us(target_ms * 1000), m_interval_us(interval_ms * 1000) {
+}
+
+bool CoDelShedder::should_drop(uint64_t queue_us) {
+    // 未开启时不加锁, 避免所有请求在同一把锁上竞争
+    if (m_target_us.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    uint64_t now = get_elapsed_us();
+    MutexType::Lock lock(m_mutex);
+    uint64_t target_us = m_target_us.load(std::memory_order_relaxed);
+    if (target_us == 0) {
+        return false;
+    }
+    if (m_interval_end == 0) {
+        m_interval_end = now + m_interval_us;
+    }
+
+    if (now >= m_interval_end) {
+        // 一个周期结束, 最小排队时间仍然超过target说明队列持续积压
+        m_overloaded = m_min_delay > target_us;
+        m_min_delay = UINT64_MAX;
+        m_interval_end = now + m_interval_us;
+    }
+    m_min_delay = std::min(m_min_delay, queue_us);
+
+    return m_overloaded && queue_us > target_us;
+}
+
+void CoDelShedder::set_target(uint64_t target_ms, uint64_t interval_ms) {
+    MutexType::Lock lock(m_mutex);
+    if (m_target_us == target_ms * 1000 && m_interval_us == interval_ms * 1000) {
+        return;
+    }
+    m_target_us = target_ms * 1000;
+    m_interval_us = interval_ms * 1000;
+    // 从新的周期重新开始统计
+    m_min_delay = UINT64_MAX;
+    m_interval_end = 0;
+    m_overloaded = false;
+}
+
+}  // namespace acid::rpc
@@ -0,0 +1,166 @@
+/**
+ * @file rpc_limiter.h
+ * @author kbjcx (lulu5v@163.com)
+ * @brief rpc服务端的并发限制与过载丢弃
+ * @version 0.1
+ * @date 2023-08-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ACID_RPC_LIMITER_H
+#define ACID_RPC_LIMITER_H
+
+#include "acid/common/mutex.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace acid::rpc {
+
+/**
+ * @brief 单个方法的并发限制器
+ * 固定模式下并发数不超过max_limit; 自适应模式下按窗口统计请求延迟,
+ * 用 最小延迟 / 窗口平均延迟 的梯度调整并发上限, 排队导致延迟升高时收缩, 延迟恢复时增长
+ */
+class ConcurrencyLimiter {
+public:
+    using ptr = std::shared_ptr<ConcurrencyLimiter>;
+    using MutexType = Spinlock;
+
+    // 自适应模式下的并发下限
+    static constexpr uint32_t MIN_LIMIT = 2;
+    // 自适应模式下的初始并发数
+    static constexpr uint32_t INITIAL_LIMIT = 32;
+    // 自适应模式下未设置max_limit时的并发上限
+    static constexpr uint32_t DEFAULT_MAX_LIMIT = 10000;
+
+    /**
+     * @brief 构造函数
+     *
+     * @param max_limit 并发上限, 0表示不限制
+     * @param adaptive 是否根据延迟自适应调整并发上限
+     */
+    explicit ConcurrencyLimiter(uint32_t max_limit = 0, bool adaptive = false);
+
+    /**
+     * @brief 尝试占用一个并发名额
+     *
+     * @return true 成功
+     * @return false 超过并发上限, 请求应当被拒绝
+     */
+    bool try_acquire();
+
+    /**
+     * @brief 请求处理完成, 归还并发名额
+     *
+     * @param latency_us 请求从到达到处理完成的耗时(us)
+     * @param sampled 是否作为延迟样本, 被丢弃的请求不参与调整
+     */
+    void release(uint64_t latency_us, bool sampled = true);
+
+    /**
+     * @brief 设置并发上限, 自适应模式下为调整的上界
+     *
+     * @param max_limit 0表示不限制
+     */
+    void set_max_limit(uint32_t max_limit);
+
+    /**
+     * @brief 重新设置并发上限和是否自适应, 配置修改后由服务端调用
+     * 切换到自适应模式时从初始并发数重新开始调整
+     *
+     * @param max_limit 0表示不限制
+     */
+    void configure(uint32_t max_limit, bool adaptive);
+
+    uint32_t get_limit() const {
+        return m_limit;
+    }
+
+    uint32_t get_inflight() const {
+        return m_inflight;
+    }
+
+    bool is_adaptive() const {
+        return m_adaptive;
+    }
+
+private:
+    /**
+     * @brief 一个统计窗口结束, 根据延迟梯度更新并发上限
+     */
+    void update();
+
+    uint32_t get_ceiling() const {
+        return m_max_limit ? m_max_limit : DEFAULT_MAX_LIMIT;
+    }
+
+private:
+    std::atomic<uint32_t> m_inflight {0};  // 正在处理的请求数
+    std::atomic<uint32_t> m_limit;         // 当前的并发上限, 0表示不限制
+    uint32_t m_max_limit;                  // 并发上限的上界
+    std::atomic<bool> m_adaptive;          // 是否自适应
+
+    MutexType m_mutex;            // 保护以下的统计数据
+    double m_estimated_limit;     // 平滑后的并发上限
+    uint64_t m_min_latency = 0;   // 观测到的最小窗口延迟(us), 近似无排队时的处理耗时
+    uint64_t m_window_start = 0;  // 窗口开始时间(us)
+    uint64_t m_window_sum = 0;    // 窗口内的延迟总和
+    uint64_t m_window_count = 0;  // 窗口内的样本数
+    uint32_t m_window_max_inflight = 0;  // 窗口内的最大并发数
+    uint32_t m_windows = 0;              // 已统计的窗口数, 用于定期重新探测最小延迟
+};
+
+/**
+ * @brief 基于排队时间的过载丢弃(CoDel)
+ * 在一个interval内, 如果请求的最小排队时间都超过了target, 说明队列持续积压而不是瞬时突发,
+ * 进入过载状态, 此时排队超过target的请求直接丢弃; 未过载时不丢弃任何请求, 瞬时突发由队列吸收
+ */
+class CoDelShedder {
+public:
+    using ptr = std::shared_ptr<CoDelShedder>;
+    using MutexType = Spinlock;
+
+    /**
+     * @brief 构造函数
+     *
+     * @param target_ms 可接受的排队时间, 0表示不丢弃
+     * @param interval_ms 统计最小排队时间的周期
+     */
+    CoDelShedder(uint64_t target_ms, uint64_t interval_ms);
+
+    /**
+     * @brief 请求出队时判断是否应当丢弃
+     *
+     * @param queue_us 请求在队列中等待的时间(us)
+     * @return true 丢弃该请求
+     */
+    bool should_drop(uint64_t queue_us);
+
+    /**
+     * @brief 修改可接受的排队时间和统计周期, 配置修改后由服务端调用
+     *
+     * @param target_ms 为0时不再丢弃
+     */
+    void set_target(uint64_t target_ms, uint64_t interval_ms);
+
+    bool is_overloaded() const {
+        return m_overloaded;
+    }
+
+private:
+    std::atomic<uint64_t> m_target_us;  // 为0时不加锁直接放行
+    uint64_t m_interval_us;
+
+    MutexType m_mutex;  // 保护m_interval_us以及以下的统计数据
+    uint64_t m_min_delay = UINT64_MAX;  // 本周期内的最小排队时间
+    uint64_t m_interval_end = 0;        // 本周期的结束时间
+    std::atomic<bool> m_overloaded {false};
+};
+
+}  // namespace acid::rpc
+
+#endif
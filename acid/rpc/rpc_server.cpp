@@ -2,6 +2,7 @@
 
 #include "acid/common/config.h"
 #include "acid/common/iomanager.h"
+#include "acid/common/util.h"
 #include "acid/logger/logger.h"
 #include "acid/net/address.h"
 #include "acid/net/socket.h"
@@ -10,9 +11,11 @@
 #include "acid/rpc/rpc.h"
 #include "acid/rpc/rpc_session.h"
 #include "acid/rpc/serializer.h"
+#include "acid/rpc/shm_session.h"
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace acid::rpc {
 
@@ -22,6 +25,26 @@ static ConfigVar<uint64_t>::ptr g_heartbeat_timeout = Config::look_up<uint64_t>(
     "rpc.server.heartbeat_timeout", 40'000, "rpc server heartbeat timeout(ms)");
 static uint64_t s_heartbeat_timeout = 0;
 
+static ConfigVar<uint32_t>::ptr g_max_concurrency = Config::look_up<uint32_t>(
+    "rpc.server.max_concurrency", 0, "rpc server max concurrency per method, 0 means unlimited");
+static uint32_t s_max_concurrency = 0;
+
+static ConfigVar<bool>::ptr g_adaptive_limit = Config::look_up<bool>(
+    "rpc.server.adaptive_limit", false, "rpc server adjust concurrency limit by latency");
+static bool s_adaptive_limit = false;
+
+static ConfigVar<uint64_t>::ptr g_codel_target = Config::look_up<uint64_t>(
+    "rpc.server.codel_target", 0, "rpc server acceptable queue time(ms), 0 means disable");
+static uint64_t s_codel_target = 0;
+
+static ConfigVar<uint64_t>::ptr g_codel_interval = Config::look_up<uint64_t>(
+    "rpc.server.codel_interval", 100, "rpc server queue time statistic interval(ms)");
+static uint64_t s_codel_interval = 0;
+
+static ConfigVar<bool>::ptr g_shm_enable = Config::look_up<bool>(
+    "rpc.server.shm", true, "rpc server accept shared memory connections from the same host");
+static bool s_shm_enable = true;
+
 struct _RpcServerIniter {
     _RpcServerIniter() {
         s_heartbeat_timeout = g_heartbeat_timeout->get_value();
@@ -30,13 +53,71 @@ struct _RpcServerIniter {
                              << new_val;
             s_heartbeat_timeout = new_val;
         });
+
+        s_max_concurrency = g_max_concurrency->get_value();
+        g_max_concurrency->add_listener([](const uint32_t& old_val, const uint32_t& new_val) {
+            LOG_INFO(logger) << "rpc server max concurrency change from " << old_val << " to "
+                             << new_val;
+            s_max_concurrency = new_val;
+        });
+
+        s_adaptive_limit = g_adaptive_limit->get_value();
+        g_adaptive_limit->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "rpc server adaptive limit change from " << old_val << " to "
+                             << new_val;
+            s_adaptive_limit = new_val;
+        });
+
+        s_codel_target = g_codel_target->get_value();
+        g_codel_target->add_listener([](const uint64_t& old_val, const uint64_t& new_val) {
+            LOG_INFO(logger) << "rpc server codel target change from " << old_val << " to "
+                             << new_val;
+            s_codel_target = new_val;
+        });
+
+        s_codel_interval = g_codel_interval->get_value();
+        g_codel_interval->add_listener([](const uint64_t& old_val, const uint64_t& new_val) {
+            LOG_INFO(logger) << "rpc server codel interval change from " << old_val << " to "
+                             << new_val;
+            s_codel_interval = new_val;
+        });
+
+        s_shm_enable = g_shm_enable->get_value();
+        g_shm_enable->add_listener([](const bool& old_val, const bool& new_val) {
+            LOG_INFO(logger) << "rpc server shm enable change from " << old_val << " to "
+                             << new_val;
+            s_shm_enable = new_val;
+        });
     }
 };
 
 static _RpcServerIniter s_initer;
 
+/**
+ * @brief 过载时的回复, 客户端收到RPC_OVERLOAD后可以换一个服务端重试
+ *
+ * @return std::string 序列化的失败结果
+ */
+static std::string overload_result() {
+    Result<> res;
+    res.set_code(RPC_OVERLOAD);
+    res.set_message("server overload");
+    Serializer s;
+    s << res;
+    s.reset();
+    return s.to_string();
+}
+
+// 过载时回复的响应
+static Protocol::ptr overload_response(uint32_t id) {
+    return Protocol::create(Protocol::MessageType::RPC_METHOD_RESPONSE, overload_result(), id);
+}
+
 RpcServer::RpcServer(IOManager* worker, IOManager* io_worker, IOManager* accept_worker)
-    : TcpServer("RpcServer", worker, io_worker, accept_worker), m_alive_time(s_heartbeat_timeout) {
+    : TcpServer("RpcServer", worker, io_worker, accept_worker)
+    , m_shedder(std::make_shared<CoDelShedder>(s_codel_target, s_codel_interval))
+    , m_config_version(ConfigVarBase::get_version())
+    , m_alive_time(s_heartbeat_timeout) {
 }
 
 RpcServer::~RpcServer() {
@@ -49,10 +130,38 @@ RpcServer::~RpcServer() {
 }
 
 bool RpcServer::bind(Address::ptr addr, bool ssl) {
-    // 获取绑定的端口号
-    m_port = std::dynamic_pointer_cast<IPv4Address>(addr)->get_port();
     // 创建socket并绑定地址
-    return TcpServer::bind(addr);
+    if (!TcpServer::bind(addr)) {
+        return false;
+    }
+
+    IPAddress::ptr ip_address = std::dynamic_pointer_cast<IPAddress>(addr);
+    if (ip_address) {
+        // 获取绑定的端口号, 服务中心用连接的ip加上该端口作为服务地址
+        m_port = ip_address->get_port();
+        if (s_shm_enable) {
+            bind_shm();
+        }
+    }
+    else if (!m_address) {
+        // unix socket没有端口, 直接把地址告知服务中心
+        m_address = addr;
+    }
+    return true;
+}
+
+void RpcServer::bind_shm() {
+    // 同一主机的客户端通过端口对应的unix socket建立共享内存连接, 绑定失败时只提供tcp服务
+    Address::ptr address = ShmSession::get_address(m_port);
+    Socket::ptr sock = Socket::create_tcp(address);
+    if (!sock->bind(address) || !sock->listen()) {
+        LOG_WARN(logger) << "bind shared memory address fail, port=" << m_port
+                         << " errno=" << errno << " errstr=" << strerror(errno);
+        return;
+    }
+    LOG_INFO(logger) << "rpc server accept shared memory connection on " << *sock;
+    m_sockets.push_back(sock);
+    m_shm_address = address;
 }
 
 bool RpcServer::bind_registry(Address::ptr address) {
@@ -70,8 +179,9 @@ bool RpcServer::bind_registry(Address::ptr address) {
 
     m_registry = std::make_shared<RpcSession>(sock);
 
+    // 只监听unix socket时没有端口, 同时发送监听地址
     Serializer s;
-    s << m_port;
+    s << m_port << (m_port || !m_address ? std::string() : m_address->to_string());
     s.reset();
 
     // 向服务中心声明为provider, 注册服务端口
@@ -143,7 +253,20 @@ bool RpcServer::start() {
 
 void RpcServer::handle_client(Socket::ptr client) {
     LOG_DEBUG(logger) << "RpcServer::handle_client: " << client->to_string();
-    RpcSession::ptr session = std::make_shared<RpcSession>(client);
+    RpcSession::ptr session;
+    Address::ptr local_address = client->get_local_address();
+    if (m_shm_address && local_address && *local_address == *m_shm_address) {
+        // 同一主机的客户端, 先交换共享内存, 之后的报文都经过共享内存
+        session = ShmSession::accept(client);
+        if (!session) {
+            client->close();
+            return;
+        }
+    }
+    else {
+        session = std::make_shared<RpcSession>(client);
+    }
+    InflightCalls::ptr calls = std::make_shared<InflightCalls>();
 
     Timer::ptr heart_timer;
     // 开启心跳定时器
@@ -157,18 +280,73 @@ void RpcServer::handle_client(Socket::ptr client) {
         // 更新定时器
         update(heart_timer, client);
 
+        Protocol::MessageType type = request->get_message_type();
+        uint32_t id = request->get_sequence_id();
+        // 取消请求直接在接收协程中处理, 不占用工作协程
+        if (type == Protocol::MessageType::RPC_CANCEL_REQUEST) {
+            Mutex::Lock lock(calls->mutex);
+            auto it = calls->contexts.find(id);
+            if (it != calls->contexts.end()) {
+                it->second->cancel();
+            }
+            continue;
+        }
+
+        RpcContext::ptr context;
+        ConcurrencyLimiter::ptr limiter;
+        if (type == Protocol::MessageType::RPC_METHOD_REQUEST ||
+            type == Protocol::MessageType::RPC_BATCH_REQUEST) {
+            context = std::make_shared<RpcContext>(request->get_deadline());
+            // 到达时已经超时, 客户端不会再等待结果, 直接丢弃
+            if (context->is_expired()) {
+                LOG_DEBUG(logger) << "drop expired request, sequence id = " << id;
+                continue;
+            }
+            apply_config();
+            // 超过方法的并发上限, 立即拒绝而不是继续堆积到工作队列, 批量调用在执行时逐个限制
+            if (type == Protocol::MessageType::RPC_METHOD_REQUEST) {
+                limiter = get_limiter(request);
+            }
+            if (limiter && !limiter->try_acquire()) {
+                LOG_DEBUG(logger) << "reject request, sequence id = " << id
+                                  << " limit = " << limiter->get_limit();
+                session->send_protocol(overload_response(id));
+                continue;
+            }
+            Mutex::Lock lock(calls->mutex);
+            calls->contexts[id] = context;
+        }
+
         auto self = shared_from_this();
+        uint64_t arrive_us = get_elapsed_us();
 
         // 启动一个任务协程
-        m_worker->schedule([request, session, self, this]() mutable {
+        m_worker->schedule([request, session, calls, context, limiter, arrive_us, self,
+                            this]() mutable {
             Protocol::ptr response;
             Protocol::MessageType type = request->get_message_type();
             switch (type) {
                 case Protocol::MessageType::HEARTBEAT_PACKET:
                     response = handle_heartbeat_packet(request);
                     break;
-                case Protocol::MessageType::RPC_METHOD_REQUEST:
-                    response = handle_method_call(request);
+                case Protocol::MessageType::RPC_METHOD_REQUEST: {
+                    // 只有真正执行了的请求才作为延迟样本
+                    bool sampled = false;
+                    if (m_shedder->should_drop(get_elapsed_us() - arrive_us)) {
+                        // 队列持续积压, 排队过久的请求直接拒绝
+                        response = overload_response(request->get_sequence_id());
+                    }
+                    else {
+                        sampled = !context->is_done();
+                        response = handle_method_call(request, context);
+                    }
+                    if (limiter) {
+                        limiter->release(get_elapsed_us() - arrive_us, sampled);
+                    }
+                    break;
+                }
+                case Protocol::MessageType::RPC_BATCH_REQUEST:
+                    response = handle_batch_call(request, context);
                     break;
                 case Protocol::MessageType::RPC_SUBSCRIBE_REQUEST:
                     response = handle_subscribe(request, session);
@@ -180,6 +358,14 @@ void RpcServer::handle_client(Socket::ptr client) {
                     break;
             }
 
+            if (context) {
+                Mutex::Lock lock(calls->mutex);
+                auto it = calls->contexts.find(request->get_sequence_id());
+                if (it != calls->contexts.end() && it->second == context) {
+                    calls->contexts.erase(it);
+                }
+            }
+
             if (response) {
                 session->send_protocol(response);
             }
@@ -187,9 +373,23 @@ void RpcServer::handle_client(Socket::ptr client) {
             self.reset();
         });
     }
+
+    // 连接关闭, 未完成的调用不再需要回复
+    {
+        Mutex::Lock lock(calls->mutex);
+        for (auto& item : calls->contexts) {
+            item.second->cancel();
+        }
+        calls->contexts.clear();
+    }
+
+    if (heart_timer) {
+        heart_timer->cancel();
+    }
+    session->close();
 }
 
-void RpcServer::update(Timer::ptr heart_timer, Socket::ptr client) {
+void RpcServer::update(Timer::ptr& heart_timer, Socket::ptr client) {
     if (!heart_timer) {
         heart_timer = m_worker->add_timer(
             m_alive_time,
@@ -216,16 +416,154 @@ Serializer::ptr RpcServer::call(const std::string& name, const std::string& arg)
     return serializer;
 }
 
-Protocol::ptr RpcServer::handle_method_call(Protocol::ptr proto) {
+Protocol::ptr RpcServer::handle_method_call(Protocol::ptr proto, RpcContext::ptr context) {
+    // 在工作队列中等待期间已经超时或被取消, 不再执行
+    if (context->is_done()) {
+        LOG_DEBUG(logger) << "skip abandoned request, sequence id = " << proto->get_sequence_id();
+        return nullptr;
+    }
+
     std::string func_name;
     Serializer request(proto->get_content());
     request >> func_name;
-    Serializer::ptr ret = call(func_name, request.to_string());
+    // 处理函数可以通过RpcContext::get_this()获取剩余时间
+    Serializer::ptr ret;
+    {
+        RpcContext::Scope scope(context);
+        ret = call(func_name, request.to_string());
+    }
+
+    // 客户端已经放弃等待, 结果没有必要再发送
+    if (context->is_done()) {
+        return nullptr;
+    }
+
     Protocol::ptr response = Protocol::create(Protocol::MessageType::RPC_METHOD_RESPONSE,
                                               ret->to_string(), proto->get_sequence_id());
     return response;
 }
 
+Protocol::ptr RpcServer::handle_batch_call(Protocol::ptr proto, RpcContext::ptr context) {
+    if (context->is_done()) {
+        LOG_DEBUG(logger) << "skip abandoned batch, sequence id = " << proto->get_sequence_id();
+        return nullptr;
+    }
+
+    std::vector<std::string> calls;
+    Serializer request(proto->get_content());
+    try {
+        request >> calls;
+    }
+    catch (...) {
+        LOG_WARN(logger) << "invalid batch request, sequence id = " << proto->get_sequence_id();
+        return nullptr;
+    }
+
+    std::vector<std::string> results(calls.size());
+    if (!calls.empty()) {
+        // 每个调用在独立的协程中并行执行, 当前协程等待全部完成
+        CoCountDownLatch latch(static_cast<int>(calls.size()));
+        for (size_t i = 0; i < calls.size(); ++i) {
+            m_worker->schedule([&calls, &results, &latch, context, i, this]() {
+                results[i] = handle_batch_item(calls[i], context);
+                latch.count_down();
+            });
+        }
+        latch.wait();
+    }
+
+    // 客户端已经放弃等待, 结果没有必要再发送
+    if (context->is_done()) {
+        return nullptr;
+    }
+
+    Serializer response;
+    response << results;
+    response.reset();
+    return Protocol::create(Protocol::MessageType::RPC_BATCH_RESPONSE, response.to_string(),
+                            proto->get_sequence_id());
+}
+
+std::string RpcServer::handle_batch_item(const std::string& content, RpcContext::ptr context) {
+    std::string func_name;
+    Serializer request(content);
+    try {
+        request >> func_name;
+    }
+    catch (...) {
+        return "";
+    }
+
+    // 批量调用中的每一项同样受方法并发上限约束
+    ConcurrencyLimiter::ptr limiter;
+    auto it = m_limiters.find(func_name);
+    if (it != m_limiters.end()) {
+        limiter = it->second;
+    }
+    if (limiter && !limiter->try_acquire()) {
+        return overload_result();
+    }
+
+    uint64_t start_us = get_elapsed_us();
+    std::string result;
+    if (!context->is_done()) {
+        RpcContext::Scope scope(context);
+        result = call(func_name, request.to_string())->to_string();
+    }
+
+    if (limiter) {
+        limiter->release(get_elapsed_us() - start_us);
+    }
+    return result;
+}
+
+ConcurrencyLimiter::ptr RpcServer::create_limiter() {
+    return std::make_shared<ConcurrencyLimiter>(s_max_concurrency, s_adaptive_limit);
+}
+
+void RpcServer::apply_config() {
+    // 监听函数先更新静态变量再发布新的版本号, 看到新版本时静态变量已经是新值
+    uint64_t version = ConfigVarBase::get_version();
+    if (version == m_config_version.load(std::memory_order_relaxed)) {
+        return;
+    }
+    Mutex::Lock lock(m_limit_mutex);
+    if (version == m_config_version.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (auto& [name, limiter] : m_limiters) {
+        auto it = m_method_limits.find(name);
+        limiter->configure(it == m_method_limits.end() ? s_max_concurrency : it->second,
+                           s_adaptive_limit);
+    }
+    m_shedder->set_target(s_codel_target, s_codel_interval);
+    m_config_version.store(version, std::memory_order_relaxed);
+}
+
+ConcurrencyLimiter::ptr RpcServer::get_limiter(Protocol::ptr proto) {
+    std::string func_name;
+    Serializer request(proto->get_content());
+    try {
+        request >> func_name;
+    }
+    catch (...) {
+        return nullptr;
+    }
+    auto it = m_limiters.find(func_name);
+    return it == m_limiters.end() ? nullptr : it->second;
+}
+
+void RpcServer::set_method_limit(const std::string& name, uint32_t limit) {
+    auto it = m_limiters.find(name);
+    if (it == m_limiters.end()) {
+        LOG_WARN(logger) << "set method limit fail, no method: " << name;
+        return;
+    }
+    Mutex::Lock lock(m_limit_mutex);
+    m_method_limits[name] = limit;
+    it->second->set_max_limit(limit);
+}
+
 void RpcServer::register_service(const std::string& name) {
     Protocol::ptr proto = Protocol::create(Protocol::MessageType::RPC_SERVICE_REGISTER, name, 0);
     // 向服务中心发送服务注册消息, 消息体携带注册的函数名
@@ -15,6 +15,7 @@
 #include "acid/common/channel.h"
 #include "acid/common/co_mutex.h"
 #include "acid/common/iomanager.h"
+#include "acid/common/mutex.h"
 #include "acid/common/traits.h"
 #include "acid/logger/logger.h"
 #include "acid/net/address.h"
@@ -24,6 +25,8 @@
 #include "acid/rpc/serializer.h"
 #include "protocol.h"
 #include "rpc.h"
+#include "rpc_context.h"
+#include "rpc_limiter.h"
 #include "rpc_session.h"
 
 #include <cstddef>
@@ -78,8 +81,17 @@ public:
         m_handlers[name] = [func, this](Serializer::ptr s, const std::string& arg) {
             proxy(func, s, arg);
         };
+        m_limiters[name] = create_limiter();
     }
 
+    /**
+     * @brief 设置方法的并发上限, 超过上限的请求直接返回RPC_OVERLOAD
+     *
+     * @param name 注册的函数名
+     * @param limit 并发上限, 开启自适应时为调整的上界, 0表示不限制
+     */
+    void set_method_limit(const std::string& name, uint32_t limit);
+
     void set_name(std::string& name) override {
         TcpServer::set_name(name);
     }
@@ -160,7 +172,7 @@ protected:
             // 出现异常说明反序列化类型不匹配，即传入的参数与调用的函数参数不匹配
             Result<Return> res;
             res.set_code(RPC_NO_MATCH);
-            res.set_code("params not match");
+            res.set_message("params not match");
             *serializer << res;
             return;
         }
@@ -187,13 +199,18 @@ protected:
         *serializer << val;
     }
 
+    /**
+     * @brief 在端口对应的unix socket上监听同一主机的共享内存连接
+     */
+    void bind_shm();
+
     /**
      * @brief 更新心跳定时器
      *
-     * @param heart_timer
+     * @param[in, out] heart_timer
      * @param client
      */
-    void update(Timer::ptr heart_timer, Socket::ptr client);
+    void update(Timer::ptr& heart_timer, Socket::ptr client);
 
     /**
      * @brief 处理客户端连接
@@ -203,12 +220,52 @@ protected:
     void handle_client(Socket::ptr client) override;
 
     /**
-     * @brief 处理客户端过程调用请求
+     * @brief 处理客户端过程调用请求, 调用已被取消或超时则不再执行也不回复
      *
      * @param proto
-     * @return Protocol::ptr
+     * @param context 本次调用的上下文, 执行期间绑定到当前协程
+     * @return Protocol::ptr 不需要回复时返回nullptr
+     */
+    Protocol::ptr handle_method_call(Protocol::ptr proto, RpcContext::ptr context);
+
+    /**
+     * @brief 处理批量调用请求, 每个调用在m_worker上并行执行, 全部完成后一次性回复
+     *
+     * @param proto
+     * @param context 整个批量调用共享的上下文
+     * @return Protocol::ptr 不需要回复时返回nullptr
      */
-    Protocol::ptr handle_method_call(Protocol::ptr proto);
+    Protocol::ptr handle_batch_call(Protocol::ptr proto, RpcContext::ptr context);
+
+    /**
+     * @brief 执行批量调用中的一项
+     *
+     * @param content 序列化的调用请求
+     * @param context
+     * @return std::string 序列化的调用结果, 没有找到调用函数时为空
+     */
+    std::string handle_batch_item(const std::string& content, RpcContext::ptr context);
+
+    /**
+     * @brief 根据配置创建方法的并发限制器
+     *
+     * @return ConcurrencyLimiter::ptr
+     */
+    ConcurrencyLimiter::ptr create_limiter();
+
+    /**
+     * @brief 配置修改后把新的并发限制和CoDel参数应用到已有的限制器上, 配置没有变化时只比较一次版本号
+     * set_method_limit单独设置过的方法保留自己的上限
+     */
+    void apply_config();
+
+    /**
+     * @brief 获取调用请求对应方法的并发限制器
+     *
+     * @param proto
+     * @return ConcurrencyLimiter::ptr 方法不存在时返回nullptr
+     */
+    ConcurrencyLimiter::ptr get_limiter(Protocol::ptr proto);
 
     /**
      * @brief 处理心跳包
@@ -228,14 +285,35 @@ protected:
     Protocol::ptr handle_subscribe(Protocol::ptr proto, RpcSession::ptr client);
 
 private:
+    // 一个连接上尚未完成的调用, 用于响应客户端的取消请求
+    struct InflightCalls {
+        using ptr = std::shared_ptr<InflightCalls>;
+        Mutex mutex;
+        std::unordered_map<uint32_t, RpcContext::ptr> contexts;
+    };
+
     // 保存服务端注册的函数
     std::map<std::string, std::function<void(Serializer::ptr, const std::string&)>> m_handlers;
+    // 每个方法的并发限制器, 与m_handlers一同注册
+    std::map<std::string, ConcurrencyLimiter::ptr> m_limiters;
+    // 基于排队时间的过载丢弃, codel_target为0时不丢弃
+    CoDelShedder::ptr m_shedder;
+    // 保护m_method_limits, 以及应用配置的过程
+    Mutex m_limit_mutex;
+    // 通过set_method_limit单独设置的并发上限
+    std::map<std::string, uint32_t> m_method_limits;
+    // 已经应用到限制器上的配置版本
+    std::atomic<uint64_t> m_config_version {0};
     // 服务中心连接
     RpcSession::ptr m_registry;
     // 心跳定时器
     Timer::ptr m_heart_timer;
     // 开放服务的端口
-    uint32_t m_port;
+    uint32_t m_port = 0;
+    // 开放服务的unix socket地址, 没有端口时作为服务地址
+    Address::ptr m_address;
+    // 共享内存握手的unix socket地址, 未开启时为nullptr
+    Address::ptr m_shm_address;
     // 心跳时间
     uint64_t m_alive_time;
     // 订阅的客户端
@@ -117,6 +117,7 @@ void RpcServiceRegistry::handle_client(Socket::ptr client) {
                                  << provider_address->to_string();
                 handle_unregidter_service(provider_address);
             }
+            break;
         }
         // 每次收到消息, 更新定时器
         update(heart_timer, client);
@@ -174,11 +175,26 @@ Protocol::ptr RpcServiceRegistry::handle_heartbeat_packet(Protocol::ptr protocol
 Address::ptr RpcServiceRegistry::hanlde_provider(Protocol::ptr protocol, Socket::ptr sock) {
     // 无法获取远程端口, 因此需要通过报文传输服务开放的端口
     uint32_t port = 0;
+    std::string listen_address;
     Serializer s(protocol->get_content());
     s.reset();
-    s >> port;
-    IPv4Address::ptr address(
-        new IPv4Address(*std::dynamic_pointer_cast<IPv4Address>(sock->get_remote_address())));
+    s >> port >> listen_address;
+
+    // 服务端只监听unix socket, 直接使用它的监听地址
+    if (!listen_address.empty()) {
+        return Address::look_up_any(listen_address);
+    }
+
+    IPAddress::ptr remote = std::dynamic_pointer_cast<IPAddress>(sock->get_remote_address());
+    IPAddress::ptr address;
+    if (remote) {
+        address = std::dynamic_pointer_cast<IPAddress>(
+            Address::create(remote->get_addr(), remote->get_addr_len()));
+    }
+    else {
+        // 通过unix socket连接服务中心, 服务端与服务中心在同一主机
+        address = IPv4Address::create("127.0.0.1", port);
+    }
     address->set_port(port);
     return address;
 }
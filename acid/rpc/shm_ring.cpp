@@ -0,0 +1,122 @@
+#include "shm_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace acid::rpc {
+
+ShmRing ShmRing::create(void* addr, uint32_t capacity) {
+    Header* header = new (addr) Header;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_relaxed);
+    header->reader_waiting.store(0, std::memory_order_relaxed);
+    header->writer_waiting.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    header->capacity = capacity;
+    return ShmRing(addr, capacity);
+}
+
+ShmRing::ShmRing(void* addr, uint32_t capacity)
+    : m_header(static_cast<Header*>(addr))
+    , m_data(static_cast<char*>(addr) + sizeof(Header))
+    , m_capacity(capacity) {
+}
+
+bool ShmRing::check_used(uint64_t head, uint64_t tail, size_t& used) {
+    used = head - tail;
+    if (used > m_capacity) [[unlikely]] {
+        set_closed();
+        return false;
+    }
+    return true;
+}
+
+size_t ShmRing::write(const void* buffer, size_t length) {
+    uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+    uint32_t capacity = m_capacity;
+    size_t used = 0;
+    if (!check_used(head, tail, used)) {
+        return 0;
+    }
+    size_t size = std::min<size_t>(length, capacity - used);
+    if (size == 0) {
+        return 0;
+    }
+
+    // 写入位置到数据区末尾放不下时分两段拷贝
+    size_t offset = head & (capacity - 1);
+    size_t first = std::min<size_t>(size, capacity - offset);
+    memcpy(m_data + offset, buffer, first);
+    memcpy(m_data, static_cast<const char*>(buffer) + first, size - first);
+    // 数据拷贝完成后再发布写位置
+    m_header->head.store(head + size, std::memory_order_release);
+    return size;
+}
+
+size_t ShmRing::read(void* buffer, size_t length) {
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    uint64_t head = m_header->head.load(std::memory_order_acquire);
+    size_t used = 0;
+    if (!check_used(head, tail, used)) {
+        return 0;
+    }
+    size_t size = std::min<size_t>(length, used);
+    if (size == 0) {
+        return 0;
+    }
+
+    uint32_t capacity = m_capacity;
+    size_t offset = tail & (capacity - 1);
+    size_t first = std::min<size_t>(size, capacity - offset);
+    memcpy(buffer, m_data + offset, first);
+    memcpy(static_cast<char*>(buffer) + first, m_data, size - first);
+    // 数据读取完成后再归还空间
+    m_header->tail.store(tail + size, std::memory_order_release);
+    return size;
+}
+
+size_t ShmRing::readable() const {
+    return m_header->head.load(std::memory_order_acquire) -
+           m_header->tail.load(std::memory_order_acquire);
+}
+
+size_t ShmRing::writable() const {
+    size_t used = readable();
+    if (used > m_capacity) {
+        // 读写位置被破坏, 返回非0让调用方通过write发现并关闭
+        return 1;
+    }
+    return m_capacity - used;
+}
+
+// 等待方先设置标志再检查缓冲区, 通知方先修改位置再检查标志, 两边都需要全序栅栏,
+// 保证至少有一方看到对方的修改, 不会出现等待方睡眠而通知方没有唤醒的情况
+void ShmRing::set_reader_waiting() {
+    m_header->reader_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool ShmRing::take_reader_waiting() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_header->reader_waiting.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return m_header->reader_waiting.exchange(0, std::memory_order_acq_rel);
+}
+
+void ShmRing::set_writer_waiting() {
+    m_header->writer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool ShmRing::take_writer_waiting() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_header->writer_waiting.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    return m_header->writer_waiting.exchange(0, std::memory_order_acq_rel);
+}
+
+}  // namespace acid::rpc
@@ -0,0 +1,123 @@
+/**
+ * @file shm_ring.h
+ * @author kbjcx (lulu5v@163.com)
+ * @brief 位于共享内存中的单生产者单消费者环形缓冲区
+ * @version 0.1
+ * @date 2023-08-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ACID_RPC_SHM_RING_H
+#define ACID_RPC_SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace acid::rpc {
+
+/**
+ * @brief 共享内存中的SPSC字节环形缓冲区
+ * 头部与数据区连续存放在同一块共享内存中, ShmRing只是这块内存的视图, 可以在不同进程中分别映射。
+ * 读写位置单调递增, 对容量取模得到下标, 写端只修改head, 读端只修改tail, 不需要加锁。
+ * 缓冲区为空或已满时通过waiting标志告知对端需要唤醒, 唤醒方式由使用者决定
+ */
+class ShmRing {
+public:
+    // 缓存行大小, 读写位置分别独占缓存行, 避免两端互相使缓存失效
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct Header {
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;  // 写位置, 只由写端修改
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;  // 读位置, 只由读端修改
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> reader_waiting;  // 读端等待数据
+        std::atomic<uint32_t> writer_waiting;                           // 写端等待空间
+        std::atomic<uint32_t> closed;                                   // 任意一端已关闭
+        uint32_t capacity;                                              // 数据区大小, 2的幂
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "shared memory ring requires lock free atomics");
+
+    /**
+     * @brief 容量为capacity的环形缓冲区需要的共享内存大小
+     */
+    static size_t get_segment_size(uint32_t capacity) {
+        return sizeof(Header) + capacity;
+    }
+
+    /**
+     * @brief 在addr处初始化一个空的环形缓冲区
+     *
+     * @param addr 共享内存地址, 至少get_segment_size(capacity)字节
+     * @param capacity 数据区大小, 必须是2的幂
+     */
+    static ShmRing create(void* addr, uint32_t capacity);
+
+    /**
+     * @brief 映射已经初始化过的环形缓冲区
+     * @details 共享内存中的头部对端也能修改, 容量使用双方握手确定的capacity, 不从头部读取
+     */
+    explicit ShmRing(void* addr = nullptr, uint32_t capacity = 0);
+
+    /**
+     * @brief 写入数据, 空间不足时只写入一部分
+     *
+     * @return size_t 实际写入的字节数, 缓冲区已满时为0; 读写位置被对端破坏时关闭缓冲区并返回0
+     */
+    size_t write(const void* buffer, size_t length);
+
+    /**
+     * @brief 读取数据, 数据不足时只读取一部分
+     *
+     * @return size_t 实际读取的字节数, 缓冲区为空时为0; 读写位置被对端破坏时关闭缓冲区并返回0
+     */
+    size_t read(void* buffer, size_t length);
+
+    size_t readable() const;
+
+    size_t writable() const;
+
+    uint32_t get_capacity() const {
+        return m_capacity;
+    }
+
+    /**
+     * @brief 读端准备等待数据, 设置后需要再检查一次readable, 避免错过写端的唤醒
+     */
+    void set_reader_waiting();
+
+    /**
+     * @brief 写端写入数据后调用, 读端在等待时返回true并清除标志, 此时需要唤醒读端
+     */
+    bool take_reader_waiting();
+
+    void set_writer_waiting();
+
+    bool take_writer_waiting();
+
+    void set_closed() {
+        m_header->closed.store(1, std::memory_order_release);
+    }
+
+    bool is_closed() const {
+        return m_header->closed.load(std::memory_order_acquire);
+    }
+
+private:
+    /**
+     * @brief 已用空间, 超过容量说明对端改坏了读写位置, 这时关闭缓冲区并返回false
+     */
+    bool check_used(uint64_t head, uint64_t tail, size_t& used);
+
+private:
+    Header* m_header;
+    char* m_data;
+    uint32_t m_capacity;
+};
+
+}  // namespace acid::rpc
+
+#endif
@@ -0,0 +1,420 @@
+#include "shm_session.h"
+
+#include "acid/common/config.h"
+#include "acid/common/fiber.h"
+#include "acid/logger/logger.h"
+#include "acid/net/address.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace acid::rpc {
+
+static auto logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_shm_ring_size = Config::look_up<uint32_t>(
+    "rpc.shm.ring_size", 1 << 20, "rpc shared memory ring size per direction(bytes)");
+static uint32_t s_shm_ring_size = 0;
+
+struct _ShmSessionIniter {
+    _ShmSessionIniter() {
+        s_shm_ring_size = g_shm_ring_size->get_value();
+        g_shm_ring_size->add_listener([](const uint32_t& old_val, const uint32_t& new_val) {
+            LOG_INFO(logger) << "rpc shm ring size change from " << old_val << " to " << new_val;
+            s_shm_ring_size = new_val;
+        });
+    }
+};
+
+static _ShmSessionIniter s_initer;
+
+// 握手消息, 随共享内存和eventfd一起发送
+struct ShmHandshake {
+    static constexpr uint32_t MAGIC = 0x41534D31;  // "ASM1"
+    uint32_t magic;
+    uint32_t capacity;  // 每个方向ring的数据区大小
+};
+
+// 共享内存fd加四个eventfd
+static constexpr int SHM_FD_COUNT = 5;
+
+// ring的数据区最小为一页, 并且是2的幂
+static uint32_t get_ring_capacity() {
+    return std::bit_ceil(std::max<uint32_t>(s_shm_ring_size, 4096));
+}
+
+// 一个方向的ring占用的共享内存, 按缓存行对齐, 让第二个ring的头部也对齐
+static size_t get_ring_segment_size(uint32_t capacity) {
+    size_t size = ShmRing::get_segment_size(capacity);
+    return (size + ShmRing::CACHE_LINE_SIZE - 1) & ~(ShmRing::CACHE_LINE_SIZE - 1);
+}
+
+static void close_fds(int* fds, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (fds[i] != -1) {
+            ::close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+Address::ptr ShmSession::get_address(uint32_t port) {
+    std::string path(1, '\0');
+    path += "acid-rpc-shm-" + std::to_string(port);
+    return std::make_shared<UnixAddress>(path);
+}
+
+ShmSession::ptr ShmSession::connect(Socket::ptr socket) {
+    uint32_t capacity = get_ring_capacity();
+    size_t ring_size = get_ring_segment_size(capacity);
+    size_t segment_size = ring_size * 2;
+
+    int fds[SHM_FD_COUNT] = {-1, -1, -1, -1, -1};
+    fds[0] = memfd_create("acid-rpc-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    // 固定共享内存的大小, 服务端映射之后不会因为被截断而在访问时收到SIGBUS
+    if (fds[0] == -1 || ftruncate(fds[0], static_cast<off_t>(segment_size)) != 0 ||
+        fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        LOG_ERROR(logger) << "create shared memory fail errno=" << errno
+                          << " errstr=" << strerror(errno);
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+    for (int i = 1; i < SHM_FD_COUNT; ++i) {
+        fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fds[i] == -1) {
+            LOG_ERROR(logger) << "eventfd fail errno=" << errno << " errstr=" << strerror(errno);
+            close_fds(fds, SHM_FD_COUNT);
+            return nullptr;
+        }
+    }
+
+    void* segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (segment == MAP_FAILED) {
+        LOG_ERROR(logger) << "mmap fail errno=" << errno << " errstr=" << strerror(errno);
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+    ShmRing::create(segment, capacity);
+    ShmRing::create(static_cast<char*>(segment) + ring_size, capacity);
+
+    // 通过SCM_RIGHTS把共享内存和eventfd传给服务端
+    ShmHandshake handshake {ShmHandshake::MAGIC, capacity};
+    iovec iov {&handshake, sizeof(handshake)};
+    char control[CMSG_SPACE(sizeof(fds))] {};
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // 等待服务端映射成功的确认
+    char ack = 0;
+    if (sendmsg(socket->get_socketfd(), &msg, 0) != sizeof(handshake) ||
+        socket->recv(&ack, 1) != 1 || ack != 1) {
+        LOG_ERROR(logger) << "shared memory handshake fail errno=" << errno
+                          << " errstr=" << strerror(errno);
+        munmap(segment, segment_size);
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+
+    // 映射建立之后不再需要共享内存的fd
+    close_fds(fds, 1);
+    ShmSession::ptr session(new ShmSession(socket, segment, segment_size, capacity, true, fds + 1));
+    watch(session);
+    return session;
+}
+
+ShmSession::ptr ShmSession::accept(Socket::ptr socket) {
+    // 抽象命名空间的地址没有文件权限保护, 只接受同一用户或root的进程
+    ucred cred {};
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(socket->get_socketfd(), SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 ||
+        (cred.uid != geteuid() && cred.uid != 0)) {
+        LOG_ERROR(logger) << "reject shared memory peer pid=" << cred.pid << " uid=" << cred.uid;
+        return nullptr;
+    }
+
+    ShmHandshake handshake {};
+    iovec iov {&handshake, sizeof(handshake)};
+    int fds[SHM_FD_COUNT] = {-1, -1, -1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] {};
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t ret = recvmsg(socket->get_socketfd(), &msg, MSG_CMSG_CLOEXEC);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (ret != sizeof(handshake) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        LOG_ERROR(logger) << "receive shared memory fail, ret=" << ret << " errno=" << errno
+                          << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    size_t fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), std::min(fd_count, static_cast<size_t>(SHM_FD_COUNT)) * sizeof(int));
+    if (fd_count != SHM_FD_COUNT || handshake.magic != ShmHandshake::MAGIC ||
+        !std::has_single_bit(handshake.capacity)) {
+        LOG_ERROR(logger) << "invalid shared memory handshake, fd count=" << fd_count;
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+
+    // 共享内存的大小由客户端决定, 需要校验能否容纳两个ring, 并且已经禁止截断
+    struct stat st {};
+    size_t segment_size = 0;
+    if (fstat(fds[0], &st) == 0) {
+        segment_size = static_cast<size_t>(st.st_size);
+    }
+    int seals = fcntl(fds[0], F_GET_SEALS);
+    if (seals == -1 || !(seals & F_SEAL_SHRINK) ||
+        segment_size < get_ring_segment_size(handshake.capacity) * 2) {
+        LOG_ERROR(logger) << "invalid shared memory, size=" << segment_size << " seals=" << seals;
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+
+    void* segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close_fds(fds, 1);
+    if (segment == MAP_FAILED) {
+        LOG_ERROR(logger) << "mmap fail errno=" << errno << " errstr=" << strerror(errno);
+        close_fds(fds, SHM_FD_COUNT);
+        return nullptr;
+    }
+
+    // ring的容量以握手时校验过的值为准, 不再读取共享内存中的头部
+    ShmSession::ptr session(
+        new ShmSession(socket, segment, segment_size, handshake.capacity, false, fds + 1));
+
+    char ack = 1;
+    if (socket->send(&ack, 1) != 1) {
+        return nullptr;
+    }
+    watch(session);
+    return session;
+}
+
+ShmSession::ShmSession(Socket::ptr socket, void* segment, size_t segment_size, uint32_t capacity,
+                       bool client, const int efds[4])
+    : RpcSession(socket)
+    , m_segment(segment)
+    , m_segment_size(segment_size) {
+    ShmRing c2s(segment, capacity);
+    ShmRing s2c(static_cast<char*>(segment) + get_ring_segment_size(capacity), capacity);
+    if (client) {
+        m_send_ring = c2s;
+        m_recv_ring = s2c;
+        m_send_data_efd = efds[0];
+        m_send_space_efd = efds[1];
+        m_recv_data_efd = efds[2];
+        m_recv_space_efd = efds[3];
+    }
+    else {
+        m_send_ring = s2c;
+        m_recv_ring = c2s;
+        m_recv_data_efd = efds[0];
+        m_recv_space_efd = efds[1];
+        m_send_data_efd = efds[2];
+        m_send_space_efd = efds[3];
+    }
+}
+
+ShmSession::~ShmSession() {
+    if (m_iomanager) {
+        // 不再有协程等待, 清理可能残留的监听事件, 避免fd被复用时重复添加
+        m_iomanager->del_event(m_recv_data_efd, IOManager::READ);
+        m_iomanager->del_event(m_send_space_efd, IOManager::READ);
+    }
+    ::close(m_send_data_efd);
+    ::close(m_send_space_efd);
+    ::close(m_recv_data_efd);
+    ::close(m_recv_space_efd);
+    munmap(m_segment, m_segment_size);
+}
+
+size_t ShmSession::read(void* buffer, size_t length) {
+    iovec iov {buffer, length};
+    return recv(&iov, 1);
+}
+
+size_t ShmSession::read(ByteArray::ptr byte_array, size_t length) {
+    std::vector<iovec> iovs;
+    byte_array->get_write_buffers(iovs, length);
+    size_t ret = recv(iovs.data(), iovs.size());
+    if (ret != static_cast<size_t>(-1) && ret > 0) {
+        byte_array->set_position(byte_array->get_position() + ret);
+    }
+    return ret;
+}
+
+size_t ShmSession::write(const void* buffer, size_t length) {
+    iovec iov {const_cast<void*>(buffer), length};
+    return send(&iov, 1);
+}
+
+size_t ShmSession::write(ByteArray::ptr byte_array, size_t length) {
+    std::vector<iovec> iovs;
+    byte_array->get_read_buffers(iovs, length);
+    size_t ret = send(iovs.data(), iovs.size());
+    if (ret != static_cast<size_t>(-1) && ret > 0) {
+        byte_array->set_position(byte_array->get_position() + ret);
+    }
+    return ret;
+}
+
+void ShmSession::close() {
+    if (m_closed.exchange(true)) {
+        return;
+    }
+    // 只唤醒对端, 本端的协程由调用者负责, 与tcp连接关闭时的行为一致
+    m_send_ring.set_closed();
+    m_recv_ring.set_closed();
+    eventfd_write(m_send_data_efd, 1);
+    eventfd_write(m_recv_space_efd, 1);
+    SocketStream::close();
+}
+
+size_t ShmSession::recv(const iovec* iovs, size_t count) {
+    while (true) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t ret = m_recv_ring.read(iovs[i].iov_base, iovs[i].iov_len);
+            total += ret;
+            if (ret < iovs[i].iov_len) {
+                break;
+            }
+        }
+        if (total > 0) {
+            // 腾出了空间, 对端正在等待时唤醒它
+            if (m_recv_ring.take_writer_waiting()) {
+                eventfd_write(m_recv_space_efd, 1);
+            }
+            return total;
+        }
+
+        // 对端关闭前写入的数据读完之后才返回关闭
+        if (m_closed || m_recv_ring.is_closed()) {
+            return 0;
+        }
+        m_recv_ring.set_reader_waiting();
+        if (m_recv_ring.readable() || m_recv_ring.is_closed()) {
+            continue;
+        }
+        if (!wait_event(m_recv_data_efd)) {
+            return -1;
+        }
+    }
+}
+
+size_t ShmSession::send(const iovec* iovs, size_t count) {
+    while (true) {
+        if (m_closed || m_send_ring.is_closed()) {
+            return -1;
+        }
+
+        size_t total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            size_t ret = m_send_ring.write(iovs[i].iov_base, iovs[i].iov_len);
+            total += ret;
+            if (ret < iovs[i].iov_len) {
+                break;
+            }
+        }
+        if (total > 0) {
+            if (m_send_ring.take_reader_waiting()) {
+                eventfd_write(m_send_data_efd, 1);
+            }
+            return total;
+        }
+
+        m_send_ring.set_writer_waiting();
+        if (m_send_ring.writable() || m_send_ring.is_closed()) {
+            continue;
+        }
+        if (!wait_event(m_send_space_efd)) {
+            return -1;
+        }
+    }
+}
+
+bool ShmSession::wait_event(int efd) {
+    eventfd_t value;
+    while (eventfd_read(efd, &value) != 0) {
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            return false;
+        }
+
+        IOManager* iom = IOManager::get_this();
+        if (!iom) {
+            // 不在协程调度器中, 直接阻塞线程等待
+            pollfd pfd {efd, POLLIN, 0};
+            ::poll(&pfd, 1, -1);
+            continue;
+        }
+        m_iomanager = iom;
+        if (iom->add_event(efd, IOManager::READ)) {
+            return false;
+        }
+        Fiber::get_this()->yield();
+    }
+    return true;
+}
+
+void ShmSession::shutdown() {
+    if (m_closed.exchange(true)) {
+        return;
+    }
+    m_send_ring.set_closed();
+    m_recv_ring.set_closed();
+    // 对端已经不在, 唤醒本端所有等待的协程
+    eventfd_write(m_send_data_efd, 1);
+    eventfd_write(m_send_space_efd, 1);
+    eventfd_write(m_recv_data_efd, 1);
+    eventfd_write(m_recv_space_efd, 1);
+    SocketStream::close();
+}
+
+void ShmSession::watch(ShmSession::ptr session) {
+    IOManager* iom = IOManager::get_this();
+    if (!iom) {
+        return;
+    }
+    std::weak_ptr<ShmSession> weak = session;
+    Socket::ptr socket = session->get_socket();
+    iom->schedule([weak, socket]() {
+        // 握手之后对端不会再通过socket发送数据, recv返回说明对端关闭或者socket被关闭
+        char buffer;
+        while (socket->is_connected()) {
+            ssize_t ret = socket->recv(&buffer, 1);
+            if (ret < 0 && (errno == ETIMEDOUT || errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+            break;
+        }
+        ShmSession::ptr session = weak.lock();
+        if (session) {
+            session->shutdown();
+        }
+    });
+}
+
+}  // namespace acid::rpc
@@ -0,0 +1,113 @@
+/**
+ * @file shm_session.h
+ * @author kbjcx (lulu5v@163.com)
+ * @brief 同主机进程间基于共享内存的rpc连接
+ * @version 0.1
+ * @date 2023-08-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef ACID_RPC_SHM_SESSION_H
+#define ACID_RPC_SHM_SESSION_H
+
+#include "acid/common/iomanager.h"
+#include "rpc_session.h"
+#include "shm_ring.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace acid::rpc {
+
+/**
+ * @brief 共享内存rpc连接
+ * 客户端通过unix socket连接服务端后, 创建一块memfd共享内存和四个eventfd, 用SCM_RIGHTS传给服务端。
+ * 共享内存中是两个方向的ShmRing, 报文格式与tcp连接完全相同, 只是读写不再经过内核协议栈;
+ * eventfd只在对端等待时才写入, 由IOManager监听, 等待数据的协程让出执行权而不是阻塞线程。
+ * 握手之后unix socket只用于感知对端进程退出
+ */
+class ShmSession : public RpcSession {
+public:
+    using ptr = std::shared_ptr<ShmSession>;
+
+    /**
+     * @brief 监听tcp端口port的服务端对应的共享内存握手地址, 位于unix socket抽象命名空间
+     */
+    static Address::ptr get_address(uint32_t port);
+
+    /**
+     * @brief 客户端在已连接的unix socket上创建共享内存并完成握手
+     *
+     * @param socket 连接到get_address()的unix socket
+     * @return ShmSession::ptr 失败返回nullptr
+     */
+    static ShmSession::ptr connect(Socket::ptr socket);
+
+    /**
+     * @brief 服务端在accept得到的unix socket上接收共享内存并完成握手
+     *
+     * @return ShmSession::ptr 失败返回nullptr
+     */
+    static ShmSession::ptr accept(Socket::ptr socket);
+
+    ~ShmSession() override;
+
+    size_t read(void* buffer, size_t length) override;
+
+    size_t read(ByteArray::ptr byte_array, size_t length) override;
+
+    size_t write(const void* buffer, size_t length) override;
+
+    size_t write(ByteArray::ptr byte_array, size_t length) override;
+
+    /**
+     * @brief 关闭连接, 唤醒对端正在等待的协程
+     */
+    void close() override;
+
+private:
+    /**
+     * @brief 构造函数
+     *
+     * @param segment 映射的共享内存
+     * @param segment_size 共享内存大小, 依次是客户端发往服务端的ring和相反方向的ring
+     * @param capacity 握手确定的每个ring的数据区大小
+     * @param client 是否是客户端
+     * @param efds 客户端到服务端的数据/空间通知, 服务端到客户端的数据/空间通知
+     */
+    ShmSession(Socket::ptr socket, void* segment, size_t segment_size, uint32_t capacity,
+               bool client, const int efds[4]);
+
+    // 从接收ring读取到iovs, 没有数据时等待
+    size_t recv(const iovec* iovs, size_t count);
+
+    // 把iovs写入发送ring, 没有空间时等待
+    size_t send(const iovec* iovs, size_t count);
+
+    // 在eventfd上等待通知
+    bool wait_event(int efd);
+
+    // 对端进程退出或者socket被关闭, 唤醒本端等待的协程
+    void shutdown();
+
+    // 开启协程等待unix socket关闭, 只持有session的弱引用
+    static void watch(ShmSession::ptr session);
+
+private:
+    void* m_segment;
+    size_t m_segment_size;
+    ShmRing m_send_ring;
+    ShmRing m_recv_ring;
+    int m_send_data_efd;   // 写入数据后通知对端
+    int m_send_space_efd;  // 等待对端读取后腾出空间
+    int m_recv_data_efd;   // 等待对端写入数据
+    int m_recv_space_efd;  // 读取数据后通知对端
+    IOManager* m_iomanager = nullptr;  // 监听eventfd的调度器
+    std::atomic<bool> m_closed {false};
+};
+
+}  // namespace acid::rpc
+
+#endif
@@ -0,0 +1,200 @@
+/**
+ * Channel吞吐测试
+ * ping-pong: 两个协程通过两个容量为1的channel来回传递, 每次传递都要挂起和唤醒对方;
+ * fan-in: 多个生产者协程向同一个channel发送, 一个消费者接收, 分别测试逐个和批量收发;
+ * 最后检查select, try和超时接口以及关闭后的行为
+ *
+ * 用法: channel_bench [线程数] [ping-pong次数] [每个生产者发送的数量]
+ */
+#include "acid/acid.h"
+#include "acid/common/channel.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using acid::test::check;
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void bench_ping_pong(int threads, int rounds) {
+    acid::Channel<int> ping(1);
+    acid::Channel<int> pong(1);
+    int64_t sum = 0;
+    double seconds = 0;
+    {
+        acid::IOManager iom(threads, false, "bench");
+        iom.schedule([ping, pong, rounds]() mutable {
+            int value = 0;
+            while (ping.pop(value) && value < rounds) {
+                pong.push(value + 1);
+            }
+        });
+        iom.schedule([ping, pong, rounds, &sum, &seconds]() mutable {
+            auto start = Clock::now();
+            int value = 0;
+            ping.push(0);
+            while (pong.pop(value)) {
+                sum += value;
+                ping.push(value);
+                if (value == rounds) {
+                    break;
+                }
+            }
+            seconds = seconds_since(start);
+        });
+    }
+    std::cout << "ping-pong threads: " << threads << " " << static_cast<int64_t>(rounds / seconds)
+              << " round trips/s" << std::endl;
+    check(sum == static_cast<int64_t>(rounds) * (rounds + 1) / 2, "ping-pong values in order");
+}
+
+static void bench_fan_in(int threads, int producers, int count, size_t batch) {
+    acid::Channel<int> channel(1024);
+    int64_t sum = 0;
+    int64_t received = 0;
+    double seconds = 0;
+    {
+        acid::IOManager iom(threads, false, "bench");
+        auto start = Clock::now();
+        for (int p = 0; p < producers; ++p) {
+            iom.schedule([channel, count, batch]() mutable {
+                std::vector<int> items(batch);
+                for (int i = 0; i < count; i += batch) {
+                    size_t n = std::min<size_t>(batch, count - i);
+                    for (size_t j = 0; j < n; ++j) {
+                        items[j] = i + j + 1;
+                    }
+                    if (batch == 1) {
+                        channel.push(items[0]);
+                    }
+                    else {
+                        channel.push_n(items.data(), n);
+                    }
+                }
+            });
+        }
+        iom.schedule([channel, producers, count, batch, start, &sum, &received, &seconds]() mutable {
+            std::vector<int> items(batch);
+            int64_t total = static_cast<int64_t>(producers) * count;
+            while (received < total) {
+                size_t n = 1;
+                if (batch == 1) {
+                    channel.pop(items[0]);
+                }
+                else {
+                    n = channel.pop_n(items.data(), batch);
+                }
+                for (size_t j = 0; j < n; ++j) {
+                    sum += items[j];
+                }
+                received += n;
+            }
+            seconds = seconds_since(start);
+        });
+    }
+    int64_t total = static_cast<int64_t>(producers) * count;
+    std::cout << "fan-in threads: " << threads << " producers: " << producers << " batch: " << batch
+              << " " << static_cast<int64_t>(total / seconds) << " msgs/s" << std::endl;
+    check(received == total && sum == static_cast<int64_t>(producers) * count * (count + 1) / 2,
+          "fan-in receives every message once");
+}
+
+static void test_select(int threads) {
+    std::vector<acid::Channel<int>> channels {acid::Channel<int>(4), acid::Channel<int>(4),
+                                              acid::Channel<int>(4)};
+    const int count = 10000;
+    std::vector<int> received(channels.size(), 0);
+    int64_t sum = 0;
+    {
+        acid::IOManager iom(threads, false, "bench");
+        for (size_t c = 0; c < channels.size(); ++c) {
+            iom.schedule([channel = channels[c], c, count]() mutable {
+                for (int i = 1; i <= count; ++i) {
+                    channel.push(static_cast<int>(c) * count + i);
+                }
+                // 等缓冲区里的数据被读走再关闭, 关闭会丢弃剩余的数据
+                while (!channel.empty()) {
+                    usleep(100);
+                }
+                channel.close();
+            });
+        }
+        iom.schedule([&channels, &received, &sum] {
+            int value = 0;
+            int index;
+            while ((index = acid::Channel<int>::select(channels, value)) >= 0) {
+                ++received[index];
+                sum += value;
+            }
+        });
+    }
+    bool ok = true;
+    int64_t expected = 0;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        ok &= received[c] == count;
+        expected += static_cast<int64_t>(c) * count * count + static_cast<int64_t>(count) * (count + 1) / 2;
+    }
+    check(ok && sum == expected, "select reads from every channel until all are closed");
+}
+
+static void test_try_and_timeout() {
+    acid::IOManager iom(1, false, "bench");
+    iom.schedule([] {
+        acid::Channel<int> channel(2);
+        int value = 0;
+        check(!channel.try_pop(value), "try_pop on empty channel fails");
+        check(channel.try_push(1) && channel.try_push(2) && !channel.try_push(3),
+              "try_push stops at capacity");
+        auto start = Clock::now();
+        check(!channel.push_for(3, 50) && seconds_since(start) >= 0.045,
+              "push_for times out on a full channel");
+        check(channel.pop_for(value, 50) && value == 1, "pop_for returns buffered data");
+        check(channel.pop(value) && value == 2, "pop keeps fifo order");
+        start = Clock::now();
+        check(!channel.pop_for(value, 50) && seconds_since(start) >= 0.045,
+              "pop_for times out on an empty channel");
+
+        // 超时之前被另一个协程唤醒
+        acid::IOManager::get_this()->schedule([channel]() mutable {
+            usleep(10 * 1000);
+            channel.push(7);
+        });
+        start = Clock::now();
+        check(channel.pop_for(value, 1000) && value == 7 && seconds_since(start) < 0.5,
+              "pop_for wakes up when data arrives");
+
+        acid::Channel<int> closed(1);
+        acid::IOManager::get_this()->schedule([closed]() mutable {
+            usleep(10 * 1000);
+            closed.close();
+        });
+        check(!closed.pop(value) && !closed && !closed.push(1), "close wakes waiters and rejects data");
+    });
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200000;
+    int count = argc > 3 ? atoi(argv[3]) : 100000;
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    bench_ping_pong(1, rounds);
+    bench_ping_pong(threads, rounds);
+    bench_fan_in(1, 8, count, 1);
+    bench_fan_in(threads, 8, count, 1);
+    bench_fan_in(1, 8, count, 64);
+    bench_fan_in(threads, 8, count, 64);
+    test_select(threads);
+    test_try_and_timeout();
+    return 0;
+}
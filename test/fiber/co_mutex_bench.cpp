@@ -0,0 +1,161 @@
+/**
+ * 协程锁竞争测试
+ * 多个线程上的大量协程竞争同一把CoMutex, 每隔几次在持有锁时让出协程, 让其它协程进入等待队列,
+ * 统计每秒加解锁次数并检查计数没有丢失; CoSemaphore只允许两个协程同时持有, 测试条件变量的唤醒;
+ * CoRWMutex每8次操作中有1次写, 检查写者独占且读者之间可以并发
+ *
+ * 用法: co_mutex_bench [线程数] [每个线程的协程数] [每个协程的加锁次数]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using acid::test::check;
+
+// 重新加入调度后让出, 模拟持有锁时的IO等待
+static void yield_to_scheduler() {
+    acid::IOManager::get_this()->schedule(acid::Fiber::get_this());
+    acid::Fiber::get_this()->yield();
+}
+
+// 计时到最后一个协程结束为止, 不包括调度器停止时空闲线程等待epoll超时的时间
+template <class F>
+static double run(int threads, int fibers, F&& f) {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    clock::time_point end;
+    std::atomic<int> running {threads * fibers};
+    {
+        acid::IOManager iom(threads, false, "bench");
+        for (int i = 0; i < threads * fibers; ++i) {
+            iom.schedule([&, i] {
+                f(i);
+                if (running.fetch_sub(1) == 1) {
+                    end = clock::now();
+                }
+            });
+        }
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void bench_mutex(int threads, int fibers, int ops) {
+    acid::CoMutex mutex;
+    int64_t counter = 0;
+    std::atomic<int> inside {0};
+    std::atomic<bool> exclusive {true};
+    double seconds = run(threads, fibers, [&](int) {
+        for (int i = 0; i < ops; ++i) {
+            acid::CoMutex::Lock lock(mutex);
+            if (inside.fetch_add(1) != 0) {
+                exclusive = false;
+            }
+            ++counter;
+            if (i % 16 == 0) {
+                yield_to_scheduler();
+            }
+            inside.fetch_sub(1);
+        }
+    });
+    int64_t total = static_cast<int64_t>(threads) * fibers * ops;
+    std::cout << "mutex threads: " << threads << " fibers: " << threads * fibers << " "
+              << static_cast<int64_t>(total / seconds) << " locks/s" << std::endl;
+    check(exclusive && counter == total, "mutex exclusive and no lost updates");
+}
+
+static void bench_semaphore(int threads, int fibers, int ops) {
+    // 最多2个协程同时持有, 其它协程在条件变量上等待
+    const int slots = 2;
+    acid::CoSemaphore semaphore(slots);
+    std::atomic<int> inside {0};
+    std::atomic<bool> bounded {true};
+    std::atomic<int64_t> acquired {0};
+    double seconds = run(threads, fibers, [&](int) {
+        for (int i = 0; i < ops; ++i) {
+            semaphore.wait();
+            if (inside.fetch_add(1) >= slots) {
+                bounded = false;
+            }
+            acquired.fetch_add(1, std::memory_order_relaxed);
+            if (i % 4 == 0) {
+                yield_to_scheduler();
+            }
+            inside.fetch_sub(1);
+            semaphore.notify();
+        }
+    });
+    int64_t total = static_cast<int64_t>(threads) * fibers * ops;
+    std::cout << "semaphore threads: " << threads << " fibers: " << threads * fibers << " "
+              << static_cast<int64_t>(total / seconds) << " acquires/s" << std::endl;
+    check(bounded && acquired == total, "semaphore bounds holders and wakes waiters");
+}
+
+static void bench_rwmutex(int threads, int fibers, int ops) {
+    acid::CoRWMutex mutex;
+    std::atomic<int> readers {0};
+    std::atomic<int> writers {0};
+    std::atomic<int> max_readers {0};
+    std::atomic<bool> exclusive {true};
+    int64_t written = 0;
+    double seconds = run(threads, fibers, [&](int id) {
+        for (int i = 0; i < ops; ++i) {
+            if ((id + i) % 8 == 0) {
+                acid::CoRWMutex::WriteLock lock(mutex);
+                if (writers.fetch_add(1) != 0 || readers.load() != 0) {
+                    exclusive = false;
+                }
+                ++written;
+                writers.fetch_sub(1);
+            }
+            else {
+                acid::CoRWMutex::ReadLock lock(mutex);
+                int n = readers.fetch_add(1) + 1;
+                if (writers.load() != 0) {
+                    exclusive = false;
+                }
+                int max = max_readers.load();
+                while (n > max && !max_readers.compare_exchange_weak(max, n)) {
+                }
+                if (i % 16 == 1) {
+                    yield_to_scheduler();
+                }
+                readers.fetch_sub(1);
+            }
+        }
+    });
+    int64_t total = static_cast<int64_t>(threads) * fibers * ops;
+    int64_t expected = 0;
+    for (int id = 0; id < threads * fibers; ++id) {
+        for (int i = 0; i < ops; ++i) {
+            expected += (id + i) % 8 == 0;
+        }
+    }
+    std::cout << "rwmutex threads: " << threads << " fibers: " << threads * fibers << " "
+              << static_cast<int64_t>(total / seconds) << " locks/s, max readers "
+              << max_readers.load() << std::endl;
+    check(exclusive && written == expected, "rwmutex writers exclusive");
+    check(max_readers.load() > 1, "rwmutex readers shared");
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int fibers = argc > 2 ? atoi(argv[2]) : 64;
+    int ops = argc > 3 ? atoi(argv[3]) : 2000;
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    bench_mutex(1, fibers, ops);
+    bench_mutex(threads, fibers, ops);
+    bench_semaphore(1, fibers, ops);
+    bench_semaphore(threads, fibers, ops);
+    bench_rwmutex(1, fibers, ops);
+    bench_rwmutex(threads, fibers, ops);
+    return 0;
+}
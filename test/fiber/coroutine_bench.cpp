@@ -0,0 +1,186 @@
+/**
+ * C++20协程与Fiber的开销对比
+ * 1. 同时挂起N个等待者(都在等同一个channel), 统计每个等待者占用的堆内存和常驻内存
+ * 2. 一个任务反复让出并重新调度自己, 统计每次切换的耗时
+ * 3. 两个任务通过一对容量为1的channel来回传递数据, 统计每秒往返次数
+ *
+ * 用法: coroutine_bench [挂起的等待者数量] [切换次数]
+ */
+#include "acid/acid.h"
+#include "acid/common/channel.h"
+#include "acid/common/task.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <string>
+#include <unistd.h>
+
+using acid::test::check;
+using Clock = std::chrono::steady_clock;
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Memory {
+    int64_t heap;  // malloc分配出去的字节数, 包括mmap分配的大块
+    int64_t rss;   // 常驻内存字节数
+};
+
+static Memory memory_now() {
+    struct mallinfo2 info = mallinfo2();
+    std::ifstream statm("/proc/self/statm");
+    int64_t pages = 0;
+    int64_t resident = 0;
+    statm >> pages >> resident;
+    return {static_cast<int64_t>(info.uordblks + info.hblkhd), resident * sysconf(_SC_PAGESIZE)};
+}
+
+static void report(const char* name, int waiters, const Memory& before, const Memory& after) {
+    std::cout << name << " waiters: " << waiters
+              << " heap/waiter: " << (after.heap - before.heap) / waiters
+              << "B rss/waiter: " << (after.rss - before.rss) / waiters << "B" << std::endl;
+}
+
+static acid::Task<> co_wait_for(acid::Channel<int> channel, std::atomic<int>& parked,
+                                std::atomic<int>& woken) {
+    int value = 0;
+    ++parked;
+    co_await channel.co_pop(value);
+    ++woken;
+}
+
+static void bench_memory(int waiters) {
+    acid::IOManager iom(1, false, "memory");
+    for (int coroutine = 0; coroutine < 2; ++coroutine) {
+        acid::Channel<int> channel(1);
+        std::atomic<int> parked {0};
+        std::atomic<int> woken {0};
+        Memory before = memory_now();
+        for (int i = 0; i < waiters; ++i) {
+            if (coroutine) {
+                acid::co_spawn(co_wait_for(channel, parked, woken), &iom);
+            }
+            else {
+                iom.schedule([channel, &parked, &woken]() mutable {
+                    int value = 0;
+                    ++parked;
+                    channel.pop(value);
+                    ++woken;
+                });
+            }
+        }
+        while (parked < waiters) {
+            usleep(1000);
+        }
+        usleep(10 * 1000);
+        Memory after = memory_now();
+        report(coroutine ? "coroutine" : "fiber", waiters, before, after);
+        channel.close();
+        while (woken < waiters) {
+            usleep(1000);
+        }
+        check(true, coroutine ? "coroutine waiters resume" : "fiber waiters resume");
+    }
+}
+
+static acid::Task<> co_yield_loop(int rounds, double& seconds) {
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        co_await acid::resume_on(acid::Scheduler::get_this());
+    }
+    seconds = seconds_since(start);
+}
+
+static acid::Task<> co_ping(acid::Channel<int> out, acid::Channel<int> in, int rounds, double& seconds) {
+    auto start = Clock::now();
+    int value = 0;
+    for (int i = 0; i < rounds; ++i) {
+        co_await out.co_push(i);
+        co_await in.co_pop(value);
+    }
+    seconds = seconds_since(start);
+    out.close();
+}
+
+static acid::Task<> co_pong(acid::Channel<int> in, acid::Channel<int> out) {
+    int value = 0;
+    while (co_await in.co_pop(value)) {
+        co_await out.co_push(value);
+    }
+}
+
+static void bench_switch(int rounds) {
+    double fiber_seconds = 0;
+    double coroutine_seconds = 0;
+    {
+        acid::IOManager iom(1, false, "switch");
+        iom.schedule([rounds, &fiber_seconds] {
+            auto start = Clock::now();
+            for (int i = 0; i < rounds; ++i) {
+                acid::Scheduler::get_this()->schedule(acid::Fiber::get_this());
+                acid::Fiber::get_this()->yield();
+            }
+            fiber_seconds = seconds_since(start);
+        });
+    }
+    {
+        acid::IOManager iom(1, false, "switch");
+        acid::co_spawn(co_yield_loop(rounds, coroutine_seconds), &iom);
+    }
+    std::cout << "yield+reschedule fiber: " << static_cast<int64_t>(fiber_seconds * 1e9 / rounds)
+              << "ns coroutine: " << static_cast<int64_t>(coroutine_seconds * 1e9 / rounds) << "ns"
+              << std::endl;
+
+    int round_trips = rounds / 10;
+    fiber_seconds = 0;
+    coroutine_seconds = 0;
+    {
+        acid::IOManager iom(1, false, "pingpong");
+        acid::Channel<int> ping(1);
+        acid::Channel<int> pong(1);
+        iom.schedule([ping, pong, round_trips, &fiber_seconds]() mutable {
+            auto start = Clock::now();
+            int value = 0;
+            for (int i = 0; i < round_trips; ++i) {
+                ping << i;
+                pong >> value;
+            }
+            fiber_seconds = seconds_since(start);
+            ping.close();
+        });
+        iom.schedule([ping, pong]() mutable {
+            int value = 0;
+            while (ping.pop(value)) {
+                pong << value;
+            }
+        });
+    }
+    {
+        acid::IOManager iom(1, false, "pingpong");
+        acid::Channel<int> ping(1);
+        acid::Channel<int> pong(1);
+        acid::co_spawn(co_ping(ping, pong, round_trips, coroutine_seconds), &iom);
+        acid::co_spawn(co_pong(ping, pong), &iom);
+    }
+    std::cout << "channel ping-pong fiber: " << static_cast<int64_t>(round_trips / fiber_seconds)
+              << " round trips/s coroutine: " << static_cast<int64_t>(round_trips / coroutine_seconds)
+              << " round trips/s" << std::endl;
+    check(fiber_seconds > 0 && coroutine_seconds > 0, "both ping-pong loops finish");
+}
+
+int main(int argc, char** argv) {
+    int waiters = argc > 1 ? atoi(argv[1]) : 10000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 1000000;
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    bench_memory(waiters);
+    bench_switch(rounds);
+    return 0;
+}
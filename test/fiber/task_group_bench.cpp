@@ -0,0 +1,113 @@
+/**
+ * 任务组扇出测试
+ * 模拟scatter-gather请求: 每个请求访问若干个后端分片, 每个分片耗时固定(用hook后的usleep模拟IO),
+ * 对比顺序访问和用TaskGroup并发访问时的单个请求延迟; 再用空任务测量spawn和join本身的开销
+ *
+ * 用法: task_group_bench [线程数] [分片数] [每个分片耗时us]
+ */
+#include "acid/acid.h"
+#include "acid/common/task_group.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using acid::test::check;
+using Clock = std::chrono::steady_clock;
+
+static double us_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static acid::FiberLocal<uint64_t> s_request_id(true);
+
+static int query_shard(int shard, int cost_us) {
+    usleep(cost_us);
+    return shard + static_cast<int>(*s_request_id.get());
+}
+
+static void bench_scatter_gather(int threads, int shards, int cost_us) {
+    const int requests = 20;
+    double sequential_us = 0;
+    double fan_out_us = 0;
+    bool ok = true;
+    {
+        acid::IOManager iom(threads, false, "bench");
+        iom.schedule([&] {
+            for (int r = 0; r < requests; ++r) {
+                s_request_id.set(r);
+                int expected = shards * r + shards * (shards - 1) / 2;
+
+                auto start = Clock::now();
+                int sum = 0;
+                for (int s = 0; s < shards; ++s) {
+                    sum += query_shard(s, cost_us);
+                }
+                sequential_us += us_since(start);
+                ok &= sum == expected;
+
+                start = Clock::now();
+                std::vector<int> results(shards);
+                acid::TaskGroup group;
+                for (int s = 0; s < shards; ++s) {
+                    group.spawn([&results, s, cost_us] { results[s] = query_shard(s, cost_us); });
+                }
+                group.wait();
+                fan_out_us += us_since(start);
+                sum = 0;
+                for (int value : results) {
+                    sum += value;
+                }
+                ok &= sum == expected;
+            }
+        });
+    }
+    std::cout << "scatter-gather threads: " << threads << " shards: " << shards
+              << " cost: " << cost_us << "us sequential: " << static_cast<int64_t>(sequential_us / requests)
+              << "us fan-out: " << static_cast<int64_t>(fan_out_us / requests) << "us" << std::endl;
+    check(ok, "fan-out gathers the same results with the request id inherited");
+    check(fan_out_us * 2 < sequential_us, "fan-out overlaps the shard waits");
+}
+
+static void bench_spawn_join(int threads) {
+    const int rounds = 2000;
+    const int width = 16;
+    std::atomic<int64_t> done {0};
+    double seconds = 0;
+    {
+        acid::IOManager iom(threads, false, "bench");
+        iom.schedule([&] {
+            auto start = Clock::now();
+            for (int r = 0; r < rounds; ++r) {
+                acid::TaskGroup group;
+                for (int i = 0; i < width; ++i) {
+                    group.spawn([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+                }
+                group.wait();
+            }
+            seconds = us_since(start) / 1e6;
+        });
+    }
+    std::cout << "spawn+join threads: " << threads << " width: " << width << " "
+              << static_cast<int64_t>(rounds * width / seconds) << " tasks/s" << std::endl;
+    check(done == static_cast<int64_t>(rounds) * width, "every spawned task runs once");
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int shards = argc > 2 ? atoi(argv[2]) : 8;
+    int cost_us = argc > 3 ? atoi(argv[3]) : 2000;
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    bench_scatter_gather(1, shards, cost_us);
+    bench_scatter_gather(threads, shards, cost_us);
+    bench_spawn_join(1);
+    bench_spawn_join(threads);
+    return 0;
+}
@@ -0,0 +1,230 @@
+/**
+ * C++20协程测试
+ * 检查Task的返回值和异常传递, 在Fiber和普通线程中sync_wait, co_sleep, socket读写/accept/connect及超时,
+ * C++20协程与Fiber之间通过Channel和CoMutex交互, 以及挂起在Channel上的协程不会让调度器提前退出
+ */
+#include "acid/acid.h"
+#include "acid/common/channel.h"
+#include "acid/common/task.h"
+#include "test/test_util.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <iostream>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using acid::test::check;
+
+static acid::Task<int> add(int a, int b) {
+    co_await acid::resume_on(acid::Scheduler::get_this());
+    co_return a + b;
+}
+
+static acid::Task<int> sum_to(int n) {
+    int sum = 0;
+    for (int i = 1; i <= n; ++i) {
+        sum = co_await add(sum, i);
+    }
+    co_return sum;
+}
+
+static acid::Task<> fail() {
+    co_await acid::resume_on(acid::Scheduler::get_this());
+    throw std::runtime_error("boom");
+}
+
+static void test_task() {
+    acid::IOManager iom(2, false, "task");
+    iom.schedule([] {
+        check(acid::sync_wait(sum_to(100)) == 5050, "nested tasks return values from a fiber");
+        bool caught = false;
+        try {
+            acid::sync_wait(fail());
+        }
+        catch (const std::runtime_error&) {
+            caught = true;
+        }
+        check(caught, "exception propagates to sync_wait");
+    });
+    iom.schedule([] {
+        uint64_t start = acid::get_current_ms();
+        acid::sync_wait([]() -> acid::Task<> { co_await acid::IOManager::get_this()->co_sleep(50); }());
+        check(acid::get_current_ms() - start >= 45, "co_sleep waits on a timer");
+    });
+    check(acid::sync_wait(sum_to(10), &iom) == 55, "plain thread waits for a task on an IOManager");
+}
+
+static void test_socket() {
+    acid::IOManager iom(2, false, "socket");
+    iom.schedule([&iom] {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        const int rounds = 1000;
+        auto echo = [](int fd) -> acid::Task<> {
+            char buf[64];
+            while (true) {
+                ssize_t n = co_await acid::IOManager::get_this()->co_read(fd, buf, sizeof(buf));
+                if (n <= 0) {
+                    break;
+                }
+                co_await acid::IOManager::get_this()->co_write(fd, buf, n);
+            }
+        };
+        acid::co_spawn(echo(fds[1]));
+        auto client = [](int fd, int rounds) -> acid::Task<int> {
+            int ok = 0;
+            for (int i = 0; i < rounds; ++i) {
+                std::string message = std::to_string(i);
+                co_await acid::IOManager::get_this()->co_write(fd, message.data(), message.size());
+                char buf[64];
+                ssize_t n = co_await acid::IOManager::get_this()->co_read(fd, buf, sizeof(buf));
+                ok += n > 0 && std::string(buf, n) == message;
+            }
+            co_return ok;
+        };
+        check(acid::sync_wait(client(fds[0], rounds)) == rounds, "co_read and co_write echo");
+
+        char buf[8];
+        uint64_t start = acid::get_current_ms();
+        ssize_t n = acid::sync_wait(iom.co_read(fds[0], buf, sizeof(buf), 30));
+        check(n == -1 && errno == ETIMEDOUT && acid::get_current_ms() - start >= 25,
+              "co_read times out");
+        close(fds[0]);
+        close(fds[1]);
+
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(listener, reinterpret_cast<sockaddr*>(&addr), len);
+        listen(listener, 16);
+        getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+        std::atomic<int> accepted {-1};
+        acid::co_spawn([](int listener, std::atomic<int>& accepted) -> acid::Task<> {
+            accepted = co_await acid::IOManager::get_this()->co_accept(listener);
+        }(listener, accepted));
+        int conn = socket(AF_INET, SOCK_STREAM, 0);
+        int ret = acid::sync_wait(iom.co_connect(conn, reinterpret_cast<sockaddr*>(&addr), len, 1000));
+        acid::sync_wait(iom.co_write(conn, "hi", 2));
+        while (accepted < 0) {
+            usleep(1000);
+        }
+        n = acid::sync_wait(iom.co_read(accepted, buf, sizeof(buf), 1000));
+        check(ret == 0 && n == 2 && std::string(buf, 2) == "hi", "co_accept and co_connect");
+        close(conn);
+        close(accepted);
+        close(listener);
+    });
+}
+
+static void test_channel() {
+    std::atomic<int> coroutine_sum {0};
+    std::atomic<int> fiber_sum {0};
+    {
+        acid::IOManager iom(2, false, "channel");
+        acid::Channel<int> to_coroutine(4);
+        acid::Channel<int> to_fiber(4);
+        // 协程读Fiber写的数据, 再写给另一个Fiber
+        acid::co_spawn(
+            [](acid::Channel<int> in, acid::Channel<int> out, std::atomic<int>& sum) -> acid::Task<> {
+                // 关闭channel会丢弃缓冲区中的数据, 用0表示结束
+                int value = 0;
+                while (co_await in.co_pop(value) && value) {
+                    sum += value;
+                    co_await out.co_push(value);
+                }
+                co_await out.co_push(0);
+            }(to_coroutine, to_fiber, coroutine_sum),
+            &iom);
+        iom.schedule([to_coroutine]() mutable {
+            for (int i = 1; i <= 1000; ++i) {
+                to_coroutine << i;
+            }
+            to_coroutine << 0;
+        });
+        iom.schedule([to_fiber, &fiber_sum]() mutable {
+            int value = 0;
+            while (to_fiber.pop(value) && value) {
+                fiber_sum += value;
+            }
+        });
+    }
+    check(coroutine_sum == 500500 && fiber_sum == 500500, "coroutine and fibers share channels");
+
+    acid::IOManager iom(1, false, "timeout");
+    iom.schedule([] {
+        acid::Channel<int> empty(1);
+        int value = 0;
+        uint64_t start = acid::get_current_ms();
+        bool ok = acid::sync_wait(empty.co_pop(value, 30));
+        check(!ok && acid::get_current_ms() - start >= 25, "co_pop times out");
+    });
+}
+
+static void test_mutex() {
+    acid::CoMutex mutex;
+    int64_t counter = 0;
+    {
+        acid::IOManager iom(4, false, "mutex");
+        for (int i = 0; i < 8; ++i) {
+            acid::co_spawn(
+                [](acid::CoMutex& mutex, int64_t& counter) -> acid::Task<> {
+                    for (int j = 0; j < 2000; ++j) {
+                        co_await mutex.co_lock();
+                        ++counter;
+                        mutex.unlock();
+                        if (j % 64 == 0) {
+                            co_await acid::resume_on(acid::Scheduler::get_this());
+                        }
+                    }
+                }(mutex, counter),
+                &iom);
+            iom.schedule([&mutex, &counter] {
+                for (int j = 0; j < 2000; ++j) {
+                    acid::CoMutex::Lock lock(mutex);
+                    ++counter;
+                }
+            });
+        }
+    }
+    check(counter == 8 * 2000 * 2, "co_lock excludes fibers and coroutines");
+}
+
+static void test_stopping() {
+    std::atomic<int> woken {0};
+    acid::Channel<int> channel(1);
+    {
+        acid::IOManager iom(2, false, "stopping");
+        for (int i = 0; i < 100; ++i) {
+            acid::co_spawn(
+                [](acid::Channel<int> channel, std::atomic<int>& woken) -> acid::Task<> {
+                    int value = 0;
+                    co_await channel.co_pop(value);
+                    ++woken;
+                }(channel, woken),
+                &iom);
+        }
+        iom.schedule([channel]() mutable {
+            usleep(20 * 1000);
+            channel.close();
+        });
+    }
+    check(woken == 100, "scheduler waits for suspended coroutines");
+}
+
+int main() {
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    test_task();
+    test_socket();
+    test_channel();
+    test_mutex();
+    test_stopping();
+    return 0;
+}
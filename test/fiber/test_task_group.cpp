@@ -0,0 +1,138 @@
+/**
+ * 协程局部变量和任务组测试
+ * 检查协程局部变量在协程迁移线程后仍然跟着协程, 子任务只继承标记为可继承的变量;
+ * 任务组等待时不阻塞线程, 取消会传到嵌套的任务组, 取消后的spawn不再执行
+ */
+#include "acid/acid.h"
+#include "acid/common/task_group.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using acid::test::check;
+
+static acid::FiberLocal<std::string> s_trace_id(true);
+static acid::FiberLocal<int> s_private;
+
+static void test_fiber_local_migrates() {
+    std::atomic<bool> ok {true};
+    {
+        acid::IOManager iom(4, false, "local");
+        for (int i = 0; i < 64; ++i) {
+            iom.schedule([i, &ok] {
+                s_private.set(i);
+                for (int j = 0; j < 100; ++j) {
+                    // 放回调度队列后可能在另一个线程上恢复
+                    acid::IOManager::get_this()->schedule(acid::Fiber::get_this());
+                    acid::Fiber::get_this()->yield();
+                    if (!s_private.get() || *s_private.get() != i) {
+                        ok = false;
+                    }
+                }
+            });
+        }
+    }
+    check(ok, "fiber local follows the fiber across threads");
+    check(!s_private.get(), "fiber local is unset outside the fibers");
+}
+
+static void test_inherit() {
+    acid::IOManager iom(2, false, "inherit");
+    iom.schedule([] {
+        s_trace_id.set("trace-1");
+        s_private.set(42);
+        std::string child_trace;
+        bool child_private = true;
+        acid::TaskGroup group;
+        group.spawn([&] {
+            child_trace = s_trace_id.get() ? *s_trace_id : "";
+            child_private = s_private.get() != nullptr;
+            s_trace_id.set("trace-2");
+        });
+        group.wait();
+        check(child_trace == "trace-1", "child inherits inheritable locals");
+        check(!child_private, "child does not inherit other locals");
+        check(*s_trace_id == "trace-1", "child set does not change the parent");
+    });
+}
+
+static void test_wait_does_not_block_thread() {
+    // 只有一个线程, 等待如果阻塞线程, 子任务就永远没有机会执行
+    std::atomic<int> sum {0};
+    {
+        acid::IOManager iom(1, false, "join");
+        iom.schedule([&sum] {
+            acid::TaskGroup group;
+            for (int i = 1; i <= 100; ++i) {
+                group.spawn([i, &sum] {
+                    usleep(100);
+                    sum += i;
+                });
+            }
+            group.wait();
+            check(sum == 5050 && group.running() == 0, "wait returns after every child finishes");
+        });
+    }
+    check(sum == 5050, "single thread runs the children while the parent waits");
+}
+
+static void test_cancel() {
+    std::atomic<int> stopped {0};
+    std::atomic<int> started_after_cancel {0};
+    {
+        acid::IOManager iom(2, false, "cancel");
+        iom.schedule([&] {
+            acid::TaskGroup group;
+            for (int i = 0; i < 4; ++i) {
+                group.spawn([&] {
+                    // 子任务中的任务组挂在外层任务组下
+                    acid::TaskGroup nested;
+                    for (int j = 0; j < 4; ++j) {
+                        nested.spawn([&] {
+                            while (!acid::TaskGroup::cancelled()) {
+                                usleep(1000);
+                            }
+                            ++stopped;
+                        });
+                    }
+                    nested.wait();
+                });
+            }
+            usleep(20 * 1000);
+            group.cancel();
+            bool spawned = group.spawn([&] { ++started_after_cancel; });
+            group.wait();
+            check(!spawned && group.is_cancelled(), "spawn after cancel is rejected");
+        });
+    }
+    check(stopped == 16, "cancel reaches nested groups");
+    check(started_after_cancel == 0, "cancelled group starts no new task");
+}
+
+static void test_wait_from_thread() {
+    acid::IOManager iom(2, false, "thread");
+    std::atomic<int> count {0};
+    {
+        acid::TaskGroup group(&iom);
+        for (int i = 0; i < 50; ++i) {
+            group.spawn([&count] { ++count; });
+        }
+        group.wait();
+    }
+    check(count == 50, "a plain thread can wait for a group");
+}
+
+int main() {
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    test_fiber_local_migrates();
+    test_inherit();
+    test_wait_does_not_block_thread();
+    test_cancel();
+    test_wait_from_thread();
+    return 0;
+}
@@ -0,0 +1,502 @@
+/**
+ * HTTP/2(h2c)测试
+ * 先检查HPACK(RFC 7541附录C.4), 直接连接和h2c升级的请求, 流量控制以及同一连接上流的并发处理,
+ * 再对比少量连接上多路复用的HTTP/2与使用1000个协程的HTTP/1.1保持连接连接池的吞吐
+ *
+ * 用法: http2_bench [请求数量] [连接数量] [每个连接并发的流数量]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+using namespace acid::http;
+
+static const uint16_t PORT = 6035;
+static acid::Address::ptr s_address;
+
+using acid::test::check;
+
+static std::string from_hex(const std::string& hex) {
+    std::string out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back(static_cast<char>(std::stoi(hex.substr(i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+static void test_hpack() {
+    // RFC 7541 C.4, 三个使用Huffman编码并共享动态表的请求
+    const char* blocks[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    HPackDecoder decoder;
+    std::vector<std::vector<HPackHeader>> results;
+    bool ok = true;
+    for (auto block : blocks) {
+        std::string data = from_hex(block);
+        std::vector<HPackHeader> headers;
+        ok = ok && decoder.decode(data.data(), data.size(), headers);
+        results.push_back(headers);
+    }
+    ok = ok && results[0].size() == 4 && results[0][3].second == "www.example.com" &&
+         results[1].size() == 5 && results[1][4] == HPackHeader("cache-control", "no-cache") &&
+         results[2].size() == 5 && results[2][3].second == "www.example.com" &&
+         results[2][4] == HPackHeader("custom-key", "custom-value");
+    check(ok, "hpack decode");
+
+    HPackEncoder encoder;
+    HPackDecoder round_trip;
+    for (int i = 0; ok && i < 3; ++i) {
+        std::vector<HPackHeader> headers = {{":status", "200"},
+                                            {"content-type", "text/html"},
+                                            {"server", "acid/1.0"},
+                                            {"x-request", std::to_string(i)}};
+        std::string block;
+        encoder.encode(headers, block);
+        std::vector<HPackHeader> decoded;
+        ok = round_trip.decode(block.data(), block.size(), decoded) && decoded == headers;
+    }
+    check(ok, "hpack round trip");
+
+    // 一个加入动态表的条目, 后面是大量只占一个字节的索引引用, 解码后的大小要受限制
+    HPackDecoder limited(4096, 16 * 1024);
+    std::string block = std::string("\x40\x05x-big\x64", 8) + std::string(100, 'a');
+    block.append(1000, '\xbe');
+    std::vector<HPackHeader> headers;
+    check(!limited.decode(block.data(), block.size(), headers) && limited.is_too_large() &&
+              headers.size() < 1000,
+          "hpack header list size limit");
+
+    // 超过32位的索引不能截断成表中存在的索引(2^32 + 2截断后为2, 即":method: GET")
+    uint64_t index = (1ull << 32) + 2 - 127;
+    block = "\xff";
+    while (index >= 128) {
+        block.push_back(static_cast<char>((index & 0x7F) | 0x80));
+        index >>= 7;
+    }
+    block.push_back(static_cast<char>(index));
+    headers.clear();
+    check(!limited.decode(block.data(), block.size(), headers) && !limited.is_too_large(),
+          "hpack index overflow");
+}
+
+/**
+ * @brief 测试用的最简HTTP/2客户端, 一个协程读写同一个连接
+ */
+class Http2Client {
+public:
+    struct Response {
+        std::string status;
+        std::string body;
+        bool done = false;
+    };
+
+    explicit Http2Client(acid::Socket::ptr socket) : m_stream(socket) {
+    }
+
+    static std::unique_ptr<Http2Client> connect() {
+        auto socket = acid::Socket::create_tcp(s_address);
+        if (!socket->connect(s_address, 3000)) {
+            return nullptr;
+        }
+        socket->set_recv_timeout(3000);
+        return std::make_unique<Http2Client>(socket);
+    }
+
+    /**
+     * @brief 发送连接序言, 等待服务端的SETTINGS和连接的WINDOW_UPDATE
+     */
+    bool handshake() {
+        std::string out = Http2Session::PREFACE;
+        append_frame(out, Http2FrameType::SETTINGS, 0, 0, "");
+        if (!write(out)) {
+            return false;
+        }
+        while (m_send_window <= 65535 || !m_settings) {
+            if (!read_frame()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 通过Upgrade: h2c升级, 升级请求成为流1
+     */
+    bool upgrade(const std::string& path) {
+        std::string request = "GET " + path +
+                              " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+                              "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+        if (!write(request)) {
+            return false;
+        }
+        // 101响应之后紧跟HTTP/2的帧
+        while (true) {
+            std::string data(m_buffer.data(), m_buffer.size());
+            size_t pos = data.find("\r\n\r\n");
+            if (pos != std::string::npos) {
+                if (data.compare(0, 12, "HTTP/1.1 101") != 0) {
+                    return false;
+                }
+                m_buffer.erase(0, pos + 4);
+                break;
+            }
+            if (!fill()) {
+                return false;
+            }
+        }
+        m_next_stream = 3;
+        m_responses[1];
+        return handshake();
+    }
+
+    /**
+     * @brief 把请求追加到输出缓冲区, 返回流id
+     */
+    uint32_t add_request(const std::string& method, const std::string& path,
+                         const std::string& body = "") {
+        uint32_t id = m_next_stream;
+        m_next_stream += 2;
+        std::vector<HPackHeader> headers = {
+            {":method", method}, {":scheme", "http"}, {":path", path}, {":authority", "127.0.0.1"}};
+        if (!body.empty()) {
+            headers.emplace_back("content-length", std::to_string(body.size()));
+        }
+        std::string block;
+        m_encoder.encode(headers, block);
+        append_frame(m_output, Http2FrameType::HEADERS,
+                     Http2Flag::END_HEADERS | (body.empty() ? Http2Flag::END_STREAM : 0), id, block);
+        // 服务端的接收窗口足够大, 这里不等待WINDOW_UPDATE
+        for (size_t offset = 0; offset < body.size(); offset += 16384) {
+            size_t len = std::min<size_t>(16384, body.size() - offset);
+            append_frame(m_output, Http2FrameType::DATA,
+                         offset + len == body.size() ? Http2Flag::END_STREAM : 0, id,
+                         body.substr(offset, len));
+        }
+        m_responses[id];
+        return id;
+    }
+
+    bool flush() {
+        bool ok = m_output.empty() || write(m_output);
+        m_output.clear();
+        return ok;
+    }
+
+    /**
+     * @brief 读取一个帧并处理, 完成的流id写入finished
+     */
+    bool read_frame(uint32_t* finished = nullptr) {
+        while (m_buffer.size() < 9 || m_buffer.size() < 9 + frame_length()) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        uint32_t length = frame_length();
+        auto type = static_cast<Http2FrameType>(m_buffer[3]);
+        uint8_t flags = m_buffer[4];
+        uint32_t id = read_uint32(m_buffer.data() + 5) & 0x7FFFFFFF;
+        std::string payload = m_buffer.substr(9, length);
+        m_buffer.erase(0, 9 + length);
+
+        switch (type) {
+            case Http2FrameType::SETTINGS:
+                if (!(flags & Http2Flag::ACK)) {
+                    m_settings = true;
+                    append_frame(m_output, Http2FrameType::SETTINGS, Http2Flag::ACK, 0, "");
+                }
+                break;
+            case Http2FrameType::WINDOW_UPDATE:
+                if (id == 0) {
+                    m_send_window += read_uint32(payload.data());
+                }
+                break;
+            case Http2FrameType::HEADERS: {
+                std::vector<HPackHeader> headers;
+                if (!m_decoder.decode(payload.data(), payload.size(), headers)) {
+                    return false;
+                }
+                for (auto& header : headers) {
+                    if (header.first == ":status") {
+                        m_responses[id].status = header.second;
+                    }
+                }
+                break;
+            }
+            case Http2FrameType::DATA:
+                m_responses[id].body += payload;
+                // 消费了多少就归还多少窗口, 响应体超过65535字节时服务端需要等待
+                if (length > 0) {
+                    std::string increment;
+                    append_uint32(increment, length);
+                    append_frame(m_output, Http2FrameType::WINDOW_UPDATE, 0, 0, increment);
+                    if (!(flags & Http2Flag::END_STREAM)) {
+                        append_frame(m_output, Http2FrameType::WINDOW_UPDATE, 0, id, increment);
+                    }
+                }
+                break;
+            case Http2FrameType::RST_STREAM:
+            case Http2FrameType::GOAWAY:
+                return false;
+            default:
+                break;
+        }
+        if ((type == Http2FrameType::HEADERS || type == Http2FrameType::DATA) &&
+            (flags & Http2Flag::END_STREAM)) {
+            m_responses[id].done = true;
+            if (finished) {
+                *finished = id;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief 等待流id的响应
+     */
+    Response* wait(uint32_t id) {
+        while (!m_responses[id].done) {
+            if (!flush() || !read_frame()) {
+                return nullptr;
+            }
+        }
+        return &m_responses[id];
+    }
+
+    Response* get_response(uint32_t id) {
+        return &m_responses[id];
+    }
+
+    void erase(uint32_t id) {
+        m_responses.erase(id);
+    }
+
+    void close() {
+        append_frame(m_output, Http2FrameType::GOAWAY, 0, 0, std::string(8, '\0'));
+        flush();
+        m_stream.close();
+    }
+
+private:
+    static uint32_t read_uint32(const char* data) {
+        auto p = reinterpret_cast<const uint8_t*>(data);
+        return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    static void append_uint32(std::string& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>(value >> shift));
+        }
+    }
+
+    static void append_frame(std::string& out, Http2FrameType type, uint8_t flags, uint32_t id,
+                             const std::string& payload) {
+        out.push_back(static_cast<char>(payload.size() >> 16));
+        out.push_back(static_cast<char>(payload.size() >> 8));
+        out.push_back(static_cast<char>(payload.size()));
+        out.push_back(static_cast<char>(type));
+        out.push_back(static_cast<char>(flags));
+        append_uint32(out, id);
+        out += payload;
+    }
+
+    uint32_t frame_length() const {
+        auto p = reinterpret_cast<const uint8_t*>(m_buffer.data());
+        return (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+
+    bool fill() {
+        char buffer[64 * 1024];
+        auto len = static_cast<ssize_t>(m_stream.read(buffer, sizeof(buffer)));
+        if (len <= 0) {
+            return false;
+        }
+        m_buffer.append(buffer, len);
+        return true;
+    }
+
+    bool write(const std::string& data) {
+        return static_cast<ssize_t>(m_stream.write_fix_size(data.data(), data.size())) > 0;
+    }
+
+private:
+    acid::SocketStream m_stream;
+    HPackEncoder m_encoder;
+    HPackDecoder m_decoder;
+    std::string m_buffer;
+    std::string m_output;
+    std::map<uint32_t, Response> m_responses;
+    uint32_t m_next_stream = 1;
+    int64_t m_send_window = 65535;
+    bool m_settings = false;
+};
+
+static void test_protocol() {
+    auto client = Http2Client::connect();
+    check(client && client->handshake(), "handshake");
+
+    auto response = client->wait(client->add_request("GET", "/hello?acid"));
+    check(response && response->status == "200" && response->body == "hello acid", "get");
+
+    response = client->wait(client->add_request("GET", "/not_found"));
+    check(response && response->status == "404", "not found");
+
+    // 响应体超过客户端的初始窗口, 服务端需要等待WINDOW_UPDATE
+    std::string body(100 * 1024, 'x');
+    response = client->wait(client->add_request("POST", "/echo", body));
+    check(response && response->status == "200" && response->body == body, "flow control");
+
+    // 每个流在单独的协程中处理, 慢请求不阻塞之后的请求
+    uint32_t slow = client->add_request("GET", "/slow");
+    uint32_t fast = client->add_request("GET", "/hello?fast");
+    response = client->wait(fast);
+    check(response && response->body == "hello fast" && !client->get_response(slow)->done,
+          "concurrent streams");
+    response = client->wait(slow);
+    check(response && response->body == "slow", "slow stream");
+
+    std::vector<uint32_t> ids;
+    for (int i = 0; i < 32; ++i) {
+        ids.push_back(client->add_request("GET", "/hello?" + std::to_string(i)));
+    }
+    bool ok = true;
+    for (int i = 0; ok && i < 32; ++i) {
+        response = client->wait(ids[i]);
+        ok = response && response->body == "hello " + std::to_string(i);
+    }
+    check(ok, "multiplex");
+    client->close();
+
+    client = Http2Client::connect();
+    ok = client && client->upgrade("/hello?upgrade");
+    response = ok ? client->wait(1) : nullptr;
+    check(response && response->status == "200" && response->body == "hello upgrade", "upgrade");
+    response = client->wait(client->add_request("GET", "/hello?after"));
+    check(response && response->body == "hello after", "after upgrade");
+    client->close();
+}
+
+static void bench_http2(int total, int connections, int streams, std::function<void()> done) {
+    auto remain = std::make_shared<std::atomic<int>>(connections);
+    auto success = std::make_shared<std::atomic<int>>(0);
+    uint64_t start = acid::get_elapsed_us();
+    for (int c = 0; c < connections; ++c) {
+        acid::IOManager::get_this()->schedule([=]() {
+            int count = total / connections + (c < total % connections ? 1 : 0);
+            auto client = Http2Client::connect();
+            if (client && client->handshake()) {
+                // 始终保持streams个流在处理中
+                int sent = 0;
+                int finished = 0;
+                for (; sent < std::min(count, streams); ++sent) {
+                    client->add_request("GET", "/hello");
+                }
+                while (finished < count && client->flush()) {
+                    uint32_t id = 0;
+                    if (!client->read_frame(&id)) {
+                        break;
+                    }
+                    if (id == 0) {
+                        continue;
+                    }
+                    if (client->get_response(id)->status == "200") {
+                        ++*success;
+                    }
+                    client->erase(id);
+                    ++finished;
+                    if (sent < count) {
+                        client->add_request("GET", "/hello");
+                        ++sent;
+                    }
+                }
+                client->close();
+            }
+            if (--*remain == 0) {
+                uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+                std::cout << "http2 " << connections << "x" << streams
+                          << " streams: requests: " << *success << "/" << total
+                          << " elapsed: " << elapsed / 1000 << "ms "
+                          << *success * 1'000'000ull / elapsed << " req/s" << std::endl;
+                done();
+            }
+        });
+    }
+}
+
+static void bench_http1(int total, int fibers, std::function<void()> done) {
+    auto pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, 64);
+    auto remain = std::make_shared<std::atomic<int>>(fibers);
+    auto success = std::make_shared<std::atomic<int>>(0);
+    uint64_t start = acid::get_elapsed_us();
+    for (int f = 0; f < fibers; ++f) {
+        acid::IOManager::get_this()->schedule([=]() {
+            for (int i = f; i < total; i += fibers) {
+                auto result = pool->do_get("/hello", 3000);
+                if (result->result == HttpResult::Error::OK) {
+                    ++*success;
+                }
+            }
+            if (--*remain == 0) {
+                uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+                std::cout << "http/1.1 keep-alive " << fibers << " fibers: requests: " << *success
+                          << "/" << total << " elapsed: " << elapsed / 1000 << "ms "
+                          << *success * 1'000'000ull / elapsed
+                          << " req/s connections: " << pool->get_total_count() << std::endl;
+                done();
+            }
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 100000;
+    int connections = argc > 2 ? atoi(argv[2]) : 8;
+    int streams = argc > 3 ? atoi(argv[3]) : 125;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    test_hpack();
+
+    s_address = acid::Address::look_up_any("127.0.0.1:" + std::to_string(PORT));
+
+    auto create_server = []() {
+        auto server = std::make_shared<HttpServer>(true);
+        auto dispatch = server->get_servlet_dispatch();
+        dispatch->add_servlet("/hello", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                           HttpSession::ptr session) {
+            response->set_body("hello " + std::string(request->get_query()));
+            return 0;
+        });
+        dispatch->add_servlet("/echo", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            response->set_body(request->get_body());
+            return 0;
+        });
+        dispatch->add_servlet("/slow", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            usleep(200 * 1000);
+            response->set_body("slow");
+            return 0;
+        });
+        return server;
+    };
+    auto run_client = [=]() {
+        test_protocol();
+        bench_http2(total, connections, streams, [=]() {
+            bench_http1(total, 1000, []() {
+                acid::test::finish_bench(0);
+            });
+        });
+    };
+    acid::test::run_bench(create_server, {s_address}, run_client);
+    return 0;
+}
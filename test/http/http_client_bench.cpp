@@ -0,0 +1,185 @@
+/**
+ * http客户端测试
+ * 先检查普通请求, 流水线请求, 超时, 按流读取响应体和连接失效时的重试,
+ * 再用1000个协程并发请求本地HttpServer,
+ * 对比保持连接的连接池与每个请求新建连接(每条连接只发送一个请求)的吞吐
+ *
+ * 用法: http_client_bench [请求数量] [协程数量]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using namespace acid::http;
+
+static const uint16_t PORT = 6033;
+static const size_t BIG_BODY_SIZE = 1024 * 1024;
+static std::atomic<int> s_drop_count {0};
+
+using acid::test::check;
+
+static void test_client() {
+    HttpClient client;
+    std::string url = "http://127.0.0.1:" + std::to_string(PORT);
+
+    auto result = client.do_get(url + "/hello?acid", 1000);
+    check(result->result == HttpResult::Error::OK && result->response->get_body() == "hello acid",
+          "get");
+
+    result = client.do_post(url + "/echo", std::string(100 * 1024, 'x'), 1000);
+    check(result->result == HttpResult::Error::OK &&
+              result->response->get_body() == std::string(100 * 1024, 'x'),
+          "post");
+
+    HttpRequest::ptr head(new HttpRequest);
+    head->set_method(HttpMethod::HEAD);
+    result = client.do_request(url + "/hello", head, 1000);
+    check(result->result == HttpResult::Error::OK && result->response->get_body().empty(),
+          "head");
+
+    result = client.do_get(url + "/slow", 50);
+    check(result->result == HttpResult::Error::TIMEOUT, "timeout");
+
+    result = client.do_get("ftp://127.0.0.1/", 1000);
+    check(result->result == HttpResult::Error::INVALID_URL, "invalid url");
+
+    // 按流读取分块传输的响应体
+    HttpRequest::ptr request(new HttpRequest);
+    result = client.do_request_stream(url + "/big", request, 1000);
+    size_t total = 0;
+    if (result->stream) {
+        char buffer[16 * 1024];
+        ssize_t len;
+        while ((len = static_cast<ssize_t>(result->stream->read(buffer, sizeof(buffer)))) > 0) {
+            total += len;
+        }
+    }
+    check(result->result == HttpResult::Error::OK && total == BIG_BODY_SIZE, "stream");
+
+    // 流水线请求的响应按请求的顺序返回
+    auto pool = client.get_pool("127.0.0.1", PORT);
+    std::vector<HttpRequest::ptr> requests;
+    for (int i = 0; i < 16; ++i) {
+        HttpRequest::ptr request(new HttpRequest);
+        request->set_path("/hello");
+        request->set_query(std::to_string(i));
+        requests.push_back(request);
+    }
+    auto results = pool->do_pipeline(requests, 1000);
+    bool ok = results.size() == requests.size();
+    for (size_t i = 0; ok && i < results.size(); ++i) {
+        ok = results[i]->result == HttpResult::Error::OK &&
+             results[i]->response->get_body() == "hello " + std::to_string(i);
+    }
+    check(ok, "pipeline");
+    check(pool->get_idle_count() > 0, "keep alive");
+
+    // 服务端收到请求后不响应直接关闭复用的连接, POST可能已经被处理, 不能重发
+    auto drop_pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, 1);
+    drop_pool->do_get("/hello", 1000);
+    result = drop_pool->do_post("/drop", "once", 1000);
+    check(result->result != HttpResult::Error::OK && s_drop_count == 1, "post not retried");
+    drop_pool->do_get("/hello", 1000);
+    result = drop_pool->do_get("/drop", 1000);
+    check(result->result != HttpResult::Error::OK && s_drop_count == 3, "get retried");
+
+    // 连接数达到上限时, 等待其它请求归还连接也受超时限制
+    auto busy_pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, 1);
+    acid::IOManager::get_this()->schedule([busy_pool]() { busy_pool->do_get("/slow", 1000); });
+    usleep(20 * 1000);
+    uint64_t start = acid::get_current_ms();
+    result = busy_pool->do_get("/hello", 50);
+    check(result->result == HttpResult::Error::TIMEOUT && acid::get_current_ms() - start < 150,
+          "wait for connection timeout");
+}
+
+static void bench(const std::string& name, HttpConnectionPool::ptr pool, int total, int fibers,
+                  std::function<void()> done) {
+    auto remain = std::make_shared<std::atomic<int>>(fibers);
+    auto success = std::make_shared<std::atomic<int>>(0);
+    uint64_t start = acid::get_elapsed_us();
+    for (int f = 0; f < fibers; ++f) {
+        acid::IOManager::get_this()->schedule([=]() {
+            for (int i = f; i < total; i += fibers) {
+                auto result = pool->do_get("/hello", 3000);
+                if (result->result == HttpResult::Error::OK) {
+                    ++*success;
+                }
+            }
+            if (--*remain == 0) {
+                uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+                std::cout << name << ": requests: " << *success << "/" << total
+                          << " elapsed: " << elapsed / 1000 << "ms "
+                          << *success * 1'000'000ull / elapsed
+                          << " req/s connections: " << pool->get_total_count() << std::endl;
+                done();
+            }
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 100000;
+    int fibers = argc > 2 ? atoi(argv[2]) : 1000;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:" + std::to_string(PORT));
+
+    auto create_server = []() {
+        auto server = std::make_shared<HttpServer>(true);
+        auto dispatch = server->get_servlet_dispatch();
+        dispatch->add_servlet("/hello", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                           HttpSession::ptr session) {
+            response->set_body("hello " + std::string(request->get_query()));
+            return 0;
+        });
+        dispatch->add_servlet("/echo", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            response->set_body(request->get_body());
+            return 0;
+        });
+        dispatch->add_servlet("/drop", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            ++s_drop_count;
+            session->close();
+            return 0;
+        });
+        dispatch->add_servlet("/slow", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            usleep(200 * 1000);
+            response->set_body("slow");
+            return 0;
+        });
+        dispatch->add_servlet("/big", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                         HttpSession::ptr session) {
+            auto stream = session->get_body_stream(response);
+            std::string chunk(64 * 1024, 'b');
+            for (size_t i = 0; i < BIG_BODY_SIZE / chunk.size(); ++i) {
+                stream->write(chunk.data(), chunk.size());
+            }
+            stream->close();
+            return 0;
+        });
+        return server;
+    };
+    auto run_client = [total, fibers]() {
+        test_client();
+
+        // 每条连接只发送一个请求, 相当于不使用连接池
+        auto short_pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, fibers, 1);
+        auto keep_alive_pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, 64);
+        bench("short connection", short_pool, total, fibers, [=]() {
+            bench("keep-alive pool", keep_alive_pool, total, fibers, []() {
+                acid::test::finish_bench(0);
+            });
+        });
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
@@ -0,0 +1,332 @@
+/**
+ * 响应压缩测试
+ * 先检查Accept-Encoding协商, 各编码的完整响应体和按流发送的响应体能否正确解压, 不压缩的情况,
+ * 再对比复用线程池中的压缩器与每次新建zlib上下文的开销, 以及各编码压缩100KB JSON的吞吐和压缩比
+ *
+ * 用法: http_compress_bench [请求数量]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <zlib.h>
+
+#if ACID_ENABLE_BROTLI
+#include <brotli/decode.h>
+#endif
+
+#if ACID_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace acid::http;
+
+static const uint16_t PORT = 6037;
+
+using acid::test::check;
+
+// 类似接口返回的JSON数组, 字段名重复, 数值各不相同
+static std::string make_json(size_t size) {
+    std::string json = "[";
+    for (int i = 0; json.size() < size; ++i) {
+        if (i > 0) {
+            json.push_back(',');
+        }
+        json += "{\"id\":" + std::to_string(i * 7919 % 100003) + ",\"name\":\"user" +
+                std::to_string(i) + "\",\"score\":" + std::to_string(i * 31 % 1000) +
+                ",\"active\":" + (i % 3 ? "true" : "false") + ",\"tags\":[\"a" +
+                std::to_string(i % 17) + "\",\"b" + std::to_string(i % 5) + "\"]}";
+    }
+    json.push_back(']');
+    return json;
+}
+
+static const std::string& get_json() {
+    static std::string s_json = make_json(100 * 1024);
+    return s_json;
+}
+
+static bool decompress(const std::string& encoding, const std::string& data, std::string& out) {
+    out.clear();
+    if (encoding == "gzip") {
+        z_stream stream {};
+        if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+            return false;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        char buffer[16 * 1024];
+        int ret;
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            ret = inflate(&stream, Z_NO_FLUSH);
+            out.append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (ret == Z_OK);
+        inflateEnd(&stream);
+        return ret == Z_STREAM_END;
+    }
+#if ACID_ENABLE_BROTLI
+    if (encoding == "br") {
+        auto state = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+        size_t avail_in = data.size();
+        auto next_in = reinterpret_cast<const uint8_t*>(data.data());
+        BrotliDecoderResult ret;
+        do {
+            uint8_t buffer[16 * 1024];
+            size_t avail_out = sizeof(buffer);
+            uint8_t* next_out = buffer;
+            ret = BrotliDecoderDecompressStream(state, &avail_in, &next_in, &avail_out, &next_out,
+                                                nullptr);
+            out.append(reinterpret_cast<char*>(buffer), sizeof(buffer) - avail_out);
+        } while (ret == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+        BrotliDecoderDestroyInstance(state);
+        return ret == BROTLI_DECODER_RESULT_SUCCESS;
+    }
+#endif
+#if ACID_ENABLE_ZSTD
+    if (encoding == "zstd") {
+        auto ctx = ZSTD_createDCtx();
+        ZSTD_inBuffer input {data.data(), data.size(), 0};
+        size_t ret = 0;
+        while (input.pos < input.size) {
+            char buffer[16 * 1024];
+            ZSTD_outBuffer output {buffer, sizeof(buffer), 0};
+            ret = ZSTD_decompressStream(ctx, &output, &input);
+            if (ZSTD_isError(ret)) {
+                break;
+            }
+            out.append(buffer, output.pos);
+        }
+        ZSTD_freeDCtx(ctx);
+        return !ZSTD_isError(ret) && ret == 0;
+    }
+#endif
+    return false;
+}
+
+static std::vector<std::string> get_encodings() {
+    std::vector<std::string> encodings = {"gzip"};
+#if ACID_ENABLE_BROTLI
+    encodings.push_back("br");
+#endif
+#if ACID_ENABLE_ZSTD
+    encodings.push_back("zstd");
+#endif
+    return encodings;
+}
+
+static void test_negotiate() {
+    bool ok = negotiate_content_encoding("") == ContentEncoding::IDENTITY &&
+              negotiate_content_encoding("gzip") == ContentEncoding::GZIP &&
+              negotiate_content_encoding("GZIP;q=0.5, identity") == ContentEncoding::GZIP &&
+              negotiate_content_encoding("gzip;q=0") == ContentEncoding::IDENTITY &&
+              negotiate_content_encoding("deflate, compress") == ContentEncoding::IDENTITY;
+#if ACID_ENABLE_BROTLI
+    ok = ok && negotiate_content_encoding("gzip, deflate, br") == ContentEncoding::BROTLI &&
+         negotiate_content_encoding("br;q=0.5, gzip") == ContentEncoding::GZIP &&
+         negotiate_content_encoding("*") == ContentEncoding::BROTLI &&
+         negotiate_content_encoding("*, br;q=0") != ContentEncoding::BROTLI;
+#endif
+    check(ok, "negotiate");
+}
+
+static void test_client() {
+    HttpClient client;
+    std::string url = "http://127.0.0.1:" + std::to_string(PORT);
+    std::string body;
+
+    for (auto& encoding : get_encodings()) {
+        auto result = client.do_get(url + "/json", 3000, {{"Accept-Encoding", encoding}});
+        auto response = result->response;
+        check(response && response->get_header("Content-Encoding") == encoding &&
+                  response->get_header("Vary") == "Accept-Encoding" &&
+                  response->get_body().size() < get_json().size() / 4 &&
+                  decompress(encoding, response->get_body(), body) && body == get_json(),
+              encoding + " body");
+
+        result = client.do_get(url + "/stream", 3000, {{"Accept-Encoding", encoding}});
+        response = result->response;
+        check(response && response->get_header("Content-Encoding") == encoding &&
+                  decompress(encoding, response->get_body(), body) && body == get_json(),
+              encoding + " stream");
+    }
+
+    auto result = client.do_get(url + "/json", 3000);
+    check(result->response && !result->response->has_header("Content-Encoding") &&
+              result->response->get_body() == get_json(),
+          "no accept encoding");
+
+    result = client.do_get(url + "/small", 3000, {{"Accept-Encoding", "gzip"}});
+    check(result->response && !result->response->has_header("Content-Encoding") &&
+              result->response->get_body() == "{\"ok\":true}",
+          "below min size");
+
+    result = client.do_get(url + "/binary", 3000, {{"Accept-Encoding", "gzip"}});
+    check(result->response && !result->response->has_header("Content-Encoding"), "binary type");
+
+    // 压缩后的ETag改为弱校验, 条件请求仍然可以匹配
+    result = client.do_get(url + "/etag", 3000, {{"Accept-Encoding", "gzip"}});
+    check(result->response && result->response->get_header("ETag") == "W/\"v1\"", "weak etag");
+}
+
+// 每次压缩都新建上下文, 作为对比
+static void compress_without_pool(ContentEncoding encoding, const std::string& data,
+                                  std::string& out) {
+    if (encoding == ContentEncoding::GZIP) {
+        z_stream stream {};
+        deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        out.resize(deflateBound(&stream, data.size()));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_out = out.size();
+        deflate(&stream, Z_FINISH);
+        out.resize(out.size() - stream.avail_out);
+        deflateEnd(&stream);
+    }
+#if ACID_ENABLE_ZSTD
+    if (encoding == ContentEncoding::ZSTD) {
+        out.resize(ZSTD_compressBound(data.size()));
+        auto ctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, 3);
+        out.resize(ZSTD_compress2(ctx, out.data(), out.size(), data.data(), data.size()));
+        ZSTD_freeCCtx(ctx);
+    }
+#endif
+}
+
+static void bench_context(ContentEncoding encoding, int count) {
+    std::string data = make_json(2 * 1024);
+    std::string out;
+    uint64_t start = acid::get_elapsed_us();
+    for (int i = 0; i < count; ++i) {
+        compress_without_pool(encoding, data, out);
+    }
+    uint64_t fresh = acid::get_elapsed_us() - start;
+
+    start = acid::get_elapsed_us();
+    for (int i = 0; i < count; ++i) {
+        auto compressor = HttpCompressor::acquire(encoding);
+        out.clear();
+        compressor->compress(data.data(), data.size(), out, HttpCompressor::FINISH);
+    }
+    uint64_t pooled = acid::get_elapsed_us() - start;
+    std::cout << content_encoding_to_string(encoding) << " 2KB body: new context "
+              << fresh * 1000 / count << "ns/op, pooled context " << pooled * 1000 / count
+              << "ns/op" << std::endl;
+}
+
+static void bench_encoding(HttpConnectionPool::ptr pool, const std::vector<std::string>& encodings,
+                           size_t index, int total) {
+    if (index == encodings.size()) {
+        acid::test::finish_bench(0);
+    }
+    const std::string& encoding = encodings[index];
+    const int fibers = 16;
+    auto remain = std::make_shared<std::atomic<int>>(fibers);
+    auto bytes = std::make_shared<std::atomic<uint64_t>>(0);
+    auto type = encoding == "br"     ? ContentEncoding::BROTLI
+                : encoding == "zstd" ? ContentEncoding::ZSTD
+                : encoding == "gzip" ? ContentEncoding::GZIP
+                                     : ContentEncoding::IDENTITY;
+    auto before = HttpCompressor::get_stats(type);
+    uint64_t start = acid::get_elapsed_us();
+    for (int f = 0; f < fibers; ++f) {
+        acid::IOManager::get_this()->schedule([=]() {
+            for (int i = f; i < total; i += fibers) {
+                auto result = pool->do_get("/json", 3000, {{"Accept-Encoding", encoding}});
+                if (result->response) {
+                    *bytes += result->response->get_body().size();
+                }
+            }
+            if (--*remain > 0) {
+                return;
+            }
+            uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+            std::cout << encoding << ": " << total * 1'000'000ull / elapsed << " req/s, "
+                      << *bytes / total << " bytes/response";
+            if (type != ContentEncoding::IDENTITY) {
+                // 只统计这一轮的请求
+                auto stats = HttpCompressor::get_stats(type);
+                stats.responses -= before.responses;
+                stats.input_bytes -= before.input_bytes;
+                stats.output_bytes -= before.output_bytes;
+                stats.cpu_us -= before.cpu_us;
+                std::cout << ", ratio " << stats.get_ratio() << ", cpu "
+                          << stats.cpu_us / std::max<uint64_t>(stats.responses, 1)
+                          << "us/response";
+            }
+            std::cout << std::endl;
+            bench_encoding(pool, encodings, index + 1, total);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 2000;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    test_negotiate();
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:" + std::to_string(PORT));
+
+    auto create_server = []() {
+        auto server = std::make_shared<HttpServer>(true);
+        auto dispatch = server->get_servlet_dispatch();
+        dispatch->add_servlet("/json", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            response->set_content_type("application/json");
+            response->set_body(get_json());
+            return 0;
+        });
+        dispatch->add_servlet("/small", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                           HttpSession::ptr session) {
+            response->set_content_type("application/json");
+            response->set_body("{\"ok\":true}");
+            return 0;
+        });
+        dispatch->add_servlet("/binary", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                            HttpSession::ptr session) {
+            response->set_content_type("image/png");
+            response->set_body(get_json());
+            return 0;
+        });
+        dispatch->add_servlet("/etag", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                          HttpSession::ptr session) {
+            response->set_content_type("text/plain");
+            response->set_header("ETag", "\"v1\"");
+            response->set_body(get_json());
+            return 0;
+        });
+        dispatch->add_servlet("/stream", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                            HttpSession::ptr session) {
+            response->set_content_type("application/json");
+            auto stream = session->get_body_stream(response);
+            const std::string& json = get_json();
+            for (size_t offset = 0; offset < json.size(); offset += 8192) {
+                stream->write(json.data() + offset, std::min<size_t>(8192, json.size() - offset));
+            }
+            stream->close();
+            return 0;
+        });
+        return server;
+    };
+    auto run_client = [total]() {
+        test_client();
+        bench_context(ContentEncoding::GZIP, total * 10);
+#if ACID_ENABLE_ZSTD
+        bench_context(ContentEncoding::ZSTD, total * 10);
+#endif
+
+        auto pool = std::make_shared<HttpConnectionPool>("127.0.0.1", PORT, 16);
+        auto encodings = get_encodings();
+        encodings.insert(encodings.begin(), "identity");
+        bench_encoding(pool, encodings, 0, total);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
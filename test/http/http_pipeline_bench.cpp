@@ -0,0 +1,87 @@
+/**
+ * http流水线请求的吞吐测试
+ * 客户端在一个连接上每次连续写入depth个GET请求, 再读取全部响应, 对比depth为1与16时的吞吐。
+ * 与 wrk -t1 -c1 -d10s -s pipeline.lua http://127.0.0.1:6028/ -- 16 的测试方式相同
+ *
+ * 用法: http_pipeline_bench [请求数量]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+static const std::string REQUEST = "GET /hello HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+static void bench(acid::Socket::ptr socket, size_t response_size, int total, int depth) {
+    std::string requests;
+    for (int i = 0; i < depth; ++i) {
+        requests += REQUEST;
+    }
+
+    std::string buffer;
+    int success = 0;
+    uint64_t start = acid::get_elapsed_us();
+    for (int i = 0; i < total / depth; ++i) {
+        if (socket->send(requests.data(), requests.size()) != static_cast<int>(requests.size()) ||
+            !acid::test::read_response(socket, buffer, response_size * depth)) {
+            std::cout << "depth: " << depth << " connection closed" << std::endl;
+            return;
+        }
+        success += depth;
+    }
+    uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+    std::cout << "depth: " << depth << " requests: " << success << " elapsed: " << elapsed / 1000
+              << "ms " << success * 1'000'000ull / elapsed << " req/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 100000;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:6028");
+
+    auto create_server = []() {
+        auto server = std::make_shared<acid::http::HttpServer>(true);
+        server->get_servlet_dispatch()->add_servlet(
+            "/hello",
+            [](acid::http::HttpRequest::ptr request, acid::http::HttpResponse::ptr response,
+               acid::http::HttpSession::ptr session) {
+                response->set_body("hello world");
+                return 0;
+            });
+        return server;
+    };
+    auto run_client = [address, total]() {
+        acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+        if (!socket->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            _exit(1);
+        }
+
+        // 每个响应的长度相同, 先发一个请求得到响应长度
+        socket->send(REQUEST.data(), REQUEST.size());
+        std::string response;
+        char buffer[4096];
+        while (response.find("hello world") == std::string::npos) {
+            int len = socket->recv(buffer, sizeof(buffer));
+            if (len <= 0) {
+                std::cout << "recv response fail" << std::endl;
+                _exit(1);
+            }
+            response.append(buffer, len);
+        }
+
+        bench(socket, response.size(), total, 1);
+        bench(socket, response.size(), total, 16);
+
+        socket->close();
+        acid::test::finish_bench(0);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * http响应发送的吞吐测试
+ * 多个保持连接的客户端并发请求10字节和64KiB的响应体, 统计每秒请求数与吞吐量
+ *
+ * 用法: http_response_bench [请求数量] [并发连接数]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string make_request(const std::string& path) {
+    return "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+}
+
+static void bench(acid::Address::ptr address, const std::string& path, size_t body_size, int total,
+                  int concurrency) {
+    std::string request = make_request(path);
+    size_t response_size = acid::test::get_response_size(address, request, body_size);
+    if (response_size == 0) {
+        std::cout << "request " << path << " fail" << std::endl;
+        _exit(1);
+    }
+
+    std::atomic<int> success {0};
+    acid::CoCountDownLatch latch(concurrency);
+    uint64_t start = acid::get_elapsed_us();
+    for (int i = 0; i < concurrency; ++i) {
+        acid::IOManager::get_this()->schedule(
+            [address, &request, response_size, total, concurrency, &success, &latch]() {
+                acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+                if (socket->connect(address)) {
+                    std::string buffer;
+                    for (int j = 0; j < total / concurrency; ++j) {
+                        if (socket->send(request.data(), request.size()) <= 0 ||
+                            !acid::test::read_response(socket, buffer, response_size)) {
+                            break;
+                        }
+                        ++success;
+                    }
+                    socket->close();
+                }
+                latch.count_down();
+            });
+    }
+    latch.wait();
+
+    uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+    std::cout << "body: " << body_size << "B concurrency: " << concurrency
+              << " requests: " << success << " " << success * 1'000'000ull / elapsed << " req/s "
+              << success * response_size * 1'000'000ull / elapsed / (1 << 20) << " MB/s"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 100000;
+    int concurrency = argc > 2 ? atoi(argv[2]) : 64;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:6029");
+
+    auto create_server = []() {
+        auto server = std::make_shared<acid::http::HttpServer>(true);
+        auto dispatch = server->get_servlet_dispatch();
+        dispatch->add_servlet("/small", [](acid::http::HttpRequest::ptr request,
+                                           acid::http::HttpResponse::ptr response,
+                                           acid::http::HttpSession::ptr session) {
+            response->set_body("0123456789");
+            return 0;
+        });
+        static const std::string large(64 * 1024, 'x');
+        dispatch->add_servlet("/large", [](acid::http::HttpRequest::ptr request,
+                                           acid::http::HttpResponse::ptr response,
+                                           acid::http::HttpSession::ptr session) {
+            response->set_body(large);
+            return 0;
+        });
+        return server;
+    };
+    auto run_client = [address, total, concurrency]() {
+        bench(address, "/small", 10, total, concurrency);
+        bench(address, "/large", 64 * 1024, total / 10, concurrency);
+        acid::test::finish_bench(0);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * 路由匹配的性能测试
+ * 注册1000条路由(精确路径, 带参数的路由, 前缀glob和复杂glob),
+ * 对比ServletDispatch的前缀树快照与逐条fnmatch的线性匹配, 统计每次匹配的耗时
+ *
+ * 用法: http_router_bench [匹配次数] [线程数]
+ */
+#include "acid/acid.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fnmatch.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace acid::http;
+
+static const int EXACT_ROUTES = 400;
+static const int PARAM_ROUTES = 300;
+static const int PREFIX_ROUTES = 200;
+static const int GLOB_ROUTES = 100;
+
+/**
+ * 原来的匹配方式: 先查精确路径, 再在读锁下逐条fnmatch
+ */
+class LinearDispatch {
+public:
+    void add_servlet(const std::string& uri, Servlet::ptr servlet) {
+        acid::RWMutex::WriteLock lock(m_mutex);
+        m_datas[uri] = servlet;
+    }
+
+    void add_glob_servlet(const std::string& uri, Servlet::ptr servlet) {
+        acid::RWMutex::WriteLock lock(m_mutex);
+        m_globs.emplace_back(uri, servlet);
+    }
+
+    Servlet::ptr get_matched_servlet(const std::string& uri) {
+        acid::RWMutex::ReadLock lock(m_mutex);
+        auto it = m_datas.find(uri);
+        if (it != m_datas.end()) {
+            return it->second;
+        }
+        for (auto& i : m_globs) {
+            if (fnmatch(i.first.c_str(), uri.c_str(), 0) == 0) {
+                return i.second;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    acid::RWMutex m_mutex;
+    std::unordered_map<std::string, Servlet::ptr> m_datas;
+    std::vector<std::pair<std::string, Servlet::ptr>> m_globs;
+};
+
+static Servlet::ptr make_servlet() {
+    return std::make_shared<FunctionServlet>(
+        [](HttpRequest::ptr, HttpResponse::ptr, HttpSession::ptr) { return 0; });
+}
+
+// 每类路由各取一部分请求路径, 再加上一些不匹配的路径
+static std::vector<std::string> make_paths() {
+    std::vector<std::string> paths;
+    for (int i = 0; i < EXACT_ROUTES; i += 7) {
+        paths.push_back("/api/v1/resource" + std::to_string(i));
+    }
+    for (int i = 0; i < PARAM_ROUTES; i += 5) {
+        paths.push_back("/svc" + std::to_string(i) + "/1234/items/abcd");
+    }
+    for (int i = 0; i < PREFIX_ROUTES; i += 3) {
+        paths.push_back("/static" + std::to_string(i) + "/js/app.js");
+    }
+    for (int i = 0; i < GLOB_ROUTES; i += 2) {
+        paths.push_back("/img" + std::to_string(i) + "/logo.png");
+    }
+    for (int i = 0; i < 20; ++i) {
+        paths.push_back("/missing/" + std::to_string(i));
+    }
+    return paths;
+}
+
+template <class F>
+static void bench(const std::string& name, int total, int threads, F&& match) {
+    auto paths = make_paths();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            HttpRequest::ptr request(new HttpRequest);
+            request->set_method(HttpMethod::GET);
+            size_t matched = 0;
+            for (int i = t; i < total; i += threads) {
+                request->set_path(paths[i % paths.size()]);
+                matched += match(request) != nullptr;
+            }
+            if (matched == 0) {
+                std::cout << "no route matched" << std::endl;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+                    .count();
+    std::cout << name << ": " << total << " lookups, " << ns / total << " ns/lookup, "
+              << static_cast<uint64_t>(total / (ns / 1e9)) << " lookups/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 200000;
+    int threads = argc > 2 ? atoi(argv[2]) : 1;
+
+    ServletDispatch dispatch;
+    LinearDispatch linear;
+    for (int i = 0; i < EXACT_ROUTES; ++i) {
+        std::string uri = "/api/v1/resource" + std::to_string(i);
+        dispatch.add_servlet(uri, make_servlet());
+        linear.add_servlet(uri, make_servlet());
+    }
+    // 原来的方式只能用glob表达带参数的路由
+    for (int i = 0; i < PARAM_ROUTES; ++i) {
+        dispatch.add_route(HttpMethod::GET, "/svc" + std::to_string(i) + "/:id/items/:item",
+                           make_servlet());
+        linear.add_glob_servlet("/svc" + std::to_string(i) + "/*/items/*", make_servlet());
+    }
+    for (int i = 0; i < PREFIX_ROUTES; ++i) {
+        std::string uri = "/static" + std::to_string(i) + "/*";
+        dispatch.add_glob_servlet(uri, make_servlet());
+        linear.add_glob_servlet(uri, make_servlet());
+    }
+    for (int i = 0; i < GLOB_ROUTES; ++i) {
+        std::string uri = "/img" + std::to_string(i) + "/*.png";
+        dispatch.add_glob_servlet(uri, make_servlet());
+        linear.add_glob_servlet(uri, make_servlet());
+    }
+
+    std::cout << "routes: " << EXACT_ROUTES + PARAM_ROUTES + PREFIX_ROUTES + GLOB_ROUTES
+              << " threads: " << threads << std::endl;
+    bench("linear fnmatch", total, threads, [&linear](HttpRequest::ptr request) {
+        static thread_local std::string path;
+        path.assign(request->get_path());
+        return linear.get_matched_servlet(path);
+    });
+    bench("radix snapshot", total, threads, [&dispatch](HttpRequest::ptr request) {
+        return dispatch.get_matched_servlet(request);
+    });
+    return 0;
+}
@@ -13,8 +13,12 @@ void run() {
     logger->set_level(acid::LogLevel::INFO);
 
     acid::http::HttpServer::ptr server(new acid::http::HttpServer(true));
-    acid::Address::ptr addr = acid::Address::look_up_any_ipaddress("0.0.0.0:6027");
-    while (!server->bind(addr)) {
+    // 同一主机的代理也可以通过unix socket访问, 例如 curl --abstract-unix-socket acid-http-6027
+    std::vector<acid::Address::ptr> addrs = {acid::Address::look_up_any_ipaddress("0.0.0.0:6027"),
+                                             acid::Address::look_up_any("unix:@acid-http-6027")};
+    std::vector<acid::Address::ptr> fails;
+    while (!server->bind(addrs, fails)) {
+        fails.clear();
         sleep(2);
     }
 
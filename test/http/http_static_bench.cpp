@@ -0,0 +1,150 @@
+/**
+ * 静态文件servlet与每次把文件读入响应体的servlet的吞吐对比
+ * 在临时目录中生成4KiB和1MiB的文件, 多个保持连接的客户端并发请求。
+ * 最后检查客户端不读取时, sendfile在发送超时后放弃, 不会一直占着处理连接的协程;
+ * 以及可写的文件被截断后仍然可以正常请求
+ *
+ * 用法: http_static_bench [请求数量] [并发连接数]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string s_root;
+
+// 请求大文件后不读取, 服务端发送超时后关闭连接, 之后只能收到文件的一部分
+static bool stalled_client(acid::Address::ptr address, size_t body_size) {
+    acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+    if (!socket->connect(address)) {
+        return false;
+    }
+    socket->set_recv_timeout(5000);
+    std::string request = "GET /static/huge.bin HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    socket->send(request.data(), request.size());
+    // 超过服务端的发送超时
+    usleep(1500 * 1000);
+    size_t total = 0;
+    char buffer[64 * 1024];
+    int len = 0;
+    while ((len = socket->recv(buffer, sizeof(buffer))) > 0) {
+        total += len;
+    }
+    socket->close();
+    return total > 0 && total < body_size;
+}
+
+// 可写的文件不映射, 截断之后再次请求得到截断后的内容, 不会访问失效的映射
+static bool truncated_file() {
+    std::string path = s_root + "/writable.txt";
+    std::ofstream(path) << std::string(16 * 1024, 'w');
+    auto client = std::make_shared<acid::http::HttpClient>();
+    std::string url = "http://127.0.0.1:6032/static/writable.txt";
+    auto before = client->do_get(url, 1000);
+    truncate(path.c_str(), 1024);
+    auto after = client->do_get(url, 1000);
+    client->close();
+    unlink(path.c_str());
+    return before->response && before->response->get_body().size() == 16 * 1024 &&
+           after->response && after->response->get_body().size() == 1024;
+}
+
+static void bench(acid::Address::ptr address, const std::string& path, size_t body_size, int total,
+                  int concurrency) {
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    size_t response_size = acid::test::get_response_size(address, request, body_size);
+    if (response_size == 0) {
+        std::cout << "request " << path << " fail" << std::endl;
+        _exit(1);
+    }
+
+    std::atomic<int> success {0};
+    acid::CoCountDownLatch latch(concurrency);
+    uint64_t start = acid::get_elapsed_us();
+    for (int i = 0; i < concurrency; ++i) {
+        acid::IOManager::get_this()->schedule(
+            [address, &request, response_size, total, concurrency, &success, &latch]() {
+                acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+                if (socket->connect(address)) {
+                    std::string buffer;
+                    for (int j = 0; j < total / concurrency; ++j) {
+                        if (socket->send(request.data(), request.size()) <= 0 ||
+                            !acid::test::read_response(socket, buffer, response_size)) {
+                            break;
+                        }
+                        ++success;
+                    }
+                    socket->close();
+                }
+                latch.count_down();
+            });
+    }
+    latch.wait();
+
+    uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+    std::cout << path << " requests: " << success << " " << success * 1'000'000ull / elapsed
+              << " req/s " << success * response_size * 1'000'000ull / elapsed / (1 << 20)
+              << " MB/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 20000;
+    int concurrency = argc > 2 ? atoi(argv[2]) : 32;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    char dir[] = "/tmp/acid_static_XXXXXX";
+    s_root = mkdtemp(dir);
+    std::ofstream(s_root + "/small.txt") << std::string(4 * 1024, 's');
+    std::ofstream(s_root + "/large.bin") << std::string(1024 * 1024, 'l');
+    // 只读的小文件才会映射到缓存中
+    chmod((s_root + "/small.txt").c_str(), 0444);
+    const size_t huge_size = 64 * 1024 * 1024;
+    std::ofstream(s_root + "/huge.bin") << std::string(huge_size, 'h');
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:6032");
+
+    auto create_server = []() {
+        auto server = std::make_shared<acid::http::HttpServer>(true);
+        server->set_send_timeout(500);
+        auto dispatch = server->get_servlet_dispatch();
+        dispatch->add_glob_servlet("/static/*",
+                                   std::make_shared<acid::http::StaticFileServlet>("/static", s_root));
+        // 每次请求都打开文件并读入响应体
+        dispatch->add_glob_servlet("/naive/*", [](acid::http::HttpRequest::ptr request,
+                                                  acid::http::HttpResponse::ptr response,
+                                                  acid::http::HttpSession::ptr session) {
+            std::ifstream file(s_root + std::string(request->get_path().substr(6)), std::ios::binary);
+            std::stringstream ss;
+            ss << file.rdbuf();
+            response->set_body(ss.str());
+            return 0;
+        });
+        return server;
+    };
+    auto run_client = [address, total, concurrency, huge_size]() {
+        bench(address, "/naive/small.txt", 4 * 1024, total, concurrency);
+        bench(address, "/static/small.txt", 4 * 1024, total, concurrency);
+        bench(address, "/naive/large.bin", 1024 * 1024, total / 10, concurrency);
+        bench(address, "/static/large.bin", 1024 * 1024, total / 10, concurrency);
+        bool timed_out = stalled_client(address, huge_size);
+        std::cout << "sendfile send timeout: " << (timed_out ? "ok" : "FAIL") << std::endl;
+        bool truncated = truncated_file();
+        std::cout << "truncated writable file: " << (truncated ? "ok" : "FAIL") << std::endl;
+        unlink((s_root + "/small.txt").c_str());
+        unlink((s_root + "/large.bin").c_str());
+        unlink((s_root + "/huge.bin").c_str());
+        rmdir(s_root.c_str());
+        acid::test::finish_bench(timed_out && truncated ? 0 : 1);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
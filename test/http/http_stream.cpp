@@ -0,0 +1,179 @@
+/**
+ * 按流上传和下载大文件
+ * 上传的请求体通过HttpBodyStream边读边丢弃, 下载的响应体分块发送, 两个方向都不把整个文件放进内存,
+ * 结束时输出进程的最大常驻内存
+ * 同样可以用curl测试:
+ *   curl -T big.file http://127.0.0.1:6030/upload
+ *   curl -o /dev/null "http://127.0.0.1:6030/download?size=1073741824"
+ *
+ * 用法: http_stream [文件大小(MiB)]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static acid::http::HttpServer::ptr create_server() {
+    auto server = std::make_shared<acid::http::HttpServer>(true);
+    auto dispatch = server->get_servlet_dispatch();
+
+    // 读取请求体并统计长度
+    dispatch->add_stream_servlet("/upload", [](acid::http::HttpRequest::ptr request,
+                                               acid::http::HttpResponse::ptr response,
+                                               acid::http::HttpSession::ptr session) {
+        auto stream = session->get_body_stream(response);
+        char buffer[64 * 1024];
+        uint64_t total = 0;
+        ssize_t len = 0;
+        while ((len = stream->read(buffer, sizeof(buffer))) > 0) {
+            total += len;
+        }
+        if (len < 0) {
+            response->set_status(acid::http::HttpStatus::BAD_REQUEST);
+            response->set_close(true);
+            return 0;
+        }
+        response->set_body(std::to_string(total));
+        return 0;
+    });
+
+    // 按请求的大小分块发送响应体
+    dispatch->add_servlet("/download", [](acid::http::HttpRequest::ptr request,
+                                          acid::http::HttpResponse::ptr response,
+                                          acid::http::HttpSession::ptr session) {
+        uint64_t size = request->get_param_as<uint64_t>("size");
+        auto stream = session->get_body_stream(response);
+        std::string buffer(64 * 1024, 'x');
+        while (size > 0) {
+            size_t len = std::min<uint64_t>(size, buffer.size());
+            if (stream->write_fix_size(buffer.data(), len) != len) {
+                break;
+            }
+            size -= len;
+        }
+        stream->close();
+        return 0;
+    });
+
+    // 不读取请求体
+    dispatch->add_stream_servlet("/ignore", [](acid::http::HttpRequest::ptr request,
+                                               acid::http::HttpResponse::ptr response,
+                                               acid::http::HttpSession::ptr session) {
+        response->set_body("ignored");
+        return 0;
+    });
+
+    return server;
+}
+
+static uint64_t upload(acid::Socket::ptr socket, uint64_t size) {
+    std::string head = "PUT /upload HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " +
+                       std::to_string(size) + "\r\n\r\n";
+    socket->send(head.data(), head.size());
+    std::string buffer(64 * 1024, 'x');
+    for (uint64_t sent = 0; sent < size;) {
+        int len = socket->send(buffer.data(), std::min<uint64_t>(size - sent, buffer.size()));
+        if (len <= 0) {
+            return 0;
+        }
+        sent += len;
+    }
+
+    std::string response;
+    char data[1024];
+    while (response.find("\r\n\r\n") == std::string::npos ||
+           response.find(std::to_string(size), response.find("\r\n\r\n")) == std::string::npos) {
+        int len = socket->recv(data, sizeof(data));
+        if (len <= 0) {
+            return 0;
+        }
+        response.append(data, len);
+    }
+    return size;
+}
+
+static uint64_t download(acid::Socket::ptr socket, uint64_t size) {
+    std::string request = "GET /download?size=" + std::to_string(size) +
+                          " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    socket->send(request.data(), request.size());
+
+    // 响应体全是x, 只需要统计收到的字节数, 直到遇到结束分块
+    static const std::string END = "\r\n0\r\n\r\n";
+    std::string buffer(64 * 1024, '\0');
+    std::string tail;
+    uint64_t total = 0;
+    while (tail.size() < END.size() || tail.compare(tail.size() - END.size(), END.size(), END) != 0) {
+        int len = socket->recv(buffer.data(), buffer.size());
+        if (len <= 0) {
+            return 0;
+        }
+        total += len;
+        tail.append(buffer.data(), len);
+        if (tail.size() > END.size()) {
+            tail.erase(0, tail.size() - END.size());
+        }
+    }
+    return total;
+}
+
+// 请求体超过上限无法丢弃, 服务端关闭连接之前仍然要写出已经生成的响应
+static bool ignore_body(acid::Address::ptr address) {
+    acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+    if (!socket->connect(address)) {
+        return false;
+    }
+    // 请求头和一部分请求体一起发送, 服务端读入后还有未解析的数据, 响应会先暂存
+    std::string request = "PUT /ignore HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " +
+                          std::to_string(1ull << 40) + "\r\n\r\n" + std::string(1024, 'x');
+    socket->send(request.data(), request.size());
+    std::string response;
+    char data[1024];
+    int len = 0;
+    while ((len = socket->recv(data, sizeof(data))) > 0) {
+        response.append(data, len);
+    }
+    socket->close();
+    return response.find("ignored") != std::string::npos;
+}
+
+int main(int argc, char** argv) {
+    uint64_t size = (argc > 1 ? atoll(argv[1]) : 1024) * 1024 * 1024;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:6030");
+
+    auto run_client = [address, size]() {
+        acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+        if (!socket->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            _exit(1);
+        }
+
+        uint64_t start = acid::get_elapsed_us();
+        uint64_t uploaded = upload(socket, size);
+        uint64_t elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+        std::cout << "upload: " << uploaded << " bytes " << uploaded / elapsed << " MB/s" << std::endl;
+
+        // 同一个连接上继续下载, 验证请求体读完之后连接可以复用
+        start = acid::get_elapsed_us();
+        uint64_t downloaded = download(socket, size);
+        elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+        std::cout << "download: " << downloaded << " bytes (with chunk framing) "
+                  << downloaded / elapsed << " MB/s" << std::endl;
+
+        bool ignored = ignore_body(address);
+        std::cout << "response before close: " << (ignored ? "ok" : "FAIL") << std::endl;
+
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << "max rss: " << usage.ru_maxrss / 1024 << " MiB" << std::endl;
+        acid::test::finish_bench(uploaded == size && downloaded > size && ignored ? 0 : 1);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * 路由优先级测试
+ * 检查同一路径上精确路由优先于前缀glob, 前缀glob优先于add_route, 冲突的路由不会替换先注册的;
+ * 修改查询参数后路由参数保留; 修改路由后线程缓存的快照随之更新
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+using namespace acid::http;
+
+using acid::test::check;
+
+static Servlet::ptr make_servlet() {
+    return std::make_shared<FunctionServlet>(
+        [](HttpRequest::ptr, HttpResponse::ptr, HttpSession::ptr) { return 0; });
+}
+
+static Servlet::ptr match(ServletDispatch& dispatch, HttpMethod method, const std::string& path) {
+    HttpRequest::ptr request(new HttpRequest);
+    request->set_method(method);
+    request->set_path(path);
+    return dispatch.get_matched_servlet(request);
+}
+
+static void test_exact_before_route() {
+    ServletDispatch dispatch;
+    auto exact = make_servlet();
+    auto any = make_servlet();
+    auto get = make_servlet();
+    dispatch.add_servlet("/user/list", exact);
+    // 后注册的路由与精确路由在同一节点上, 不能替换精确路由
+    dispatch.add_route("/user/list", any);
+    dispatch.add_route(HttpMethod::GET, "/user/list", get);
+    check(match(dispatch, HttpMethod::GET, "/user/list") == exact, "exact servlet beats GET route");
+    check(match(dispatch, HttpMethod::POST, "/user/list") == exact,
+          "exact servlet beats any-method route");
+
+    // 先注册路由再注册精确路由, 精确路由同样优先
+    auto route = make_servlet();
+    auto late = make_servlet();
+    dispatch.add_route(HttpMethod::GET, "/user/info", route);
+    dispatch.add_servlet("/user/info", late);
+    check(match(dispatch, HttpMethod::GET, "/user/info") == late,
+          "exact servlet registered later still wins");
+
+    // 删除精确路由后路由生效
+    dispatch.del_servlet("/user/list");
+    check(match(dispatch, HttpMethod::GET, "/user/list") == get, "route after exact removed");
+    check(match(dispatch, HttpMethod::POST, "/user/list") == any,
+          "any-method route after exact removed");
+}
+
+static void test_glob_before_route() {
+    ServletDispatch dispatch;
+    auto glob = make_servlet();
+    auto wildcard = make_servlet();
+    dispatch.add_glob_servlet("/static/*", glob);
+    dispatch.add_route("/static/*path", wildcard);
+    auto request = HttpRequest::ptr(new HttpRequest);
+    request->set_method(HttpMethod::GET);
+    request->set_path("/static/js/app.js");
+    check(dispatch.get_matched_servlet(request) == glob, "prefix glob beats wildcard route");
+    check(request->get_param("path").empty(), "ignored route sets no param");
+}
+
+static void test_route_conflict() {
+    ServletDispatch dispatch;
+    auto first = make_servlet();
+    auto second = make_servlet();
+    // 参数名不同但是落在同一节点上, 先注册的保留
+    dispatch.add_route(HttpMethod::GET, "/item/:id", first);
+    dispatch.add_route(HttpMethod::GET, "/item/:name", second);
+    auto request = HttpRequest::ptr(new HttpRequest);
+    request->set_method(HttpMethod::GET);
+    request->set_path("/item/42");
+    check(dispatch.get_matched_servlet(request) == first, "first route kept on conflict");
+    check(request->get_param("id") == "42", "param of the kept route");
+
+    // 同一路由不同方法不冲突
+    auto post = make_servlet();
+    dispatch.add_route(HttpMethod::POST, "/item/:id", post);
+    check(match(dispatch, HttpMethod::POST, "/item/42") == post, "different method no conflict");
+    check(match(dispatch, HttpMethod::GET, "/item/42") == first, "GET route unchanged");
+}
+
+static void test_route_param_after_set_query() {
+    ServletDispatch dispatch;
+    auto user = make_servlet();
+    dispatch.add_route(HttpMethod::GET, "/user/:id", user);
+    auto request = HttpRequest::ptr(new HttpRequest);
+    request->set_method(HttpMethod::GET);
+    request->set_path("/user/42");
+    request->set_query("tab=info");
+    check(dispatch.get_matched_servlet(request) == user && request->get_param("id") == "42" &&
+              request->get_param("tab") == "info",
+          "route and query params");
+
+    // 重新设置查询参数只丢弃原来的查询参数, 路由参数保留并优先于同名的查询参数
+    request->set_query("tab=posts&id=7");
+    check(request->get_param("id") == "42", "route param kept after set_query");
+    check(request->get_param("tab") == "posts", "query param reparsed");
+    request->set_query("");
+    check(request->get_param("id") == "42" && !request->has_param("tab"),
+          "old query param dropped");
+}
+
+static void test_snapshot_refresh() {
+    ServletDispatch a;
+    ServletDispatch b;
+    auto sa = make_servlet();
+    auto sb = make_servlet();
+    a.add_servlet("/x", sa);
+    b.add_servlet("/x", sb);
+    // 同一线程交替使用两个实例, 线程缓存不能混用快照
+    check(match(a, HttpMethod::GET, "/x") == sa && match(b, HttpMethod::GET, "/x") == sb &&
+              match(a, HttpMethod::GET, "/x") == sa,
+          "thread cache per dispatch");
+
+    auto replaced = make_servlet();
+    a.add_servlet("/x", replaced);
+    check(match(a, HttpMethod::GET, "/x") == replaced, "thread cache refreshed after change");
+    a.del_servlet("/x");
+    check(match(a, HttpMethod::GET, "/x") == a.get_default(), "default after removal");
+}
+
+int main() {
+    test_exact_before_route();
+    test_glob_before_route();
+    test_route_conflict();
+    test_route_param_after_set_query();
+    test_snapshot_refresh();
+    return 0;
+}
@@ -0,0 +1,475 @@
+/**
+ * websocket测试
+ * 服务端运行在父进程中, 客户端在子进程中用原始socket完成握手并发送带掩码的帧,
+ * 先检查回显, 分片, ping/pong, permessage-deflate, 关闭握手和错误的请求,
+ * 再建立大量空闲连接, 通过服务端的/rss统计每个连接占用的内存, 最后测量一次广播发送给全部连接的耗时
+ *
+ * 用法: ws_bench [空闲连接数] [广播消息大小]
+ */
+#include "acid/acid.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace acid::http;
+
+static const uint16_t PORT = 6034;
+// RFC 6455中的示例, 对应的Sec-WebSocket-Accept为s3pPLMBiTxaQ9kYGzzhZRbK+xOo=
+static const char* KEY = "dGhlIHNhbXBsZSBub25jZQ==";
+static const char* ACCEPT = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+static std::vector<WSSession::ptr> s_chat_sessions;
+static acid::Address::ptr s_address;
+
+using acid::test::check;
+
+static uint64_t get_rss_kb() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+/**
+ * 原始socket实现的websocket客户端
+ */
+struct Client {
+    acid::Socket::ptr socket;
+    std::string buffer;
+
+    bool send_all(const std::string& data) {
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t len = socket->send(data.data() + offset, data.size() - offset);
+            if (len <= 0) {
+                return false;
+            }
+            offset += len;
+        }
+        return true;
+    }
+
+    // 缓冲区中至少有n字节
+    bool ensure(size_t n) {
+        char data[16 * 1024];
+        while (buffer.size() < n) {
+            ssize_t len = socket->recv(data, sizeof(data));
+            if (len <= 0) {
+                return false;
+            }
+            buffer.append(data, len);
+        }
+        return true;
+    }
+
+    bool connect(const std::string& path, const std::string& extra_headers = "",
+                 std::string* head = nullptr, bool upgrade = true) {
+        socket = acid::Socket::create_tcp(s_address);
+        if (!socket->connect(s_address, 3000)) {
+            return false;
+        }
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+        if (upgrade) {
+            request += "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\n";
+        }
+        request += extra_headers + "\r\n";
+        if (!send_all(request)) {
+            return false;
+        }
+        size_t pos;
+        while ((pos = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!ensure(buffer.size() + 1)) {
+                return false;
+            }
+        }
+        std::string response = buffer.substr(0, pos + 4);
+        buffer.erase(0, pos + 4);
+        if (head) {
+            *head = response;
+        }
+        return response.compare(0, 12, "HTTP/1.1 101") == 0 &&
+               response.find(ACCEPT) != std::string::npos;
+    }
+
+    bool send_frame(uint8_t opcode, const std::string& payload, bool fin = true, bool rsv1 = false,
+                    bool mask = true) {
+        std::string frame;
+        frame.push_back(static_cast<char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode));
+        uint8_t mask_bit = mask ? 0x80 : 0;
+        if (payload.size() < 126) {
+            frame.push_back(static_cast<char>(mask_bit | payload.size()));
+        }
+        else if (payload.size() <= 0xFFFF) {
+            frame.push_back(static_cast<char>(mask_bit | 126));
+            frame.push_back(static_cast<char>(payload.size() >> 8));
+            frame.push_back(static_cast<char>(payload.size()));
+        }
+        else {
+            frame.push_back(static_cast<char>(mask_bit | 127));
+            for (int i = 0; i < 8; ++i) {
+                frame.push_back(static_cast<char>(static_cast<uint64_t>(payload.size()) >>
+                                                  (56 - 8 * i)));
+            }
+        }
+        if (!mask) {
+            return send_all(frame + payload);
+        }
+        uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+        frame.append(reinterpret_cast<char*>(key), 4);
+        for (size_t i = 0; i < payload.size(); ++i) {
+            frame.push_back(static_cast<char>(payload[i] ^ key[i & 3]));
+        }
+        return send_all(frame);
+    }
+
+    bool recv_frame(uint8_t& opcode, std::string& payload, bool* fin = nullptr,
+                    bool* rsv1 = nullptr) {
+        if (!ensure(2)) {
+            return false;
+        }
+        uint8_t b0 = buffer[0];
+        uint8_t b1 = buffer[1];
+        // 服务端的帧不带掩码
+        if (b1 & 0x80) {
+            return false;
+        }
+        size_t header = 2;
+        uint64_t length = b1 & 0x7F;
+        if (length == 126) {
+            if (!ensure(4)) {
+                return false;
+            }
+            length = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+            header = 4;
+        }
+        else if (length == 127) {
+            if (!ensure(10)) {
+                return false;
+            }
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | static_cast<uint8_t>(buffer[2 + i]);
+            }
+            header = 10;
+        }
+        if (!ensure(header + length)) {
+            return false;
+        }
+        opcode = b0 & 0x0F;
+        if (fin) {
+            *fin = b0 & 0x80;
+        }
+        if (rsv1) {
+            *rsv1 = b0 & 0x40;
+        }
+        payload = buffer.substr(header, length);
+        buffer.erase(0, header + length);
+        return true;
+    }
+};
+
+static std::string raw_deflate(const std::string& data) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&zs, data.size()) + 16, '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    deflate(&zs, Z_SYNC_FLUSH);
+    out.resize(out.size() - zs.avail_out - 4);
+    deflateEnd(&zs);
+    return out;
+}
+
+static std::string raw_inflate(const std::string& data) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    inflateInit2(&zs, -MAX_WBITS);
+    std::string input = data + std::string("\x00\x00\xff\xff", 4);
+    std::string out(1024 * 1024, '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(input.data());
+    zs.avail_in = input.size();
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    inflate(&zs, Z_SYNC_FLUSH);
+    out.resize(out.size() - zs.avail_out);
+    inflateEnd(&zs);
+    return out;
+}
+
+static void test_protocol() {
+    std::string key_header = std::string("Sec-WebSocket-Key: ") + KEY + "\r\n";
+    uint8_t opcode;
+    std::string payload;
+    bool rsv1;
+
+    Client client;
+    check(client.connect("/echo", key_header), "handshake");
+    check(client.send_frame(0x1, "hello") && client.recv_frame(opcode, payload) &&
+              opcode == 0x1 && payload == "hello",
+          "echo");
+
+    // 分片之间插入ping, 先收到pong, 再收到拼接后的消息
+    client.send_frame(0x1, "frag-", false);
+    client.send_frame(0x9, "p");
+    client.send_frame(0x0, "ment", false);
+    client.send_frame(0x0, "ed", true);
+    bool ok = client.recv_frame(opcode, payload) && opcode == 0xA && payload == "p";
+    ok = ok && client.recv_frame(opcode, payload) && opcode == 0x1 && payload == "frag-mented";
+    check(ok, "fragment and ping");
+
+    std::string big(200 * 1024, '\0');
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = static_cast<char>(i * 131);
+    }
+    check(client.send_frame(0x2, big) && client.recv_frame(opcode, payload) && opcode == 0x2 &&
+              payload == big,
+          "big binary");
+
+    // 关闭握手, 服务端回复同样的关闭码后关闭连接
+    client.send_frame(0x8, std::string("\x03\xe8", 2));
+    ok = client.recv_frame(opcode, payload) && opcode == 0x8 &&
+         payload == std::string("\x03\xe8", 2);
+    check(ok && !client.ensure(client.buffer.size() + 1), "close");
+
+    // 不合法的关闭帧回复1002
+    const std::string bad_closes[] = {
+        std::string("\x03", 1),              // 只有一个字节
+        std::string("\x03\xed", 2),          // 1005
+        std::string("\x03\xee", 2),          // 1006
+        std::string("\x03\xf7", 2),          // 1015
+        std::string("\x03\xe7", 2),          // 999
+        std::string("\x03\xe8\xc0\xaf", 4),  // 超长编码的原因
+    };
+    ok = true;
+    for (auto& close_payload : bad_closes) {
+        Client bad_close;
+        ok = ok && bad_close.connect("/echo", key_header) &&
+             bad_close.send_frame(0x8, close_payload) && bad_close.recv_frame(opcode, payload) &&
+             opcode == 0x8 && payload == std::string("\x03\xea", 2);
+    }
+    check(ok, "invalid close payload");
+    // 应用自定义的关闭码3000, 原因是UTF-8
+    Client app_close;
+    ok = app_close.connect("/echo", key_header) &&
+         app_close.send_frame(0x8, std::string("\x0b\xb8\xe5\x86\x8d\xe8\xa7\x81", 8)) &&
+         app_close.recv_frame(opcode, payload) && opcode == 0x8 &&
+         payload == std::string("\x0b\xb8", 2);
+    check(ok, "application close code");
+
+    // 文本消息必须是UTF-8, 否则回复1007
+    Client utf8;
+    ok = utf8.connect("/echo", key_header) && utf8.send_frame(0x1, "\xe4\xbd\xa0\xe5\xa5\xbd") &&
+         utf8.recv_frame(opcode, payload) && payload == "\xe4\xbd\xa0\xe5\xa5\xbd";
+    check(ok, "utf-8 text");
+    ok = utf8.send_frame(0x1, "\xe4\xbd", false) && utf8.send_frame(0x0, "\xa0\xed\xa0\x80") &&
+         utf8.recv_frame(opcode, payload) && opcode == 0x8 &&
+         payload == std::string("\x03\xef", 2);
+    check(ok, "invalid utf-8 text");
+
+    // permessage-deflate
+    std::string head;
+    Client deflate_client;
+    ok = deflate_client.connect(
+        "/echo", key_header + "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n",
+        &head);
+    check(ok && head.find("permessage-deflate") != std::string::npos, "deflate negotiate");
+    std::string text;
+    for (int i = 0; text.size() < 8192; ++i) {
+        text += "websocket message " + std::to_string(i % 100) + " ";
+    }
+    ok = deflate_client.send_frame(0x1, raw_deflate(text), true, true) &&
+         deflate_client.recv_frame(opcode, payload, nullptr, &rsv1);
+    check(ok && rsv1 && payload.size() < text.size() && raw_inflate(payload) == text,
+          "deflate message");
+    ok = deflate_client.send_frame(0x1, "short") &&
+         deflate_client.recv_frame(opcode, payload, nullptr, &rsv1);
+    check(ok && !rsv1 && payload == "short", "deflate small message");
+
+    Client declined;
+    ok = declined.connect("/echo", key_header +
+                                       "Sec-WebSocket-Extensions: permessage-deflate; "
+                                       "server_max_window_bits=10\r\n",
+                          &head);
+    check(ok && head.find("permessage-deflate") == std::string::npos, "deflate declined");
+
+    // 客户端的帧没有掩码
+    Client unmasked;
+    unmasked.connect("/echo", key_header);
+    ok = unmasked.send_frame(0x1, "x", true, false, false) &&
+         unmasked.recv_frame(opcode, payload) && opcode == 0x8 &&
+         payload == std::string("\x03\xea", 2);
+    check(ok, "unmasked frame");
+
+    Client bad_key;
+    check(!bad_key.connect("/echo", "", &head) && head.compare(0, 12, "HTTP/1.1 400") == 0,
+          "missing key");
+    Client no_upgrade;
+    check(!no_upgrade.connect("/echo", "", &head, false) &&
+              head.compare(0, 12, "HTTP/1.1 426") == 0,
+          "upgrade required");
+}
+
+static uint64_t get_server_number(HttpClient& client, const std::string& path) {
+    auto result = client.do_get("http://127.0.0.1:" + std::to_string(PORT) + path, 10000);
+    if (result->result != HttpResult::Error::OK) {
+        return 0;
+    }
+    return strtoull(result->response->get_body().c_str(), nullptr, 10);
+}
+
+static void test_idle_and_broadcast(int count, int message_size) {
+    HttpClient http;
+    uint64_t server_before = get_server_number(http, "/rss");
+    uint64_t client_before = get_rss_kb();
+
+    std::string key_header = std::string("Sec-WebSocket-Key: ") + KEY + "\r\n";
+    auto clients = std::make_shared<std::vector<Client>>(count);
+    const int fibers = 50;
+    auto remain = std::make_shared<std::atomic<int>>(fibers);
+    auto failed = std::make_shared<std::atomic<int>>(0);
+    uint64_t start = acid::get_elapsed_ms();
+    for (int f = 0; f < fibers; ++f) {
+        acid::IOManager::get_this()->schedule([=]() {
+            for (int i = f; i < count; i += fibers) {
+                if (!(*clients)[i].connect("/chat", key_header)) {
+                    ++*failed;
+                }
+            }
+            --*remain;
+        });
+    }
+    while (*remain > 0) {
+        usleep(10 * 1000);
+    }
+    // 等服务端的所有会话都进入接收循环
+    while (get_server_number(http, "/count") < static_cast<uint64_t>(count - *failed)) {
+        usleep(10 * 1000);
+    }
+    uint64_t server_after = get_server_number(http, "/rss");
+    uint64_t client_after = get_rss_kb();
+    std::cout << "idle connections: " << count - *failed << "/" << count
+              << " connect elapsed: " << acid::get_elapsed_ms() - start << "ms" << std::endl;
+    std::cout << "server rss: " << server_before << "KB -> " << server_after << "KB, "
+              << (server_after - server_before) * 1024 / std::max(count, 1)
+              << " bytes/connection" << std::endl;
+    std::cout << "client rss: " << client_before << "KB -> " << client_after << "KB" << std::endl;
+    check(*failed == 0, "idle connections");
+
+    // 广播: 服务端只编码一次, 统计从发起广播到所有客户端收到消息的时间
+    uint64_t begin = acid::get_elapsed_us();
+    uint64_t encode_us = get_server_number(http, "/broadcast?" + std::to_string(message_size));
+    size_t received = 0;
+    uint8_t opcode;
+    std::string payload;
+    for (auto& client : *clients) {
+        if (client.recv_frame(opcode, payload) && payload.size() == static_cast<size_t>(message_size)) {
+            ++received;
+        }
+    }
+    uint64_t elapsed = acid::get_elapsed_us() - begin;
+    std::cout << "broadcast " << message_size << " bytes to " << received
+              << " connections: schedule " << encode_us << "us, all received " << elapsed / 1000
+              << "ms" << std::endl;
+    check(received == static_cast<size_t>(count), "broadcast");
+}
+
+static HttpServer::ptr create_server() {
+    auto server = std::make_shared<HttpServer>(true);
+    auto dispatch = server->get_servlet_dispatch();
+    dispatch->add_ws_servlet("/echo", [](HttpRequest::ptr request, WSFrameMessage::ptr message,
+                                         WSSession::ptr session) {
+        return session->send_message(message) < 0 ? -1 : 0;
+    });
+    dispatch->add_ws_servlet(
+        "/chat",
+        [](HttpRequest::ptr request, WSFrameMessage::ptr message, WSSession::ptr session) {
+            return 0;
+        },
+        [](HttpRequest::ptr request, WSSession::ptr session) {
+            s_chat_sessions.push_back(session);
+            return 0;
+        },
+        [](HttpRequest::ptr request, WSSession::ptr session) {
+            s_chat_sessions.erase(
+                std::remove(s_chat_sessions.begin(), s_chat_sessions.end(), session),
+                s_chat_sessions.end());
+            return 0;
+        });
+    dispatch->add_servlet("/rss", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                     HttpSession::ptr session) {
+        response->set_body(std::to_string(get_rss_kb()));
+        return 0;
+    });
+    dispatch->add_servlet("/count", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                       HttpSession::ptr session) {
+        response->set_body(std::to_string(s_chat_sessions.size()));
+        return 0;
+    });
+    dispatch->add_servlet("/broadcast", [](HttpRequest::ptr request, HttpResponse::ptr response,
+                                           HttpSession::ptr session) {
+        std::string message(atoi(std::string(request->get_query()).c_str()), 'm');
+        uint64_t start = acid::get_elapsed_us();
+        WSSession::broadcast(s_chat_sessions, message, WSOpcode::BINARY);
+        response->set_body(std::to_string(acid::get_elapsed_us() - start));
+        return 0;
+    });
+    return server;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    int message_size = argc > 2 ? atoi(argv[2]) : 1024;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    // 每个进程都需要count个以上的描述符
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (static_cast<rlim_t>(count) + 256 > limit.rlim_cur) {
+        count = static_cast<int>(limit.rlim_cur) - 256;
+        std::cout << "open files limit " << limit.rlim_cur << ", use " << count
+                  << " connections" << std::endl;
+    }
+
+    s_address = acid::Address::look_up_any("127.0.0.1:" + std::to_string(PORT));
+    // 服务端和客户端分在两个进程, 服务端的内存统计不包括客户端
+    pid_t pid = fork();
+    if (pid == 0) {
+        sleep(1);
+        acid::IOManager client_io(1, false, "client");
+        client_io.schedule([count, message_size]() {
+            test_protocol();
+            test_idle_and_broadcast(count, message_size);
+            acid::test::finish_bench(0);
+        });
+        while (true) {
+            sleep(10);
+        }
+    }
+
+    acid::IOManager server_io(1, false, "server");
+    server_io.schedule([]() { acid::test::start_server(create_server(), {s_address}); });
+    int status = 0;
+    waitpid(pid, &status, 0);
+    acid::test::finish_bench(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
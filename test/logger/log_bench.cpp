@@ -0,0 +1,90 @@
+/**
+ * 异步日志的吞吐测试
+ * 1到32个线程同时向同一个FileLogAppender写日志, 统计写日志调用的吞吐, 以及所有日志写到文件为止的吞吐,
+ * 并检查文件中的行数。再对比环满时阻塞, 丢弃和溢出三种策略
+ *
+ * 用法: log_bench [每个线程的日志条数]
+ */
+#include "acid/common/thread.h"
+#include "acid/logger/async_logger.h"
+#include "acid/logger/logger.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const char* LOG_FILE = "./log_bench.log";
+
+// 只统计测试写入的日志, 不包括丢弃日志时的统计行
+static size_t count_lines(const char* file) {
+    std::ifstream in(file);
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        lines += line.find("request done") != std::string::npos;
+    }
+    return lines;
+}
+
+static void bench(int threads, int total, acid::AsyncLogger::OverflowPolicy policy,
+                  const std::string& name) {
+    auto logger = GET_LOGGER_BY_NAME("bench");
+    unlink(LOG_FILE);
+    auto appender = std::make_shared<acid::FileLogAppender>(LOG_FILE, acid::LogLevel::DEBUG, policy);
+    logger->add_appender(appender);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<acid::Thread::ptr> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::make_shared<acid::Thread>(
+            [logger, total]() {
+                for (int i = 0; i < total; ++i) {
+                    LOG_INFO(logger) << "request done, path: /api/v1/items, status: 200, cost: "
+                                     << i % 997 << "us";
+                }
+            },
+            "log_" + std::to_string(t)));
+    }
+    for (auto& worker : workers) {
+        worker->join();
+    }
+    auto logged = std::chrono::steady_clock::now();
+
+    // 析构时写出所有剩余的日志
+    uint64_t dropped = appender->get_async_logger()->get_dropped();
+    uint64_t spilled = appender->get_async_logger()->get_spilled();
+    logger->clear_appender();
+    appender.reset();
+    auto written = std::chrono::steady_clock::now();
+
+    uint64_t lines = static_cast<uint64_t>(threads) * total;
+    double log_s = std::chrono::duration<double>(logged - start).count();
+    double write_s = std::chrono::duration<double>(written - start).count();
+    size_t file_lines = count_lines(LOG_FILE);
+    std::cout << name << " threads: " << threads << " calls: " << static_cast<uint64_t>(lines / log_s)
+              << " lines/s, written: " << static_cast<uint64_t>(lines / write_s)
+              << " lines/s, file lines: " << file_lines << " dropped: " << dropped
+              << " spilled: " << spilled << std::endl;
+    if (file_lines + dropped != lines) {
+        std::cout << "line count mismatch" << std::endl;
+        _exit(1);
+    }
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 100000;
+
+    for (int threads : {1, 2, 4, 8, 16, 32}) {
+        bench(threads, total / threads * 4, acid::AsyncLogger::OverflowPolicy::BLOCK, "block");
+    }
+    for (auto [policy, name] : {std::make_pair(acid::AsyncLogger::OverflowPolicy::DROP, "drop"),
+                                std::make_pair(acid::AsyncLogger::OverflowPolicy::SPILL, "spill")}) {
+        bench(8, total, policy, name);
+    }
+    unlink(LOG_FILE);
+    return 0;
+}
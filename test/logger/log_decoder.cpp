@@ -0,0 +1,49 @@
+/**
+ * 解码延迟格式化日志写出的二进制文件
+ * 按LogFormatter的格式模板输出到标准输出, 默认使用与FileLogAppender相同的格式
+ *
+ * 用法: log_decoder <二进制日志文件> [格式模板]
+ */
+#include "acid/logger/deferred_logger.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <binary log file> [pattern]" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "open " << argv[1] << " failed" << std::endl;
+        return 1;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string data = ss.str();
+
+    acid::DeferredLogDecoder decoder;
+    if (!decoder.load_formats(data.data(), data.size())) {
+        std::cerr << argv[1] << " is not a deferred log file" << std::endl;
+        return 1;
+    }
+    auto formatter = argc > 2 ? std::make_shared<acid::LogFormatter>(argv[2])
+                              : std::make_shared<acid::LogFormatter>();
+    if (formatter->is_error()) {
+        return 1;
+    }
+
+    size_t offset = sizeof(acid::DEFERRED_LOG_MAGIC);
+    size_t n = decoder.decode(data.data() + offset, data.size() - offset,
+                              [&formatter](const acid::LogFormatInfo&, acid::LogEvent::ptr event) {
+                                  std::cout << formatter->format(event);
+                              });
+    if (offset + n != data.size()) {
+        std::cerr << "truncated record at offset " << offset + n << std::endl;
+        return 1;
+    }
+    return 0;
+}
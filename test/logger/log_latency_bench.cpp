@@ -0,0 +1,142 @@
+/**
+ * 写日志调用的延迟测试
+ * 对比流式输出, printf格式化和延迟格式化三种写法每次调用的延迟, 日志都写到同一个FileLogAppender。
+ * 每1000次调用暂停一下让后台线程写出, 只统计调用本身的开销。最后检查延迟格式化的日志内容与snprintf一致
+ * text模式在后台线程格式化后写到日志文件, binary模式写二进制文件, 再用DeferredLogDecoder解码检查
+ *
+ * 用法: log_latency_bench [text|binary] [每种写法的调用次数]
+ */
+#include "acid/logger/deferred_logger.h"
+#include "acid/logger/logger.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const char* LOG_FILE = "./log_latency.log";
+static const char* BINARY_FILE = "./log_latency.bin";
+static const int BURST = 1000;
+
+using acid::test::check;
+
+static std::string read_file(const char* file) {
+    std::ifstream in(file, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// 每次调用前后各取一次时间, 减去取时间本身的开销
+template <class F>
+static void bench(const std::string& name, int total, F&& f) {
+    using clock = std::chrono::steady_clock;
+    std::vector<int64_t> empty(BURST);
+    for (auto& ns : empty) {
+        auto start = clock::now();
+        ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+    }
+    std::sort(empty.begin(), empty.end());
+    int64_t overhead = empty[empty.size() / 2];
+
+    std::vector<int64_t> latencies(total);
+    for (int i = 0; i < total; ++i) {
+        auto start = clock::now();
+        f(i);
+        latencies[i] = std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count() -
+                overhead,
+            0);
+        if (i % BURST == BURST - 1) {
+            usleep(2000);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    int64_t sum = 0;
+    for (auto ns : latencies) {
+        sum += ns;
+    }
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))];
+    };
+    std::cout << name << ": avg " << sum / total << " ns, p50 " << percentile(0.5) << " ns, p99 "
+              << percentile(0.99) << " ns, p99.9 " << percentile(0.999) << " ns, max "
+              << latencies.back() << " ns" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    bool binary = argc > 1 && std::string(argv[1]) == "binary";
+    int total = argc > 2 ? atoi(argv[2]) : 200000;
+    if (binary) {
+        check(acid::DeferredLoggerMgr::instance()->open_binary(BINARY_FILE), "open binary log");
+    }
+
+    auto logger = GET_LOGGER_BY_NAME("latency");
+    unlink(LOG_FILE);
+    auto appender = std::make_shared<acid::FileLogAppender>(LOG_FILE, acid::LogLevel::DEBUG);
+    logger->add_appender(appender);
+    const char* path = "/api/v1/items";
+
+    bench("stream", total, [&](int i) {
+        LOG_INFO(logger) << "stream request done, path: " << path << ", status: " << 200
+                         << ", cost: " << i % 997 << "us, ratio: " << i / 3.0;
+    });
+    bench("printf", total, [&](int i) {
+        LOG_FMT_INFO(logger, "printf request done, path: %s, status: %d, cost: %dus, ratio: %.2f",
+                     path, 200, i % 997, i / 3.0);
+    });
+    bench("deferred", total, [&](int i) {
+        LOG_DEFER_INFO(logger, "deferred request done, path: %s, status: %d, cost: %dus, ratio: %.2f",
+                       path, 200, i % 997, i / 3.0);
+    });
+
+    // 各种转换说明的格式化结果与snprintf一致
+#define CHECK_FORMAT "check: [%05d] [%#x] [%-6s] [%.3f] [%c] [%p] [%llu] [%+ld] [%10.4e] [%s] %%"
+#define CHECK_ARGS                                                                          \
+    -42, 255u, "ab", 3.14159, 'z', reinterpret_cast<void*>(0x1234), 18446744073709551615ull, \
+        7L, 12345.678, ""
+    LOG_DEFER_INFO(logger, CHECK_FORMAT, CHECK_ARGS);
+    char expected[256];
+    snprintf(expected, sizeof(expected), CHECK_FORMAT, CHECK_ARGS);
+    acid::DeferredLoggerMgr::instance()->flush();
+    appender->get_async_logger()->flush();
+
+    size_t lines = 0;
+    bool found = false;
+    if (binary) {
+        std::string data = read_file(BINARY_FILE);
+        acid::DeferredLogDecoder decoder;
+        check(decoder.load_formats(data.data(), data.size()), "load formats");
+        size_t offset = sizeof(acid::DEFERRED_LOG_MAGIC);
+        size_t n = decoder.decode(
+            data.data() + offset, data.size() - offset,
+            [&](const acid::LogFormatInfo& info, acid::LogEvent::ptr event) {
+                std::string content = event->get_content();
+                lines += content.find("deferred request done") == 0;
+                found = found || (content == expected && info.logger_name == "latency" &&
+                                  event->get_level() == acid::LogLevel::INFO);
+            });
+        check(offset + n == data.size(), "decode whole file");
+        std::cout << "binary log: " << data.size() << " bytes" << std::endl;
+    }
+    else {
+        std::istringstream in(read_file(LOG_FILE));
+        std::string line;
+        while (std::getline(in, line)) {
+            lines += line.find("deferred request done") != std::string::npos;
+            found = found || line.find(std::string("\t") + expected) != std::string::npos;
+        }
+    }
+    check(lines == static_cast<size_t>(total), "all deferred lines written");
+    check(found, "deferred formatting matches snprintf");
+
+    unlink(LOG_FILE);
+    unlink(BINARY_FILE);
+    return 0;
+}
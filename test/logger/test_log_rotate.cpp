@@ -0,0 +1,181 @@
+/**
+ * 日志文件切分测试
+ * 用yaml配置按大小切分, 压缩并只保留最近的几个历史文件, 检查历史文件的内容没有丢失或截断;
+ * 再检查按时间切分和外部移走文件后的reopen
+ */
+#include "acid/common/config.h"
+#include "acid/logger/async_logger.h"
+#include "acid/logger/logger.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+static const std::string SIZE_FILE = "log_rotate_size.log";
+static const std::string TIME_FILE = "log_rotate_time.log";
+
+using acid::test::check;
+
+// 当前目录中file的历史文件, 按切分的先后排序
+static std::vector<std::string> list_rotated(const std::string& file) {
+    std::vector<std::string> files;
+    DIR* dir = opendir(".");
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > file.size() + 1 && name.compare(0, file.size() + 1, file + ".") == 0) {
+            files.push_back(name);
+        }
+    }
+    closedir(dir);
+    acid::AsyncLogger::sort_rotated(file + ".", files);
+    return files;
+}
+
+static void remove_all(const std::string& file) {
+    unlink(file.c_str());
+    for (auto& name : list_rotated(file)) {
+        unlink(name.c_str());
+    }
+}
+
+template <class F>
+static bool wait_until(F&& done, int timeout_ms = 5000) {
+    for (int i = 0; i < timeout_ms / 10; ++i) {
+        if (done()) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return done();
+}
+
+// 解压后的所有行
+static std::vector<std::string> read_gzip_lines(const std::string& file) {
+    std::vector<std::string> lines;
+    gzFile in = gzopen(file.c_str(), "rb");
+    if (!in) {
+        return lines;
+    }
+    std::string data;
+    char buffer[64 * 1024];
+    int n;
+    while ((n = gzread(in, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, n);
+    }
+    gzclose(in);
+    size_t begin = 0;
+    for (size_t end; (end = data.find('\n', begin)) != std::string::npos; begin = end + 1) {
+        lines.push_back(data.substr(begin, end - begin));
+    }
+    return lines;
+}
+
+static size_t count_lines(const std::string& file) {
+    std::ifstream in(file);
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        ++lines;
+    }
+    return lines;
+}
+
+static void test_size_rotate() {
+    remove_all(SIZE_FILE);
+    acid::Config::load_from_yaml(YAML::Load(R"(
+logs:
+  - name: rotate
+    level: info
+    formatter: "%p %m%n"
+    appenders:
+      - type: FileLogAppender
+        file: )" + SIZE_FILE + R"(
+        overflow: block
+        rotate:
+          max_size: 64K
+          keep: 3
+          compress: true
+)"));
+    auto logger = GET_LOGGER_BY_NAME("rotate");
+    check(logger->get_level() == acid::LogLevel::INFO, "level from yaml");
+
+    // 每行100字节左右, 一共约1MB, 切分十几次
+    const int total = 10000;
+    for (int i = 0; i < total; ++i) {
+        LOG_INFO(logger) << "line " << i << " " << std::string(80, 'x');
+        LOG_DEBUG(logger) << "filtered by level";
+    }
+
+    // 等待写出和归档全部完成: 只剩3个压缩文件, 当前文件从最后一个历史文件之后继续
+    int next = -1;
+    bool ok = true;
+    size_t lines = 0;
+    auto rotated = [&] {
+        auto files = list_rotated(SIZE_FILE);
+        if (files.size() != 3 || std::any_of(files.begin(), files.end(), [](auto& name) {
+                return name.compare(name.size() - 3, 3, ".gz") != 0;
+            })) {
+            return false;
+        }
+        // 保留的历史文件中的行连续并且完整
+        next = -1;
+        ok = true;
+        lines = 0;
+        for (auto& file : files) {
+            for (auto& line : read_gzip_lines(file)) {
+                int n = -1;
+                ok = ok && sscanf(line.c_str(), "INFO line %d", &n) == 1 &&
+                     line.size() == line.find(' ', 10) + 81 && (next < 0 || n == next);
+                next = n + 1;
+                ++lines;
+            }
+        }
+        return count_lines(SIZE_FILE) == static_cast<size_t>(total - next);
+    };
+    check(wait_until(rotated), "keep 3 compressed files");
+    check(ok && lines > 3 * 500, "rotated files are complete");
+
+    // 去掉配置后日志器不再有appender, 旧的AsyncLogger析构
+    acid::Config::load_from_yaml(YAML::Load("logs: []"));
+    remove_all(SIZE_FILE);
+}
+
+static void test_time_rotate_and_reopen() {
+    remove_all(TIME_FILE);
+    auto logger = GET_LOGGER_BY_NAME("time_rotate");
+    auto appender = std::make_shared<acid::FileLogAppender>(TIME_FILE, acid::LogLevel::DEBUG);
+    appender->set_rotate_config({0, 1, 0, false});
+    logger->add_appender(appender);
+
+    LOG_INFO(logger) << "before rotate";
+    check(wait_until([] { return list_rotated(TIME_FILE).size() == 1; }), "rotate every second");
+    LOG_INFO(logger) << "after rotate";
+    appender->get_async_logger()->flush();
+    check(count_lines(list_rotated(TIME_FILE)[0]) == 1, "rotated by time");
+
+    // 外部工具移走文件后重新打开
+    appender->set_rotate_config({});
+    appender->get_async_logger()->flush();
+    rename(TIME_FILE.c_str(), (TIME_FILE + ".moved").c_str());
+    appender->reopen();
+    usleep(200 * 1000);
+    LOG_INFO(logger) << "after reopen";
+    check(wait_until([] { return count_lines(TIME_FILE) == 1; }), "reopen");
+
+    logger->clear_appender();
+    appender.reset();
+    remove_all(TIME_FILE);
+}
+
+int main() {
+    test_size_rotate();
+    test_time_rotate_and_reopen();
+    return 0;
+}
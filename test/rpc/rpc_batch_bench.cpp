@@ -0,0 +1,88 @@
+/**
+ * 1000个小调用分别以逐个调用, 并发流水线, 批量调用三种方式发起, 比较总耗时
+ *
+ * 用法: rpc_batch_bench [调用数量]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "acid/rpc/rpc_client.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 1000;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9003");
+
+    auto create_server = []() {
+        auto server = std::make_shared<acid::rpc::RpcServer>();
+        server->register_method("add", [](int a, int b) { return a + b; });
+        return server;
+    };
+    auto run_client = [address, total]() {
+        auto client = std::make_shared<acid::rpc::RpcClient>(false);
+        client->set_timeout(5000);
+        if (!client->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            _exit(1);
+        }
+
+        // 逐个调用, 每次等待上一个调用返回
+        uint64_t start = acid::get_elapsed_us();
+        int success = 0;
+        for (int i = 0; i < total; ++i) {
+            success += client->call<int>("add", i, 1).get_value() == i + 1;
+        }
+        uint64_t elapsed = acid::get_elapsed_us() - start;
+        std::cout << "sequential: " << elapsed / 1000 << "ms success: " << success << std::endl;
+
+        // 并发流水线, 所有调用同时发出
+        start = acid::get_elapsed_us();
+        std::atomic<int> pipelined {0};
+        acid::CoCountDownLatch latch(total);
+        for (int i = 0; i < total; ++i) {
+            acid::IOManager::get_this()->schedule([client, i, &pipelined, &latch]() {
+                pipelined += client->call<int>("add", i, 1).get_value() == i + 1;
+                latch.count_down();
+            });
+        }
+        latch.wait();
+        elapsed = acid::get_elapsed_us() - start;
+        std::cout << "pipelined: " << elapsed / 1000 << "ms success: " << pipelined << std::endl;
+
+        // 批量调用, 所有调用打包在一个请求中
+        start = acid::get_elapsed_us();
+        acid::rpc::RpcBatch batch;
+        for (int i = 0; i < total; ++i) {
+            batch.add("add", i, 1);
+        }
+        auto results = client->batch_call<int>(batch);
+        elapsed = acid::get_elapsed_us() - start;
+        success = 0;
+        for (int i = 0; i < static_cast<int>(results.size()); ++i) {
+            success += results[i].get_value() == i + 1;
+        }
+        std::cout << "batched: " << elapsed / 1000 << "ms success: " << success << std::endl;
+
+        // 回调模式, 不存在的方法单独返回RPC_NO_METHOD
+        acid::rpc::RpcBatch callbacks;
+        callbacks.add_callback("add", 1, 2, [](acid::rpc::Result<int> res) {
+            std::cout << "callback add: " << res.to_string() << std::endl;
+        });
+        callbacks.add_callback("sub", 1, 2, [](acid::rpc::Result<int> res) {
+            std::cout << "callback sub: " << res.to_string() << std::endl;
+        });
+        client->batch_call(callbacks);
+
+        client->close();
+        acid::test::finish_bench(0);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * 大量并发rpc调用时Fiber与C++20协程的内存占用对比
+ * 服务端在子进程中运行, 每个调用固定耗时; 客户端同时发起N个调用, 在调用都还没返回时统计客户端进程
+ * 每个进行中的调用占用的堆内存和常驻内存, 再统计全部完成的耗时。Fiber版本每个调用一个协程栈,
+ * 协程版本每个调用只有co_call的协程帧和响应channel
+ *
+ * 用法: rpc_coroutine_bench [并发调用数] [单次调用耗时ms]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "acid/common/task.h"
+#include "acid/rpc/rpc_client.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using acid::test::check;
+
+struct Memory {
+    int64_t heap;  // malloc分配出去的字节数, 包括mmap分配的大块
+    int64_t rss;   // 常驻内存字节数
+};
+
+static Memory memory_now() {
+    struct mallinfo2 info = mallinfo2();
+    std::ifstream statm("/proc/self/statm");
+    int64_t pages = 0;
+    int64_t resident = 0;
+    statm >> pages >> resident;
+    return {static_cast<int64_t>(info.uordblks + info.hblkhd), resident * sysconf(_SC_PAGESIZE)};
+}
+
+static void run_server(acid::Address::ptr address) {
+    acid::IOManager server_io(2, false, "server");
+    server_io.schedule([address]() {
+        static acid::rpc::RpcServer::ptr server = std::make_shared<acid::rpc::RpcServer>();
+        server->register_method("sleep", [](int value, int cost_ms) {
+            usleep(cost_ms * 1000);
+            return value;
+        });
+        while (!server->bind(address)) {
+            sleep(1);
+        }
+        server->start();
+    });
+}
+
+static acid::Task<> co_call_once(acid::rpc::RpcClient::ptr client, int value, int cost_ms,
+                                 std::atomic<int>& success, acid::CoWaitGroup& wait) {
+    auto result = co_await client->co_call<int>("sleep", value, cost_ms);
+    success += result.get_code() == acid::rpc::RPC_SUCCESS && result.get_value() == value;
+    wait.done();
+}
+
+static void bench(acid::rpc::RpcClient::ptr client, bool coroutine, int total, int cost_ms) {
+    std::atomic<int> success {0};
+    acid::CoWaitGroup wait;
+    wait.add(total);
+    Memory before = memory_now();
+    uint64_t start = acid::get_elapsed_ms();
+    for (int i = 0; i < total; ++i) {
+        if (coroutine) {
+            acid::co_spawn(co_call_once(client, i, cost_ms, success, wait));
+        }
+        else {
+            acid::IOManager::get_this()->schedule([client, i, cost_ms, &success, &wait]() {
+                auto result = client->call<int>("sleep", i, cost_ms);
+                success += result.get_code() == acid::rpc::RPC_SUCCESS && result.get_value() == i;
+                wait.done();
+            });
+        }
+    }
+    // 调用都已经发出、还没有返回时统计
+    usleep(cost_ms * 1000 / 2);
+    Memory peak = memory_now();
+    wait.wait();
+    uint64_t elapsed = acid::get_elapsed_ms() - start;
+    std::cout << (coroutine ? "coroutine" : "fiber") << " in-flight: " << total
+              << " heap/call: " << (peak.heap - before.heap) / total
+              << "B rss/call: " << (peak.rss - before.rss) / total << "B elapsed: " << elapsed
+              << "ms success: " << success << std::endl;
+    check(success == total, coroutine ? "coroutine calls succeed" : "fiber calls succeed");
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 2000;
+    int cost_ms = argc > 2 ? atoi(argv[2]) : 400;
+
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9005");
+    pid_t server = fork();
+    if (server == 0) {
+        run_server(address);
+        _exit(0);
+    }
+    sleep(1);
+
+    acid::IOManager client_io(1, false, "client");
+    client_io.schedule([address, total, cost_ms, server]() {
+        auto client = std::make_shared<acid::rpc::RpcClient>(false);
+        if (!client->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            kill(server, SIGKILL);
+            _exit(1);
+        }
+        bench(client, false, total, cost_ms);
+        bench(client, true, total, cost_ms);
+
+        client->set_timeout(cost_ms / 4);
+        auto result = acid::sync_wait(client->co_call<int>("sleep", 1, cost_ms));
+        check(result.get_code() == acid::rpc::RPC_TIMEOUT, "co_call honours the client timeout");
+        client->close();
+        kill(server, SIGKILL);
+        waitpid(server, nullptr, 0);
+        _exit(0);
+    });
+    return 0;
+}
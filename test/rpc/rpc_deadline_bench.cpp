@@ -0,0 +1,96 @@
+/**
+ * 过载场景下截止时间传递与取消的效果
+ * 服务端只有一个工作线程, 客户端并发发起远超服务端处理能力的调用, 统计服务端实际执行的调用数量。
+ * 没有截止时间时每个请求都会被完整执行; 携带截止时间后, 排队中已超时的请求会被直接丢弃,
+ * 执行中的请求也可以通过RpcContext提前结束。
+ *
+ * 用法: rpc_deadline_bench [并发调用数] [超时时间ms] [单次调用耗时ms]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "acid/rpc/rpc_client.h"
+#include "acid/rpc/rpc_context.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+
+static std::atomic<uint64_t> s_executed {0};   // 开始执行的调用
+static std::atomic<uint64_t> s_abandoned {0};  // 执行中途放弃的调用
+static std::atomic<uint64_t> s_busy_ms {0};    // 处理函数占用的cpu时间
+
+// 模拟cost_ms的计算, 计算过程中检查调用是否已经被放弃
+static int work(int value, uint64_t cost_ms) {
+    ++s_executed;
+    auto context = acid::rpc::RpcContext::get_this();
+    uint64_t start = acid::get_elapsed_ms();
+    while (acid::get_elapsed_ms() - start < cost_ms) {
+        if (context && context->is_done()) {
+            ++s_abandoned;
+            break;
+        }
+    }
+    s_busy_ms += acid::get_elapsed_ms() - start;
+    return value;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 2000;
+    uint64_t timeout = argc > 2 ? atoi(argv[2]) : 100;
+    uint64_t cost = argc > 3 ? atoi(argv[3]) : 2;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9001");
+
+    auto create_server = [cost]() {
+        auto server = std::make_shared<acid::rpc::RpcServer>();
+        server->register_method("work", [cost](int value) { return work(value, cost); });
+        return server;
+    };
+    auto run_client = [address, total, timeout, cost]() {
+        auto client = std::make_shared<acid::rpc::RpcClient>(false);
+        client->set_timeout(timeout);
+        if (!client->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            return;
+        }
+
+        std::atomic<uint64_t> success {0};
+        std::atomic<uint64_t> timeouts {0};
+        acid::CoCountDownLatch latch(total);
+        uint64_t start = acid::get_elapsed_ms();
+        for (int i = 0; i < total; ++i) {
+            acid::IOManager::get_this()->schedule([client, i, &success, &timeouts, &latch]() {
+                auto result = client->call<int>("work", i);
+                if (result.get_code() == acid::rpc::RPC_SUCCESS) {
+                    ++success;
+                }
+                else if (result.get_code() == acid::rpc::RPC_TIMEOUT) {
+                    ++timeouts;
+                }
+                latch.count_down();
+            });
+        }
+        latch.wait();
+        uint64_t elapsed = acid::get_elapsed_ms() - start;
+        // 等待服务端处理完已经开始执行的请求
+        sleep(1);
+
+        std::cout << "calls: " << total << " timeout: " << timeout << "ms cost: " << cost << "ms"
+                  << std::endl;
+        std::cout << "elapsed: " << elapsed << "ms success: " << success
+                  << " timeout: " << timeouts << std::endl;
+        std::cout << "server executed: " << s_executed << " abandoned: " << s_abandoned
+                  << " dropped before dispatch: " << total - s_executed << std::endl;
+        std::cout << "server busy: " << s_busy_ms << "ms, without deadline: "
+                  << total * cost << "ms" << std::endl;
+
+        client->close();
+        acid::test::finish_bench(0);
+    };
+    acid::test::run_bench(create_server, {address}, run_client, 2);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * 过载场景下的压测: 以服务端处理能力的1倍, 2倍, 3倍速率持续发起调用, 统计有效吞吐
+ * 服务端的接收与处理分别在两个调度器上, 处理只有一个工作线程, 每次调用占用cpu cost毫秒,
+ * 处理能力约为 1000 / cost 次每秒。
+ * 不做限制时请求在工作队列中堆积, 排队时间超过超时时间后大部分计算都是无用功;
+ * 开启并发限制或者排队时间丢弃后, 超出能力的请求被立即拒绝, 有效吞吐保持稳定。
+ * 限制在服务端启动并注册方法之后才通过配置开启, 同时验证配置修改对已有的方法生效
+ *
+ * 用法: rpc_overload_bench [none|limit|codel] [单次调用耗时ms] [每轮压测秒数] [超时时间ms]
+ */
+#include "acid/acid.h"
+#include "acid/common/config.h"
+#include "acid/common/mutex.h"
+#include "acid/rpc/rpc_client.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+struct Stats {
+    std::atomic<uint64_t> success {0};
+    std::atomic<uint64_t> overload {0};
+    std::atomic<uint64_t> timeout {0};
+    std::atomic<uint64_t> other {0};
+    acid::Mutex mutex;
+    std::vector<uint64_t> latency;  // 成功调用的延迟(ms)
+};
+
+static int work(int value, uint64_t cost_ms) {
+    uint64_t start = acid::get_elapsed_ms();
+    while (acid::get_elapsed_ms() - start < cost_ms) {
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    const char* mode = argc > 1 ? argv[1] : "limit";
+    uint64_t cost = argc > 2 ? atoi(argv[2]) : 2;
+    uint64_t seconds = argc > 3 ? atoi(argv[3]) : 3;
+    uint64_t timeout = argc > 4 ? atoi(argv[4]) : 100;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9002");
+
+    acid::IOManager worker(1, false, "worker");
+    auto create_server = [cost, &worker]() {
+        auto server = std::make_shared<acid::rpc::RpcServer>(&worker);
+        server->register_method("work", [cost](int value) { return work(value, cost); });
+        return server;
+    };
+    auto run_client = [address, mode, cost, seconds, timeout]() {
+        // 服务端启动之后再修改配置
+        if (strcmp(mode, "limit") == 0) {
+            acid::Config::look_up<bool>("rpc.server.adaptive_limit")->set_value(true);
+        }
+        else if (strcmp(mode, "codel") == 0) {
+            acid::Config::look_up<uint64_t>("rpc.server.codel_target")->set_value(cost * 5);
+        }
+
+        auto client = std::make_shared<acid::rpc::RpcClient>(false);
+        client->set_timeout(timeout);
+        if (!client->connect(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            _exit(1);
+        }
+
+        uint64_t capacity = 1000 / cost;
+        std::cout << "mode: " << mode << " cost: " << cost << "ms timeout: " << timeout
+                  << "ms capacity: " << capacity << "/s" << std::endl;
+
+        uint64_t total_overload = 0;
+        for (uint64_t factor = 1; factor <= 3; ++factor) {
+            auto stats = std::make_shared<Stats>();
+            uint64_t rate = capacity * factor;
+            uint64_t start = acid::get_elapsed_ms();
+            uint64_t sent = 0;
+            // 开环压测, 按时间补齐应发出的调用数
+            while (acid::get_elapsed_ms() - start < seconds * 1000) {
+                uint64_t expect = (acid::get_elapsed_ms() - start) * rate / 1000;
+                for (; sent < expect; ++sent) {
+                    acid::IOManager::get_this()->schedule([client, stats, sent]() {
+                        uint64_t begin = acid::get_elapsed_ms();
+                        auto result = client->call<int>("work", static_cast<int>(sent));
+                        switch (result.get_code()) {
+                            case acid::rpc::RPC_SUCCESS: {
+                                ++stats->success;
+                                acid::Mutex::Lock lock(stats->mutex);
+                                stats->latency.push_back(acid::get_elapsed_ms() - begin);
+                                break;
+                            }
+                            case acid::rpc::RPC_OVERLOAD:
+                                ++stats->overload;
+                                break;
+                            case acid::rpc::RPC_TIMEOUT:
+                                ++stats->timeout;
+                                break;
+                            default:
+                                ++stats->other;
+                                break;
+                        }
+                    });
+                }
+                usleep(1000);
+            }
+            // 等待剩余的调用结束
+            usleep((timeout + 200) * 1000);
+
+            std::sort(stats->latency.begin(), stats->latency.end());
+            auto percentile = [&stats](double p) -> uint64_t {
+                if (stats->latency.empty()) {
+                    return 0;
+                }
+                return stats->latency[static_cast<size_t>(p * (stats->latency.size() - 1))];
+            };
+            std::cout << factor << "x offered: " << rate << "/s goodput: "
+                      << stats->success / seconds << "/s overload: " << stats->overload
+                      << " timeout: " << stats->timeout << " other: " << stats->other
+                      << " p50: " << percentile(0.5) << "ms p99: " << percentile(0.99) << "ms"
+                      << std::endl;
+            total_overload += stats->overload;
+        }
+
+        client->close();
+        // 开启了限制时超出能力的请求应该被拒绝
+        bool limited = strcmp(mode, "none") == 0 || total_overload > 0;
+        std::cout << "runtime config applied: " << (limited ? "ok" : "FAIL") << std::endl;
+        acid::test::finish_bench(limited ? 0 : 1);
+    };
+    acid::test::run_bench(create_server, {address}, run_client);
+    return 0;
+}
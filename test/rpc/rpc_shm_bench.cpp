@@ -0,0 +1,91 @@
+/**
+ * 同一主机上共享内存连接, unix socket连接与tcp回环连接的对比
+ * 分别以逐个调用测量往返延迟, 以并发流水线测量吞吐, 负载为不同大小的字符串回显
+ *
+ * 用法: rpc_shm_bench [调用数量]
+ */
+#include "acid/acid.h"
+#include "acid/common/co_mutex.h"
+#include "acid/rpc/rpc_client.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+static void bench(acid::rpc::RpcClient::ptr client, const char* name, int total, size_t size) {
+    std::string payload(size, 'x');
+
+    // 逐个调用, 统计每次调用的往返延迟
+    std::vector<uint64_t> latency;
+    latency.reserve(total);
+    int success = 0;
+    uint64_t start = acid::get_elapsed_us();
+    for (int i = 0; i < total; ++i) {
+        uint64_t begin = acid::get_elapsed_us();
+        success += client->call<std::string>("echo", payload).get_value().size() == size;
+        latency.push_back(acid::get_elapsed_us() - begin);
+    }
+    uint64_t elapsed = acid::get_elapsed_us() - start;
+    std::sort(latency.begin(), latency.end());
+    std::cout << name << " payload: " << size << "B sequential avg: " << elapsed / total
+              << "us p50: " << latency[total / 2] << "us p99: " << latency[total * 99 / 100]
+              << "us success: " << success << std::endl;
+
+    // 并发流水线, 统计吞吐
+    std::atomic<int> pipelined {0};
+    acid::CoCountDownLatch latch(total);
+    start = acid::get_elapsed_us();
+    for (int i = 0; i < total; ++i) {
+        acid::IOManager::get_this()->schedule([client, &payload, size, &pipelined, &latch]() {
+            pipelined += client->call<std::string>("echo", payload).get_value().size() == size;
+            latch.count_down();
+        });
+    }
+    latch.wait();
+    elapsed = std::max<uint64_t>(acid::get_elapsed_us() - start, 1);
+    std::cout << name << " payload: " << size << "B pipelined: " << total * 1'000'000 / elapsed
+              << " calls/s " << total * size * 1'000'000 / elapsed / (1 << 20)
+              << " MB/s success: " << pipelined << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int total = argc > 1 ? atoi(argv[1]) : 10000;
+
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9004");
+    acid::Address::ptr unix_address = acid::Address::look_up_any("unix:@acid-rpc-bench");
+
+    auto create_server = []() {
+        auto server = std::make_shared<acid::rpc::RpcServer>();
+        server->register_method("echo", [](std::string value) { return value; });
+        return server;
+    };
+    auto run_client = [address, unix_address, total]() {
+        auto tcp_client = std::make_shared<acid::rpc::RpcClient>(false);
+        auto unix_client = std::make_shared<acid::rpc::RpcClient>(false);
+        auto shm_client = std::make_shared<acid::rpc::RpcClient>(false);
+        if (!tcp_client->connect(address) || !unix_client->connect(unix_address) ||
+            !shm_client->connect_shm(address)) {
+            std::cout << "connect " << address->to_string() << " fail" << std::endl;
+            _exit(1);
+        }
+
+        for (size_t size : {64, 4096, 65536}) {
+            bench(tcp_client, "tcp", total, size);
+            bench(unix_client, "unix", total, size);
+            bench(shm_client, "shm", total, size);
+        }
+
+        tcp_client->close();
+        unix_client->close();
+        shm_client->close();
+        acid::test::finish_bench(0);
+    };
+    acid::test::run_bench(create_server, {address, unix_address}, run_client);
+    return 0;
+}
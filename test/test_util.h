@@ -0,0 +1,120 @@
+/**
+ * @file test_util.h
+ * @brief 测试与压测共用的辅助函数
+ */
+
+#ifndef ACID_TEST_UTIL_H
+#define ACID_TEST_UTIL_H
+
+#include "acid/acid.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace acid::test {
+
+/**
+ * @brief 输出检查结果, 失败时直接退出进程
+ */
+inline void check(bool ok, const std::string& name) {
+    std::cout << name << ": " << (ok ? "ok" : "FAIL") << std::endl;
+    if (!ok) {
+        _exit(1);
+    }
+}
+
+/**
+ * @brief 压测结束, 直接退出进程
+ * @details 服务端的定时器会一直运行, IOManager不会自己结束, 统计完成后直接退出
+ */
+[[noreturn]] inline void finish_bench(int code = 0) {
+    std::cout.flush();
+    _exit(code);
+}
+
+/**
+ * @brief 在当前协程中绑定全部地址并启动服务端, 绑定失败时每秒重试
+ * @details 逐个调用bind(Address::ptr), 子类(如RpcServer)对单个地址的处理才会生效
+ */
+inline void start_server(TcpServer::ptr server, const std::vector<Address::ptr>& addresses) {
+    while (!std::all_of(addresses.begin(), addresses.end(),
+                        [&server](const Address::ptr& address) { return server->bind(address); })) {
+        sleep(1);
+    }
+    server->start();
+}
+
+/**
+ * @brief 在server线程创建并启动服务端, 一秒后在client线程执行压测
+ * @param[in] create_server 在server线程中创建并配置服务端
+ * @param[in] addresses 服务端监听的地址
+ * @param[in] client 压测逻辑, 结束时调用finish_bench退出
+ * @param[in] client_threads client线程数
+ */
+inline void run_bench(std::function<TcpServer::ptr()> create_server,
+                      std::vector<Address::ptr> addresses, std::function<void()> client,
+                      size_t client_threads = 1) {
+    // 服务端在整个压测期间保持存活
+    TcpServer::ptr server;
+    IOManager server_io(1, false, "server");
+    server_io.schedule([&server, create_server, addresses]() {
+        server = create_server();
+        start_server(server, addresses);
+    });
+    sleep(1);
+
+    IOManager client_io(client_threads, false, "client");
+    client_io.schedule(client);
+}
+
+/**
+ * @brief 读取n个字节的响应
+ * @return 对端关闭或出错时返回false
+ */
+inline bool read_response(Socket::ptr socket, std::string& buffer, size_t n) {
+    buffer.resize(n);
+    size_t offset = 0;
+    while (offset < n) {
+        int len = socket->recv(&buffer[offset], n - offset);
+        if (len <= 0) {
+            return false;
+        }
+        offset += len;
+    }
+    return true;
+}
+
+/**
+ * @brief 响应长度固定时, 先请求一次得到完整响应的长度
+ * @param[in] body_size 响应体的长度
+ * @return 完整响应的长度, 失败返回0
+ */
+inline size_t get_response_size(Address::ptr address, const std::string& request,
+                                size_t body_size) {
+    Socket::ptr socket = Socket::create_tcp(address);
+    if (!socket->connect(address)) {
+        return 0;
+    }
+    socket->send(request.data(), request.size());
+    std::string response;
+    char buffer[4096];
+    size_t pos = std::string::npos;
+    while ((pos = response.find("\r\n\r\n")) == std::string::npos ||
+           response.size() < pos + 4 + body_size) {
+        int len = socket->recv(buffer, sizeof(buffer));
+        if (len <= 0) {
+            return 0;
+        }
+        response.append(buffer, len);
+    }
+    socket->close();
+    return pos + 4 + body_size;
+}
+
+}  // namespace acid::test
+
+#endif  // ACID_TEST_UTIL_H
@@ -0,0 +1,163 @@
+/**
+ * 配置读取开销对比
+ * 32个线程同时读取同一个配置, 分别用原来的读锁加复制、get_value(复制)、snapshot(只读快照)和ConfigRef(线程缓存),
+ * 统计每次读取的平均耗时和总吞吐; 读取期间另一个线程不断修改配置。
+ * 同时检查快照不随修改变化, 修改其它配置不影响线程缓存, 以及修改后每个线程通过ConfigRef都能读到新值
+ *
+ * 用法: config_bench [线程数] [每个线程的读取次数]
+ */
+#include "acid/common/config.h"
+#include "acid/common/thread.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using acid::test::check;
+using Clock = std::chrono::steady_clock;
+
+static std::vector<std::string> make_hosts(int version) {
+    std::vector<std::string> hosts;
+    for (int i = 0; i < 16; ++i) {
+        // 超过短字符串优化的长度, 复制时每个元素都要分配内存
+        hosts.push_back("backend-" + std::to_string(i) + ".service.cluster.local:" + std::to_string(version));
+    }
+    return hosts;
+}
+
+static auto g_hosts = acid::Config::look_up("bench.hosts", make_hosts(0), "bench hosts");
+static auto g_limit = acid::Config::look_up("bench.limit", 100, "bench limit");
+
+static acid::ConfigRef<std::vector<std::string>> s_hosts(g_hosts);
+static acid::ConfigRef<int> s_limit(g_limit);
+
+// 原来get_value的做法: 读锁保护下复制
+static acid::RWMutex s_mutex;
+static std::vector<std::string> s_locked_hosts = make_hosts(0);
+static int s_locked_limit = 100;
+
+/**
+ * @brief threads个线程各调用reads次read, 同时有一个线程修改配置, 返回每次读取的平均耗时ns
+ */
+template <class Read>
+static double run(int threads, int reads, Read read) {
+    std::atomic<bool> stop {false};
+    acid::Thread writer(
+        [&stop] {
+            int version = 1;
+            while (!stop) {
+                g_limit->set_value(100 + version % 2);
+                g_hosts->set_value(make_hosts(version % 2));
+                {
+                    acid::RWMutex::WriteLock lock(s_mutex);
+                    s_locked_limit = 100 + version % 2;
+                    s_locked_hosts = make_hosts(version % 2);
+                }
+                ++version;
+                usleep(1000);
+            }
+        },
+        "writer");
+
+    std::atomic<size_t> total {0};
+    std::vector<acid::Thread::ptr> readers;
+    auto start = Clock::now();
+    for (int i = 0; i < threads; ++i) {
+        readers.push_back(std::make_shared<acid::Thread>(
+            [reads, &read, &total] {
+                size_t sum = 0;
+                for (int j = 0; j < reads; ++j) {
+                    sum += read();
+                }
+                total += sum;
+            },
+            "reader_" + std::to_string(i)));
+    }
+    for (auto& reader : readers) {
+        reader->join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stop = true;
+    writer.join();
+    check(total > 0, "readers see the config");
+    return seconds * 1e9 / (static_cast<double>(threads) * reads);
+}
+
+static void report(const char* name, double locked, double get_value, double snapshot, double ref) {
+    std::cout << name << " ns/read locked copy: " << locked << " get_value: " << get_value
+              << " snapshot: " << snapshot << " ConfigRef: " << ref << " (ConfigRef ";
+    // 比加锁复制慢时如实报告
+    if (ref <= locked) {
+        std::cout << locked / ref << "x faster";
+    }
+    else {
+        std::cout << ref / locked << "x slower";
+    }
+    std::cout << " than locked copy)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 32;
+    int reads = argc > 2 ? atoi(argv[2]) : 100000;
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+
+    auto before = g_hosts->snapshot();
+    g_hosts->set_value(make_hosts(7));
+    check(*before == make_hosts(0) && *g_hosts->snapshot() == make_hosts(7), "snapshot is immutable");
+    check(*s_hosts == make_hosts(7), "ConfigRef reads the new value");
+    // 修改其它配置不让这个配置的线程缓存失效
+    const int* cached_limit = &*s_limit;
+    g_hosts->set_value(make_hosts(8));
+    check(&*s_limit == cached_limit, "other config changes keep the cache");
+
+    double hosts_locked = run(threads, reads, [] {
+        acid::RWMutex::ReadLock lock(s_mutex);
+        return std::vector<std::string>(s_locked_hosts).size();
+    });
+    double hosts_get = run(threads, reads, [] { return g_hosts->get_value().size(); });
+    double hosts_snapshot = run(threads, reads, [] { return g_hosts->snapshot()->size(); });
+    double hosts_ref = run(threads, reads, [] { return s_hosts->size(); });
+    report("vector<string>", hosts_locked, hosts_get, hosts_snapshot, hosts_ref);
+
+    double limit_locked = run(threads, reads, [] {
+        acid::RWMutex::ReadLock lock(s_mutex);
+        return static_cast<size_t>(s_locked_limit);
+    });
+    double limit_get = run(threads, reads, [] { return static_cast<size_t>(g_limit->get_value()); });
+    double limit_snapshot = run(threads, reads, [] { return static_cast<size_t>(*g_limit->snapshot()); });
+    double limit_ref = run(threads, reads, [] { return static_cast<size_t>(*s_limit); });
+    report("int", limit_locked, limit_get, limit_snapshot, limit_ref);
+
+    // 每个线程先缓存旧值, 修改之后再读要拿到新值
+    std::atomic<int> cached {0};
+    std::atomic<bool> updated {false};
+    std::atomic<int> stale {0};
+    std::vector<acid::Thread::ptr> readers;
+    for (int i = 0; i < threads; ++i) {
+        readers.push_back(std::make_shared<acid::Thread>(
+            [&cached, &updated, &stale] {
+                stale += s_hosts->empty();
+                ++cached;
+                while (!updated) {
+                    usleep(100);
+                }
+                stale += s_hosts->back() != make_hosts(42).back();
+            },
+            "check_" + std::to_string(i)));
+    }
+    while (cached < threads) {
+        usleep(100);
+    }
+    g_hosts->set_value(make_hosts(42));
+    updated = true;
+    for (auto& reader : readers) {
+        reader->join();
+    }
+    check(stale == 0, "every thread sees the update through ConfigRef");
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * NUMA放置对比
+ * echo服务端的IO调度器按scheduler.affinity交替分布在两个节点上, 客户端建立N个连接各做M次往返。
+ * 分别在不开和开启SO_INCOMING_CPU放置时统计服务端协程跨节点恢复的次数(每次都意味着协程栈和连接的数据在远端节点)
+ * 和每秒往返次数。机器只有一个节点时按numa.simulated_nodes模拟两个节点: CPU数大于1时对半分,
+ * 只有一个CPU时两个节点都是CPU 0, 这时只能比较跨节点恢复次数, 吞吐量差异没有意义
+ *
+ * 用法: numa_bench [连接数] [每个连接的往返次数]
+ */
+#include "acid/acid.h"
+#include "acid/common/numa.h"
+#include "acid/net/tcp_server.h"
+#include "test/test_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+using acid::test::check;
+using Clock = std::chrono::steady_clock;
+
+class EchoServer : public acid::TcpServer {
+public:
+    using ptr = std::shared_ptr<EchoServer>;
+
+    using TcpServer::TcpServer;
+
+protected:
+    void handle_client(acid::Socket::ptr client) override {
+        char buf[64];
+        while (true) {
+            ssize_t n = client->recv(buf, sizeof(buf));
+            if (n <= 0 || client->send(buf, n) != n) {
+                break;
+            }
+        }
+        client->close();
+    }
+};
+
+/**
+ * @brief 真实的节点数, 只读sysfs, 不能在设置模拟拓扑之前初始化Numa
+ */
+static int real_node_count() {
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string line;
+    std::getline(in, line);
+    return std::max<int>(1, acid::Numa::parse_cpu_list(line).size());
+}
+
+struct Result {
+    double round_trips_per_second;
+    uint64_t cross_node_resumes;
+};
+
+static Result bench(bool incoming_cpu, int connections, int rounds) {
+    acid::IOManager server_io(4, false, "server");
+    acid::IOManager accept_io(1, false, "accept");
+    acid::IOManager client_io(2, false, "client");
+    // accept单独一个调度器, server_io只统计处理连接的协程
+    EchoServer::ptr server = std::make_shared<EchoServer>("echo", &server_io, &server_io, &accept_io);
+    server->set_incoming_cpu(incoming_cpu);
+    acid::Address::ptr address = acid::Address::look_up_any("127.0.0.1:9006");
+    // 监听socket要在调度器线程中创建, 否则hook不生效, accept会阻塞线程
+    std::atomic<bool> started {false};
+    accept_io.schedule([server, address, &started] {
+        while (!server->bind(address)) {
+            sleep(1);
+        }
+        server->start();
+        started = true;
+    });
+    while (!started) {
+        usleep(1000);
+    }
+
+    std::atomic<int> finished {0};
+    std::atomic<int> failed {0};
+    auto start = Clock::now();
+    for (int i = 0; i < connections; ++i) {
+        client_io.schedule([address, rounds, &finished, &failed] {
+            acid::Socket::ptr socket = acid::Socket::create_tcp(address);
+            if (!socket->connect(address)) {
+                ++failed;
+                ++finished;
+                return;
+            }
+            char buf[64] = {0};
+            for (int j = 0; j < rounds; ++j) {
+                if (socket->send(buf, sizeof(buf)) != sizeof(buf) ||
+                    socket->recv(buf, sizeof(buf), MSG_WAITALL) != sizeof(buf)) {
+                    ++failed;
+                    break;
+                }
+            }
+            socket->close();
+            ++finished;
+        });
+    }
+    while (finished < connections) {
+        usleep(1000);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    check(failed == 0, incoming_cpu ? "incoming cpu echo" : "default echo");
+    server->stop();
+    return {connections * rounds / seconds, server_io.get_cross_node_resumes()};
+}
+
+int main(int argc, char** argv) {
+    int connections = argc > 1 ? atoi(argv[1]) : 64;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    if (real_node_count() < 2) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        std::vector<std::string> nodes = {"0", "0"};
+        if (cpus > 1) {
+            nodes = {"0-" + std::to_string(cpus / 2 - 1),
+                     std::to_string(cpus / 2) + "-" + std::to_string(cpus - 1)};
+        }
+        acid::Config::look_up<std::vector<std::string>>("numa.simulated_nodes")->set_value(nodes);
+    }
+    acid::Config::look_up<std::map<std::string, std::string>>("scheduler.affinity")
+        ->set_value({{"server", "node0,node1"}});
+    std::cout << "nodes: " << acid::Numa::node_count()
+              << (acid::Numa::is_simulated() ? " (simulated)" : "") << std::endl;
+    for (int node = 0; node < acid::Numa::node_count(); ++node) {
+        std::cout << "node" << node << " cpus:";
+        for (int cpu : acid::Numa::node_cpus(node)) {
+            std::cout << " " << cpu;
+        }
+        std::cout << std::endl;
+    }
+
+    Result normal = bench(false, connections, rounds);
+    Result local = bench(true, connections, rounds);
+    uint64_t total = static_cast<uint64_t>(connections) * rounds;
+    std::cout << "default: " << static_cast<int64_t>(normal.round_trips_per_second)
+              << " round trips/s cross-node resumes: " << normal.cross_node_resumes << " ("
+              << normal.cross_node_resumes * 100.0 / total << "% of round trips)" << std::endl;
+    std::cout << "incoming cpu: " << static_cast<int64_t>(local.round_trips_per_second)
+              << " round trips/s cross-node resumes: " << local.cross_node_resumes << " ("
+              << local.cross_node_resumes * 100.0 / total << "% of round trips)" << std::endl;
+    check(local.cross_node_resumes == 0, "connections stay on their node");
+    return 0;
+}
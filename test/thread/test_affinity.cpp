@@ -0,0 +1,144 @@
+/**
+ * CPU亲和性与NUMA放置测试
+ * 检查CPU列表解析和拓扑, 按scheduler.affinity绑核, 绑定给指定线程的任务能及时被该线程取走,
+ * 绑定了线程的协程在IO唤醒后回到原线程, 以及按节点分配的内存可用
+ *
+ * 用法: test_affinity
+ */
+#include "acid/acid.h"
+#include "acid/common/fd_manager.h"
+#include "acid/common/numa.h"
+#include "test/test_util.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <sched.h>
+#include <set>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using acid::test::check;
+
+static void test_topology() {
+    check(acid::Numa::parse_cpu_list("0-3,8, 10-11") == std::vector<int>({0, 1, 2, 3, 8, 10, 11}),
+          "parse cpu list");
+    check(acid::Numa::parse_cpu_list("").empty(), "parse empty cpu list");
+
+    int cpu = acid::Numa::current_cpu();
+    int node = acid::Numa::cpu_node(cpu);
+    const std::vector<int>& cpus = acid::Numa::node_cpus(node);
+    std::cout << "nodes: " << acid::Numa::node_count() << " current cpu: " << cpu << " node: " << node
+              << std::endl;
+    check(acid::Numa::node_count() >= 1 && std::find(cpus.begin(), cpus.end(), cpu) != cpus.end(),
+          "current cpu belongs to its node");
+
+    const size_t size = 1 << 20;
+    char* memory = static_cast<char*>(acid::Numa::alloc_on_node(size, node));
+    check(memory != nullptr, "alloc on node");
+    memset(memory, 1, size);
+    acid::Numa::free_on_node(memory, size);
+}
+
+static void test_pin() {
+    int cpu = acid::Numa::current_cpu();
+    acid::Config::look_up<std::map<std::string, std::string>>("scheduler.affinity")
+        ->set_value({{"pinned", std::to_string(cpu)}, {"wake", "0,0,0,0"}});
+
+    acid::IOManager iom(2, false, "pinned");
+    check(iom.get_numa_node() == acid::Numa::cpu_node(cpu), "scheduler numa node");
+    std::atomic<bool> pinned {false};
+    int thread = iom.get_thread_for_cpu(cpu);
+    iom.schedule(
+        [&pinned, cpu] {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(0, sizeof(set), &set);
+            pinned = CPU_COUNT(&set) == 1 && CPU_ISSET(cpu, &set);
+        },
+        thread);
+    while (!pinned) {
+        usleep(1000);
+    }
+    check(thread != -1 && pinned, "worker bound to configured cpu");
+}
+
+static void test_wake() {
+    // 四个线程都绑定在CPU 0上, 轮流取出每个线程号
+    acid::IOManager iom(4, false, "wake");
+    std::set<int> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.insert(iom.get_thread_for_cpu(0));
+    }
+    check(threads.size() == 4, "four threads on cpu 0");
+
+    // 依次把任务绑定给不同线程, 每个任务结束后才发出下一个; 只用pipe随便唤醒一个线程时会在两个线程之间
+    // 互相唤醒, 目标线程要等epoll_wait超时
+    const int rounds = 400;
+    std::vector<int> order(threads.begin(), threads.end());
+    std::atomic<int> done {0};
+    std::atomic<int> wrong {0};
+    uint64_t start = acid::get_current_ms();
+    for (int i = 0; i < rounds; ++i) {
+        int target = order[i % order.size()];
+        iom.schedule(
+            [&done, &wrong, target] {
+                wrong += acid::get_thread_id() != target;
+                ++done;
+            },
+            target);
+        while (done <= i) {
+            usleep(100);
+        }
+    }
+    uint64_t elapsed = acid::get_current_ms() - start;
+    std::cout << "pinned tasks: " << rounds << " elapsed: " << elapsed << "ms" << std::endl;
+    check(wrong == 0 && elapsed < 2000, "pinned tasks wake their thread");
+
+    // 绑定了线程的协程每次IO唤醒后都回到原线程
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    // 登记到FdMgr后hook的read才会挂起协程而不是阻塞线程
+    acid::FdMgr::instance()->get(fds[0], true);
+    acid::FdMgr::instance()->get(fds[1], true);
+    int target = order[1];
+    std::atomic<int> moved {0};
+    std::atomic<bool> finished {false};
+    iom.schedule(
+        [&moved, &finished, target, fd = fds[0]] {
+            acid::Fiber::get_this()->bind_thread(target);
+            char c;
+            for (int i = 0; i < 50; ++i) {
+                read(fd, &c, 1);
+                moved += acid::get_thread_id() != target;
+            }
+            finished = true;
+        },
+        target);
+    iom.schedule([fd = fds[1]] {
+        for (int i = 0; i < 50; ++i) {
+            usleep(1000);
+            write(fd, "x", 1);
+            // 让出当前线程, 让IO事件有机会在别的线程上被处理
+            acid::Scheduler::get_this()->schedule(acid::Fiber::get_this());
+            acid::Fiber::get_this()->yield();
+        }
+    });
+    while (!finished) {
+        usleep(1000);
+    }
+    check(moved == 0, "bound fiber resumes on its thread after IO");
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main() {
+    GET_ROOT_LOGGER()->set_level(acid::LogLevel::FATAL);
+    GET_LOGGER_BY_NAME("system")->set_level(acid::LogLevel::FATAL);
+
+    test_topology();
+    test_pin();
+    test_wake();
+    return 0;
+}
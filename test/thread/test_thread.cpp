@@ -6,8 +6,12 @@
  */
 
 #include "acid/common/thread.h"
+#include "acid/logger/log_context.h"
 #include "acid/logger/logger.h"
 
+#include <cstring>
+#include <iostream>
+
 auto logger = GET_ROOT_LOGGER();
 
 void run() {
@@ -23,5 +27,9 @@ int main() {
 
     t->join();
 
-    return 0;
+    // 已经写过日志的线程改名后, 日志使用新的线程名
+    acid::Thread::set_name("renamed");
+    bool renamed = strcmp(acid::LogContext::current().thread_name, "renamed") == 0;
+    std::cout << "thread name after rename: " << (renamed ? "ok" : "FAIL") << std::endl;
+    return renamed ? 0 : 1;
 }
\ No newline at end of file